@@ -1,16 +1,42 @@
 #include "SCMLpp.h"
 
 #include "XML_Helpers.h"
+#include "XML_Stream.h"
 #include "stdarg.h"
 #include <climits>
 #define _USE_MATH_DEFINES
 #include <cmath>
 
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
 #ifndef _MSC_VER
     #include "libgen.h"
     #include <algorithm>
 #endif
 
+#if defined(WIN32) || defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// SIMD for AnimationWorld.  Define SCML_NO_SIMD to use only the scalar code.
+#ifndef SCML_NO_SIMD
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define SCML_USE_AVX2
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #include <emmintrin.h>
+        #define SCML_USE_SSE2
+    #endif
+#endif
+
 #ifndef PATH_MAX
     #define PATH_MAX MAX_PATH
 #endif
@@ -18,6 +44,36 @@
 namespace SCML
 {
 
+// Element and attribute names known to the streaming loader.  TOKEN_<name> is the index of <name> in token_names.
+#define SCML_TOKENS(X) \
+    X(spriter_data) X(scml_version) X(generator) X(generator_version) X(pixel_art_mode) \
+    X(meta_data) X(variable) X(tag) X(name) X(type) X(value) \
+    X(folder) X(file) X(id) X(pivot_x) X(pivot_y) X(width) X(height) \
+    X(atlas_x) X(atlas_y) X(offset_x) X(offset_y) X(original_width) X(original_height) \
+    X(atlas) X(data_path) X(image_path) X(image) X(full_path) \
+    X(entity) X(animation) X(length) X(looping) X(loop_to) X(mainline) X(key) X(time) \
+    X(bone) X(bone_ref) X(object) X(object_ref) X(parent) \
+    X(x) X(y) X(angle) X(scale_x) X(scale_y) X(r) X(g) X(b) X(a) \
+    X(timeline) X(object_type) X(usage) X(blend_mode) X(w) X(h) \
+    X(variable_type) X(min) X(max) X(t) X(z_index) X(volume) X(panning) \
+    X(curve_type) X(c1) X(c2) X(c3) X(c4) X(spin) \
+    X(character_map) X(map) X(target_atlas) X(target_folder) X(target_file) \
+    X(document_info) X(author) X(copyright) X(license) X(version) X(last_modified) X(notes)
+
+#define SCML_TOKEN_ENUM(name) TOKEN_##name,
+#define SCML_TOKEN_NAME(name) #name,
+
+enum Token
+{
+    SCML_TOKENS(SCML_TOKEN_ENUM)
+    NUM_TOKENS
+};
+
+static const char* const token_names[] = { SCML_TOKENS(SCML_TOKEN_NAME) };
+
+#undef SCML_TOKEN_ENUM
+#undef SCML_TOKEN_NAME
+
 // Visual Studio doesn't have dirname?
 #ifdef _MSC_VER
     // FIXME: This breaks the STL abstraction
@@ -30,7 +86,8 @@ namespace SCML
 
 static void log(const char* formatted_text, ...)
 {
-    static char buffer[2000];
+    // Not static, since worker threads can log too
+    char buffer[2000];
     if(formatted_text == NULL)
         return;
 
@@ -92,29 +149,95 @@ Data::~Data()
     clear();
 }
 
+// Checks the file extension, ignoring case.
+static bool hasExtension(const SCML_STRING& file, const char* extension)
+{
+    int length = strlen(extension);
+    int size = SCML_STRING_SIZE(file);
+    if(size < length)
+        return false;
+    
+    const char* s = SCML_TO_CSTRING(file) + size - length;
+    for(int i = 0; i < length; i++)
+    {
+        if(tolower(s[i]) != extension[i])
+            return false;
+    }
+    return true;
+}
+
 bool Data::load(const SCML_STRING& file)
 {
+    if(hasExtension(file, ".scon"))
+        return loadSCON(file);
+    
     name = file;
     
-    TiXmlDocument doc;
-
-    if(!doc.LoadFile(SCML_TO_CSTRING(file)))
+    // Stream the file straight into the Data model instead of building a TinyXML document first.
+    XML_Stream stream(token_names, NUM_TOKENS);
+    
+    if(!stream.loadFile(SCML_TO_CSTRING(file)))
     {
         SCML::log("SCML::Data failed to load: Couldn't open %s.\n", SCML_TO_CSTRING(file));
-        SCML::log("%s\n", doc.ErrorDesc());
+        SCML::log("%s\n", stream.getError());
         return false;
     }
-
-    TiXmlElement* root = doc.FirstChildElement("spriter_data");
-    if(root == NULL)
+    
+    bool found_root = false;
+    while(!found_root && stream.nextElement())
+    {
+        if(stream.getToken() == TOKEN_spriter_data)
+            found_root = true;
+        else
+            stream.skipElement();
+    }
+    
+    if(found_root)
+        load(stream);
+    
+    if(stream.hasError())
+    {
+        SCML::log("SCML::Data failed to load: %s at line %d of %s.\n", stream.getError(), stream.getErrorLine(), SCML_TO_CSTRING(file));
+        clear();
+        return false;
+    }
+    
+    if(!found_root)
     {
         SCML::log("SCML::Data failed to load: No spriter_data XML element in %s.\n", SCML_TO_CSTRING(file));
         return false;
     }
     
-    load(root);
+    return true;
+}
+
+bool Data::loadSCON(const SCML_STRING& file)
+{
+    name = file;
+    
+    // The JSON document is read through the same stream interface, so the element readers are shared with .scml files.
+    XML_Stream stream(token_names, NUM_TOKENS);
+    
+    if(!stream.loadJSONFile(SCML_TO_CSTRING(file)))
+    {
+        if(stream.getErrorLine() > 0)
+            SCML::log("SCML::Data failed to load: %s at line %d of %s.\n", stream.getError(), stream.getErrorLine(), SCML_TO_CSTRING(file));
+        else
+            SCML::log("SCML::Data failed to load: Couldn't open %s.\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    
+    // The root object is the spriter_data element.
+    if(stream.nextElement())
+        load(stream);
+    
+    if(stream.hasError())
+    {
+        SCML::log("SCML::Data failed to load: %s in %s.\n", stream.getError(), SCML_TO_CSTRING(file));
+        clear();
+        return false;
+    }
     
-    doc.Clear();
     return true;
 }
 
@@ -215,6 +338,126 @@ bool Data::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::load(XML_Stream& stream)
+{
+    scml_version = "";
+    generator = "(Spriter)";
+    generator_version = "(1.0)";
+    pixel_art_mode = false;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_scml_version:
+                scml_version = value;
+                break;
+            case TOKEN_generator:
+                generator = value;
+                break;
+            case TOKEN_generator_version:
+                generator_version = value;
+                break;
+            case TOKEN_pixel_art_mode:
+                pixel_art_mode = toBool(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            case TOKEN_folder:
+            {
+                Folder* folder = new Folder;
+                if(folder->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(folders, folder->id, folder))
+                    {
+                        SCML::log("SCML::Data loaded a folder with a duplicate id (%d).\n", folder->id);
+                        delete folder;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data failed to load a folder.\n");
+                    delete folder;
+                }
+                break;
+            }
+            case TOKEN_atlas:
+            {
+                Atlas* atlas = new Atlas;
+                if(atlas->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(atlases, atlas->id, atlas))
+                    {
+                        SCML::log("SCML::Data loaded an atlas with a duplicate id (%d).\n", atlas->id);
+                        delete atlas;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data failed to load an atlas.\n");
+                    delete atlas;
+                }
+                break;
+            }
+            case TOKEN_entity:
+            {
+                Entity* entity = new Entity;
+                if(entity->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(entities, entity->id, entity))
+                    {
+                        SCML::log("SCML::Data loaded an entity with a duplicate id (%d).\n", entity->id);
+                        delete entity;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data failed to load an entity.\n");
+                    delete entity;
+                }
+                break;
+            }
+            case TOKEN_character_map:
+            {
+                Character_Map* character_map = new Character_Map;
+                if(character_map->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(character_maps, character_map->id, character_map))
+                    {
+                        SCML::log("SCML::Data loaded a character_map with a duplicate id (%d).\n", character_map->id);
+                        delete character_map;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data failed to load a character_map.\n");
+                    delete character_map;
+                }
+                break;
+            }
+            case TOKEN_document_info:
+                document_info.load(stream);
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::log(int recursive_depth) const
 {
     SCML::log("scml_version=%s\n", SCML_TO_CSTRING(scml_version));
@@ -364,6 +607,57 @@ bool Data::Meta_Data::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Meta_Data::load(XML_Stream& stream)
+{
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_variable:
+            {
+                Variable* variable = new Variable;
+                if(variable->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(variables, variable->name, variable))
+                    {
+                        SCML::log("SCML::Data::Meta_Data loaded a variable with a duplicate name (%s).\n", SCML_TO_CSTRING(variable->name));
+                        delete variable;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Meta_Data failed to load a variable.\n");
+                    delete variable;
+                }
+                break;
+            }
+            case TOKEN_tag:
+            {
+                Tag* tag = new Tag;
+                if(tag->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(tags, tag->name, tag))
+                    {
+                        SCML::log("SCML::Data::Meta_Data loaded a tag with a duplicate name (%s).\n", SCML_TO_CSTRING(tag->name));
+                        delete tag;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Meta_Data failed to load a tag.\n");
+                    delete tag;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Meta_Data::log(int recursive_depth) const
 {
     if(recursive_depth == 0)
@@ -431,6 +725,44 @@ bool Data::Meta_Data::Variable::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Meta_Data::Variable::load(XML_Stream& stream)
+{
+    name = "";
+    type = "string";
+    
+    // The value's meaning depends on the type, which may come after it.
+    const char* value_attr = NULL;
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_name:
+                name = value;
+                break;
+            case TOKEN_type:
+                type = value;
+                break;
+            case TOKEN_value:
+                value_attr = value;
+                break;
+        }
+    }
+    
+    if(type == "string")
+        value_string = (value_attr == NULL? "" : value_attr);
+    else if(type == "int")
+        value_int = (value_attr == NULL? 0 : toInt(value_attr));
+    else if(type == "float")
+        value_float = (value_attr == NULL? 0.0f : toFloat(value_attr));
+    else
+        SCML::log("Data::Meta_Data::Variable loaded invalid variable type (%s) named '%s'.\n", SCML_TO_CSTRING(type), SCML_TO_CSTRING(name));
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Meta_Data::Variable::log(int recursive_depth) const
 {
     SCML::log("name=%s\n", SCML_TO_CSTRING(name));
@@ -470,6 +802,26 @@ bool Data::Meta_Data::Tag::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Meta_Data::Tag::load(XML_Stream& stream)
+{
+    name = "";
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_name:
+                name = value;
+                break;
+        }
+    }
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Meta_Data::Tag::log(int recursive_depth) const
 {
     SCML::log("name=%s\n", SCML_TO_CSTRING(name));
@@ -485,11 +837,11 @@ void Data::Meta_Data::Tag::clear()
 
 
 Data::Folder::Folder()
-    : id(0)
+    : id(0), atlas(-1)
 {}
 
 Data::Folder::Folder(TiXmlElement* elem)
-    : id(0)
+    : id(0), atlas(-1)
 {
     load(elem);
 }
@@ -498,6 +850,7 @@ bool Data::Folder::load(TiXmlElement* elem)
 {
     id = xmlGetIntAttr(elem, "id", 0);
     name = xmlGetStringAttr(elem, "name", "");
+    atlas = xmlGetIntAttr(elem, "atlas", -1);
     
     for(TiXmlElement* child = elem->FirstChildElement("file"); child != NULL; child = child->NextSiblingElement("file"))
     {
@@ -517,13 +870,83 @@ bool Data::Folder::load(TiXmlElement* elem)
         }
     }
     
+    inheritAtlas();
+    
+    return true;
+}
+
+bool Data::Folder::load(XML_Stream& stream)
+{
+    id = 0;
+    name = "";
+    atlas = -1;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_name:
+                name = value;
+                break;
+            case TOKEN_atlas:
+                atlas = toInt(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_file:
+            {
+                File* file = new File;
+                if(file->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(files, file->id, file))
+                    {
+                        SCML::log("SCML::Data::Folder loaded a file with a duplicate id (%d).\n", file->id);
+                        delete file;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Folder failed to load a file.\n");
+                    delete file;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    inheritAtlas();
+    
     return true;
 }
 
+void Data::Folder::inheritAtlas()
+{
+    // Files without their own atlas page are on the folder's
+    SCML_BEGIN_MAP_FOREACH_CONST(files, int, File*, item)
+    {
+        if(item->atlas < 0)
+            item->atlas = atlas;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
 void Data::Folder::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
     SCML::log("name=%s\n", SCML_TO_CSTRING(name));
+    SCML::log("atlas=%d\n", atlas);
     
     if(recursive_depth == 0)
         return;
@@ -541,6 +964,7 @@ void Data::Folder::clear()
 {
     id = 0;
     name.clear();
+    atlas = -1;
     
     SCML_BEGIN_MAP_FOREACH_CONST(files, int, File*, item)
     {
@@ -555,11 +979,11 @@ void Data::Folder::clear()
 
 
 Data::Folder::File::File()
-    : id(0)
+    : id(0), atlas(-1)
 {}
 
 Data::Folder::File::File(TiXmlElement* elem)
-    : id(0)
+    : id(0), atlas(-1)
 {
     load(elem);
 }
@@ -579,6 +1003,79 @@ bool Data::Folder::File::load(TiXmlElement* elem)
     offset_y = xmlGetIntAttr(elem, "offset_y", 0);
     original_width = xmlGetIntAttr(elem, "original_width", 0);
     original_height = xmlGetIntAttr(elem, "original_height", 0);
+    atlas = xmlGetIntAttr(elem, "atlas", -1);
+    
+    return true;
+}
+
+bool Data::Folder::File::load(XML_Stream& stream)
+{
+    type = "image";
+    id = 0;
+    name = "";
+    pivot_x = 0.0f;
+    pivot_y = 0.0f;
+    width = 0;
+    height = 0;
+    atlas_x = 0;
+    atlas_y = 0;
+    offset_x = 0;
+    offset_y = 0;
+    original_width = 0;
+    original_height = 0;
+    atlas = -1;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_type:
+                type = value;
+                break;
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_name:
+                name = value;
+                break;
+            case TOKEN_pivot_x:
+                pivot_x = toFloat(value);
+                break;
+            case TOKEN_pivot_y:
+                pivot_y = toFloat(value);
+                break;
+            case TOKEN_width:
+                width = toInt(value);
+                break;
+            case TOKEN_height:
+                height = toInt(value);
+                break;
+            case TOKEN_atlas_x:
+                atlas_x = toInt(value);
+                break;
+            case TOKEN_atlas_y:
+                atlas_y = toInt(value);
+                break;
+            case TOKEN_offset_x:
+                offset_x = toInt(value);
+                break;
+            case TOKEN_offset_y:
+                offset_y = toInt(value);
+                break;
+            case TOKEN_original_width:
+                original_width = toInt(value);
+                break;
+            case TOKEN_original_height:
+                original_height = toInt(value);
+                break;
+            case TOKEN_atlas:
+                atlas = toInt(value);
+                break;
+        }
+    }
+    
+    stream.skipElement();
     
     return true;
 }
@@ -598,6 +1095,7 @@ void Data::Folder::File::log(int recursive_depth) const
     SCML::log("offset_y=%d\n", offset_y);
     SCML::log("original_width=%d\n", original_width);
     SCML::log("original_height=%d\n", original_height);
+    SCML::log("atlas=%d\n", atlas);
 }
 
 void Data::Folder::File::clear()
@@ -615,6 +1113,7 @@ void Data::Folder::File::clear()
     offset_y = 0;
     original_width = 0;
     original_height = 0;
+    atlas = -1;
 }
 
 
@@ -658,6 +1157,60 @@ bool Data::Atlas::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Atlas::load(XML_Stream& stream)
+{
+    id = 0;
+    data_path = "";
+    image_path = "";
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_data_path:
+                data_path = value;
+                break;
+            case TOKEN_image_path:
+                image_path = value;
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_folder:
+            {
+                Folder* folder = new Folder;
+                if(folder->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(folders, folder->id, folder))
+                    {
+                        SCML::log("SCML::Data::Atlas loaded a folder with a duplicate id (%d).\n", folder->id);
+                        delete folder;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Atlas failed to load a folder.\n");
+                    delete folder;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Atlas::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -730,6 +1283,56 @@ bool Data::Atlas::Folder::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Atlas::Folder::load(XML_Stream& stream)
+{
+    id = 0;
+    name = "";
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_name:
+                name = value;
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_image:
+            {
+                Image* image = new Image;
+                if(image->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(images, image->id, image))
+                    {
+                        SCML::log("SCML::Data::Atlas::Folder loaded an image with a duplicate id (%d).\n", image->id);
+                        delete image;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Atlas::Folder failed to load an image.\n");
+                    delete image;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Atlas::Folder::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -782,6 +1385,30 @@ bool Data::Atlas::Folder::Image::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Atlas::Folder::Image::load(XML_Stream& stream)
+{
+    id = 0;
+    full_path = "";
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_full_path:
+                full_path = value;
+                break;
+        }
+    }
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Atlas::Folder::Image::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -803,15 +1430,20 @@ void Data::Atlas::Folder::Image::clear()
 
 
 Data::Entity::Entity()
-    : id(0), meta_data(NULL)
+    : id(0), meta_data(NULL), prototype(NULL), quantized_prototype(NULL)
 {}
 
 Data::Entity::Entity(TiXmlElement* elem)
-    : id(0), meta_data(NULL)
+    : id(0), meta_data(NULL), prototype(NULL), quantized_prototype(NULL)
 {
     load(elem);
 }
 
+Data::Entity::~Entity()
+{
+    clear();
+}
+
 bool Data::Entity::load(TiXmlElement* elem)
 {
     id = xmlGetIntAttr(elem, "id", 0);
@@ -846,25 +1478,80 @@ bool Data::Entity::load(TiXmlElement* elem)
     return true;
 }
 
-void Data::Entity::log(int recursive_depth) const
+bool Data::Entity::load(XML_Stream& stream)
 {
-    SCML::log("id=%d\n", id);
-    SCML::log("name=%s\n", SCML_TO_CSTRING(name));
-    
-    if(recursive_depth == 0)
-        return;
+    id = 0;
+    name = "";
     
-    if(meta_data != NULL)
+    for(int i = 0; i < stream.getNumAttributes(); i++)
     {
-        SCML::log("Meta_Data:\n");
-        meta_data->log(recursive_depth-1);
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_name:
+                name = value;
+                break;
+        }
     }
     
-    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
+    while(stream.nextChild())
     {
-        SCML::log("Animation:\n");
-        item->log(recursive_depth - 1);
-    }
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            case TOKEN_animation:
+            {
+                Animation* animation = new Animation;
+                if(animation->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(animations, animation->id, animation))
+                    {
+                        SCML::log("SCML::Data::Entity loaded an animation with a duplicate id (%d).\n", animation->id);
+                        delete animation;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity failed to load an animation.\n");
+                    delete animation;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
+void Data::Entity::log(int recursive_depth) const
+{
+    SCML::log("id=%d\n", id);
+    SCML::log("name=%s\n", SCML_TO_CSTRING(name));
+    
+    if(recursive_depth == 0)
+        return;
+    
+    if(meta_data != NULL)
+    {
+        SCML::log("Meta_Data:\n");
+        meta_data->log(recursive_depth-1);
+    }
+    
+    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
+    {
+        SCML::log("Animation:\n");
+        item->log(recursive_depth - 1);
+    }
     SCML_END_MAP_FOREACH_CONST;
     
 }
@@ -876,6 +1563,14 @@ void Data::Entity::clear()
     delete meta_data;
     meta_data = NULL;
     
+    // Entities that still use the prototype keep it alive.
+    if(prototype != NULL)
+        prototype->release();
+    prototype = NULL;
+    if(quantized_prototype != NULL)
+        quantized_prototype->release();
+    quantized_prototype = NULL;
+
     SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
     {
         delete item;
@@ -884,6 +1579,17 @@ void Data::Entity::clear()
     animations.clear();
 }
 
+EntityPrototype* Data::Entity::getPrototype(bool quantized)
+{
+    EntityPrototype*& result = (quantized? quantized_prototype : prototype);
+    if(result == NULL)
+    {
+        result = new EntityPrototype(this, quantized);
+        result->retain();
+    }
+    return result;
+}
+
 
 
 
@@ -946,6 +1652,93 @@ bool Data::Entity::Animation::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::load(XML_Stream& stream)
+{
+    id = 0;
+    name = "";
+    length = 0;
+    looping = "true";
+    loop_to = 0;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_name:
+                name = value;
+                break;
+            case TOKEN_length:
+                length = toInt(value);
+                break;
+            case TOKEN_looping:
+                looping = value;
+                break;
+            case TOKEN_loop_to:
+                loop_to = toInt(value);
+                break;
+        }
+    }
+    
+    bool has_mainline = false;
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            case TOKEN_mainline:
+                if(has_mainline)
+                {
+                    stream.skipElement();
+                    break;
+                }
+                has_mainline = true;
+                if(!mainline.load(stream))
+                {
+                    SCML::log("SCML::Data::Entity::Animation failed to load the mainline.\n");
+                    mainline.clear();
+                }
+                break;
+            case TOKEN_timeline:
+            {
+                Timeline* timeline = new Timeline;
+                if(timeline->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(timelines, timeline->id, timeline))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation loaded a timeline with a duplicate id (%d).\n", timeline->id);
+                        delete timeline;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation failed to load a timeline.\n");
+                    delete timeline;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    if(!has_mainline)
+    {
+        SCML::log("SCML::Data::Entity::Animation failed to load the mainline.\n");
+        mainline.clear();
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1034,6 +1827,39 @@ bool Data::Entity::Animation::Mainline::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Mainline::load(XML_Stream& stream)
+{
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_key:
+            {
+                Key* key = new Key;
+                if(key->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(keys, key->id, key))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation::Mainline loaded a key with a duplicate id (%d).\n", key->id);
+                        delete key;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Mainline failed to load a key.\n");
+                    delete key;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Mainline::log(int recursive_depth) const
 {
     if(recursive_depth == 0)
@@ -1164,6 +1990,115 @@ bool Data::Entity::Animation::Mainline::Key::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Mainline::Key::load(XML_Stream& stream)
+{
+    id = 0;
+    time = 0;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_time:
+                time = toInt(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            case TOKEN_bone:
+            {
+                Bone* bone = new Bone;
+                if(bone->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(bones, bone->id, bone))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation::Mainline::Key loaded a bone with a duplicate id (%d).\n", bone->id);
+                        delete bone;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Mainline::Key failed to load a bone.\n");
+                    delete bone;
+                }
+                break;
+            }
+            case TOKEN_bone_ref:
+            {
+                Bone_Ref* bone_ref = new Bone_Ref;
+                if(bone_ref->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(bones, bone_ref->id, Bone_Container(bone_ref)))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation::Mainline::Key loaded a bone_ref with a duplicate id (%d).\n", bone_ref->id);
+                        delete bone_ref;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Mainline::Key failed to load a bone_ref.\n");
+                    delete bone_ref;
+                }
+                break;
+            }
+            case TOKEN_object:
+            {
+                Object* object = new Object;
+                if(object->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(objects, object->id, object))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation::Mainline::Key loaded an object with a duplicate id (%d).\n", object->id);
+                        delete object;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Mainline::Key failed to load an object.\n");
+                    delete object;
+                }
+                break;
+            }
+            case TOKEN_object_ref:
+            {
+                Object_Ref* object_ref = new Object_Ref;
+                if(object_ref->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(objects, object_ref->id, Object_Container(object_ref)))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation::Mainline::Key loaded an object_ref with a duplicate id (%d).\n", object_ref->id);
+                        delete object_ref;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Mainline::Key failed to load an object_ref.\n");
+                    delete object_ref;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Mainline::Key::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1278,6 +2213,79 @@ bool Data::Entity::Animation::Mainline::Key::Bone::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Mainline::Key::Bone::load(XML_Stream& stream)
+{
+    id = 0;
+    parent = -1;
+    x = 0.0f;
+    y = 0.0f;
+    angle = 0.0f;
+    scale_x = 1.0f;
+    scale_y = 1.0f;
+    r = 1.0f;
+    g = 1.0f;
+    b = 1.0f;
+    a = 1.0f;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_parent:
+                parent = toInt(value);
+                break;
+            case TOKEN_x:
+                x = toFloat(value);
+                break;
+            case TOKEN_y:
+                y = toFloat(value);
+                break;
+            case TOKEN_angle:
+                angle = toFloat(value);
+                break;
+            case TOKEN_scale_x:
+                scale_x = toFloat(value);
+                break;
+            case TOKEN_scale_y:
+                scale_y = toFloat(value);
+                break;
+            case TOKEN_r:
+                r = toFloat(value);
+                break;
+            case TOKEN_g:
+                g = toFloat(value);
+                break;
+            case TOKEN_b:
+                b = toFloat(value);
+                break;
+            case TOKEN_a:
+                a = toFloat(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Mainline::Key::Bone::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1347,6 +2355,38 @@ bool Data::Entity::Animation::Mainline::Key::Bone_Ref::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Mainline::Key::Bone_Ref::load(XML_Stream& stream)
+{
+    id = 0;
+    parent = -1;
+    timeline = 0;
+    key = 0;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_parent:
+                parent = toInt(value);
+                break;
+            case TOKEN_timeline:
+                timeline = toInt(value);
+                break;
+            case TOKEN_key:
+                key = toInt(value);
+                break;
+        }
+    }
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Entity::Animation::Mainline::Key::Bone_Ref::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1445,6 +2485,186 @@ bool Data::Entity::Animation::Mainline::Key::Object::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Mainline::Key::Object::load(XML_Stream& stream)
+{
+    id = 0;
+    parent = -1;
+    object_type = "sprite";
+    atlas = 0;
+    folder = 0;
+    file = 0;
+    usage = "display";
+    blend_mode = "alpha";
+    x = 0.0f;
+    y = 0.0f;
+    pivot_x = 0.0f;
+    pivot_y = 1.0f;
+    pixel_art_mode_x = 0;
+    pixel_art_mode_y = 0;
+    pixel_art_mode_pivot_x = 0;
+    pixel_art_mode_pivot_y = 0;
+    angle = 0.0f;
+    w = 0.0f;
+    h = 0.0f;
+    scale_x = 1.0f;
+    scale_y = 1.0f;
+    r = 1.0f;
+    g = 1.0f;
+    b = 1.0f;
+    a = 1.0f;
+    variable_type = "string";
+    animation = 0;
+    t = 0.0f;
+    z_index = 0;
+    
+    // These depend on variable_type and object_type, which may come later in the tag.
+    const char* value_attr = NULL;
+    const char* min_attr = NULL;
+    const char* max_attr = NULL;
+    const char* volume_attr = NULL;
+    const char* panning_attr = NULL;
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_parent:
+                parent = toInt(value);
+                break;
+            case TOKEN_object_type:
+                object_type = value;
+                break;
+            case TOKEN_atlas:
+                atlas = toInt(value);
+                break;
+            case TOKEN_folder:
+                folder = toInt(value);
+                break;
+            case TOKEN_file:
+                file = toInt(value);
+                break;
+            case TOKEN_usage:
+                usage = value;
+                break;
+            case TOKEN_blend_mode:
+                blend_mode = value;
+                break;
+            case TOKEN_x:
+                x = toFloat(value);
+                pixel_art_mode_x = toInt(value);
+                break;
+            case TOKEN_y:
+                y = toFloat(value);
+                pixel_art_mode_y = toInt(value);
+                break;
+            case TOKEN_pivot_x:
+                pivot_x = toFloat(value);
+                pixel_art_mode_pivot_x = toInt(value);
+                break;
+            case TOKEN_pivot_y:
+                pivot_y = toFloat(value);
+                pixel_art_mode_pivot_y = toInt(value);
+                break;
+            case TOKEN_angle:
+                angle = toFloat(value);
+                break;
+            case TOKEN_w:
+                w = toFloat(value);
+                break;
+            case TOKEN_h:
+                h = toFloat(value);
+                break;
+            case TOKEN_scale_x:
+                scale_x = toFloat(value);
+                break;
+            case TOKEN_scale_y:
+                scale_y = toFloat(value);
+                break;
+            case TOKEN_r:
+                r = toFloat(value);
+                break;
+            case TOKEN_g:
+                g = toFloat(value);
+                break;
+            case TOKEN_b:
+                b = toFloat(value);
+                break;
+            case TOKEN_a:
+                a = toFloat(value);
+                break;
+            case TOKEN_variable_type:
+                variable_type = value;
+                break;
+            case TOKEN_value:
+                value_attr = value;
+                break;
+            case TOKEN_min:
+                min_attr = value;
+                break;
+            case TOKEN_max:
+                max_attr = value;
+                break;
+            case TOKEN_animation:
+                animation = toInt(value);
+                break;
+            case TOKEN_t:
+                t = toFloat(value);
+                break;
+            case TOKEN_z_index:
+                z_index = toInt(value);
+                break;
+            case TOKEN_volume:
+                volume_attr = value;
+                break;
+            case TOKEN_panning:
+                panning_attr = value;
+                break;
+        }
+    }
+    
+    if(variable_type == "string")
+    {
+        value_string = (value_attr == NULL? "" : value_attr);
+    }
+    else if(variable_type == "int")
+    {
+        value_int = (value_attr == NULL? 0 : toInt(value_attr));
+        min_int = (min_attr == NULL? 0 : toInt(min_attr));
+        max_int = (max_attr == NULL? 0 : toInt(max_attr));
+    }
+    else if(variable_type == "float")
+    {
+        value_float = (value_attr == NULL? 0.0f : toFloat(value_attr));
+        min_float = (min_attr == NULL? 0.0f : toFloat(min_attr));
+        max_float = (max_attr == NULL? 0.0f : toFloat(max_attr));
+    }
+    if(object_type == "sound")
+    {
+        volume = (volume_attr == NULL? 1.0f : toFloat(volume_attr));
+        panning = (panning_attr == NULL? 0.0f : toFloat(panning_attr));
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Mainline::Key::Object::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1582,6 +2802,42 @@ bool Data::Entity::Animation::Mainline::Key::Object_Ref::load(TiXmlElement* elem
     return true;
 }
 
+bool Data::Entity::Animation::Mainline::Key::Object_Ref::load(XML_Stream& stream)
+{
+    id = 0;
+    parent = -1;
+    timeline = 0;
+    key = 0;
+    z_index = 0;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_parent:
+                parent = toInt(value);
+                break;
+            case TOKEN_timeline:
+                timeline = toInt(value);
+                break;
+            case TOKEN_key:
+                key = toInt(value);
+                break;
+            case TOKEN_z_index:
+                z_index = toInt(value);
+                break;
+        }
+    }
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Entity::Animation::Mainline::Key::Object_Ref::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1666,6 +2922,88 @@ bool Data::Entity::Animation::Timeline::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Timeline::load(XML_Stream& stream)
+{
+    id = 0;
+    object_type = "sprite";
+    variable_type = "string";
+    
+    // These depend on object_type, which may come later in the tag.
+    const char* name_attr = NULL;
+    const char* usage_attr = NULL;
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_object_type:
+                object_type = value;
+                break;
+            case TOKEN_variable_type:
+                variable_type = value;
+                break;
+            case TOKEN_name:
+                name_attr = value;
+                break;
+            case TOKEN_usage:
+                usage_attr = value;
+                break;
+        }
+    }
+    
+    if(object_type != "sound")
+        name = (name_attr == NULL? "" : name_attr);
+    
+    if(usage_attr != NULL && (object_type == "point" || object_type == "box" || object_type == "sprite" || object_type == "entity"))
+        usage = usage_attr;
+    else if(object_type == "point")
+        usage = "neither";
+    else if(object_type == "box")
+        usage = "collision";
+    else if(object_type == "sprite")
+        usage = "display";
+    else if(object_type == "entity")
+        usage = "display";
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data;
+                meta_data->load(stream);
+                break;
+            case TOKEN_key:
+            {
+                Key* key = new Key;
+                if(key->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(keys, key->id, key))
+                    {
+                        SCML::log("SCML::Data::Entity::Animation::Timeline loaded a key with a duplicate id (%d).\n", key->id);
+                        delete key;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Timeline failed to load a key.\n");
+                    delete key;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Timeline::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -1718,11 +3056,11 @@ void Data::Entity::Animation::Timeline::clear()
 
 
 Data::Entity::Animation::Timeline::Key::Key()
-    : id(0), time(0), curve_type("linear"), c1(0.0f), c2(0.0f), spin(1), meta_data(NULL)
+    : id(0), time(0), curve_type("linear"), c1(0.0f), c2(0.0f), c3(0.0f), c4(0.0f), spin(1), meta_data(NULL)
 {}
 
 Data::Entity::Animation::Timeline::Key::Key(TiXmlElement* elem)
-    : id(0), time(0), curve_type("linear"), c1(0.0f), c2(0.0f), spin(1), meta_data(NULL)
+    : id(0), time(0), curve_type("linear"), c1(0.0f), c2(0.0f), c3(0.0f), c4(0.0f), spin(1), meta_data(NULL)
 {
     load(elem);
 }
@@ -1734,6 +3072,8 @@ bool Data::Entity::Animation::Timeline::Key::load(TiXmlElement* elem)
     curve_type = xmlGetStringAttr(elem, "curve_type", "linear");
     c1 = xmlGetFloatAttr(elem, "c1", 0.0f);
     c2 = xmlGetFloatAttr(elem, "c2", 0.0f);
+    c3 = xmlGetFloatAttr(elem, "c3", 0.0f);
+    c4 = xmlGetFloatAttr(elem, "c4", 0.0f);
     spin = xmlGetIntAttr(elem, "spin", 1);
     
     
@@ -1767,20 +3107,98 @@ bool Data::Entity::Animation::Timeline::Key::load(TiXmlElement* elem)
     return true;
 }
 
-void Data::Entity::Animation::Timeline::Key::log(int recursive_depth) const
+bool Data::Entity::Animation::Timeline::Key::load(XML_Stream& stream)
 {
-    SCML::log("id=%d\n", id);
-    SCML::log("time=%d\n", time);
-    SCML::log("curve_type=%s\n", SCML_TO_CSTRING(curve_type));
-    SCML::log("c1=%f\n", c1);
-    SCML::log("c2=%f\n", c2);
-    SCML::log("spin=%d\n", spin);
-    
-    if(recursive_depth == 0)
-        return;
-    
-    if(meta_data != NULL)
-    {
+    id = 0;
+    time = 0;
+    curve_type = "linear";
+    c1 = 0.0f;
+    c2 = 0.0f;
+    c3 = 0.0f;
+    c4 = 0.0f;
+    spin = 1;
+    has_object = true;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_time:
+                time = toInt(value);
+                break;
+            case TOKEN_curve_type:
+                curve_type = value;
+                break;
+            case TOKEN_c1:
+                c1 = toFloat(value);
+                break;
+            case TOKEN_c2:
+                c2 = toFloat(value);
+                break;
+            case TOKEN_c3:
+                c3 = toFloat(value);
+                break;
+            case TOKEN_c4:
+                c4 = toFloat(value);
+                break;
+            case TOKEN_spin:
+                spin = toInt(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data_Tweenable;
+                meta_data->load(stream);
+                break;
+            case TOKEN_bone:
+                has_object = false;
+                if(!bone.load(stream))
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Timeline::Key failed to load a bone.\n");
+                }
+                break;
+            case TOKEN_object:
+                if(!object.load(stream))
+                {
+                    SCML::log("SCML::Data::Entity::Animation::Timeline::Key failed to load an object.\n");
+                    has_object = true;
+                }
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
+void Data::Entity::Animation::Timeline::Key::log(int recursive_depth) const
+{
+    SCML::log("id=%d\n", id);
+    SCML::log("time=%d\n", time);
+    SCML::log("curve_type=%s\n", SCML_TO_CSTRING(curve_type));
+    SCML::log("c1=%f\n", c1);
+    SCML::log("c2=%f\n", c2);
+    SCML::log("c3=%f\n", c3);
+    SCML::log("c4=%f\n", c4);
+    SCML::log("spin=%d\n", spin);
+    
+    if(recursive_depth == 0)
+        return;
+    
+    if(meta_data != NULL)
+    {
         SCML::log("Meta_Data:\n");
         meta_data->log(recursive_depth - 1);
     }
@@ -1804,6 +3222,8 @@ void Data::Entity::Animation::Timeline::Key::clear()
     curve_type = "linear";
     c1 = 0.0f;
     c2 = 0.0f;
+    c3 = 0.0f;
+    c4 = 0.0f;
     spin = 1;
     
     delete meta_data;
@@ -1851,6 +3271,39 @@ bool Data::Meta_Data_Tweenable::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Meta_Data_Tweenable::load(XML_Stream& stream)
+{
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_variable:
+            {
+                Variable* variable = new Variable;
+                if(variable->load(stream))
+                {
+                    if(!SCML_MAP_INSERT(variables, variable->name, variable))
+                    {
+                        SCML::log("SCML::Data::Meta_Data_Tweenable loaded a variable with a duplicate name (%s).\n", SCML_TO_CSTRING(variable->name));
+                        delete variable;
+                    }
+                }
+                else
+                {
+                    SCML::log("SCML::Data::Meta_Data_Tweenable failed to load a variable.\n");
+                    delete variable;
+                }
+                break;
+            }
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Meta_Data_Tweenable::log(int recursive_depth) const
 {
     if(recursive_depth == 0)
@@ -1909,6 +3362,50 @@ bool Data::Meta_Data_Tweenable::Variable::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Meta_Data_Tweenable::Variable::load(XML_Stream& stream)
+{
+    type = "string";
+    curve_type = "linear";
+    c1 = 0.0f;
+    c2 = 0.0f;
+    
+    // The value's meaning depends on the type, which may come after it.
+    const char* value_attr = NULL;
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_type:
+                type = value;
+                break;
+            case TOKEN_value:
+                value_attr = value;
+                break;
+            case TOKEN_curve_type:
+                curve_type = value;
+                break;
+            case TOKEN_c1:
+                c1 = toFloat(value);
+                break;
+            case TOKEN_c2:
+                c2 = toFloat(value);
+                break;
+        }
+    }
+    
+    if(type == "string")
+        value_string = (value_attr == NULL? "" : value_attr);
+    else if(type == "int")
+        value_int = (value_attr == NULL? 0 : toInt(value_attr));
+    else if(type == "float")
+        value_float = (value_attr == NULL? 0.0f : toFloat(value_attr));
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Meta_Data_Tweenable::Variable::log(int recursive_depth) const
 {
     SCML::log("type=%s\n", SCML_TO_CSTRING(type));
@@ -1977,6 +3474,71 @@ bool Data::Entity::Animation::Timeline::Key::Bone::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Timeline::Key::Bone::load(XML_Stream& stream)
+{
+    x = 0.0f;
+    y = 0.0f;
+    angle = 0.0f;
+    scale_x = 1.0f;
+    scale_y = 1.0f;
+    r = 1.0f;
+    g = 1.0f;
+    b = 1.0f;
+    a = 1.0f;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_x:
+                x = toFloat(value);
+                break;
+            case TOKEN_y:
+                y = toFloat(value);
+                break;
+            case TOKEN_angle:
+                angle = toFloat(value);
+                break;
+            case TOKEN_scale_x:
+                scale_x = toFloat(value);
+                break;
+            case TOKEN_scale_y:
+                scale_y = toFloat(value);
+                break;
+            case TOKEN_r:
+                r = toFloat(value);
+                break;
+            case TOKEN_g:
+                g = toFloat(value);
+                break;
+            case TOKEN_b:
+                b = toFloat(value);
+                break;
+            case TOKEN_a:
+                a = toFloat(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data_Tweenable;
+                meta_data->load(stream);
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Timeline::Key::Bone::log(int recursive_depth) const
 {
     SCML::log("x=%f\n", x);
@@ -2092,6 +3654,139 @@ bool Data::Entity::Animation::Timeline::Key::Object::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Entity::Animation::Timeline::Key::Object::load(XML_Stream& stream)
+{
+    atlas = 0;
+    folder = 0;
+    file = 0;
+    x = 0.0f;
+    y = 0.0f;
+    pivot_x = 0.0f;
+    pivot_y = 1.0f;
+    angle = 0.0f;
+    w = 0.0f;
+    h = 0.0f;
+    scale_x = 1.0f;
+    scale_y = 1.0f;
+    r = 1.0f;
+    g = 1.0f;
+    b = 1.0f;
+    a = 1.0f;
+    blend_mode = "alpha";
+    value_string = "";
+    value_int = 0;
+    min_int = 0;
+    max_int = 0;
+    value_float = 0.0f;
+    min_float = 0.0f;
+    max_float = 0.0f;
+    animation = 0;
+    t = 0.0f;
+    volume = 1.0f;
+    panning = 0.0f;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_atlas:
+                atlas = toInt(value);
+                break;
+            case TOKEN_folder:
+                folder = toInt(value);
+                break;
+            case TOKEN_file:
+                file = toInt(value);
+                break;
+            case TOKEN_x:
+                x = toFloat(value);
+                break;
+            case TOKEN_y:
+                y = toFloat(value);
+                break;
+            case TOKEN_pivot_x:
+                pivot_x = toFloat(value);
+                break;
+            case TOKEN_pivot_y:
+                pivot_y = toFloat(value);
+                break;
+            case TOKEN_angle:
+                angle = toFloat(value);
+                break;
+            case TOKEN_w:
+                w = toFloat(value);
+                break;
+            case TOKEN_h:
+                h = toFloat(value);
+                break;
+            case TOKEN_scale_x:
+                scale_x = toFloat(value);
+                break;
+            case TOKEN_scale_y:
+                scale_y = toFloat(value);
+                break;
+            case TOKEN_r:
+                r = toFloat(value);
+                break;
+            case TOKEN_g:
+                g = toFloat(value);
+                break;
+            case TOKEN_b:
+                b = toFloat(value);
+                break;
+            case TOKEN_a:
+                a = toFloat(value);
+                break;
+            case TOKEN_blend_mode:
+                blend_mode = value;
+                break;
+            case TOKEN_value:
+                value_string = value;
+                value_int = toInt(value);
+                value_float = toFloat(value);
+                break;
+            case TOKEN_min:
+                min_int = toInt(value);
+                min_float = toFloat(value);
+                break;
+            case TOKEN_max:
+                max_int = toInt(value);
+                max_float = toFloat(value);
+                break;
+            case TOKEN_animation:
+                animation = toInt(value);
+                break;
+            case TOKEN_t:
+                t = toFloat(value);
+                break;
+            case TOKEN_volume:
+                volume = toFloat(value);
+                break;
+            case TOKEN_panning:
+                panning = toFloat(value);
+                break;
+        }
+    }
+    
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_meta_data:
+                if(meta_data == NULL)
+                    meta_data = new Meta_Data_Tweenable;
+                meta_data->load(stream);
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    return true;
+}
+
 void Data::Entity::Animation::Timeline::Key::Object::log(int recursive_depth) const
 {
     //SCML::log("object_type=%s\n", SCML_TO_CSTRING(object_type));
@@ -2216,6 +3911,53 @@ bool Data::Character_Map::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Character_Map::load(XML_Stream& stream)
+{
+    id = 0;
+    name = "";
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_id:
+                id = toInt(value);
+                break;
+            case TOKEN_name:
+                name = value;
+                break;
+        }
+    }
+    
+    bool has_map = false;
+    while(stream.nextChild())
+    {
+        switch(stream.getToken())
+        {
+            case TOKEN_map:
+                if(has_map)
+                {
+                    stream.skipElement();
+                    break;
+                }
+                has_map = true;
+                map.load(stream);
+                break;
+            default:
+                stream.skipElement();
+                break;
+        }
+    }
+    
+    if(!has_map)
+    {
+        SCML::log("SCML::Data::Character_Map failed to load a map.\n");
+    }
+    
+    return true;
+}
+
 void Data::Character_Map::log(int recursive_depth) const
 {
     SCML::log("id=%d\n", id);
@@ -2265,6 +4007,46 @@ bool Data::Character_Map::Map::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Character_Map::Map::load(XML_Stream& stream)
+{
+    atlas = 0;
+    folder = 0;
+    file = 0;
+    target_atlas = 0;
+    target_folder = 0;
+    target_file = 0;
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_atlas:
+                atlas = toInt(value);
+                break;
+            case TOKEN_folder:
+                folder = toInt(value);
+                break;
+            case TOKEN_file:
+                file = toInt(value);
+                break;
+            case TOKEN_target_atlas:
+                target_atlas = toInt(value);
+                break;
+            case TOKEN_target_folder:
+                target_folder = toInt(value);
+                break;
+            case TOKEN_target_file:
+                target_file = toInt(value);
+                break;
+        }
+    }
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Character_Map::Map::log(int recursive_depth) const
 {
     SCML::log("atlas=%d\n", atlas);
@@ -2316,6 +4098,46 @@ bool Data::Document_Info::load(TiXmlElement* elem)
     return true;
 }
 
+bool Data::Document_Info::load(XML_Stream& stream)
+{
+    author = "author not specified";
+    copyright = "copyright info not specified";
+    license = "no license specified";
+    version = "version not specified";
+    last_modified = "date and time not included";
+    notes = "no additional notes";
+    
+    for(int i = 0; i < stream.getNumAttributes(); i++)
+    {
+        const char* value = stream.getAttributeValue(i);
+        switch(stream.getAttributeToken(i))
+        {
+            case TOKEN_author:
+                author = value;
+                break;
+            case TOKEN_copyright:
+                copyright = value;
+                break;
+            case TOKEN_license:
+                license = value;
+                break;
+            case TOKEN_version:
+                version = value;
+                break;
+            case TOKEN_last_modified:
+                last_modified = value;
+                break;
+            case TOKEN_notes:
+                notes = value;
+                break;
+        }
+    }
+    
+    stream.skipElement();
+    
+    return true;
+}
+
 void Data::Document_Info::log(int recursive_depth) const
 {
     SCML::log("author=%s\n", SCML_TO_CSTRING(author));
@@ -2357,21 +4179,46 @@ static bool pathIsAbsolute(const SCML_STRING& path)
 }
 
 
-void FileSystem::load(SCML::Data* data)
+// Gets the directory that the files referenced by a data file are relative to.
+static SCML_STRING getBaseDir(const SCML_STRING& path)
 {
-    if(data == NULL || SCML_STRING_SIZE(data->name) == 0)
-        return;
-    
     SCML_STRING basedir;
-    if(!pathIsAbsolute(data->name))
+    if(!pathIsAbsolute(path))
     {
         // Create a relative directory name for the path's base
         char buf[PATH_MAX];
-        snprintf(buf, PATH_MAX, "%s", SCML_TO_CSTRING(data->name));
+        snprintf(buf, PATH_MAX, "%s", SCML_TO_CSTRING(path));
         SCML_SET_STRING(basedir, dirname(buf));
         if(SCML_STRING_SIZE(basedir) > 0 && basedir[SCML_STRING_SIZE(basedir)-1] != '/')
             SCML_STRING_APPEND(basedir, '/');
     }
+    return basedir;
+}
+
+
+FileSystem::Atlas_Region::Atlas_Region()
+    : page(-1), x(0), y(0), width(0), height(0), u0(0.0f), v0(0.0f), u1(0.0f), v1(0.0f)
+    , offset_x(0), offset_y(0), original_width(0), original_height(0)
+{}
+
+void FileSystem::load(SCML::Data* data)
+{
+    if(data == NULL || SCML_STRING_SIZE(data->name) == 0)
+        return;
+    
+    SCML_STRING basedir = getBaseDir(data->name);
+    
+    // Load the atlas pages first.  Their images are drawn from the pages.
+    SCML_MAP(int, bool) pages;
+    SCML_BEGIN_MAP_FOREACH_CONST(data->atlases, int, SCML::Data::Atlas*, atlas)
+    {
+        if(SCML_STRING_SIZE(atlas->image_path) > 0)
+        {
+            printf("Loading atlas page \"%s\"\n", SCML_TO_CSTRING(basedir + atlas->image_path));
+            SCML_MAP_INSERT(pages, atlas->id, loadAtlasPage(atlas->id, basedir + atlas->image_path));
+        }
+    }
+    SCML_END_MAP_FOREACH_CONST;
     
     SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, folder)
     {
@@ -2379,6 +4226,11 @@ void FileSystem::load(SCML::Data* data)
         {
             if(file->type == "image")
             {
+                if(file->atlas >= 0 && SCML_MAP_FIND(pages, file->atlas)
+                   && addAtlasRegion(folder->id, file->id, file->atlas, file->atlas_x, file->atlas_y, file->width, file->height,
+                                     file->offset_x, file->offset_y, file->original_width, file->original_height))
+                    continue;
+                
                 printf("Loading \"%s\"\n", SCML_TO_CSTRING(basedir + file->name));
                 loadImageFile(folder->id, file->id, basedir + file->name);
             }
@@ -2388,65 +4240,218 @@ void FileSystem::load(SCML::Data* data)
     SCML_END_MAP_FOREACH_CONST;
 }
 
-
-
-
-
-
-
-Entity::Entity()
-    : entity(-1), animation(-1), key(-1), time(0)
-{}
-
-Entity::Entity(SCML::Data* data, int entity, int animation, int key)
-    : entity(entity), animation(animation), key(key), time(0)
-{
-    load(data);
-}
-
-Entity::~Entity()
-{
-    clear();
-}
-
-void Entity::load(SCML::Data* data)
+void FileSystem::load(SCML::BinaryData* data)
 {
-    if(data == NULL)
+    if(data == NULL || SCML_STRING_SIZE(data->name) == 0)
         return;
     
-    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data->entities, entity);
-    if(entity_ptr == NULL)
-        return;
+    SCML_STRING basedir = getBaseDir(data->name);
     
-    name = entity_ptr->name;
+    SCML_MAP(int, bool) pages;
+    for(int i = 0; i < data->getNumAtlasPages(); i++)
+    {
+        const SCML::BinaryData::Atlas_Page* page = data->getAtlasPage(i);
+        SCML_STRING filename = basedir + data->getString(page->image_path);
+        printf("Loading atlas page \"%s\"\n", SCML_TO_CSTRING(filename));
+        SCML_MAP_INSERT(pages, page->atlas, loadAtlasPage(page->atlas, filename));
+    }
     
-    SCML_BEGIN_MAP_FOREACH_CONST(entity_ptr->animations, int, SCML::Data::Entity::Animation*, item)
+    for(int i = 0; i < data->getNumFiles(); i++)
     {
-        SCML_MAP_INSERT(animations, item->id, new Animation(item));
+        const SCML::BinaryData::File* file = data->getFile(i);
+        if(strcmp(data->getString(file->type), "image") == 0)
+        {
+            if(file->atlas >= 0 && SCML_MAP_FIND(pages, file->atlas)
+               && addAtlasRegion(file->folder, file->file, file->atlas, file->atlas_x, file->atlas_y, file->width, file->height,
+                                 file->offset_x, file->offset_y, file->original_width, file->original_height))
+                continue;
+            
+            SCML_STRING filename = basedir + data->getString(file->name);
+            printf("Loading \"%s\"\n", SCML_TO_CSTRING(filename));
+            loadImageFile(file->folder, file->file, filename);
+        }
     }
-    SCML_END_MAP_FOREACH_CONST;
 }
 
-void Entity::clear()
+void FileSystem::load(SCML::Flipbook* flipbook)
 {
-    entity = -1;
-    animation = -1;
-    key = -1;
-    time = 0;
+    if(flipbook == NULL || SCML_STRING_SIZE(flipbook->name) == 0)
+        return;
     
-    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
+    SCML_STRING basedir = getBaseDir(flipbook->name);
+    
+    SCML_MAP(int, bool) pages;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(flipbook->sheets); i++)
     {
-        delete item;
+        const Flipbook::Sheet& sheet = flipbook->sheets[i];
+        printf("Loading flipbook sheet \"%s\"\n", SCML_TO_CSTRING(basedir + sheet.image_path));
+        SCML_MAP_INSERT(pages, sheet.atlas, loadAtlasPage(sheet.atlas, basedir + sheet.image_path));
+    }
+    
+    // The frames are trimmed already, so each one is all of its own image
+    SCML_BEGIN_MAP_FOREACH_CONST(flipbook->animations, int, Flipbook::Animation*, animation)
+    {
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(animation->frames); i++)
+        {
+            const Flipbook::Frame& frame = animation->frames[i];
+            if(SCML_MAP_FIND(pages, frame.atlas))
+                addAtlasRegion(flipbook->folder, frame.file, frame.atlas, frame.x, frame.y, frame.width, frame.height, 0, 0, frame.width, frame.height);
+        }
     }
     SCML_END_MAP_FOREACH_CONST;
-    animations.clear();
 }
 
-void Entity::startAnimation(int animation)
+const FileSystem::Atlas_Region* FileSystem::getAtlasRegion(int folderID, int fileID) const
 {
-    this->animation = animation;
-    key = 0;
-    time = 0;
+    if(SCML_VECTOR_SIZE(atlas_regions) == 0)
+        return NULL;
+    int index = SCML_MAP_FIND(atlas_region_indices, SCML_MAKE_PAIR(folderID, fileID));
+    return (index > 0? &atlas_regions[index - 1] : NULL);
+}
+
+bool FileSystem::getAtlasImageDimensions(int folderID, int fileID, SCML_PAIR(unsigned int, unsigned int)& dimensions) const
+{
+    const Atlas_Region* region = getAtlasRegion(folderID, fileID);
+    if(region == NULL)
+        return false;
+    dimensions = SCML_MAKE_PAIR((unsigned int)region->original_width, (unsigned int)region->original_height);
+    return true;
+}
+
+bool FileSystem::addAtlasRegion(int folderID, int fileID, int atlasID, int x, int y, int width, int height, int offset_x, int offset_y, int original_width, int original_height)
+{
+    SCML_PAIR(unsigned int, unsigned int) page_dims = getAtlasPageDimensions(atlasID);
+    int page_width = SCML_PAIR_FIRST(page_dims);
+    int page_height = SCML_PAIR_SECOND(page_dims);
+    if(width <= 0 || height <= 0 || x < 0 || y < 0 || x + width > page_width || y + height > page_height)
+    {
+        SCML::log("SCML::FileSystem failed to place image %d/%d: It is not on atlas page %d.\n", folderID, fileID, atlasID);
+        return false;
+    }
+    
+    Atlas_Region region;
+    region.page = atlasID;
+    region.x = x;
+    region.y = y;
+    region.width = width;
+    region.height = height;
+    region.u0 = x/float(page_width);
+    region.v0 = y/float(page_height);
+    region.u1 = (x + width)/float(page_width);
+    region.v1 = (y + height)/float(page_height);
+    
+    // Untrimmed images leave these out
+    region.offset_x = offset_x;
+    region.offset_y = offset_y;
+    region.original_width = (original_width > 0? original_width : width);
+    region.original_height = (original_height > 0? original_height : height);
+    
+    if(!SCML_MAP_INSERT(atlas_region_indices, SCML_MAKE_PAIR(folderID, fileID), SCML_VECTOR_SIZE(atlas_regions) + 1))
+    {
+        SCML::log("SCML::FileSystem failed to place image: It duplicates a folder/file id (%d/%d)\n", folderID, fileID);
+        return false;
+    }
+    SCML_VECTOR_PUSH_BACK(atlas_regions, region);
+    return true;
+}
+
+void FileSystem::clearAtlasRegions()
+{
+    SCML_VECTOR_CLEAR(atlas_regions);
+    atlas_region_indices.clear();
+}
+
+
+
+
+
+
+
+Entity::Entity()
+    : entity(-1), animation(-1), key(-1), time(0), reversed(false), prototype(NULL), baked_poses(NULL)
+{}
+
+Entity::Entity(SCML::Data* data, int entity, int animation, int key)
+    : entity(entity), animation(animation), key(key), time(0), reversed(false), prototype(NULL), baked_poses(NULL)
+{
+    load(data);
+}
+
+Entity::~Entity()
+{
+    clear();
+}
+
+void Entity::load(SCML::Data* data)
+{
+    if(data == NULL)
+        return;
+    
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data->entities, entity);
+    if(entity_ptr == NULL)
+        return;
+    
+    setPrototype(entity_ptr->getPrototype());
+}
+
+void Entity::load(SCML::BinaryData* data)
+{
+    if(data == NULL)
+        return;
+    
+    EntityPrototype* prototype = data->getPrototype(entity);
+    if(prototype == NULL)
+        return;
+    
+    setPrototype(prototype);
+}
+
+void Entity::setPrototype(EntityPrototype* prototype)
+{
+    if(prototype != NULL)
+    {
+        prototype->retain();
+        entity = prototype->id;
+    }
+    if(this->prototype != NULL)
+        this->prototype->release();
+    this->prototype = prototype;
+    
+    // The cached transforms belong to the old animation data
+    bone_transform_state = Bone_Transform_State();
+}
+
+void Entity::setBakedPoses(BakedPoses* poses)
+{
+    baked_poses = poses;
+    bone_transform_state = Bone_Transform_State();
+}
+
+BakedPoses* Entity::getBakedPoses() const
+{
+    if(baked_poses == NULL || prototype == NULL || baked_poses->prototype != prototype)
+        return NULL;
+    return baked_poses;
+}
+
+void Entity::clear()
+{
+    setPrototype(NULL);
+    baked_poses = NULL;
+    
+    entity = -1;
+    animation = -1;
+    key = -1;
+    time = 0;
+    reversed = false;
+}
+
+void Entity::startAnimation(int animation)
+{
+    this->animation = animation;
+    key = 0;
+    time = 0;
+    reversed = false;
 }
 
 
@@ -2455,43 +4460,88 @@ void Entity::update(int dt_ms)
     if(entity < 0 || animation < 0 || key < 0)
         return;
     
+    advance(dt_ms);
+}
+
+// Loops go back to the loop_to key, so after the first time through, they only cover [loop_start, length].
+static int get_loop_start(Entity::Animation* animation_ptr)
+{
+    Entity::Animation::Mainline::Key* loop_key = animation_ptr->mainline.getKey(animation_ptr->loop_to);
+    return (loop_key != NULL && loop_key->time < animation_ptr->length? loop_key->time : 0);
+}
+
+void Entity::setTime(int time_ms)
+{
+    if(entity < 0 || animation < 0)
+        return;
     
-    SCML::Entity::Animation* animation_ptr = getAnimation(animation);
+    Animation* animation_ptr = getAnimation(animation);
     if(animation_ptr == NULL)
         return;
     
-    int nextKey = getNextKeyID(animation, key);
-    int nextTime = 0;
-    if(nextKey < key)
+    int length = animation_ptr->length;
+    bool backward = false;
+    
+    if(animation_ptr->loop_mode == Animation::LOOP_TRUE && length > 0)
     {
-        // Next key is not after this one, so use end of animation time
-        nextTime = animation_ptr->length;
+        if(time_ms >= length)
+        {
+            int loop_start = get_loop_start(animation_ptr);
+            time_ms = loop_start + (time_ms - length) % (length - loop_start);
+        }
+        else if(time_ms < 0)
+            time_ms = length - 1 - (-time_ms - 1) % length;
     }
-    else
+    else if(animation_ptr->loop_mode == Animation::LOOP_PING_PONG && length > 0)
     {
-        // Get nextTime from the nextKey
-        Animation::Mainline::Key* nextKey_ptr = getKey(animation, nextKey);
-        if(nextKey_ptr != NULL)
+        if(time_ms < 0 || time_ms > length)
         {
-            nextTime = nextKey_ptr->time;
+            // Each bounce plays back from the end to the loop start, then forward to the end again.
+            int loop_start = get_loop_start(animation_ptr);
+            int loop_length = length - loop_start;
+            int phase = (time_ms - length) % (2*loop_length);
+            if(phase < 0)
+                phase += 2*loop_length;
+            
+            if(phase < loop_length)
+            {
+                time_ms = length - phase;
+                backward = (phase > 0);
+            }
+            else
+                time_ms = loop_start + phase - loop_length;
         }
     }
+    else
+    {
+        if(time_ms < 0)
+            time_ms = 0;
+        else if(time_ms > length)
+            time_ms = length;
+    }
+    
+    Animation::Mainline::Key* key_ptr = animation_ptr->mainline.getKeyAtTime(time_ms);
+    if(key_ptr == NULL)
+        return;
     
-    time += dt_ms;
-    if(time >= nextTime)
+    time = time_ms;
+    key = key_ptr->id;
+    reversed = backward;
+}
+
+void Entity::advance(int dt_ms)
+{
+    // Playing backward means being in the first bounce after the end, which is where setTime() puts length + (length - time).
+    if(reversed)
     {
-        int overshot = time - nextTime;
-        
-        // Advance to next key
-        key = nextKey;
-        
-        // Get the starting time from the new key.
-        Animation::Mainline::Key* key_ptr = getKey(animation, key);
-        if(key_ptr != NULL)
+        Animation* animation_ptr = getAnimation(animation);
+        if(animation_ptr != NULL)
         {
-            time = key_ptr->time + overshot;
+            setTime(2*animation_ptr->length - time + dt_ms);
+            return;
         }
     }
+    setTime(time + dt_ms);
 }
 
 
@@ -2502,297 +4552,606 @@ inline float lerp(float a, float b, float t)
     return a + (b-a)*t;
 }
 
-// This is for rotating untranslated points and offsetting them to a new origin.
-static void rotate_point(float& x, float& y, float angle, float origin_x, float origin_y, bool flipped)
+void Entity::evaluate(float x, float y, float angle, float scale_x, float scale_y)
 {
-    if(flipped)
-        angle = -angle;
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL || animation_ptr->mainline.getKey(key) == NULL)
+        return;
     
-    float s = sinf(angle*M_PI/180);
-    float c = cosf(angle*M_PI/180);
-    float xnew = (x * c) - (y * s);
-    float ynew = (x * s) + (y * c);
-    xnew += origin_x;
-    ynew += origin_y;
+    convert_to_SCML_coords(x, y, angle);
     
-    x = xnew;
-    y = ynew;
+    Transform base_transform(x, y, angle, scale_x, scale_y);
+    if(getBakedPoses() != NULL)
+    {
+        // The baked poses only need the base.  Forget the bones, so they are rebuilt if the poses are taken away.
+        if(bone_transform_state.entity >= 0 || bone_transform_state.base_transform != base_transform)
+        {
+            bone_transform_state.entity = -1;
+            bone_transform_state.base_transform = base_transform;
+            bone_transform_state.base_matrix = Affine(base_transform);
+        }
+        return;
+    }
+    
+    // Build up the bone transform hierarchy
+    int nextKeyID = getNextKeyID(animation, key);
+    if(bone_transform_state.should_rebuild(entity, animation, key, nextKeyID, time, base_transform))
+    {
+        bone_transform_state.rebuild(entity, animation, key, nextKeyID, time, this, base_transform);
+    }
 }
 
 void Entity::draw(float x, float y, float angle, float scale_x, float scale_y)
 {
     // Get key
-    Animation::Mainline::Key* key_ptr = getKey(animation, key);
-    if(key_ptr == NULL)
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
         return;
     
-    convert_to_SCML_coords(x, y, angle);
+    Animation::Mainline& mainline = animation_ptr->mainline;
+    Animation::Mainline::Key* key_ptr = mainline.getKey(key);
+    if(key_ptr == NULL)
+        return;
     
-    int nextKeyID = getNextKeyID(animation, key);
-    Animation::Mainline::Key* nextkey_ptr = getKey(animation, nextKeyID);
+    Animation::Mainline::Key* nextkey_ptr = mainline.getKey(getNextKeyID(animation, key));
     if(nextkey_ptr == NULL)
         nextkey_ptr = key_ptr;
     
-    // Build up the bone transform hierarchy
-    Transform base_transform(x, y, angle, scale_x, scale_y);
-    if(bone_transform_state.should_rebuild(entity, animation, key, nextKeyID, time, base_transform))
+    evaluate(x, y, angle, scale_x, scale_y);
+    
+    BakedPoses* poses = getBakedPoses();
+    if(poses != NULL)
     {
-        bone_transform_state.rebuild(entity, animation, key, nextKeyID, time, this, base_transform);
+        int frame, next_frame;
+        float t;
+        if(!poses->findFrames(animation, time, frame, next_frame, t))
+            return;
+        
+        Sprite sprite;
+        for(int i = 0; i < poses->frames[frame].num_objects; i++)
+        {
+            poses->getSprite(sprite, frame, i, next_frame, t, bone_transform_state.base_transform, bone_transform_state.base_matrix);
+            Transform draw_transform = sprite.getDrawTransform();
+            draw_internal(sprite.folder, sprite.file, draw_transform.x, draw_transform.y, draw_transform.angle, draw_transform.scale_x, draw_transform.scale_y);
+        }
+        return;
     }
     
     
-    // Go through each object
-    SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->objects, int, Animation::Mainline::Key::Object_Container, item)
+    // Go through each object, in drawing order
+    for(int i = 0; i < key_ptr->num_objects; i++)
     {
+        const Animation::Mainline::Key::Object_Container& item = mainline.getDrawSlot(key_ptr, i);
         if(item.hasObject())
         {
-            draw_simple_object(item.object);
+            draw_simple_object(mainline.getObject(item));
         }
         else
         {
-            Animation::Mainline::Key::Object_Container nextitem = SCML_MAP_FIND(nextkey_ptr->objects, _iter_e->first);  // FIXME: Breaks STL abstraction
-            draw_tweened_object(item.object_ref, nextitem.object_ref);
+            Animation::Mainline::Key::Object_Container* nextitem = mainline.getObjectSlot(nextkey_ptr, item.id);
+            draw_tweened_object(mainline.getObjectRef(item), (nextitem == NULL? NULL : mainline.getObjectRef(*nextitem)));
         }
     }
-    SCML_END_MAP_FOREACH_CONST;
 }
 
 
 void Entity::draw_simple_object(Animation::Mainline::Key::Object* obj1)
 {
-    // Get parent bone transform
-    Transform parent_transform;
-    
-    if(obj1->parent < 0)
-        parent_transform = bone_transform_state.base_transform;
-    else
-        parent_transform = bone_transform_state.transforms[obj1->parent];
-    
-    
-    // Set object transform
-    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
-    
-    // Transform the sprite by the parent transform.
-    obj_transform.apply_parent_transform(parent_transform);
-    
-    
-    // Transform the sprite by its own transform now.
-    
-    float pivot_x_ratio = obj1->pivot_x;
-    float pivot_y_ratio = obj1->pivot_y;
-    
-    // No image tweening
-    std::pair<unsigned int, unsigned int> img_dims = getImageDimensions(obj1->folder, obj1->file);
-    
-    // Rotate about the pivot point and draw from the center of the image
-    float offset_x = (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-    float offset_y = (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-    float sprite_x = -offset_x*obj_transform.scale_x;
-    float sprite_y = -offset_y*obj_transform.scale_y;
-    
-    bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-    rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
+    Sprite sprite;
+    if(!getSimpleObjectSprite(sprite, obj1))
+        return;
     
     // Let the renderer draw it
-    draw_internal(obj1->folder, obj1->file, sprite_x, sprite_y, flipped? -obj_transform.angle : obj_transform.angle, obj_transform.scale_x, obj_transform.scale_y);
+    Transform draw_transform = sprite.getDrawTransform();
+    draw_internal(sprite.folder, sprite.file, draw_transform.x, draw_transform.y, draw_transform.angle, draw_transform.scale_x, draw_transform.scale_y);
 }
 
 
 void Entity::draw_tweened_object(Animation::Mainline::Key::Object_Ref* ref1, Animation::Mainline::Key::Object_Ref* ref2)
 {
-    if(ref1 == NULL)
-        return;
-    if(ref2 == NULL)
-        ref2 = ref1;
-    // Dereference object_ref and get the next one in the timeline for tweening
-    Animation* animation_ptr = getAnimation(animation);  // Need this only if looping...
-    Animation::Timeline::Key* t_key1 = getTimelineKey(animation, ref1->timeline, ref1->key);
-    Animation::Timeline::Key* t_key2 = getTimelineKey(animation, ref2->timeline, ref2->key);
-    if(t_key2 == NULL)
-        t_key2 = t_key1;
-    if(t_key1 == NULL || !t_key1->has_object || !t_key2->has_object)
+    Sprite sprite;
+    if(!getTweenedObjectSprite(sprite, ref1, ref2))
         return;
     
-    Animation::Timeline::Key::Object* obj1 = &t_key1->object;
-    Animation::Timeline::Key::Object* obj2 = &t_key2->object;
-    if(obj2 == NULL)
-        obj2 = obj1;
-    if(obj1 != NULL)
-    {
-        // Get interpolation (tweening) factor
-        float t = 0.0f;
-        if(t_key2->time > t_key1->time)
-            t = (time - t_key1->time)/float(t_key2->time - t_key1->time);
-        else if(t_key2->time < t_key1->time)
-            t = (time - t_key1->time)/float(animation_ptr->length - t_key1->time);
-        
-        // Get parent bone transform
-        Transform parent_transform;
-        if(ref1->parent < 0)
-            parent_transform = bone_transform_state.base_transform;
-        else
-            parent_transform = bone_transform_state.transforms[ref1->parent];
-        
-        // Set object transform
-        Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
-        
-        // Tween with next key's object
-        obj_transform.lerp(Transform(obj2->x, obj2->y, obj2->angle, obj2->scale_x, obj2->scale_y), t, t_key1->spin);
-        
-        // Transform the sprite by the parent transform.
-        obj_transform.apply_parent_transform(parent_transform);
-        
-        
-        // Transform the sprite by its own transform now.
-        
-        float pivot_x_ratio = lerp(obj1->pivot_x, obj2->pivot_x, t);
-        float pivot_y_ratio = lerp(obj1->pivot_y, obj2->pivot_y, t);
-        
-        // No image tweening
-        std::pair<unsigned int, unsigned int> img_dims = getImageDimensions(obj1->folder, obj1->file);
-        
-        // Rotate about the pivot point and draw from the center of the image
-        float offset_x = (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-        float offset_y = (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-        float sprite_x = -offset_x*obj_transform.scale_x;
-        float sprite_y = -offset_y*obj_transform.scale_y;
-        
-        bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-        rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
-        
-        // Let the renderer draw it
-        draw_internal(obj1->folder, obj1->file, sprite_x, sprite_y, flipped? -obj_transform.angle : obj_transform.angle, obj_transform.scale_x, obj_transform.scale_y);
-    }
+    // Let the renderer draw it
+    Transform draw_transform = sprite.getDrawTransform();
+    draw_internal(sprite.folder, sprite.file, draw_transform.x, draw_transform.y, draw_transform.angle, draw_transform.scale_x, draw_transform.scale_y);
 }
 
 
 
 
-Transform::Transform()
-    : x(0.0f), y(0.0f), angle(0.0f), scale_x(1.0f), scale_y(1.0f)
-{}
-
-Transform::Transform(float x, float y, float angle, float scale_x, float scale_y)
-    : x(x), y(y), angle(angle), scale_x(scale_x), scale_y(scale_y)
+Entity::Sprite::Sprite()
+    : folder(-1), file(-1), width(0.0f), height(0.0f), pivot_x(0.0f), pivot_y(0.0f)
+    , r(1.0f), g(1.0f), b(1.0f), a(1.0f), blend_mode(DrawList::BLEND_ALPHA), z_index(0)
 {}
 
-bool Transform::operator==(const Transform& t) const
-{
-    return (x == t.x && y == t.y && angle == t.angle && scale_x == t.scale_x && scale_y == t.scale_y);
-}
-
-bool Transform::operator!=(const Transform& t) const
-{
-    return !(*this == t);
-}
-
-void Transform::lerp(const Transform& transform, float t, int spin)
+Transform Entity::Sprite::getDrawTransform() const
 {
-    x = SCML::lerp(x, transform.x, t);
-    y = SCML::lerp(y, transform.y, t);
+    // Rotate about the pivot point and draw from the center of the image
+    float x = -(pivot_x - 0.5f)*width;
+    float y = -(pivot_y - 0.5f)*height;
+    matrix.apply(x, y);
     
-    // 'spin' is based on what you are coming from (key1)
-    if(spin != 0)
-    {
-        if(spin > 0 && angle > transform.angle)
-            angle = SCML::lerp(angle, transform.angle + 360, t);
-        else if(spin < 0 && angle < transform.angle)
-            angle = SCML::lerp(angle, transform.angle - 360, t);
-        else
-            angle = SCML::lerp(angle, transform.angle, t);
-    }
-        
-    scale_x = SCML::lerp(scale_x, transform.scale_x, t);
-    scale_y = SCML::lerp(scale_y, transform.scale_y, t);
+    bool flipped = ((transform.scale_x < 0) != (transform.scale_y < 0));
+    return Transform(x, y, flipped? -transform.angle : transform.angle, transform.scale_x, transform.scale_y);
 }
 
-void Transform::apply_parent_transform(const Transform& parent)
+void Entity::Sprite::getQuad(float* corners) const
 {
-    x *= parent.scale_x;
-    y *= parent.scale_y;
-    
-    bool flipped = ((parent.scale_x < 0) != (parent.scale_y < 0));
-    rotate_point(x, y, parent.angle, parent.x, parent.y, flipped);
-    
-    angle += parent.angle;
-    scale_x *= parent.scale_x;
-    scale_y *= parent.scale_y;
+    matrix.getQuad(width, height, pivot_x, pivot_y, corners);
 }
 
 
 
 
-Entity::Bone_Transform_State::Bone_Transform_State()
-    : entity(-1), animation(-1), key(-1), nextKey(-1), time(-1)
-{}
-
-bool Entity::Bone_Transform_State::should_rebuild(int entity, int animation, int key, int nextKey, int time, const Transform& base_transform)
+static void add_draw_command(DrawList& list, const Entity::Sprite& sprite)
 {
-    return (entity != this->entity || animation != this->animation || key != this->key || time != this->time || this->nextKey != nextKey || this->base_transform != base_transform);
+    SCML_VECTOR_PUSH_BACK(list.commands, DrawList::Command());
+    DrawList::Command& command = list.commands.back();
+    
+    command.folder = sprite.folder;
+    command.file = sprite.file;
+    
+    Transform draw_transform = sprite.getDrawTransform();
+    command.x = draw_transform.x;
+    command.y = draw_transform.y;
+    command.angle = draw_transform.angle;
+    command.scale_x = draw_transform.scale_x;
+    command.scale_y = draw_transform.scale_y;
+    sprite.getQuad(command.corners);
+    
+    command.r = sprite.r;
+    command.g = sprite.g;
+    command.b = sprite.b;
+    command.a = sprite.a;
+    command.blend_mode = sprite.blend_mode;
+    command.z = sprite.z_index;
+    command.sort_key = DrawList::makeSortKey(list.layer, list.depth, sprite.z_index, sprite.folder, sprite.file);
 }
 
-void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, int nextKey, int time, Entity* entity_ptr, const Transform& base_transform)
+void Entity::buildDrawList(DrawList& list)
 {
-    if(entity_ptr == NULL)
-    {
-        this->entity = -1;
-        this->animation = -1;
-        this->key = -1;
-        this->nextKey = -1;
-        this->time = -1;
+    // Get key
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
         return;
-    }
     
-    this->entity = entity;
-    this->animation = animation;
-    this->key = key;
+    Animation::Mainline& mainline = animation_ptr->mainline;
+    Animation::Mainline::Key* key_ptr = mainline.getKey(key);
+    if(key_ptr == NULL)
+        return;
+    
+    BakedPoses* poses = getBakedPoses();
+    if(poses != NULL)
+    {
+        int frame, next_frame;
+        float t;
+        if(!poses->findFrames(animation, time, frame, next_frame, t))
+            return;
+        
+        Sprite sprite;
+        for(int i = 0; i < poses->frames[frame].num_objects; i++)
+        {
+            poses->getSprite(sprite, frame, i, next_frame, t, bone_transform_state.base_transform, bone_transform_state.base_matrix);
+            add_draw_command(list, sprite);
+        }
+        return;
+    }
+    
+    int nextKeyID = getNextKeyID(animation, key);
+    Animation::Mainline::Key* nextkey_ptr = mainline.getKey(nextKeyID);
+    if(nextkey_ptr == NULL)
+        nextkey_ptr = key_ptr;
+    
+    // The bones may be from an earlier time if the entity was updated without being evaluated.  Keep the last position.
+    Transform base_transform = bone_transform_state.base_transform;
+    if(bone_transform_state.should_rebuild(entity, animation, key, nextKeyID, time, base_transform))
+    {
+        bone_transform_state.rebuild(entity, animation, key, nextKeyID, time, this, base_transform);
+    }
+    
+    // Go through each object, in drawing order
+    for(int i = 0; i < key_ptr->num_objects; i++)
+    {
+        const Animation::Mainline::Key::Object_Container& item = mainline.getDrawSlot(key_ptr, i);
+        Sprite sprite;
+        bool has_sprite;
+        if(item.hasObject())
+        {
+            has_sprite = getSimpleObjectSprite(sprite, mainline.getObject(item));
+        }
+        else
+        {
+            Animation::Mainline::Key::Object_Container* nextitem = mainline.getObjectSlot(nextkey_ptr, item.id);
+            has_sprite = getTweenedObjectSprite(sprite, mainline.getObjectRef(item), (nextitem == NULL? NULL : mainline.getObjectRef(*nextitem)));
+        }
+        
+        if(has_sprite)
+            add_draw_command(list, sprite);
+    }
+}
+
+void Entity::buildDrawList(DrawList& list, float x, float y, float angle, float scale_x, float scale_y)
+{
+    evaluate(x, y, angle, scale_x, scale_y);
+    buildDrawList(list);
+}
+
+void Entity::submit(const DrawList& list)
+{
+    for(int i = 0; i < list.size(); i++)
+    {
+        const DrawList::Command& command = list[i];
+        draw_internal(command.folder, command.file, command.x, command.y, command.angle, command.scale_x, command.scale_y);
+    }
+}
+
+
+
+
+DrawList::DrawList()
+    : layer(0), depth(0)
+{}
+
+int DrawList::size() const
+{
+    return SCML_VECTOR_SIZE(commands);
+}
+
+bool DrawList::empty() const
+{
+    return (SCML_VECTOR_SIZE(commands) == 0);
+}
+
+void DrawList::clear()
+{
+    SCML_VECTOR_CLEAR(commands);
+}
+
+DrawList::Command& DrawList::operator[](int index)
+{
+    return commands[index];
+}
+
+const DrawList::Command& DrawList::operator[](int index) const
+{
+    return commands[index];
+}
+
+void DrawList::append(const DrawList& list)
+{
+    commands.insert(commands.end(), list.commands.begin(), list.commands.end());
+}
+
+bool DrawList::getQuad(int index, const FileSystem& file_system, Quad& quad) const
+{
+    const Command& command = commands[index];
+    float u0, v0, u1, v1;
+    float s0 = 0.0f, t0 = 0.0f, s1 = 1.0f, t1 = 1.0f;
+    const FileSystem::Atlas_Region* region = file_system.getAtlasRegion(command.folder, command.file);
+    if(region != NULL)
+    {
+        quad.page = region->page;
+        u0 = region->x;
+        v0 = region->y;
+        u1 = region->x + region->width;
+        v1 = region->y + region->height;
+        s0 = region->u0;
+        t0 = region->v0;
+        s1 = region->u1;
+        t1 = region->v1;
+    }
+    else
+    {
+        SCML_PAIR(unsigned int, unsigned int) dimensions = file_system.getImageDimensions(command.folder, command.file);
+        if(SCML_PAIR_FIRST(dimensions) == 0 && SCML_PAIR_SECOND(dimensions) == 0)
+            return false;
+        quad.page = -1;
+        u0 = 0.0f;
+        v0 = 0.0f;
+        u1 = SCML_PAIR_FIRST(dimensions);
+        v1 = SCML_PAIR_SECOND(dimensions);
+    }
+    
+    // The corners are in the SCML coordinate system, with +y up
+    for(int k = 0; k < 4; k++)
+    {
+        quad.x[k] = command.corners[2*k];
+        quad.y[k] = -command.corners[2*k + 1];
+    }
+    quad.u[0] = quad.u[3] = u0;
+    quad.u[1] = quad.u[2] = u1;
+    quad.v[0] = quad.v[1] = v0;
+    quad.v[2] = quad.v[3] = v1;
+    quad.s[0] = quad.s[3] = s0;
+    quad.s[1] = quad.s[2] = s1;
+    quad.t[0] = quad.t[1] = t0;
+    quad.t[2] = quad.t[3] = t1;
+    return true;
+}
+
+void DrawList::sort()
+{
+    int n = size();
+    if(n < 2)
+        return;
+    
+    SCML_VECTOR_RESIZE(sort_items, n);
+    SCML_VECTOR_RESIZE(sort_scratch, n);
+    Sort_Item* from = &sort_items[0];
+    Sort_Item* to = &sort_scratch[0];
+    
+    // Count the values of every byte of the keys in one pass
+    int counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for(int i = 0; i < n; i++)
+    {
+        unsigned long long key = commands[i].sort_key;
+        from[i].key = key;
+        from[i].index = i;
+        for(int b = 0; b < 8; b++)
+            counts[b][(key >> (8*b)) & 0xFF]++;
+    }
+    
+    // Least significant byte first.  Each pass is stable, so the commands with the same key stay in order.
+    bool moved = false;
+    for(int b = 0; b < 8; b++)
+    {
+        int* count = counts[b];
+        // Skip the bytes that are the same in every key (e.g. a layer that is not used)
+        if(count[(from[0].key >> (8*b)) & 0xFF] == n)
+            continue;
+        
+        int offset = 0;
+        for(int value = 0; value < 256; value++)
+        {
+            int num = count[value];
+            count[value] = offset;
+            offset += num;
+        }
+        for(int i = 0; i < n; i++)
+            to[count[(from[i].key >> (8*b)) & 0xFF]++] = from[i];
+        
+        Sort_Item* swap = from;
+        from = to;
+        to = swap;
+        moved = true;
+    }
+    if(!moved)
+        return;
+    
+    SCML_VECTOR_RESIZE(sorted_commands, n);
+    for(int i = 0; i < n; i++)
+        sorted_commands[i] = commands[from[i].index];
+    commands.swap(sorted_commands);
+}
+
+// Clamps a signed value into 16 bits, offset so that it sorts as an unsigned number
+static unsigned long long sort_key_bits(int value)
+{
+    if(value < -32768)
+        value = -32768;
+    else if(value > 32767)
+        value = 32767;
+    return (unsigned long long)(value + 32768);
+}
+
+unsigned long long DrawList::makeSortKey(int layer, int depth, int z, int folder, int file)
+{
+    unsigned long long key = (unsigned long long)(layer < 0? 0 : (layer > 255? 255 : layer)) << 56;
+    key |= sort_key_bits(depth) << 40;
+    key |= sort_key_bits(z) << 24;
+    key |= (unsigned long long)(folder & 0xFFF) << 12;
+    key |= (unsigned long long)(file & 0xFFF);
+    return key;
+}
+
+DrawList::Blend_Mode DrawList::toBlendMode(const char* name)
+{
+    if(name == NULL)
+        return BLEND_ALPHA;
+    if(strcmp(name, "additive") == 0)
+        return BLEND_ADDITIVE;
+    if(strcmp(name, "multiply") == 0)
+        return BLEND_MULTIPLY;
+    if(strcmp(name, "screen") == 0)
+        return BLEND_SCREEN;
+    return BLEND_ALPHA;
+}
+
+
+
+
+Transform::Transform()
+    : x(0.0f), y(0.0f), angle(0.0f), scale_x(1.0f), scale_y(1.0f)
+{}
+
+Transform::Transform(float x, float y, float angle, float scale_x, float scale_y)
+    : x(x), y(y), angle(angle), scale_x(scale_x), scale_y(scale_y)
+{}
+
+bool Transform::operator==(const Transform& t) const
+{
+    return (x == t.x && y == t.y && angle == t.angle && scale_x == t.scale_x && scale_y == t.scale_y);
+}
+
+bool Transform::operator!=(const Transform& t) const
+{
+    return !(*this == t);
+}
+
+void Transform::lerp(const Transform& transform, float t, int spin)
+{
+    x = SCML::lerp(x, transform.x, t);
+    y = SCML::lerp(y, transform.y, t);
+    
+    // 'spin' is based on what you are coming from (key1)
+    if(spin != 0)
+    {
+        if(spin > 0 && angle > transform.angle)
+            angle = SCML::lerp(angle, transform.angle + 360, t);
+        else if(spin < 0 && angle < transform.angle)
+            angle = SCML::lerp(angle, transform.angle - 360, t);
+        else
+            angle = SCML::lerp(angle, transform.angle, t);
+    }
+        
+    scale_x = SCML::lerp(scale_x, transform.scale_x, t);
+    scale_y = SCML::lerp(scale_y, transform.scale_y, t);
+}
+
+void Transform::apply_parent_transform(const Transform& parent)
+{
+    apply_parent_transform(parent, Affine(parent));
+}
+
+void Transform::apply_parent_transform(const Transform& parent, const Affine& parent_matrix)
+{
+    // Scale, rotate and translate the position all at once
+    parent_matrix.apply(x, y);
+    
+    angle += parent.angle;
+    scale_x *= parent.scale_x;
+    scale_y *= parent.scale_y;
+}
+
+
+
+
+Affine::Affine()
+    : a(1.0f), b(0.0f), c(0.0f), d(1.0f), tx(0.0f), ty(0.0f)
+{}
+
+Affine::Affine(const Transform& transform)
+    : tx(transform.x), ty(transform.y)
+{
+    float angle = transform.angle;
+    if((transform.scale_x < 0) != (transform.scale_y < 0))
+        angle = -angle;
+    
+    float s = sinf(angle*M_PI/180);
+    float co = cosf(angle*M_PI/180);
+    a = co*transform.scale_x;
+    b = s*transform.scale_x;
+    c = -s*transform.scale_y;
+    d = co*transform.scale_y;
+}
+
+void Affine::apply(float& x, float& y) const
+{
+    float xnew = a*x + c*y + tx;
+    float ynew = b*x + d*y + ty;
+    x = xnew;
+    y = ynew;
+}
+
+Affine Affine::operator*(const Affine& matrix) const
+{
+    Affine result;
+    result.a = a*matrix.a + c*matrix.b;
+    result.b = b*matrix.a + d*matrix.b;
+    result.c = a*matrix.c + c*matrix.d;
+    result.d = b*matrix.c + d*matrix.d;
+    result.tx = a*matrix.tx + c*matrix.ty + tx;
+    result.ty = b*matrix.tx + d*matrix.ty + ty;
+    return result;
+}
+
+void Affine::getQuad(float width, float height, float pivot_x, float pivot_y, float* corners) const
+{
+    float left = -pivot_x*width;
+    float right = (1.0f - pivot_x)*width;
+    float bottom = -pivot_y*height;
+    float top = (1.0f - pivot_y)*height;
+    
+    corners[0] = left;
+    corners[1] = top;
+    corners[2] = right;
+    corners[3] = top;
+    corners[4] = right;
+    corners[5] = bottom;
+    corners[6] = left;
+    corners[7] = bottom;
+    
+    for(int i = 0; i < 8; i += 2)
+        apply(corners[i], corners[i+1]);
+}
+
+
+
+
+Entity::Bone_Transform_State::Bone_Transform_State()
+    : entity(-1), animation(-1), key(-1), nextKey(-1), time(-1)
+{}
+
+bool Entity::Bone_Transform_State::should_rebuild(int entity, int animation, int key, int nextKey, int time, const Transform& base_transform)
+{
+    return (entity != this->entity || animation != this->animation || key != this->key || time != this->time || this->nextKey != nextKey || this->base_transform != base_transform);
+}
+
+void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, int nextKey, int time, Entity* entity_ptr, const Transform& base_transform)
+{
+    if(entity_ptr == NULL)
+    {
+        this->entity = -1;
+        this->animation = -1;
+        this->key = -1;
+        this->nextKey = -1;
+        this->time = -1;
+        return;
+    }
+    
+    this->entity = entity;
+    this->animation = animation;
+    this->key = key;
     this->nextKey = nextKey;
     this->time = time;
     this->base_transform = base_transform;
+    this->base_matrix = Affine(base_transform);
     SCML_VECTOR_CLEAR(transforms);
+    SCML_VECTOR_CLEAR(matrices);
+    
+    Entity::Animation* animation_ptr = entity_ptr->getAnimation(animation);
+    if(animation_ptr == NULL)
+        return;
     
-    Entity::Animation::Mainline::Key* key_ptr = entity_ptr->getKey(animation, key);
-    // FIXME: Check key_ptr == NULL here?
-    Entity::Animation::Mainline::Key* nextkey_ptr = entity_ptr->getKey(animation, nextKey);
+    Entity::Animation::Mainline& mainline = animation_ptr->mainline;
+    Entity::Animation::Mainline::Key* key_ptr = mainline.getKey(key);
+    if(key_ptr == NULL)
+        return;
+    Entity::Animation::Mainline::Key* nextkey_ptr = mainline.getKey(nextKey);
     if(nextkey_ptr == NULL)
         nextkey_ptr = key_ptr;
     
-    // Resize the transform vector according to the biggest bone index
-    int max_index = -1;
-    SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
-    {
-        int index = -1;
-        if(item.hasBone_Ref())
-            index = item.bone_ref->id;
-        else if(item.hasBone())
-            index = item.bone->id;
-        
-        if(max_index < index)
-            max_index = index;
-    }
-    SCML_END_MAP_FOREACH_CONST;
+    // The key's bone span is sorted by id, so the last slot has the biggest bone index.
+    if(key_ptr->num_bones <= 0)
+        return;
+    
+    const Animation::Mainline::Key::Bone_Container* slots = &mainline.bone_slots[key_ptr->first_bone];
+    int max_index = slots[key_ptr->num_bones - 1].id;
     
     if(max_index <= 0)
         return;
     
     SCML_VECTOR_RESIZE(transforms, max_index+1);
-    
-    Entity::Animation* animation_ptr = entity_ptr->getAnimation(animation);
+    SCML_VECTOR_RESIZE(matrices, max_index+1);
     
     // Calculate and store the transforms
-    SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
+    for(int i = 0; i < key_ptr->num_bones; i++)
     {
+        const Animation::Mainline::Key::Bone_Container& item = slots[i];
         if(item.hasBone_Ref())
         {
-            Animation::Mainline::Key::Bone_Container nextitem = SCML_MAP_FIND(nextkey_ptr->bones, _iter_e->first);  // FIXME: Breaks STL abstraction
-            Animation::Mainline::Key::Bone_Ref* ref1 = item.bone_ref;
-            Animation::Mainline::Key::Bone_Ref* ref2 = nextitem.bone_ref;
+            Animation::Mainline::Key::Bone_Container* nextitem = mainline.getBoneSlot(nextkey_ptr, item.id);
+            Animation::Mainline::Key::Bone_Ref* ref1 = mainline.getBoneRef(item);
+            Animation::Mainline::Key::Bone_Ref* ref2 = (nextitem == NULL? NULL : mainline.getBoneRef(*nextitem));
             if(ref2 == NULL)
                 ref2 = ref1;
             
             // Dereference bone_refs
-            Animation::Timeline::Key* b_key1 = entity_ptr->getTimelineKey(animation, ref1->timeline, ref1->key);
-            Animation::Timeline::Key* b_key2 = entity_ptr->getTimelineKey(animation, ref2->timeline, ref2->key);
+            Animation::Timeline::Key* b_key1 = animation_ptr->getTimelineKey(ref1->timeline, ref1->key);
+            Animation::Timeline::Key* b_key2 = animation_ptr->getTimelineKey(ref2->timeline, ref2->key);
             if(b_key2 == NULL)
                 b_key2 = b_key1;
             if(b_key1 != NULL)
@@ -2802,255 +5161,3197 @@ void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, i
                     t = (time - b_key1->time)/float(b_key2->time - b_key1->time);
                 else if(b_key2->time < b_key1->time)
                     t = (time - b_key1->time)/float(animation_ptr->length - b_key1->time);
-                
-                Entity::Animation::Timeline::Key::Bone* bone1 = &b_key1->bone;
-                Entity::Animation::Timeline::Key::Bone* bone2 = &b_key2->bone;
-                
-                
-                // Assuming that bones come in hierarchical order so that the parents have already been processed.
-                Transform parent_transform;
-                if(ref1->parent < 0)
-                    parent_transform = base_transform;
-                else
-                    parent_transform = transforms[ref1->parent];
+                t = animation_ptr->applyCurve(*b_key1, t);
                 
                 // Set bone transform
-                Transform b_transform(bone1->x, bone1->y, bone1->angle, bone1->scale_x, bone1->scale_y);
+                Transform b_transform = animation_ptr->getPose(*b_key1);
                 
                 // Tween with next key's bone
-                b_transform.lerp(Transform(bone2->x, bone2->y, bone2->angle, bone2->scale_x, bone2->scale_y), t, b_key1->spin);
+                b_transform.lerp(animation_ptr->getPose(*b_key2), t, b_key1->spin);
                 
                 // Transform the bone by the parent transform.
-                b_transform.apply_parent_transform(parent_transform);
+                // Assuming that bones come in hierarchical order so that the parents have already been processed.
+                if(ref1->parent < 0)
+                    b_transform.apply_parent_transform(base_transform, base_matrix);
+                else
+                    b_transform.apply_parent_transform(transforms[ref1->parent], matrices[ref1->parent]);
                 
                 transforms[ref1->id] = b_transform;
+                matrices[ref1->id] = Affine(b_transform);
                 
             }
             
         }
         else if(item.hasBone())
         {
-            Animation::Mainline::Key::Bone* bone1 = item.bone;
-            
-            // Assuming that bones come in hierarchical order so that the parents have already been processed.
-            Transform parent_transform;
-            if(bone1->parent < 0)
-                parent_transform = base_transform;
-            else
-                parent_transform = transforms[bone1->parent];
+            Animation::Mainline::Key::Bone* bone1 = mainline.getBone(item);
             
             // Set bone transform
             Transform b_transform(bone1->x, bone1->y, bone1->angle, bone1->scale_x, bone1->scale_y);
             
             // Transform the bone by the parent transform.
-            b_transform.apply_parent_transform(parent_transform);
+            // Assuming that bones come in hierarchical order so that the parents have already been processed.
+            if(bone1->parent < 0)
+                b_transform.apply_parent_transform(base_transform, base_matrix);
+            else
+                b_transform.apply_parent_transform(transforms[bone1->parent], matrices[bone1->parent]);
+            
+            transforms[bone1->id] = b_transform;
+            matrices[bone1->id] = Affine(b_transform);
+        
+        }
+    }
+
+}
+
+
+
+
+BakedPoses::BakedPoses()
+    : prototype(NULL), rate(0), quantized(false), max_position_error(0.0f), max_angle_error(0.0f), max_scale_error(0.0f)
+{}
+
+BakedPoses::BakedPoses(Entity* entity, int rate, bool quantized)
+    : prototype(NULL), rate(0), quantized(false), max_position_error(0.0f), max_angle_error(0.0f), max_scale_error(0.0f)
+{
+    bake(entity, rate, quantized);
+}
+
+BakedPoses::~BakedPoses()
+{
+    clear();
+}
+
+void BakedPoses::clear()
+{
+    if(prototype != NULL)
+        prototype->release();
+    prototype = NULL;
+    rate = 0;
+    quantized = false;
+    max_position_error = 0.0f;
+    max_angle_error = 0.0f;
+    max_scale_error = 0.0f;
+    
+    SCML_VECTOR_CLEAR(animations);
+    SCML_VECTOR_CLEAR(frames);
+    SCML_VECTOR_CLEAR(bones);
+    SCML_VECTOR_CLEAR(objects);
+    SCML_VECTOR_CLEAR(packed_bones);
+    SCML_VECTOR_CLEAR(packed_objects);
+    SCML_VECTOR_CLEAR(styles);
+}
+
+bool BakedPoses::bake(Entity* entity, int rate, bool quantized)
+{
+    clear();
+    if(entity == NULL || entity->prototype == NULL || rate < 1 || rate > 1000)
+        return false;
+    
+    prototype = entity->prototype;
+    prototype->retain();
+    this->rate = rate;
+    
+    // Sample with the entity itself, then put it back the way it was.
+    int old_animation = entity->animation;
+    int old_key = entity->key;
+    int old_time = entity->time;
+    bool old_reversed = entity->reversed;
+    BakedPoses* old_poses = entity->baked_poses;
+    entity->baked_poses = NULL;
+    
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(prototype->animations); i++)
+    {
+        const EntityPrototype::Animation& source = prototype->animations[i];
+        Animation animation;
+        animation.id = source.id;
+        animation.length = source.length;
+        animation.first_frame = SCML_VECTOR_SIZE(frames);
+        animation.num_frames = 0;
+        
+        entity->startAnimation(source.id);
+
+        // The pose can jump at a mainline key (an object changes timeline or image, or the key before is not
+        // tweened), so no two frames may straddle one:  Each key gets a frame at its time and one a millisecond
+        // before, merged into the frames at the rate.  The last frame is at the length, which a looping animation
+        // wraps to the start of its loop.  Tweening toward it keeps the loop seamless.
+        const Entity::Animation::Mainline& source_mainline = source.mainline;
+        SCML_VECTOR(int) times;
+        int last_time = -1;
+        int next_key = 0;
+        for(int f = 0; last_time < source.length; f++)
+        {
+            int time = int(f*1000.0/rate + 0.5);
+            if(time > source.length)
+                time = source.length;
+
+            for(; next_key < source_mainline.keys.size && source_mainline.keys[next_key].time <= time; next_key++)
+            {
+                int key_time = source_mainline.keys[next_key].time;
+                if(key_time <= 0 || key_time >= source.length)
+                    continue;
+                for(int k = key_time - 1; k <= key_time; k++)
+                {
+                    if(k > last_time)
+                    {
+                        SCML_VECTOR_PUSH_BACK(times, k);
+                        last_time = k;
+                    }
+                }
+            }
+            if(time > last_time)
+            {
+                SCML_VECTOR_PUSH_BACK(times, time);
+                last_time = time;
+            }
+        }
+
+        for(unsigned int f = 0; f < SCML_VECTOR_SIZE(times); f++)
+        {
+            int time = times[f];
+
+            entity->setTime(time);
+            int nextKey = entity->getNextKeyID(entity->animation, entity->key);
+            entity->bone_transform_state.rebuild(entity->entity, entity->animation, entity->key, nextKey, entity->time, entity, Transform());
+            
+            Frame frame;
+            frame.animation = SCML_VECTOR_SIZE(animations);
+            frame.time = time;
+            frame.key = entity->key;
+            frame.first_bone = SCML_VECTOR_SIZE(bones);
+            frame.num_bones = 0;
+            frame.first_object = SCML_VECTOR_SIZE(objects);
+            frame.num_objects = 0;
+            
+            Entity::Animation::Mainline& mainline = prototype->animations[i].mainline;
+            Entity::Animation::Mainline::Key* key_ptr = mainline.getKey(entity->key);
+            Entity::Animation::Mainline::Key* nextkey_ptr = mainline.getKey(nextKey);
+            if(nextkey_ptr == NULL)
+                nextkey_ptr = key_ptr;
+            
+            const Entity::Bone_Transform_State& state = entity->bone_transform_state;
+            for(int j = 0; key_ptr != NULL && j < key_ptr->num_bones; j++)
+            {
+                const Entity::Animation::Mainline::Key::Bone_Container& item = mainline.bone_slots[key_ptr->first_bone + j];
+                if(item.id >= int(SCML_VECTOR_SIZE(state.transforms)))
+                    continue;
+                
+                Bone bone;
+                bone.id = item.id;
+                bone.channel = (item.hasBone_Ref()? mainline.getBoneRef(item)->timeline : -1 - item.id);
+                bone.transform = state.transforms[item.id];
+                SCML_VECTOR_PUSH_BACK(bones, bone);
+                frame.num_bones++;
+            }
+            
+            for(int j = 0; key_ptr != NULL && j < key_ptr->num_objects; j++)
+            {
+                const Entity::Animation::Mainline::Key::Object_Container& item = mainline.getDrawSlot(key_ptr, j);
+                Entity::Sprite sprite;
+                bool has_sprite;
+                int channel;
+                if(item.hasObject())
+                {
+                    has_sprite = entity->getSimpleObjectSprite(sprite, mainline.getObject(item));
+                    channel = -1 - item.id;
+                }
+                else
+                {
+                    Entity::Animation::Mainline::Key::Object_Container* nextitem = mainline.getObjectSlot(nextkey_ptr, item.id);
+                    Entity::Animation::Mainline::Key::Object_Ref* ref1 = mainline.getObjectRef(item);
+                    has_sprite = entity->getTweenedObjectSprite(sprite, ref1, (nextitem == NULL? NULL : mainline.getObjectRef(*nextitem)));
+                    channel = (ref1 == NULL? -1 - item.id : ref1->timeline);
+                }
+                if(!has_sprite)
+                    continue;
+                
+                Object object;
+                object.id = item.id;
+                object.channel = channel;
+                object.folder = sprite.folder;
+                object.file = sprite.file;
+                object.transform = sprite.transform;
+                object.matrix = sprite.matrix;
+                object.width = sprite.width;
+                object.height = sprite.height;
+                object.pivot_x = sprite.pivot_x;
+                object.pivot_y = sprite.pivot_y;
+                object.r = sprite.r;
+                object.g = sprite.g;
+                object.b = sprite.b;
+                object.a = sprite.a;
+                object.blend_mode = sprite.blend_mode;
+                object.z_index = sprite.z_index;
+                SCML_VECTOR_PUSH_BACK(objects, object);
+                frame.num_objects++;
+            }
+            
+            SCML_VECTOR_PUSH_BACK(frames, frame);
+            animation.num_frames++;
+        }
+        
+        SCML_VECTOR_PUSH_BACK(animations, animation);
+    }
+    
+    entity->animation = old_animation;
+    entity->key = old_key;
+    entity->time = old_time;
+    entity->reversed = old_reversed;
+    entity->baked_poses = old_poses;
+    entity->bone_transform_state = Entity::Bone_Transform_State();
+    
+    if(quantized)
+        quantize();
+    return true;
+}
+
+static bool fits_in_short(int value)
+{
+    return (value >= -32768 && value <= 32767);
+}
+
+static void include_in_range(float& min, float& max, float value)
+{
+    if(value < min)
+        min = value;
+    if(value > max)
+        max = value;
+}
+
+static void measure_error(float& max_error, float a, float b)
+{
+    float error = fabsf(a - b);
+    if(error > max_error)
+        max_error = error;
+}
+
+// Replaces the float bones and objects with packed ones.
+void BakedPoses::quantize()
+{
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(bones); i++)
+    {
+        if(!fits_in_short(bones[i].id) || !fits_in_short(bones[i].channel))
+            return;
+    }
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(objects); i++)
+    {
+        if(!fits_in_short(objects[i].id) || !fits_in_short(objects[i].channel))
+            return;
+    }
+    
+    // Find the range of each animation
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(animations); i++)
+    {
+        Animation& animation = animations[i];
+        float x_min = 0.0f, x_max = 0.0f, y_min = 0.0f, y_max = 0.0f;
+        float angle_min = 0.0f, angle_max = 0.0f, scale_min = 0.0f, scale_max = 0.0f, matrix_min = 0.0f, matrix_max = 0.0f;
+        for(int f = animation.first_frame; f < animation.first_frame + animation.num_frames; f++)
+        {
+            const Frame& frame = frames[f];
+            for(int j = frame.first_bone; j < frame.first_bone + frame.num_bones; j++)
+            {
+                const Transform& transform = bones[j].transform;
+                include_in_range(x_min, x_max, transform.x);
+                include_in_range(y_min, y_max, transform.y);
+                include_in_range(angle_min, angle_max, transform.angle);
+                include_in_range(scale_min, scale_max, transform.scale_x);
+                include_in_range(scale_min, scale_max, transform.scale_y);
+            }
+            for(int j = frame.first_object; j < frame.first_object + frame.num_objects; j++)
+            {
+                const Transform& transform = objects[j].transform;
+                const Affine& matrix = objects[j].matrix;
+                include_in_range(x_min, x_max, transform.x);
+                include_in_range(y_min, y_max, transform.y);
+                include_in_range(angle_min, angle_max, transform.angle);
+                include_in_range(scale_min, scale_max, transform.scale_x);
+                include_in_range(scale_min, scale_max, transform.scale_y);
+                include_in_range(matrix_min, matrix_max, matrix.a);
+                include_in_range(matrix_min, matrix_max, matrix.b);
+                include_in_range(matrix_min, matrix_max, matrix.c);
+                include_in_range(matrix_min, matrix_max, matrix.d);
+            }
+        }
+        animation.position_x = Range(x_min, x_max);
+        animation.position_y = Range(y_min, y_max);
+        animation.angle = Range(angle_min, angle_max);
+        animation.scale = Range(scale_min, scale_max);
+        animation.matrix = Range(matrix_min, matrix_max);
+    }
+    
+    SCML_VECTOR_RESIZE(packed_bones, SCML_VECTOR_SIZE(bones));
+    SCML_VECTOR_RESIZE(packed_objects, SCML_VECTOR_SIZE(objects));
+    
+    // Frames keep their spans, since each record is packed in place.
+    SCML_MAP(int, int) channel_styles;
+    for(unsigned int f = 0; f < SCML_VECTOR_SIZE(frames); f++)
+    {
+        const Frame& frame = frames[f];
+        const Animation& animation = animations[frame.animation];
+        for(int j = frame.first_bone; j < frame.first_bone + frame.num_bones; j++)
+        {
+            const Bone& bone = bones[j];
+            Packed_Bone& packed = packed_bones[j];
+            packed.id = short(bone.id);
+            packed.channel = short(bone.channel);
+            packed.x = animation.position_x.encode(bone.transform.x);
+            packed.y = animation.position_y.encode(bone.transform.y);
+            packed.angle = animation.angle.encode(bone.transform.angle);
+            packed.scale_x = animation.scale.encode(bone.transform.scale_x);
+            packed.scale_y = animation.scale.encode(bone.transform.scale_y);
+        }
+        for(int j = frame.first_object; j < frame.first_object + frame.num_objects; j++)
+        {
+            const Object& object = objects[j];
+            Packed_Object& packed = packed_objects[j];
+            packed.id = short(object.id);
+            packed.channel = short(object.channel);
+            packed.x = animation.position_x.encode(object.transform.x);
+            packed.y = animation.position_y.encode(object.transform.y);
+            packed.angle = animation.angle.encode(object.transform.angle);
+            packed.scale_x = animation.scale.encode(object.transform.scale_x);
+            packed.scale_y = animation.scale.encode(object.transform.scale_y);
+            packed.a = animation.matrix.encode(object.matrix.a);
+            packed.b = animation.matrix.encode(object.matrix.b);
+            packed.c = animation.matrix.encode(object.matrix.c);
+            packed.d = animation.matrix.encode(object.matrix.d);
+            
+            // An object usually keeps its style from one frame to the next, so only compare with its last one.
+            Object_Style style;
+            style.folder = object.folder;
+            style.file = object.file;
+            style.width = object.width;
+            style.height = object.height;
+            style.pivot_x = object.pivot_x;
+            style.pivot_y = object.pivot_y;
+            style.r = object.r;
+            style.g = object.g;
+            style.b = object.b;
+            style.a = object.a;
+            style.blend_mode = object.blend_mode;
+            style.z_index = object.z_index;
+            
+            // channel_styles holds the index + 1, so 0 means none.
+            int last_style = SCML_MAP_FIND(channel_styles, object.channel) - 1;
+            if(last_style >= 0 && memcmp(&styles[last_style], &style, sizeof(Object_Style)) == 0)
+            {
+                packed.style = last_style;
+            }
+            else
+            {
+                packed.style = SCML_VECTOR_SIZE(styles);
+                SCML_VECTOR_PUSH_BACK(styles, style);
+                channel_styles[object.channel] = packed.style + 1;
+            }
+        }
+    }
+    
+    // Measure what was lost
+    this->quantized = true;
+    for(unsigned int f = 0; f < SCML_VECTOR_SIZE(frames); f++)
+    {
+        const Frame& frame = frames[f];
+        for(int j = 0; j < frame.num_bones; j++)
+        {
+            Bone bone;
+            getBone(bone, f, j);
+            const Transform& exact = bones[frame.first_bone + j].transform;
+            measure_error(max_position_error, bone.transform.x, exact.x);
+            measure_error(max_position_error, bone.transform.y, exact.y);
+            measure_error(max_angle_error, bone.transform.angle, exact.angle);
+            measure_error(max_scale_error, bone.transform.scale_x, exact.scale_x);
+            measure_error(max_scale_error, bone.transform.scale_y, exact.scale_y);
+        }
+        for(int j = 0; j < frame.num_objects; j++)
+        {
+            Object object;
+            getObject(object, f, j);
+            const Object& exact = objects[frame.first_object + j];
+            measure_error(max_position_error, object.transform.x, exact.transform.x);
+            measure_error(max_position_error, object.transform.y, exact.transform.y);
+            measure_error(max_angle_error, object.transform.angle, exact.transform.angle);
+            measure_error(max_scale_error, object.transform.scale_x, exact.transform.scale_x);
+            measure_error(max_scale_error, object.transform.scale_y, exact.transform.scale_y);
+            measure_error(max_scale_error, object.matrix.a, exact.matrix.a);
+            measure_error(max_scale_error, object.matrix.b, exact.matrix.b);
+            measure_error(max_scale_error, object.matrix.c, exact.matrix.c);
+            measure_error(max_scale_error, object.matrix.d, exact.matrix.d);
+        }
+    }
+    
+    // Free the float poses
+    SCML_VECTOR(Bone)().swap(bones);
+    SCML_VECTOR(Object)().swap(objects);
+}
+
+void BakedPoses::getBone(Bone& result, int frame, int index) const
+{
+    result = *get_bone(frames[frame], index, result);
+}
+
+void BakedPoses::getObject(Object& result, int frame, int index) const
+{
+    result = *get_object(frames[frame], index, result);
+}
+
+const BakedPoses::Bone* BakedPoses::get_bone(const Frame& frame, int index, Bone& storage) const
+{
+    if(!quantized)
+        return &bones[frame.first_bone + index];
+    
+    const Packed_Bone& packed = packed_bones[frame.first_bone + index];
+    const Animation& animation = animations[frame.animation];
+    storage.id = packed.id;
+    storage.channel = packed.channel;
+    storage.transform = Transform(animation.position_x.decode(packed.x), animation.position_y.decode(packed.y), animation.angle.decode(packed.angle), animation.scale.decode(packed.scale_x), animation.scale.decode(packed.scale_y));
+    return &storage;
+}
+
+const BakedPoses::Object* BakedPoses::get_object(const Frame& frame, int index, Object& storage) const
+{
+    if(!quantized)
+        return &objects[frame.first_object + index];
+    
+    const Packed_Object& packed = packed_objects[frame.first_object + index];
+    const Animation& animation = animations[frame.animation];
+    storage.id = packed.id;
+    storage.channel = packed.channel;
+    storage.transform = Transform(animation.position_x.decode(packed.x), animation.position_y.decode(packed.y), animation.angle.decode(packed.angle), animation.scale.decode(packed.scale_x), animation.scale.decode(packed.scale_y));
+    storage.matrix.a = animation.matrix.decode(packed.a);
+    storage.matrix.b = animation.matrix.decode(packed.b);
+    storage.matrix.c = animation.matrix.decode(packed.c);
+    storage.matrix.d = animation.matrix.decode(packed.d);
+    storage.matrix.tx = storage.transform.x;
+    storage.matrix.ty = storage.transform.y;
+    
+    const Object_Style& style = styles[packed.style];
+    storage.folder = style.folder;
+    storage.file = style.file;
+    storage.width = style.width;
+    storage.height = style.height;
+    storage.pivot_x = style.pivot_x;
+    storage.pivot_y = style.pivot_y;
+    storage.r = style.r;
+    storage.g = style.g;
+    storage.b = style.b;
+    storage.a = style.a;
+    storage.blend_mode = style.blend_mode;
+    storage.z_index = style.z_index;
+    return &storage;
+}
+
+int BakedPoses::getMemorySize() const
+{
+    return int(SCML_VECTOR_SIZE(animations)*sizeof(Animation) + SCML_VECTOR_SIZE(frames)*sizeof(Frame)
+               + SCML_VECTOR_SIZE(bones)*sizeof(Bone) + SCML_VECTOR_SIZE(objects)*sizeof(Object)
+               + SCML_VECTOR_SIZE(packed_bones)*sizeof(Packed_Bone) + SCML_VECTOR_SIZE(packed_objects)*sizeof(Packed_Object)
+               + SCML_VECTOR_SIZE(styles)*sizeof(Object_Style));
+}
+
+const BakedPoses::Animation* BakedPoses::getAnimation(int animation) const
+{
+    // Animation ids are dense, so the id is almost always the index itself.
+    int size = SCML_VECTOR_SIZE(animations);
+    if(animation >= 0 && animation < size && animations[animation].id == animation)
+        return &animations[animation];
+    
+    for(int i = 0; i < size; i++)
+    {
+        if(animations[i].id == animation)
+            return &animations[i];
+    }
+    return NULL;
+}
+
+bool BakedPoses::findFrames(int animation, int time, int& frame, int& next_frame, float& t) const
+{
+    const Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL || animation_ptr->num_frames <= 0)
+        return false;
+    
+    // The frames are in time order, but the ones around mainline keys break up the even spacing, so search for the
+    // last one at or before the time.
+    const Frame* first = &frames[animation_ptr->first_frame];
+    int last = animation_ptr->num_frames - 1;
+    int i = 0;
+    int end = last;
+    while(i < end)
+    {
+        int middle = (i + end + 1)/2;
+        if(first[middle].time <= time)
+            i = middle;
+        else
+            end = middle - 1;
+    }
+    
+    frame = animation_ptr->first_frame + i;
+    next_frame = frame;
+    t = 0.0f;
+    if(i < last)
+    {
+        next_frame = frame + 1;
+        int length = first[i+1].time - first[i].time;
+        if(length > 0)
+            t = (time - first[i].time)/float(length);
+    }
+    return true;
+}
+
+// Finds the same bone or object in the next frame.  Frames usually have the same layout, so look at the same index first.
+template<typename T>
+static int find_channel(const SCML_VECTOR(T)& records, int first, int count, int index, int channel)
+{
+    if(index < count && records[first + index].channel == channel)
+        return index;
+    
+    for(int i = 0; i < count; i++)
+    {
+        if(records[first + i].channel == channel)
+            return i;
+    }
+    return -1;
+}
+
+int BakedPoses::find_bone(const Frame& frame, int index, int channel) const
+{
+    if(quantized)
+        return find_channel(packed_bones, frame.first_bone, frame.num_bones, index, channel);
+    return find_channel(bones, frame.first_bone, frame.num_bones, index, channel);
+}
+
+int BakedPoses::find_object(const Frame& frame, int index, int channel) const
+{
+    if(quantized)
+        return find_channel(packed_objects, frame.first_object, frame.num_objects, index, channel);
+    return find_channel(objects, frame.first_object, frame.num_objects, index, channel);
+}
+
+// Within a key, the composed angles turn continuously (spins included), so they can be tweened as they are.
+// Across keys, they may have wrapped around, so tween them the shorter way.
+static float lerp_angle(float a, float b, float t, bool same_key)
+{
+    float difference = b - a;
+    if(!same_key)
+    {
+        difference = fmodf(difference, 360.0f);
+        if(difference > 180.0f)
+            difference -= 360.0f;
+        else if(difference < -180.0f)
+            difference += 360.0f;
+    }
+    return a + difference*t;
+}
+
+static Transform lerp_baked(const Transform& a, const Transform& b, float t, bool same_key)
+{
+    return Transform(lerp(a.x, b.x, t), lerp(a.y, b.y, t), lerp_angle(a.angle, b.angle, t, same_key), lerp(a.scale_x, b.scale_x, t), lerp(a.scale_y, b.scale_y, t));
+}
+
+void BakedPoses::getSprite(Entity::Sprite& result, int frame, int index, int next_frame, float t, const Transform& base_transform, const Affine& base_matrix) const
+{
+    const Frame& frame1 = frames[frame];
+    Object storage1, storage2;
+    const Object& object1 = *get_object(frame1, index, storage1);
+    
+    // Objects that are not in the next frame stay put
+    const Object* object2 = NULL;
+    if(next_frame != frame && t > 0.0f)
+    {
+        const Frame& frame2 = frames[next_frame];
+        int index2 = find_object(frame2, index, object1.channel);
+        if(index2 >= 0)
+            object2 = get_object(frame2, index2, storage2);
+    }
+    
+    if(object2 == NULL)
+    {
+        result.transform = object1.transform;
+        result.matrix = object1.matrix;
+        result.pivot_x = object1.pivot_x;
+        result.pivot_y = object1.pivot_y;
+        result.r = object1.r;
+        result.g = object1.g;
+        result.b = object1.b;
+        result.a = object1.a;
+    }
+    else
+    {
+        result.transform = lerp_baked(object1.transform, object2->transform, t, frame1.key == frames[next_frame].key);
+        
+        const Affine& m1 = object1.matrix;
+        const Affine& m2 = object2->matrix;
+        result.matrix.a = lerp(m1.a, m2.a, t);
+        result.matrix.b = lerp(m1.b, m2.b, t);
+        result.matrix.c = lerp(m1.c, m2.c, t);
+        result.matrix.d = lerp(m1.d, m2.d, t);
+        result.matrix.tx = lerp(m1.tx, m2.tx, t);
+        result.matrix.ty = lerp(m1.ty, m2.ty, t);
+        
+        result.pivot_x = lerp(object1.pivot_x, object2->pivot_x, t);
+        result.pivot_y = lerp(object1.pivot_y, object2->pivot_y, t);
+        result.r = lerp(object1.r, object2->r, t);
+        result.g = lerp(object1.g, object2->g, t);
+        result.b = lerp(object1.b, object2->b, t);
+        result.a = lerp(object1.a, object2->a, t);
+    }
+    
+    // Place it with the entity's transform
+    result.transform.apply_parent_transform(base_transform, base_matrix);
+    result.matrix = base_matrix*result.matrix;
+    
+    // No image tweening
+    result.folder = object1.folder;
+    result.file = object1.file;
+    result.width = object1.width;
+    result.height = object1.height;
+    result.blend_mode = object1.blend_mode;
+    result.z_index = object1.z_index;
+}
+
+bool BakedPoses::getBoneTransform(Transform& result, int frame, int boneID, int next_frame, float t, const Transform& base_transform, const Affine& base_matrix) const
+{
+    const Frame& frame1 = frames[frame];
+    Bone storage1, storage2;
+    const Bone* bone1 = NULL;
+    int index = 0;
+    for(; index < frame1.num_bones; index++)
+    {
+        bone1 = get_bone(frame1, index, storage1);
+        if(bone1->id == boneID)
+            break;
+    }
+    if(index == frame1.num_bones)
+        return false;
+    
+    const Bone* bone2 = NULL;
+    if(next_frame != frame && t > 0.0f)
+    {
+        const Frame& frame2 = frames[next_frame];
+        int index2 = find_bone(frame2, index, bone1->channel);
+        if(index2 >= 0)
+            bone2 = get_bone(frame2, index2, storage2);
+    }
+    
+    result = (bone2 == NULL? bone1->transform : lerp_baked(bone1->transform, bone2->transform, t, frame1.key == frames[next_frame].key));
+    result.apply_parent_transform(base_transform, base_matrix);
+    return true;
+}
+
+
+
+
+Flipbook::Frame::Frame()
+    : file(0), atlas(0), x(0), y(0), width(0), height(0), pivot_x(0.0f), pivot_y(0.0f)
+{}
+
+Flipbook::Animation::Animation()
+    : id(0), length(0), looping(true), height(0.0f)
+{}
+
+Flipbook::Flipbook()
+    : entity(0), fps(30), scale(1.0f), folder(0)
+{}
+
+Flipbook::Flipbook(const SCML_STRING& file)
+    : entity(0), fps(30), scale(1.0f), folder(0)
+{
+    load(file);
+}
+
+Flipbook::~Flipbook()
+{
+    clear();
+}
+
+bool Flipbook::load(const SCML_STRING& file)
+{
+    clear();
+    name = file;
+    
+    TiXmlDocument doc;
+    if(!doc.LoadFile(SCML_TO_CSTRING(file)))
+    {
+        SCML::log("SCML::Flipbook failed to load: Couldn't open %s.\n", SCML_TO_CSTRING(file));
+        SCML::log("%s\n", doc.ErrorDesc());
+        return false;
+    }
+    
+    TiXmlElement* root = doc.FirstChildElement("flipbook");
+    if(root == NULL)
+    {
+        SCML::log("SCML::Flipbook failed to load: %s has no <flipbook> element.\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    
+    entity = xmlGetIntAttr(root, "entity", 0);
+    fps = xmlGetIntAttr(root, "fps", 30);
+    scale = xmlGetFloatAttr(root, "scale", 1.0f);
+    folder = xmlGetIntAttr(root, "folder", 0);
+    
+    for(TiXmlElement* child = root->FirstChildElement("sheet"); child != NULL; child = child->NextSiblingElement("sheet"))
+    {
+        Sheet sheet;
+        sheet.atlas = xmlGetIntAttr(child, "atlas", 0);
+        sheet.image_path = xmlGetStringAttr(child, "image_path", "");
+        SCML_VECTOR_PUSH_BACK(sheets, sheet);
+    }
+    
+    for(TiXmlElement* child = root->FirstChildElement("animation"); child != NULL; child = child->NextSiblingElement("animation"))
+    {
+        Animation* animation = new Animation;
+        animation->id = xmlGetIntAttr(child, "id", 0);
+        animation->name = xmlGetStringAttr(child, "name", "");
+        animation->length = xmlGetIntAttr(child, "length", 0);
+        animation->looping = xmlGetBoolAttr(child, "looping", true);
+        animation->height = xmlGetFloatAttr(child, "height", 0.0f);
+        
+        for(TiXmlElement* item = child->FirstChildElement("frame"); item != NULL; item = item->NextSiblingElement("frame"))
+        {
+            Frame frame;
+            frame.file = xmlGetIntAttr(item, "file", 0);
+            frame.atlas = xmlGetIntAttr(item, "atlas", 0);
+            frame.x = xmlGetIntAttr(item, "x", 0);
+            frame.y = xmlGetIntAttr(item, "y", 0);
+            frame.width = xmlGetIntAttr(item, "width", 0);
+            frame.height = xmlGetIntAttr(item, "height", 0);
+            frame.pivot_x = xmlGetFloatAttr(item, "pivot_x", 0.0f);
+            frame.pivot_y = xmlGetFloatAttr(item, "pivot_y", 0.0f);
+            SCML_VECTOR_PUSH_BACK(animation->frames, frame);
+        }
+        
+        if(!SCML_MAP_INSERT(animations, animation->id, animation))
+        {
+            SCML::log("SCML::Flipbook duplicate animation id: %d\n", animation->id);
+            delete animation;
+        }
+    }
+    
+    return true;
+}
+
+void Flipbook::clear()
+{
+    entity = 0;
+    fps = 30;
+    scale = 1.0f;
+    folder = 0;
+    SCML_VECTOR_CLEAR(sheets);
+    
+    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    animations.clear();
+}
+
+Flipbook::Animation* Flipbook::getAnimation(int animation) const
+{
+    return SCML_MAP_FIND(animations, animation);
+}
+
+const Flipbook::Frame* Flipbook::getFrame(int animation, int time) const
+{
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL || SCML_VECTOR_SIZE(animation_ptr->frames) == 0 || fps <= 0)
+        return NULL;
+    
+    // A looping animation's frames cover [0, length), so the one after the last is the first again.
+    int num_frames = SCML_VECTOR_SIZE(animation_ptr->frames);
+    int i = int(time*double(fps)/1000.0 + 0.5);
+    if(animation_ptr->looping)
+    {
+        i %= num_frames;
+        if(i < 0)
+            i += num_frames;
+    }
+    else if(i < 0)
+        i = 0;
+    else if(i >= num_frames)
+        i = num_frames - 1;
+    return &animation_ptr->frames[i];
+}
+
+
+
+
+FlipbookEntity::FlipbookEntity()
+    : entity(NULL), flipbook(NULL), lod_height(64.0f)
+{}
+
+FlipbookEntity::FlipbookEntity(Entity* entity, Flipbook* flipbook)
+    : entity(entity), flipbook(flipbook), lod_height(64.0f)
+{}
+
+bool FlipbookEntity::useFlipbook(float scale_x, float scale_y) const
+{
+    if(entity == NULL || flipbook == NULL)
+        return false;
+    Flipbook::Animation* animation = flipbook->getAnimation(entity->animation);
+    if(animation == NULL || SCML_VECTOR_SIZE(animation->frames) == 0)
+        return false;
+    
+    float scale = (fabsf(scale_x) > fabsf(scale_y)? fabsf(scale_x) : fabsf(scale_y));
+    return animation->height*scale < lod_height;
+}
+
+void FlipbookEntity::draw(float x, float y, float angle, float scale_x, float scale_y)
+{
+    if(entity == NULL)
+        return;
+    
+    if(useFlipbook(scale_x, scale_y))
+    {
+        draw_list.clear();
+        if(buildFlipbookCommand(draw_list, x, y, angle, scale_x, scale_y))
+        {
+            entity->submit(draw_list);
+            return;
+        }
+    }
+    entity->draw(x, y, angle, scale_x, scale_y);
+}
+
+void FlipbookEntity::buildDrawList(DrawList& list, float x, float y, float angle, float scale_x, float scale_y)
+{
+    if(entity == NULL)
+        return;
+    
+    if(useFlipbook(scale_x, scale_y) && buildFlipbookCommand(list, x, y, angle, scale_x, scale_y))
+        return;
+    entity->buildDrawList(list, x, y, angle, scale_x, scale_y);
+}
+
+bool FlipbookEntity::buildFlipbookCommand(DrawList& list, float x, float y, float angle, float scale_x, float scale_y)
+{
+    if(entity == NULL || flipbook == NULL || flipbook->scale <= 0.0f)
+        return false;
+    const Flipbook::Frame* frame = flipbook->getFrame(entity->animation, entity->time);
+    if(frame == NULL)
+        return false;
+    
+    // The frame is placed like the entity's bones would be, scaled back from the size it was rendered at
+    entity->convert_to_SCML_coords(x, y, angle);
+    Transform transform(x, y, angle, scale_x/flipbook->scale, scale_y/flipbook->scale);
+    Affine matrix(transform);
+    
+    SCML_VECTOR_PUSH_BACK(list.commands, DrawList::Command());
+    DrawList::Command& command = list.commands.back();
+    
+    command.folder = flipbook->folder;
+    command.file = frame->file;
+    
+    // The center of the frame, as Entity::Sprite::getDrawTransform() finds it
+    float center_x = -(frame->pivot_x - 0.5f)*frame->width;
+    float center_y = -(frame->pivot_y - 0.5f)*frame->height;
+    matrix.apply(center_x, center_y);
+    bool flipped = ((transform.scale_x < 0) != (transform.scale_y < 0));
+    command.x = center_x;
+    command.y = center_y;
+    command.angle = (flipped? -transform.angle : transform.angle);
+    command.scale_x = transform.scale_x;
+    command.scale_y = transform.scale_y;
+    matrix.getQuad(frame->width, frame->height, frame->pivot_x, frame->pivot_y, command.corners);
+    
+    command.r = 1.0f;
+    command.g = 1.0f;
+    command.b = 1.0f;
+    command.a = 1.0f;
+    command.blend_mode = DrawList::BLEND_ALPHA;
+    command.z = 0;
+    command.sort_key = DrawList::makeSortKey(list.layer, list.depth, 0, command.folder, command.file);
+    return true;
+}
+
+
+
+
+// Thin wrappers over the platform's threads, so the scheduler itself reads the same everywhere.
+#if defined(WIN32) || defined(_WIN32)
+    typedef CRITICAL_SECTION Native_Mutex;
+    typedef CONDITION_VARIABLE Native_Condition;
+    typedef HANDLE Native_Thread;
+#else
+    typedef pthread_mutex_t Native_Mutex;
+    typedef pthread_cond_t Native_Condition;
+    typedef pthread_t Native_Thread;
+#endif
+
+static void* create_condition()
+{
+    Native_Condition* condition = new Native_Condition;
+    #if defined(WIN32) || defined(_WIN32)
+    InitializeConditionVariable(condition);
+    #else
+    pthread_cond_init(condition, NULL);
+    #endif
+    return condition;
+}
+
+static void destroy_condition(void* condition)
+{
+    #if !defined(WIN32) && !defined(_WIN32)
+    pthread_cond_destroy((Native_Condition*)condition);
+    #endif
+    delete (Native_Condition*)condition;
+}
+
+static void wait_condition(void* condition, void* mutex)
+{
+    #if defined(WIN32) || defined(_WIN32)
+    SleepConditionVariableCS((Native_Condition*)condition, (Native_Mutex*)mutex, INFINITE);
+    #else
+    pthread_cond_wait((Native_Condition*)condition, (Native_Mutex*)mutex);
+    #endif
+}
+
+static void wake_all(void* condition)
+{
+    #if defined(WIN32) || defined(_WIN32)
+    WakeAllConditionVariable((Native_Condition*)condition);
+    #else
+    pthread_cond_broadcast((Native_Condition*)condition);
+    #endif
+}
+
+
+Mutex::Mutex()
+{
+    Native_Mutex* mutex = new Native_Mutex;
+    #if defined(WIN32) || defined(_WIN32)
+    InitializeCriticalSection(mutex);
+    #else
+    pthread_mutex_init(mutex, NULL);
+    #endif
+    handle = mutex;
+}
+
+Mutex::~Mutex()
+{
+    #if defined(WIN32) || defined(_WIN32)
+    DeleteCriticalSection((Native_Mutex*)handle);
+    #else
+    pthread_mutex_destroy((Native_Mutex*)handle);
+    #endif
+    delete (Native_Mutex*)handle;
+}
+
+void Mutex::lock()
+{
+    #if defined(WIN32) || defined(_WIN32)
+    EnterCriticalSection((Native_Mutex*)handle);
+    #else
+    pthread_mutex_lock((Native_Mutex*)handle);
+    #endif
+}
+
+void Mutex::unlock()
+{
+    #if defined(WIN32) || defined(_WIN32)
+    LeaveCriticalSection((Native_Mutex*)handle);
+    #else
+    pthread_mutex_unlock((Native_Mutex*)handle);
+    #endif
+}
+
+
+
+
+/*! \brief The jobs of one thread.  The owner takes from the back and thieves take from the front.
+ */
+class JobScheduler::Queue
+{
+public:
+    
+    Mutex mutex;
+    SCML_VECTOR(Job*) jobs;
+    /*! Index of the oldest job that has not been taken */
+    int front;
+    
+    Queue()
+        : front(0)
+    {}
+};
+
+class JobScheduler::Worker
+{
+public:
+    
+    JobScheduler* scheduler;
+    int thread;
+    Native_Thread native_thread;
+    
+    Worker(JobScheduler* scheduler, int thread)
+        : scheduler(scheduler), thread(thread)
+    {}
+    
+    void loop()
+    {
+        int seen_generation = 0;
+        while((seen_generation = scheduler->wait_for_work(seen_generation)) >= 0)
+            scheduler->work(thread);
+    }
+    
+    #if defined(WIN32) || defined(_WIN32)
+    static DWORD WINAPI thread_main(LPVOID worker)
+    {
+        ((Worker*)worker)->loop();
+        return 0;
+    }
+    #else
+    static void* thread_main(void* worker)
+    {
+        ((Worker*)worker)->loop();
+        return NULL;
+    }
+    #endif
+};
+
+JobScheduler::Job::~Job()
+{}
+
+JobScheduler::JobScheduler(int num_threads)
+    : num_threads(num_threads), generation(0), remaining(0), quit(false)
+{
+    if(this->num_threads <= 0)
+        this->num_threads = getNumCores();
+    
+    wake_condition = create_condition();
+    done_condition = create_condition();
+    
+    for(int i = 0; i < this->num_threads; i++)
+        SCML_VECTOR_PUSH_BACK(queues, new Queue);
+    
+    // Thread 0 is whoever calls run()
+    for(int i = 1; i < this->num_threads; i++)
+    {
+        Worker* worker = new Worker(this, i);
+        #if defined(WIN32) || defined(_WIN32)
+        worker->native_thread = CreateThread(NULL, 0, Worker::thread_main, worker, 0, NULL);
+        bool started = (worker->native_thread != NULL);
+        #else
+        bool started = (pthread_create(&worker->native_thread, NULL, Worker::thread_main, worker) == 0);
+        #endif
+        if(!started)
+        {
+            log("SCML::JobScheduler failed to start thread %d.\n", i);
+            delete worker;
+            break;
+        }
+        SCML_VECTOR_PUSH_BACK(workers, worker);
+    }
+    
+    // Without all of its workers, the scheduler still runs every job, just on fewer threads.
+    this->num_threads = 1 + SCML_VECTOR_SIZE(workers);
+}
+
+JobScheduler::~JobScheduler()
+{
+    mutex.lock();
+    quit = true;
+    wake_all(wake_condition);
+    mutex.unlock();
+    
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(workers); i++)
+    {
+        #if defined(WIN32) || defined(_WIN32)
+        WaitForSingleObject(workers[i]->native_thread, INFINITE);
+        CloseHandle(workers[i]->native_thread);
+        #else
+        pthread_join(workers[i]->native_thread, NULL);
+        #endif
+        delete workers[i];
+    }
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(queues); i++)
+        delete queues[i];
+    
+    destroy_condition(wake_condition);
+    destroy_condition(done_condition);
+}
+
+int JobScheduler::getNumThreads() const
+{
+    return num_threads;
+}
+
+int JobScheduler::getNumCores()
+{
+    #if defined(WIN32) || defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cores = int(info.dwNumberOfProcessors);
+    #else
+    int cores = int(sysconf(_SC_NPROCESSORS_ONLN));
+    #endif
+    return (cores > 0? cores : 1);
+}
+
+void JobScheduler::run(const Span<Job*>& jobs)
+{
+    if(jobs.size <= 0)
+        return;
+    
+    if(num_threads == 1)
+    {
+        for(int i = 0; i < jobs.size; i++)
+            jobs[i]->run(0);
+        return;
+    }
+    
+    // Set the count before queueing, since a worker that is still looking for work can take a job right away.
+    mutex.lock();
+    remaining = jobs.size;
+    mutex.unlock();
+    
+    // Deal the jobs out in contiguous runs, so neighboring jobs (which often share data) stay on one thread.
+    for(int i = 0; i < num_threads; i++)
+    {
+        int begin = int(jobs.size*(long long)i/num_threads);
+        int end = int(jobs.size*(long long)(i + 1)/num_threads);
+        Queue& queue = *queues[i];
+        queue.mutex.lock();
+        SCML_VECTOR_CLEAR(queue.jobs);
+        queue.front = 0;
+        // The owner takes from the back, so reverse the run to start at its beginning.
+        for(int j = end - 1; j >= begin; j--)
+            SCML_VECTOR_PUSH_BACK(queue.jobs, jobs[j]);
+        queue.mutex.unlock();
+    }
+    
+    mutex.lock();
+    generation = (generation == INT_MAX? 1 : generation + 1);
+    wake_all(wake_condition);
+    mutex.unlock();
+    
+    work(0);
+    
+    mutex.lock();
+    while(remaining > 0)
+        wait_condition(done_condition, mutex.handle);
+    mutex.unlock();
+}
+
+bool JobScheduler::run_next_job(int thread)
+{
+    Job* job = NULL;
+    
+    // Newest job from this thread's own queue
+    Queue& own = *queues[thread];
+    own.mutex.lock();
+    if(int(SCML_VECTOR_SIZE(own.jobs)) > own.front)
+    {
+        job = own.jobs.back();
+        own.jobs.pop_back();
+    }
+    own.mutex.unlock();
+    
+    // Otherwise, steal the oldest job of another thread
+    for(int i = 1; job == NULL && i < num_threads; i++)
+    {
+        Queue& victim = *queues[(thread + i) % num_threads];
+        victim.mutex.lock();
+        if(int(SCML_VECTOR_SIZE(victim.jobs)) > victim.front)
+        {
+            job = victim.jobs[victim.front];
+            victim.front++;
+        }
+        victim.mutex.unlock();
+    }
+    
+    if(job == NULL)
+        return false;
+    
+    job->run(thread);
+    return true;
+}
+
+void JobScheduler::work(int thread)
+{
+    int done = 0;
+    while(run_next_job(thread))
+        done++;
+    
+    if(done == 0)
+        return;
+    
+    mutex.lock();
+    remaining -= done;
+    if(remaining == 0)
+        wake_all(done_condition);
+    mutex.unlock();
+}
+
+// Sleeps until run() queues new jobs.  Returns their generation, or -1 if the scheduler is being destroyed.
+int JobScheduler::wait_for_work(int seen_generation)
+{
+    mutex.lock();
+    while(!quit && generation == seen_generation)
+        wait_condition(wake_condition, mutex.handle);
+    int result = (quit? -1 : generation);
+    mutex.unlock();
+    return result;
+}
+
+
+
+
+AnimationWorld::Instance::Instance()
+    : entity(NULL), x(0.0f), y(0.0f), angle(0.0f), scale_x(1.0f), scale_y(1.0f), layer(0), depth(0)
+{}
+
+AnimationWorld::Instance::Instance(Entity* entity, float x, float y, float angle, float scale_x, float scale_y)
+    : entity(entity), x(x), y(y), angle(angle), scale_x(scale_x), scale_y(scale_y), layer(0), depth(0)
+{}
+
+void AnimationWorld::Instance::draw()
+{
+    if(entity != NULL)
+        entity->draw(x, y, angle, scale_x, scale_y);
+}
+
+void AnimationWorld::Instance::buildDrawList(DrawList& list)
+{
+    if(entity == NULL)
+        return;
+    
+    list.layer = layer;
+    list.depth = depth;
+    entity->buildDrawList(list, x, y, angle, scale_x, scale_y);
+}
+
+AnimationWorld::AnimationWorld(JobScheduler* scheduler)
+    : scheduler(scheduler)
+{
+    int num_workspaces = (scheduler == NULL? 1 : scheduler->getNumThreads());
+    for(int i = 0; i < num_workspaces; i++)
+        SCML_VECTOR_PUSH_BACK(workspaces, new Workspace);
+}
+
+AnimationWorld::~AnimationWorld()
+{
+    clear();
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(workspaces); i++)
+        delete workspaces[i];
+}
+
+void AnimationWorld::clear()
+{
+    typedef Key_Plan* Key_Plan_Ptr;
+    SCML_BEGIN_MAP_FOREACH_CONST(plans, Key_Plan_ID, Key_Plan_Ptr, plan)
+    {
+        delete plan;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    plans.clear();
+    
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(workspaces); i++)
+        workspaces[i]->plans.clear();
+}
+
+AnimationWorld::Batch_Job::Batch_Job()
+    : world(NULL), dt_ms(0)
+{}
+
+AnimationWorld::Batch_Job::Batch_Job(AnimationWorld* world, const Span<Instance>& instances, int dt_ms)
+    : world(world), instances(instances), dt_ms(dt_ms)
+{}
+
+void AnimationWorld::Batch_Job::run(int thread)
+{
+    world->evaluate_batch(*world->workspaces[thread], instances, dt_ms);
+}
+
+AnimationWorld::Key_Plan_ID::Key_Plan_ID()
+    : prototype(NULL), animation(-1), key(-1), nextKey(-1)
+{}
+
+AnimationWorld::Key_Plan_ID::Key_Plan_ID(EntityPrototype* prototype, int animation, int key, int nextKey)
+    : prototype(prototype), animation(animation), key(key), nextKey(nextKey)
+{}
+
+bool AnimationWorld::Key_Plan_ID::operator<(const Key_Plan_ID& id) const
+{
+    if(prototype != id.prototype)
+        return (prototype < id.prototype);
+    if(animation != id.animation)
+        return (animation < id.animation);
+    if(key != id.key)
+        return (key < id.key);
+    return (nextKey < id.nextKey);
+}
+
+AnimationWorld::Key_Plan::Bone::Bone()
+    : id(-1), parent(PARENT_NONE), depth(1), tweened(false), key_time(0), tween_length(0), curve_key(NULL)
+{}
+
+// This mirrors Entity::Bone_Transform_State::rebuild(), but only records what each bone is made from.
+AnimationWorld::Key_Plan::Key_Plan(Entity* entity_ptr, int animation, int key, int nextKey)
+    : prototype(entity_ptr->prototype), animation(NULL), num_transforms(0)
+{
+    // The plan is looked up by the prototype's address, so keep it from being deleted and replaced.
+    if(prototype != NULL)
+        prototype->retain();
+    
+    SCML_VECTOR_RESIZE(level_sizes, 1);
+    level_sizes[0] = 0;
+    
+    typedef Entity::Animation Animation;
+    Animation* animation_ptr = entity_ptr->getAnimation(animation);
+    if(animation_ptr == NULL)
+        return;
+    this->animation = animation_ptr;
+    
+    Animation::Mainline& mainline = animation_ptr->mainline;
+    Animation::Mainline::Key* key_ptr = mainline.getKey(key);
+    if(key_ptr == NULL || key_ptr->num_bones <= 0)
+        return;
+    Animation::Mainline::Key* nextkey_ptr = mainline.getKey(nextKey);
+    if(nextkey_ptr == NULL)
+        nextkey_ptr = key_ptr;
+    
+    const Animation::Mainline::Key::Bone_Container* slots = &mainline.bone_slots[key_ptr->first_bone];
+    int max_index = slots[key_ptr->num_bones - 1].id;
+    if(max_index <= 0)
+        return;
+    
+    num_transforms = max_index+1;
+    
+    // Bones that have not been recorded (yet) leave their children with an identity parent, just like rebuild().
+    SCML_VECTOR(int) bone_indices;
+    SCML_VECTOR_RESIZE(bone_indices, max_index+1);
+    for(int i = 0; i <= max_index; i++)
+        bone_indices[i] = PARENT_NONE;
+    
+    for(int i = 0; i < key_ptr->num_bones; i++)
+    {
+        const Animation::Mainline::Key::Bone_Container& item = slots[i];
+        Bone bone;
+        int parent;
+        
+        if(item.hasBone_Ref())
+        {
+            Animation::Mainline::Key::Bone_Container* nextitem = mainline.getBoneSlot(nextkey_ptr, item.id);
+            Animation::Mainline::Key::Bone_Ref* ref1 = mainline.getBoneRef(item);
+            Animation::Mainline::Key::Bone_Ref* ref2 = (nextitem == NULL? NULL : mainline.getBoneRef(*nextitem));
+            if(ref2 == NULL)
+                ref2 = ref1;
+            
+            Animation::Timeline::Key* b_key1 = animation_ptr->getTimelineKey(ref1->timeline, ref1->key);
+            Animation::Timeline::Key* b_key2 = animation_ptr->getTimelineKey(ref2->timeline, ref2->key);
+            if(b_key2 == NULL)
+                b_key2 = b_key1;
+            if(b_key1 == NULL)
+                continue;
+            
+            bone.key_time = b_key1->time;
+            if(b_key2->time > b_key1->time)
+            {
+                bone.tweened = true;
+                bone.tween_length = b_key2->time - b_key1->time;
+            }
+            else if(b_key2->time < b_key1->time)
+            {
+                bone.tweened = true;
+                bone.tween_length = animation_ptr->length - b_key1->time;
+            }
+            if(b_key1->curve == Animation::Timeline::Key::CURVE_INSTANT)
+                bone.tweened = false;
+            else if(b_key1->curve != Animation::Timeline::Key::CURVE_LINEAR)
+                bone.curve_key = b_key1;
+            
+            bone.id = ref1->id;
+            bone.from = animation_ptr->getPose(*b_key1);
+            bone.to = animation_ptr->getPose(*b_key2);
+            
+            // Resolve the spin like Transform::lerp() so that the angle is tweened like everything else.
+            int spin = b_key1->spin;
+            if(spin == 0)
+                bone.to.angle = bone.from.angle;
+            else if(spin > 0 && bone.from.angle > bone.to.angle)
+                bone.to.angle = bone.to.angle + 360;
+            else if(spin < 0 && bone.from.angle < bone.to.angle)
+                bone.to.angle = bone.to.angle - 360;
+            
+            parent = ref1->parent;
+        }
+        else if(item.hasBone())
+        {
+            Animation::Mainline::Key::Bone* bone1 = mainline.getBone(item);
+            bone.id = bone1->id;
+            bone.from = Transform(bone1->x, bone1->y, bone1->angle, bone1->scale_x, bone1->scale_y);
+            bone.to = bone.from;
+            
+            parent = bone1->parent;
+        }
+        else
+            continue;
+        
+        if(bone.id < 0 || bone.id > max_index)
+            continue;
+        
+        if(parent < 0)
+            bone.parent = PARENT_BASE;
+        else if(parent <= max_index)
+            bone.parent = bone_indices[parent];
+        
+        if(bone.parent >= 0)
+            bone.depth = bones[bone.parent].depth + 1;
+        
+        if(bone.depth >= int(SCML_VECTOR_SIZE(level_sizes)))
+            SCML_VECTOR_RESIZE(level_sizes, bone.depth + 1);
+        level_sizes[bone.depth]++;
+        
+        bone_indices[bone.id] = SCML_VECTOR_SIZE(bones);
+        SCML_VECTOR_PUSH_BACK(bones, bone);
+    }
+}
+
+AnimationWorld::Key_Plan::~Key_Plan()
+{
+    if(prototype != NULL)
+        prototype->release();
+}
+
+AnimationWorld::Key_Plan* AnimationWorld::getPlan(Workspace& w, Entity* entity_ptr)
+{
+    Entity::Bone_Transform_State& state = entity_ptr->bone_transform_state;
+    Key_Plan_ID id(entity_ptr->prototype, state.animation, state.key, state.nextKey);
+    
+    Key_Plan* plan = SCML_MAP_FIND(w.plans, id);
+    if(plan != NULL)
+        return plan;
+    
+    // Another thread may have made it already
+    plans_mutex.lock();
+    plan = SCML_MAP_FIND(plans, id);
+    if(plan == NULL)
+    {
+        plan = new Key_Plan(entity_ptr, state.animation, state.key, state.nextKey);
+        SCML_MAP_INSERT(plans, id, plan);
+    }
+    plans_mutex.unlock();
+    
+    SCML_MAP_INSERT(w.plans, id, plan);
+    return plan;
+}
+
+void AnimationWorld::Workspace::set_node(int node, const Transform& transform)
+{
+    x[node] = transform.x;
+    y[node] = transform.y;
+    angle[node] = transform.angle;
+    scale_x[node] = transform.scale_x;
+    scale_y[node] = transform.scale_y;
+}
+
+// Tweening pass: v = v + (next - v)*t
+static void lerp_nodes(float* v, const float* next, const float* t, int begin, int end)
+{
+    int i = begin;
+#if defined(SCML_USE_AVX2)
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 a = _mm256_loadu_ps(v + i);
+        __m256 b = _mm256_loadu_ps(next + i);
+        _mm256_storeu_ps(v + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), _mm256_loadu_ps(t + i))));
+    }
+#elif defined(SCML_USE_SSE2)
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 a = _mm_loadu_ps(v + i);
+        __m128 b = _mm_loadu_ps(next + i);
+        _mm_storeu_ps(v + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_loadu_ps(t + i))));
+    }
+#endif
+    for(; i < end; i++)
+        v[i] = lerp(v[i], next[i], t[i]);
+}
+
+// Raw pointers to the node buffers of AnimationWorld, so the loops over them do not go through the vectors.
+struct World_Nodes
+{
+    int* parents;
+    int* instances;
+    int* ids;
+    float* x;
+    float* y;
+    float* angle;
+    float* scale_x;
+    float* scale_y;
+    float* next_x;
+    float* next_y;
+    float* next_angle;
+    float* next_scale_x;
+    float* next_scale_y;
+    float* t;
+    float* matrix_a;
+    float* matrix_b;
+    float* matrix_c;
+    float* matrix_d;
+};
+
+// Composition pass: Applies each node's parent transform, like Transform::apply_parent_transform().
+// Parents must have been composed already and have their matrices stored (see store_matrices()).
+static void compose_nodes(const World_Nodes& n, int begin, int end)
+{
+    int i = begin;
+#if defined(SCML_USE_AVX2)
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(n.parents + i));
+        __m256 x = _mm256_loadu_ps(n.x + i);
+        __m256 y = _mm256_loadu_ps(n.y + i);
+        __m256 xnew = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(n.matrix_a, p, 4), x), _mm256_mul_ps(_mm256_i32gather_ps(n.matrix_c, p, 4), y));
+        __m256 ynew = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(n.matrix_b, p, 4), x), _mm256_mul_ps(_mm256_i32gather_ps(n.matrix_d, p, 4), y));
+        _mm256_storeu_ps(n.x + i, _mm256_add_ps(xnew, _mm256_i32gather_ps(n.x, p, 4)));
+        _mm256_storeu_ps(n.y + i, _mm256_add_ps(ynew, _mm256_i32gather_ps(n.y, p, 4)));
+        _mm256_storeu_ps(n.angle + i, _mm256_add_ps(_mm256_loadu_ps(n.angle + i), _mm256_i32gather_ps(n.angle, p, 4)));
+        _mm256_storeu_ps(n.scale_x + i, _mm256_mul_ps(_mm256_loadu_ps(n.scale_x + i), _mm256_i32gather_ps(n.scale_x, p, 4)));
+        _mm256_storeu_ps(n.scale_y + i, _mm256_mul_ps(_mm256_loadu_ps(n.scale_y + i), _mm256_i32gather_ps(n.scale_y, p, 4)));
+    }
+#elif defined(SCML_USE_SSE2)
+    for(; i + 4 <= end; i += 4)
+    {
+        const int* p = n.parents + i;
+        #define SCML_GATHER(a) _mm_set_ps(a[p[3]], a[p[2]], a[p[1]], a[p[0]])
+        __m128 x = _mm_loadu_ps(n.x + i);
+        __m128 y = _mm_loadu_ps(n.y + i);
+        __m128 xnew = _mm_add_ps(_mm_mul_ps(SCML_GATHER(n.matrix_a), x), _mm_mul_ps(SCML_GATHER(n.matrix_c), y));
+        __m128 ynew = _mm_add_ps(_mm_mul_ps(SCML_GATHER(n.matrix_b), x), _mm_mul_ps(SCML_GATHER(n.matrix_d), y));
+        _mm_storeu_ps(n.x + i, _mm_add_ps(xnew, SCML_GATHER(n.x)));
+        _mm_storeu_ps(n.y + i, _mm_add_ps(ynew, SCML_GATHER(n.y)));
+        _mm_storeu_ps(n.angle + i, _mm_add_ps(_mm_loadu_ps(n.angle + i), SCML_GATHER(n.angle)));
+        _mm_storeu_ps(n.scale_x + i, _mm_mul_ps(_mm_loadu_ps(n.scale_x + i), SCML_GATHER(n.scale_x)));
+        _mm_storeu_ps(n.scale_y + i, _mm_mul_ps(_mm_loadu_ps(n.scale_y + i), SCML_GATHER(n.scale_y)));
+        #undef SCML_GATHER
+    }
+#endif
+    for(; i < end; i++)
+    {
+        int p = n.parents[i];
+        float x = n.x[i];
+        float y = n.y[i];
+        n.x[i] = n.matrix_a[p]*x + n.matrix_c[p]*y + n.x[p];
+        n.y[i] = n.matrix_b[p]*x + n.matrix_d[p]*y + n.y[p];
+        n.angle[i] += n.angle[p];
+        n.scale_x[i] *= n.scale_x[p];
+        n.scale_y[i] *= n.scale_y[p];
+    }
+}
+
+// Stores Affine(transform) of the nodes.  The translation is the node's position.
+static void store_matrices(const World_Nodes& n, int begin, int end)
+{
+    for(int i = begin; i < end; i++)
+    {
+        Affine m(Transform(n.x[i], n.y[i], n.angle[i], n.scale_x[i], n.scale_y[i]));
+        n.matrix_a[i] = m.a;
+        n.matrix_b[i] = m.b;
+        n.matrix_c[i] = m.c;
+        n.matrix_d[i] = m.d;
+    }
+}
+
+void AnimationWorld::evaluate(const Span<Instance>& instances, int dt_ms)
+{
+    // Small batches keep the buffers in cache.  Each one is a job, since the batches do not share any entities.
+    SCML_VECTOR_CLEAR(jobs);
+    for(int begin = 0; begin < instances.size; begin += BATCH_SIZE)
+    {
+        int size = instances.size - begin;
+        if(size > BATCH_SIZE)
+            size = BATCH_SIZE;
+        SCML_VECTOR_PUSH_BACK(jobs, Batch_Job(this, Span<Instance>(instances.data + begin, size), dt_ms));
+    }
+    
+    int num_jobs = SCML_VECTOR_SIZE(jobs);
+    if(scheduler == NULL || num_jobs <= 1)
+    {
+        for(int i = 0; i < num_jobs; i++)
+            jobs[i].run(0);
+        return;
+    }
+    
+    SCML_VECTOR_RESIZE(job_ptrs, num_jobs);
+    for(int i = 0; i < num_jobs; i++)
+        job_ptrs[i] = &jobs[i];
+    scheduler->run(Span<JobScheduler::Job*>(&job_ptrs[0], num_jobs));
+}
+
+void AnimationWorld::evaluate_batch(Workspace& w, const Span<Instance>& instances, int dt_ms)
+{
+    // Node 0 is the identity and the instances' base transforms follow it.
+    int num_bases = 1 + instances.size;
+    SCML_VECTOR_RESIZE(w.x, num_bases);
+    SCML_VECTOR_RESIZE(w.y, num_bases);
+    SCML_VECTOR_RESIZE(w.angle, num_bases);
+    SCML_VECTOR_RESIZE(w.scale_x, num_bases);
+    SCML_VECTOR_RESIZE(w.scale_y, num_bases);
+    w.set_node(0, Transform());
+    
+    SCML_VECTOR_RESIZE(w.instance_plans, instances.size);
+    SCML_VECTOR_CLEAR(w.level_starts);
+    SCML_VECTOR_RESIZE(w.level_starts, 2);
+    
+    // Update each instance and find the bones of its current key
+    for(int i = 0; i < instances.size; i++)
+    {
+        Instance& instance = instances[i];
+        w.instance_plans[i] = NULL;
+        if(instance.entity == NULL)
+        {
+            w.set_node(1 + i, Transform());
+            continue;
+        }
+        
+        Entity* entity_ptr = instance.entity;
+        entity_ptr->update(dt_ms);
+        
+        // Baked entities have no bones to evaluate
+        if(entity_ptr->getBakedPoses() != NULL)
+        {
+            entity_ptr->evaluate(instance.x, instance.y, instance.angle, instance.scale_x, instance.scale_y);
+            w.set_node(1 + i, Transform());
+            continue;
+        }
+        
+        // Set up the state that draw() will check, so it knows that the bones are ready.
+        float base_x = instance.x;
+        float base_y = instance.y;
+        float base_angle = instance.angle;
+        entity_ptr->convert_to_SCML_coords(base_x, base_y, base_angle);
+        Transform base_transform(base_x, base_y, base_angle, instance.scale_x, instance.scale_y);
+        w.set_node(1 + i, base_transform);
+        
+        Entity::Bone_Transform_State& state = entity_ptr->bone_transform_state;
+        state.entity = entity_ptr->entity;
+        state.animation = entity_ptr->animation;
+        state.key = entity_ptr->key;
+        state.nextKey = entity_ptr->getNextKeyID(entity_ptr->animation, entity_ptr->key);
+        state.time = entity_ptr->time;
+        state.base_transform = base_transform;
+        state.base_matrix = Affine(base_transform);
+        
+        Key_Plan* plan = getPlan(w, entity_ptr);
+        w.instance_plans[i] = plan;
+        
+        SCML_VECTOR_CLEAR(state.transforms);
+        SCML_VECTOR_RESIZE(state.transforms, plan->num_transforms);
+        SCML_VECTOR_CLEAR(state.matrices);
+        SCML_VECTOR_RESIZE(state.matrices, plan->num_transforms);
+        
+        // Count the bones at each depth
+        int num_levels = SCML_VECTOR_SIZE(plan->level_sizes);
+        if(num_levels + 1 > int(SCML_VECTOR_SIZE(w.level_starts)))
+            SCML_VECTOR_RESIZE(w.level_starts, num_levels + 1);
+        for(int level = 1; level < num_levels; level++)
+            w.level_starts[level + 1] += plan->level_sizes[level];
+    }
+    
+    // Order the bones by depth, so each level only depends on the levels before it.  Level L starts at level_starts[L].
+    int num_levels = SCML_VECTOR_SIZE(w.level_starts) - 1;
+    w.level_starts[0] = 0;
+    w.level_starts[1] = num_bases;
+    for(int level = 1; level < num_levels; level++)
+        w.level_starts[level + 1] += w.level_starts[level];
+    
+    int num_nodes = w.level_starts[num_levels];
+    SCML_VECTOR_RESIZE(w.parents, num_nodes);
+    SCML_VECTOR_RESIZE(w.node_instances, num_nodes);
+    SCML_VECTOR_RESIZE(w.node_ids, num_nodes);
+    SCML_VECTOR_RESIZE(w.x, num_nodes);
+    SCML_VECTOR_RESIZE(w.y, num_nodes);
+    SCML_VECTOR_RESIZE(w.angle, num_nodes);
+    SCML_VECTOR_RESIZE(w.scale_x, num_nodes);
+    SCML_VECTOR_RESIZE(w.scale_y, num_nodes);
+    SCML_VECTOR_RESIZE(w.next_x, num_nodes);
+    SCML_VECTOR_RESIZE(w.next_y, num_nodes);
+    SCML_VECTOR_RESIZE(w.next_angle, num_nodes);
+    SCML_VECTOR_RESIZE(w.next_scale_x, num_nodes);
+    SCML_VECTOR_RESIZE(w.next_scale_y, num_nodes);
+    SCML_VECTOR_RESIZE(w.t, num_nodes);
+    SCML_VECTOR_RESIZE(w.matrix_a, num_nodes);
+    SCML_VECTOR_RESIZE(w.matrix_b, num_nodes);
+    SCML_VECTOR_RESIZE(w.matrix_c, num_nodes);
+    SCML_VECTOR_RESIZE(w.matrix_d, num_nodes);
+    
+    World_Nodes n;
+    n.parents = &w.parents[0];
+    n.instances = &w.node_instances[0];
+    n.ids = &w.node_ids[0];
+    n.x = &w.x[0];
+    n.y = &w.y[0];
+    n.angle = &w.angle[0];
+    n.scale_x = &w.scale_x[0];
+    n.scale_y = &w.scale_y[0];
+    n.next_x = &w.next_x[0];
+    n.next_y = &w.next_y[0];
+    n.next_angle = &w.next_angle[0];
+    n.next_scale_x = &w.next_scale_x[0];
+    n.next_scale_y = &w.next_scale_y[0];
+    n.t = &w.t[0];
+    n.matrix_a = &w.matrix_a[0];
+    n.matrix_b = &w.matrix_b[0];
+    n.matrix_c = &w.matrix_c[0];
+    n.matrix_d = &w.matrix_d[0];
+    
+    // Scatter the bones into the node buffers.  level_starts[L] becomes the end of level L.
+    for(int i = 0; i < instances.size; i++)
+    {
+        Key_Plan* plan = w.instance_plans[i];
+        int num_bones = (plan == NULL? 0 : SCML_VECTOR_SIZE(plan->bones));
+        if(num_bones == 0)
+            continue;
+        
+        int time = instances[i].entity->time;
+        if(num_bones > int(SCML_VECTOR_SIZE(w.bone_nodes)))
+            SCML_VECTOR_RESIZE(w.bone_nodes, num_bones);
+        
+        const Key_Plan::Bone* bones = &plan->bones[0];
+        int* nodes = &w.bone_nodes[0];
+        int* ends = &w.level_starts[0];
+        for(int j = 0; j < num_bones; j++)
+        {
+            const Key_Plan::Bone& bone = bones[j];
+            int node = ends[bone.depth]++;
+            nodes[j] = node;
+            
+            if(bone.parent >= 0)
+                n.parents[node] = nodes[bone.parent];
+            else if(bone.parent == PARENT_BASE)
+                n.parents[node] = 1 + i;
+            else
+                n.parents[node] = 0;
+            n.instances[node] = i;
+            n.ids[node] = bone.id;
+            
+            n.x[node] = bone.from.x;
+            n.y[node] = bone.from.y;
+            n.angle[node] = bone.from.angle;
+            n.scale_x[node] = bone.from.scale_x;
+            n.scale_y[node] = bone.from.scale_y;
+            n.next_x[node] = bone.to.x;
+            n.next_y[node] = bone.to.y;
+            n.next_angle[node] = bone.to.angle;
+            n.next_scale_x[node] = bone.to.scale_x;
+            n.next_scale_y[node] = bone.to.scale_y;
+            n.t[node] = (bone.tweened? (time - bone.key_time)/float(bone.tween_length) : 0.0f);
+            if(bone.curve_key != NULL)
+                n.t[node] = plan->animation->applyCurve(*bone.curve_key, n.t[node]);
+        }
+    }
+    
+    // Tween all of the bones
+    lerp_nodes(n.x, n.next_x, n.t, num_bases, num_nodes);
+    lerp_nodes(n.y, n.next_y, n.t, num_bases, num_nodes);
+    lerp_nodes(n.angle, n.next_angle, n.t, num_bases, num_nodes);
+    lerp_nodes(n.scale_x, n.next_scale_x, n.t, num_bases, num_nodes);
+    lerp_nodes(n.scale_y, n.next_scale_y, n.t, num_bases, num_nodes);
+    
+    // Compose each level with its (already composed) parents.  The sine and cosine are computed once per bone, for its matrix.
+    store_matrices(n, 0, num_bases);
+    
+    int begin = num_bases;
+    for(int level = 1; level < num_levels; level++)
+    {
+        int end = w.level_starts[level];
+        compose_nodes(n, begin, end);
+        store_matrices(n, begin, end);
+        begin = end;
+    }
+    
+    // Store the results
+    for(int i = num_bases; i < num_nodes; i++)
+    {
+        Entity::Bone_Transform_State& state = instances[n.instances[i]].entity->bone_transform_state;
+        int id = n.ids[i];
+        state.transforms[id] = Transform(n.x[i], n.y[i], n.angle[i], n.scale_x[i], n.scale_y[i]);
+        
+        Affine& m = state.matrices[id];
+        m.a = n.matrix_a[i];
+        m.b = n.matrix_b[i];
+        m.c = n.matrix_c[i];
+        m.d = n.matrix_d[i];
+        m.tx = n.x[i];
+        m.ty = n.y[i];
+    }
+}
+
+
+
+
+// Finds a record in an array sorted by id.  Spriter ids are dense, so the id is almost always the index itself.
+template<typename T>
+static T* find_by_id(T* records, int count, int id)
+{
+    if(records == NULL || id < 0)
+        return NULL;
+    
+    if(id < count && records[id].id == id)
+        return &records[id];
+    
+    // Sparse ids: Binary search
+    int low = 0;
+    int high = count;
+    while(low < high)
+    {
+        int mid = (low + high)/2;
+        if(records[mid].id < id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    
+    if(low < count && records[low].id == id)
+        return &records[low];
+    return NULL;
+}
+
+template<typename T>
+static T* find_by_id(const Span<T>& records, int first, int count, int id)
+{
+    if(count <= 0 || first < 0 || first + count > records.size)
+        return NULL;
+    return find_by_id(records.data + first, count, id);
+}
+
+template<typename T>
+static T* find_by_id(const Span<T>& records, int id)
+{
+    return find_by_id(records.data, records.size, id);
+}
+
+template<typename T>
+static T* find_by_id(SCML_VECTOR(T)& records, int id)
+{
+    if(SCML_VECTOR_SIZE(records) == 0)
+        return NULL;
+    return find_by_id(&records[0], SCML_VECTOR_SIZE(records), id);
+}
+
+// Finds the last record that starts at or before the given time in an array sorted by time.
+// Times before the first record give the first record.
+template<typename T>
+static T* find_by_time(T* records, int count, int time)
+{
+    if(records == NULL || count <= 0)
+        return NULL;
+    
+    // Binary search for the first record after 'time'
+    int low = 0;
+    int high = count;
+    while(low < high)
+    {
+        int mid = (low + high)/2;
+        if(records[mid].time <= time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    
+    return &records[low > 0? low - 1 : 0];
+}
+
+template<typename T>
+static Span<T> make_span(SCML_VECTOR(T)& records, int first, int count)
+{
+    if(count <= 0)
+        return Span<T>();
+    return Span<T>(&records[first], count);
+}
+
+
+// One coordinate of a cubic bezier curve from 0 to 1, with the control points p1 and p2
+static double bezier(double p1, double p2, double u)
+{
+    double v = 1.0 - u;
+    return 3.0*v*v*u*p1 + 3.0*v*u*u*p2 + u*u*u;
+}
+
+static double bezier_slope(double p1, double p2, double u)
+{
+    double v = 1.0 - u;
+    return 3.0*v*v*p1 + 6.0*v*u*(p2 - p1) + 3.0*u*u*(1.0 - p2);
+}
+
+// Gets the value of Spriter's bezier curve (control points (x1, y1) and (x2, y2)) at the time x.
+// The curve's parameter is solved with Newton's method, which falls back to bisection when it would leave the bracket.
+static float solve_bezier(float x1, float y1, float x2, float y2, float x)
+{
+    // Control points inside of [0, 1] keep the time increasing along the curve, so there is only one solution.
+    x1 = (x1 < 0.0f? 0.0f : (x1 > 1.0f? 1.0f : x1));
+    x2 = (x2 < 0.0f? 0.0f : (x2 > 1.0f? 1.0f : x2));
+    
+    double low = 0.0;
+    double high = 1.0;
+    double u = x;
+    for(int i = 0; i < 64; i++)
+    {
+        double error = bezier(x1, x2, u) - x;
+        if(fabs(error) < 1e-12)
+            break;
+        if(error < 0.0)
+            low = u;
+        else
+            high = u;
+        
+        double slope = bezier_slope(x1, x2, u);
+        double next = (slope != 0.0? u - error/slope : low);
+        u = (next > low && next < high? next : (low + high)/2);
+    }
+    return float(bezier(y1, y2, u));
+}
+
+Range::Range()
+    : min(0.0f), step(0.0f)
+{}
+
+Range::Range(float min, float max)
+    : min(min), step((max - min)/65535.0f)
+{}
+
+unsigned short Range::encode(float value) const
+{
+    if(step <= 0.0f)
+        return 0;
+    float q = (value - min)/step + 0.5f;
+    if(q <= 0.0f)
+        return 0;
+    if(q >= 65535.0f)
+        return 65535;
+    return (unsigned short)q;
+}
+
+float Range::decode(unsigned short q) const
+{
+    return min + step*q;
+}
+
+typedef SCML_PAIR(SCML_PAIR(float, float), SCML_PAIR(float, float)) Curve_Points;
+
+// Where an animation's records start in the prototype's storage while it is being built
+struct Animation_Layout
+{
+    int keys;
+    int bone_slots;
+    int object_slots;
+    int bones;
+    int bone_refs;
+    int objects;
+    int object_refs;
+    int draw_order;
+    int timelines;
+    int timeline_keys;
+    int curve_samples;
+    int bone_poses;
+    int object_poses;
+    int packed_bone_poses;
+    int packed_object_poses;
+    int bone_styles;
+    int object_styles;
+};
+
+EntityPrototype::EntityPrototype()
+    : id(-1), quantized(false), max_position_error(0.0f), max_angle_error(0.0f), max_scale_error(0.0f), ref_count(0), storage(NULL)
+{}
+
+static EntityPrototype::Animation::Timeline::Key::Pose make_pose(float x, float y, float angle, float scale_x, float scale_y)
+{
+    EntityPrototype::Animation::Timeline::Key::Pose pose;
+    pose.x = x;
+    pose.y = y;
+    pose.angle = angle;
+    pose.scale_x = scale_x;
+    pose.scale_y = scale_y;
+    return pose;
+}
+
+// Quantizes a bone or object transform across its animation's ranges and measures what is lost
+static EntityPrototype::Animation::Timeline::Key::Packed_Pose encode_pose(const EntityPrototype::Animation& animation, float x, float y, float angle, float scale_x, float scale_y, EntityPrototype* prototype)
+{
+    EntityPrototype::Animation::Timeline::Key::Packed_Pose pose;
+    pose.x = animation.position_x.encode(x);
+    pose.y = animation.position_y.encode(y);
+    pose.angle = animation.angle.encode(angle);
+    pose.scale_x = animation.scale.encode(scale_x);
+    pose.scale_y = animation.scale.encode(scale_y);
+    
+    measure_error(prototype->max_position_error, animation.position_x.decode(pose.x), x);
+    measure_error(prototype->max_position_error, animation.position_y.decode(pose.y), y);
+    measure_error(prototype->max_angle_error, animation.angle.decode(pose.angle), angle);
+    measure_error(prototype->max_scale_error, animation.scale.decode(pose.scale_x), scale_x);
+    measure_error(prototype->max_scale_error, animation.scale.decode(pose.scale_y), scale_y);
+    return pose;
+}
+
+// Consecutive keys of a timeline usually have the same style, so a key only shares the last one.  Returns its index.
+template<typename T>
+static int add_style(SCML_VECTOR(T)& styles, int first, const T& style, int& last_style)
+{
+    if(last_style < 0 || memcmp(&styles[first + last_style], &style, sizeof(T)) != 0)
+    {
+        last_style = SCML_VECTOR_SIZE(styles) - first;
+        SCML_VECTOR_PUSH_BACK(styles, style);
+    }
+    return last_style;
+}
+
+EntityPrototype::EntityPrototype(SCML::Data::Entity* entity, bool quantized)
+    : id(entity->id), name(entity->name), quantized(quantized), max_position_error(0.0f), max_angle_error(0.0f), max_scale_error(0.0f), ref_count(0), storage(new Storage)
+{
+    typedef SCML::Data::Entity::Animation Data_Animation;
+    typedef SCML::Data::Entity::Animation::Mainline::Key Data_Key;
+    typedef SCML::Data::Entity::Animation::Timeline Data_Timeline;
+    typedef SCML::Data::Entity::Animation::Timeline::Key Data_Timeline_Key;
+    
+    // Offset 0 is the empty string
+    SCML_VECTOR_PUSH_BACK(storage->strings, '\0');
+    
+    SCML_VECTOR(Animation_Layout) layouts;
+    
+    SCML_BEGIN_MAP_FOREACH_CONST(entity->animations, int, Data_Animation*, animation)
+    {
+        Animation a;
+        a.id = animation->id;
+        a.name = addString(animation->name);
+        a.length = animation->length;
+        a.looping = addString(animation->looping);
+        a.loop_to = animation->loop_to;
+        a.quantized = quantized;
+        
+        // Anything else is treated as "false", like Spriter does
+        const char* looping = SCML_TO_CSTRING(animation->looping);
+        if(strcmp(looping, "true") == 0)
+            a.loop_mode = Animation::LOOP_TRUE;
+        else if(strcmp(looping, "ping_pong") == 0)
+            a.loop_mode = Animation::LOOP_PING_PONG;
+        
+        Animation_Layout layout;
+        layout.keys = SCML_VECTOR_SIZE(storage->keys);
+        layout.bone_slots = SCML_VECTOR_SIZE(storage->bone_slots);
+        layout.object_slots = SCML_VECTOR_SIZE(storage->object_slots);
+        layout.bones = SCML_VECTOR_SIZE(storage->bones);
+        layout.bone_refs = SCML_VECTOR_SIZE(storage->bone_refs);
+        layout.objects = SCML_VECTOR_SIZE(storage->objects);
+        layout.object_refs = SCML_VECTOR_SIZE(storage->object_refs);
+        layout.draw_order = SCML_VECTOR_SIZE(storage->draw_order);
+        layout.timelines = SCML_VECTOR_SIZE(storage->timelines);
+        layout.timeline_keys = SCML_VECTOR_SIZE(storage->timeline_keys);
+        layout.curve_samples = SCML_VECTOR_SIZE(storage->curve_samples);
+        layout.bone_poses = SCML_VECTOR_SIZE(storage->bone_poses);
+        layout.object_poses = SCML_VECTOR_SIZE(storage->object_poses);
+        layout.packed_bone_poses = SCML_VECTOR_SIZE(storage->packed_bone_poses);
+        layout.packed_object_poses = SCML_VECTOR_SIZE(storage->packed_object_poses);
+        layout.bone_styles = SCML_VECTOR_SIZE(storage->bone_styles);
+        layout.object_styles = SCML_VECTOR_SIZE(storage->object_styles);
+        
+        // Indices stored in the records are relative to the animation's own arrays.
+        SCML_BEGIN_MAP_FOREACH_CONST(animation->mainline.keys, int, Data_Key*, item)
+        {
+            Animation::Mainline::Key key(item);
+            
+            // Lay out the key's bones and objects as contiguous spans of slots, sorted by id
+            key.first_bone = SCML_VECTOR_SIZE(storage->bone_slots) - layout.bone_slots;
+            SCML_BEGIN_MAP_FOREACH_CONST(item->bones, int, Data_Key::Bone_Container, b)
+            {
+                if(b.hasBone())
+                {
+                    SCML_VECTOR_PUSH_BACK(storage->bone_slots, Animation::Mainline::Key::Bone_Container(b.bone->id, SCML_VECTOR_SIZE(storage->bones) - layout.bones, -1));
+                    SCML_VECTOR_PUSH_BACK(storage->bones, Animation::Mainline::Key::Bone(b.bone));
+                }
+                else if(b.hasBone_Ref())
+                {
+                    SCML_VECTOR_PUSH_BACK(storage->bone_slots, Animation::Mainline::Key::Bone_Container(b.bone_ref->id, -1, SCML_VECTOR_SIZE(storage->bone_refs) - layout.bone_refs));
+                    SCML_VECTOR_PUSH_BACK(storage->bone_refs, Animation::Mainline::Key::Bone_Ref(b.bone_ref));
+                }
+            }
+            SCML_END_MAP_FOREACH_CONST;
+            key.num_bones = SCML_VECTOR_SIZE(storage->bone_slots) - layout.bone_slots - key.first_bone;
+            
+            key.first_object = SCML_VECTOR_SIZE(storage->object_slots) - layout.object_slots;
+            SCML_BEGIN_MAP_FOREACH_CONST(item->objects, int, Data_Key::Object_Container, o)
+            {
+                if(o.hasObject())
+                {
+                    SCML_VECTOR_PUSH_BACK(storage->object_slots, Animation::Mainline::Key::Object_Container(o.object->id, SCML_VECTOR_SIZE(storage->objects) - layout.objects, -1));
+                    SCML_VECTOR_PUSH_BACK(storage->objects, Animation::Mainline::Key::Object(o.object, this));
+                }
+                else if(o.hasObject_Ref())
+                {
+                    SCML_VECTOR_PUSH_BACK(storage->object_slots, Animation::Mainline::Key::Object_Container(o.object_ref->id, -1, SCML_VECTOR_SIZE(storage->object_refs) - layout.object_refs));
+                    SCML_VECTOR_PUSH_BACK(storage->object_refs, Animation::Mainline::Key::Object_Ref(o.object_ref));
+                }
+            }
+            SCML_END_MAP_FOREACH_CONST;
+            key.num_objects = SCML_VECTOR_SIZE(storage->object_slots) - layout.object_slots - key.first_object;
+            
+            // Objects are drawn in order of z_index.  Spriter usually numbers them that way already.
+            SCML_VECTOR(int) z_indices;
+            bool in_order = true;
+            for(int i = 0; i < key.num_objects; i++)
+            {
+                const Animation::Mainline::Key::Object_Container& slot = storage->object_slots[layout.object_slots + key.first_object + i];
+                int z_index = (slot.hasObject()? storage->objects[layout.objects + slot.object].z_index : storage->object_refs[layout.object_refs + slot.object_ref].z_index);
+                if(i > 0 && z_index < z_indices[i-1])
+                    in_order = false;
+                SCML_VECTOR_PUSH_BACK(z_indices, z_index);
+            }
+            if(!in_order)
+            {
+                key.first_draw = SCML_VECTOR_SIZE(storage->draw_order) - layout.draw_order;
+                
+                for(int i = 0; i < key.num_objects; i++)
+                    SCML_VECTOR_PUSH_BACK(storage->draw_order, i);
+                
+                // Insertion sort, which keeps objects with the same z_index in order of id
+                int* order = &storage->draw_order[layout.draw_order + key.first_draw];
+                for(int i = 1; i < key.num_objects; i++)
+                {
+                    int item = order[i];
+                    int j = i;
+                    for(; j > 0 && z_indices[order[j-1]] > z_indices[item]; j--)
+                        order[j] = order[j-1];
+                    order[j] = item;
+                }
+            }
+            
+            SCML_VECTOR_PUSH_BACK(storage->keys, key);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+        
+        // Keys with the same bezier curve share its samples.  This holds the index of the samples + 1, so 0 means none yet.
+        SCML_MAP(Curve_Points, int) curves;
+        
+        // Quantized transforms are steps across the ranges of the whole animation
+        if(quantized)
+        {
+            float x_min = 0.0f, x_max = 0.0f, y_min = 0.0f, y_max = 0.0f;
+            float angle_min = 0.0f, angle_max = 0.0f, scale_min = 0.0f, scale_max = 0.0f;
+            SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, Data_Timeline*, item)
+            {
+                SCML_BEGIN_MAP_FOREACH_CONST(item->keys, int, Data_Timeline_Key*, key)
+                {
+                    if(key->has_object)
+                    {
+                        include_in_range(x_min, x_max, key->object.x);
+                        include_in_range(y_min, y_max, key->object.y);
+                        include_in_range(angle_min, angle_max, key->object.angle);
+                        include_in_range(scale_min, scale_max, key->object.scale_x);
+                        include_in_range(scale_min, scale_max, key->object.scale_y);
+                    }
+                    else
+                    {
+                        include_in_range(x_min, x_max, key->bone.x);
+                        include_in_range(y_min, y_max, key->bone.y);
+                        include_in_range(angle_min, angle_max, key->bone.angle);
+                        include_in_range(scale_min, scale_max, key->bone.scale_x);
+                        include_in_range(scale_min, scale_max, key->bone.scale_y);
+                    }
+                }
+                SCML_END_MAP_FOREACH_CONST;
+            }
+            SCML_END_MAP_FOREACH_CONST;
+            a.position_x = Range(x_min, x_max);
+            a.position_y = Range(y_min, y_max);
+            a.angle = Range(angle_min, angle_max);
+            a.scale = Range(scale_min, scale_max);
+        }
+        
+        // Each timeline's keys are appended to one array for the whole animation
+        SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, Data_Timeline*, item)
+        {
+            Animation::Timeline timeline(item, this);
+            timeline.first_key = SCML_VECTOR_SIZE(storage->timeline_keys) - layout.timeline_keys;
+            int last_bone_style = -1;
+            int last_object_style = -1;
+            
+            SCML_BEGIN_MAP_FOREACH_CONST(item->keys, int, Data_Timeline_Key*, key)
+            {
+                Animation::Timeline::Key timeline_key(key, this);
+                if(key->has_object)
+                {
+                    const SCML::Data::Entity::Animation::Timeline::Key::Object& object = key->object;
+                    if(quantized)
+                    {
+                        timeline_key.pose = SCML_VECTOR_SIZE(storage->packed_object_poses) - layout.packed_object_poses;
+                        SCML_VECTOR_PUSH_BACK(storage->packed_object_poses, encode_pose(a, object.x, object.y, object.angle, object.scale_x, object.scale_y, this));
+                    }
+                    else
+                    {
+                        timeline_key.pose = SCML_VECTOR_SIZE(storage->object_poses) - layout.object_poses;
+                        SCML_VECTOR_PUSH_BACK(storage->object_poses, make_pose(object.x, object.y, object.angle, object.scale_x, object.scale_y));
+                    }
+                    timeline_key.style = add_style(storage->object_styles, layout.object_styles, Animation::Timeline::Key::Object_Style(&key->object, this), last_object_style);
+                }
+                else
+                {
+                    const SCML::Data::Entity::Animation::Timeline::Key::Bone& bone = key->bone;
+                    if(quantized)
+                    {
+                        timeline_key.pose = SCML_VECTOR_SIZE(storage->packed_bone_poses) - layout.packed_bone_poses;
+                        SCML_VECTOR_PUSH_BACK(storage->packed_bone_poses, encode_pose(a, bone.x, bone.y, bone.angle, bone.scale_x, bone.scale_y, this));
+                    }
+                    else
+                    {
+                        timeline_key.pose = SCML_VECTOR_SIZE(storage->bone_poses) - layout.bone_poses;
+                        SCML_VECTOR_PUSH_BACK(storage->bone_poses, make_pose(bone.x, bone.y, bone.angle, bone.scale_x, bone.scale_y));
+                    }
+                    timeline_key.style = add_style(storage->bone_styles, layout.bone_styles, Animation::Timeline::Key::Bone_Style(&key->bone), last_bone_style);
+                }
+                if(timeline_key.curve == Animation::Timeline::Key::CURVE_BEZIER)
+                {
+                    Curve_Points points = SCML_MAKE_PAIR(SCML_MAKE_PAIR(timeline_key.c1, timeline_key.c2), SCML_MAKE_PAIR(timeline_key.c3, timeline_key.c4));
+                    int samples = SCML_MAP_FIND(curves, points) - 1;
+                    if(samples < 0)
+                    {
+                        samples = SCML_VECTOR_SIZE(storage->curve_samples) - layout.curve_samples;
+                        for(int i = 0; i <= Animation::Timeline::Key::CURVE_SEGMENTS; i++)
+                            SCML_VECTOR_PUSH_BACK(storage->curve_samples, solve_bezier(timeline_key.c1, timeline_key.c2, timeline_key.c3, timeline_key.c4, i/float(Animation::Timeline::Key::CURVE_SEGMENTS)));
+                        SCML_MAP_INSERT(curves, points, samples + 1);
+                    }
+                    timeline_key.curve_samples = samples;
+                }
+                SCML_VECTOR_PUSH_BACK(storage->timeline_keys, timeline_key);
+            }
+            SCML_END_MAP_FOREACH_CONST;
+            
+            timeline.num_keys = SCML_VECTOR_SIZE(storage->timeline_keys) - layout.timeline_keys - timeline.first_key;
+            SCML_VECTOR_PUSH_BACK(storage->timelines, timeline);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+        
+        SCML_VECTOR_PUSH_BACK(animations, a);
+        SCML_VECTOR_PUSH_BACK(layouts, layout);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    
+    // The storage is complete, so the spans can point into it now.
+    int num_animations = SCML_VECTOR_SIZE(animations);
+    for(int i = 0; i < num_animations; i++)
+    {
+        Animation& a = animations[i];
+        const Animation_Layout& layout = layouts[i];
+        // The next animation's layout (or the end of storage) marks the end of this one's records
+        Animation_Layout end;
+        if(i+1 < num_animations)
+            end = layouts[i+1];
+        else
+        {
+            end.keys = SCML_VECTOR_SIZE(storage->keys);
+            end.bone_slots = SCML_VECTOR_SIZE(storage->bone_slots);
+            end.object_slots = SCML_VECTOR_SIZE(storage->object_slots);
+            end.bones = SCML_VECTOR_SIZE(storage->bones);
+            end.bone_refs = SCML_VECTOR_SIZE(storage->bone_refs);
+            end.objects = SCML_VECTOR_SIZE(storage->objects);
+            end.object_refs = SCML_VECTOR_SIZE(storage->object_refs);
+            end.draw_order = SCML_VECTOR_SIZE(storage->draw_order);
+            end.timelines = SCML_VECTOR_SIZE(storage->timelines);
+            end.timeline_keys = SCML_VECTOR_SIZE(storage->timeline_keys);
+            end.curve_samples = SCML_VECTOR_SIZE(storage->curve_samples);
+            end.bone_poses = SCML_VECTOR_SIZE(storage->bone_poses);
+            end.object_poses = SCML_VECTOR_SIZE(storage->object_poses);
+            end.packed_bone_poses = SCML_VECTOR_SIZE(storage->packed_bone_poses);
+            end.packed_object_poses = SCML_VECTOR_SIZE(storage->packed_object_poses);
+            end.bone_styles = SCML_VECTOR_SIZE(storage->bone_styles);
+            end.object_styles = SCML_VECTOR_SIZE(storage->object_styles);
+        }
+        
+        a.mainline.keys = make_span(storage->keys, layout.keys, end.keys - layout.keys);
+        a.mainline.bone_slots = make_span(storage->bone_slots, layout.bone_slots, end.bone_slots - layout.bone_slots);
+        a.mainline.object_slots = make_span(storage->object_slots, layout.object_slots, end.object_slots - layout.object_slots);
+        a.mainline.bones = make_span(storage->bones, layout.bones, end.bones - layout.bones);
+        a.mainline.bone_refs = make_span(storage->bone_refs, layout.bone_refs, end.bone_refs - layout.bone_refs);
+        a.mainline.objects = make_span(storage->objects, layout.objects, end.objects - layout.objects);
+        a.mainline.object_refs = make_span(storage->object_refs, layout.object_refs, end.object_refs - layout.object_refs);
+        a.mainline.draw_order = make_span(storage->draw_order, layout.draw_order, end.draw_order - layout.draw_order);
+        a.timelines = make_span(storage->timelines, layout.timelines, end.timelines - layout.timelines);
+        a.timeline_keys = make_span(storage->timeline_keys, layout.timeline_keys, end.timeline_keys - layout.timeline_keys);
+        a.curve_samples = make_span(storage->curve_samples, layout.curve_samples, end.curve_samples - layout.curve_samples);
+        a.bone_poses = make_span(storage->bone_poses, layout.bone_poses, end.bone_poses - layout.bone_poses);
+        a.object_poses = make_span(storage->object_poses, layout.object_poses, end.object_poses - layout.object_poses);
+        a.packed_bone_poses = make_span(storage->packed_bone_poses, layout.packed_bone_poses, end.packed_bone_poses - layout.packed_bone_poses);
+        a.packed_object_poses = make_span(storage->packed_object_poses, layout.packed_object_poses, end.packed_object_poses - layout.packed_object_poses);
+        a.bone_styles = make_span(storage->bone_styles, layout.bone_styles, end.bone_styles - layout.bone_styles);
+        a.object_styles = make_span(storage->object_styles, layout.object_styles, end.object_styles - layout.object_styles);
+    }
+    
+    strings = make_span(storage->strings, 0, SCML_VECTOR_SIZE(storage->strings));
+}
+
+EntityPrototype::~EntityPrototype()
+{
+    SCML_VECTOR_CLEAR(animations);
+    delete storage;
+}
+
+void EntityPrototype::retain()
+{
+    ref_count++;
+}
+
+void EntityPrototype::release()
+{
+    ref_count--;
+    if(ref_count <= 0)
+        delete this;
+}
+
+int EntityPrototype::getRefCount() const
+{
+    return ref_count;
+}
+
+const char* EntityPrototype::getString(int offset) const
+{
+    if(offset <= 0 || offset >= strings.size)
+        return "";
+    return &strings[offset];
+}
+
+int EntityPrototype::addString(const SCML_STRING& str)
+{
+    if(storage == NULL || SCML_STRING_SIZE(str) == 0)
+        return 0;
+    
+    // Offset 0 is the empty string, so it also means "not stored yet".
+    int offset = SCML_MAP_FIND(storage->string_offsets, str);
+    if(offset > 0)
+        return offset;
+    
+    offset = SCML_VECTOR_SIZE(storage->strings);
+    const char* s = SCML_TO_CSTRING(str);
+    for(int i = 0; i < int(SCML_STRING_SIZE(str)); i++)
+        SCML_VECTOR_PUSH_BACK(storage->strings, s[i]);
+    SCML_VECTOR_PUSH_BACK(storage->strings, '\0');
+    SCML_MAP_INSERT(storage->string_offsets, str, offset);
+    return offset;
+}
+
+EntityPrototype::Animation* EntityPrototype::getAnimation(int animation)
+{
+    return find_by_id(animations, animation);
+}
+
+
+EntityPrototype::Animation::Animation()
+    : id(-1), name(0), length(0), looping(0), loop_mode(LOOP_FALSE), loop_to(0), quantized(false)
+{}
+
+EntityPrototype::Animation::Timeline* EntityPrototype::Animation::getTimeline(int timeline)
+{
+    return find_by_id(timelines, timeline);
+}
+
+EntityPrototype::Animation::Timeline::Key* EntityPrototype::Animation::getTimelineKey(int timeline, int key)
+{
+    Timeline* t = getTimeline(timeline);
+    if(t == NULL)
+        return NULL;
+    
+    return find_by_id(timeline_keys, t->first_key, t->num_keys, key);
+}
+
+EntityPrototype::Animation::Timeline::Key* EntityPrototype::Animation::getTimelineKeyAtTime(int timeline, int time)
+{
+    Timeline* t = getTimeline(timeline);
+    if(t == NULL || t->num_keys <= 0 || t->first_key + t->num_keys > timeline_keys.size)
+        return NULL;
+    
+    return find_by_time(timeline_keys.data + t->first_key, t->num_keys, time);
+}
+
+Transform EntityPrototype::Animation::getPose(const Timeline::Key& key) const
+{
+    if(quantized)
+    {
+        const Timeline::Key::Packed_Pose& pose = (key.has_object? packed_object_poses[key.pose] : packed_bone_poses[key.pose]);
+        return Transform(position_x.decode(pose.x), position_y.decode(pose.y), angle.decode(pose.angle), scale.decode(pose.scale_x), scale.decode(pose.scale_y));
+    }
+    const Timeline::Key::Pose& pose = (key.has_object? object_poses[key.pose] : bone_poses[key.pose]);
+    return Transform(pose.x, pose.y, pose.angle, pose.scale_x, pose.scale_y);
+}
+
+// Spriter's polynomial curves are 1D bezier curves from 0 to 1 with the key's c1, c2, ... as the inner control points.
+// De Casteljau's algorithm evaluates them with lerps, just like Spriter does.
+static float curve_polynomial(const float* controls, int num_controls, float t)
+{
+    float points[6];
+    points[0] = 0.0f;
+    for(int i = 0; i < num_controls; i++)
+        points[i+1] = controls[i];
+    points[num_controls+1] = 1.0f;
+    
+    for(int n = num_controls+1; n > 0; n--)
+    {
+        for(int i = 0; i < n; i++)
+            points[i] = lerp(points[i], points[i+1], t);
+    }
+    return points[0];
+}
+
+float EntityPrototype::Animation::applyCurve(const Timeline::Key& key, float t) const
+{
+    if(key.curve == Timeline::Key::CURVE_LINEAR)
+        return t;
+    
+    float controls[4] = {key.c1, key.c2, key.c3, key.c4};
+    switch(key.curve)
+    {
+        case Timeline::Key::CURVE_INSTANT:
+            return 0.0f;
+        case Timeline::Key::CURVE_QUADRATIC:
+            return curve_polynomial(controls, 1, t);
+        case Timeline::Key::CURVE_CUBIC:
+            return curve_polynomial(controls, 2, t);
+        case Timeline::Key::CURVE_QUARTIC:
+            return curve_polynomial(controls, 3, t);
+        case Timeline::Key::CURVE_QUINTIC:
+            return curve_polynomial(controls, 4, t);
+        case Timeline::Key::CURVE_BEZIER:
+        {
+            if(key.curve_samples < 0 || key.curve_samples + Timeline::Key::CURVE_SEGMENTS >= curve_samples.size)
+                return t;
+            
+            // Lerp between the two samples around t
+            float position = t*Timeline::Key::CURVE_SEGMENTS;
+            int i = int(position);
+            if(i < 0)
+                i = 0;
+            else if(i >= Timeline::Key::CURVE_SEGMENTS)
+                i = Timeline::Key::CURVE_SEGMENTS - 1;
+            const float* samples = curve_samples.data + key.curve_samples;
+            return lerp(samples[i], samples[i+1], position - i);
+        }
+    }
+    return t;
+}
+
+
+EntityPrototype::Animation::Mainline::Key* EntityPrototype::Animation::Mainline::getKey(int key)
+{
+    return find_by_id(keys, key);
+}
+
+EntityPrototype::Animation::Mainline::Key* EntityPrototype::Animation::Mainline::getKeyAtTime(int time)
+{
+    return find_by_time(keys.data, keys.size, time);
+}
+
+EntityPrototype::Animation::Mainline::Key::Bone_Container* EntityPrototype::Animation::Mainline::getBoneSlot(const Key* key, int bone)
+{
+    if(key == NULL)
+        return NULL;
+    return find_by_id(bone_slots, key->first_bone, key->num_bones, bone);
+}
+
+EntityPrototype::Animation::Mainline::Key::Object_Container* EntityPrototype::Animation::Mainline::getObjectSlot(const Key* key, int object)
+{
+    if(key == NULL)
+        return NULL;
+    return find_by_id(object_slots, key->first_object, key->num_objects, object);
+}
+
+
+EntityPrototype::Animation::Mainline::Key::Key(SCML::Data::Entity::Animation::Mainline::Key* key)
+    : id(key->id), time(key->time), first_bone(0), num_bones(0), first_object(0), num_objects(0), first_draw(-1)
+{}
+
+
+EntityPrototype::Animation::Mainline::Key::Bone::Bone(SCML::Data::Entity::Animation::Mainline::Key::Bone* bone)
+    : id(bone->id), parent(bone->parent)
+    , x(bone->x), y(bone->y), angle(bone->angle), scale_x(bone->scale_x), scale_y(bone->scale_y), r(bone->r), g(bone->g), b(bone->b), a(bone->a)
+{}
+
+
+EntityPrototype::Animation::Mainline::Key::Bone_Ref::Bone_Ref(SCML::Data::Entity::Animation::Mainline::Key::Bone_Ref* bone_ref)
+    : id(bone_ref->id), parent(bone_ref->parent), timeline(bone_ref->timeline), key(bone_ref->key)
+{}
+
+
+EntityPrototype::Animation::Mainline::Key::Object::Object(SCML::Data::Entity::Animation::Mainline::Key::Object* object, EntityPrototype* prototype)
+    : id(object->id), parent(object->parent), object_type(prototype->addString(object->object_type)), atlas(object->atlas), folder(object->folder), file(object->file)
+    , usage(prototype->addString(object->usage)), blend_mode(prototype->addString(object->blend_mode)), name(prototype->addString(object->name))
+    , x(object->x), y(object->y), pivot_x(object->pivot_x), pivot_y(object->pivot_y)
+    , pixel_art_mode_x(object->pixel_art_mode_x), pixel_art_mode_y(object->pixel_art_mode_y), pixel_art_mode_pivot_x(object->pixel_art_mode_pivot_x), pixel_art_mode_pivot_y(object->pixel_art_mode_pivot_y), angle(object->angle)
+    , w(object->w), h(object->h), scale_x(object->scale_x), scale_y(object->scale_y), r(object->r), g(object->g), b(object->b), a(object->a)
+    , variable_type(prototype->addString(object->variable_type)), value_string(prototype->addString(object->value_string)), value_int(object->value_int), min_int(object->min_int), max_int(object->max_int)
+    , value_float(object->value_float), min_float(object->min_float), max_float(object->max_float), animation(object->animation), t(object->t)
+    , z_index(object->z_index)
+    , volume(object->volume), panning(object->panning)
+{}
+
+
+EntityPrototype::Animation::Mainline::Key::Object_Ref::Object_Ref(SCML::Data::Entity::Animation::Mainline::Key::Object_Ref* object_ref)
+    : id(object_ref->id), parent(object_ref->parent), timeline(object_ref->timeline), key(object_ref->key), z_index(object_ref->z_index)
+{}
+
+
+EntityPrototype::Animation::Timeline::Timeline(SCML::Data::Entity::Animation::Timeline* timeline, EntityPrototype* prototype)
+    : id(timeline->id), name(prototype->addString(timeline->name)), object_type(prototype->addString(timeline->object_type))
+    , variable_type(prototype->addString(timeline->variable_type)), usage(prototype->addString(timeline->usage))
+    , first_key(0), num_keys(0)
+{}
+
+
+EntityPrototype::Animation::Timeline::Key::Key(SCML::Data::Entity::Animation::Timeline::Key* key, EntityPrototype* prototype)
+    : id(key->id), time(key->time), curve_type(prototype->addString(key->curve_type)), c1(key->c1), c2(key->c2), c3(key->c3), c4(key->c4)
+    , curve(CURVE_LINEAR), curve_samples(-1), spin(key->spin), has_object(key->has_object), pose(-1), style(-1)
+{
+    // Spriter's names, in Curve_Type order.  Unknown curves are tweened linearly.
+    static const char* const curve_names[] = {"instant", "linear", "quadratic", "cubic", "quartic", "quintic", "bezier"};
+    for(int i = 0; i < int(sizeof(curve_names)/sizeof(char*)); i++)
+    {
+        if(strcmp(SCML_TO_CSTRING(key->curve_type), curve_names[i]) == 0)
+            curve = i;
+    }
+}
+
+
+EntityPrototype::Animation::Timeline::Key::Bone_Style::Bone_Style(SCML::Data::Entity::Animation::Timeline::Key::Bone* bone)
+    : r(bone->r), g(bone->g), b(bone->b), a(bone->a)
+{}
+
+
+EntityPrototype::Animation::Timeline::Key::Object_Style::Object_Style(SCML::Data::Entity::Animation::Timeline::Key::Object* object, EntityPrototype* prototype)
+    : atlas(object->atlas), folder(object->folder), file(object->file), name(prototype->addString(object->name))
+    , pivot_x(object->pivot_x), pivot_y(object->pivot_y)
+    , w(object->w), h(object->h), r(object->r), g(object->g), b(object->b), a(object->a)
+    , blend_mode(prototype->addString(object->blend_mode)), value_string(prototype->addString(object->value_string)), value_int(object->value_int), min_int(object->min_int), max_int(object->max_int)
+    , value_float(object->value_float), min_float(object->min_float), max_float(object->max_float), animation(object->animation), t(object->t)
+    , volume(object->volume), panning(object->panning)
+{}
+
+
+
+
+// Layout of a .scmlb file.  Offsets are in bytes from the start of the file and every array starts on an 8-byte boundary.
+// The prototype records are stored exactly as they are in memory, so the header records their sizes to catch mismatched builds.
+#define SCMLB_MAGIC "SCMB"
+#define SCMLB_VERSION 7
+#define SCMLB_ENDIAN_MARKER 0x01020304
+
+enum Binary_Record
+{
+    RECORD_MAINLINE_KEY,
+    RECORD_BONE_SLOT,
+    RECORD_OBJECT_SLOT,
+    RECORD_BONE,
+    RECORD_BONE_REF,
+    RECORD_OBJECT,
+    RECORD_OBJECT_REF,
+    RECORD_DRAW_ORDER,
+    RECORD_TIMELINE,
+    RECORD_TIMELINE_KEY,
+    RECORD_CURVE_SAMPLE,
+    RECORD_BONE_POSE,
+    RECORD_OBJECT_POSE,
+    RECORD_PACKED_BONE_POSE,
+    RECORD_PACKED_OBJECT_POSE,
+    RECORD_BONE_STYLE,
+    RECORD_OBJECT_STYLE,
+    NUM_ANIMATION_RECORDS,
+    RECORD_FILE = NUM_ANIMATION_RECORDS,
+    RECORD_ATLAS_PAGE,
+    NUM_BINARY_RECORDS
+};
+
+struct Binary_Header
+{
+    char magic[4];
+    int version;
+    int endian_marker;
+    int record_sizes[NUM_BINARY_RECORDS];
+    int num_entities;
+    int entities_offset;
+    int num_files;
+    int files_offset;
+    int num_atlas_pages;
+    int atlas_pages_offset;
+    int strings_offset;
+    int strings_size;
+};
+
+struct Binary_Entity
+{
+    int id;
+    int name;  // Offset in the file's string table
+    int quantized;
+    float max_position_error;
+    float max_angle_error;
+    float max_scale_error;
+    int num_animations;
+    int animations_offset;
+    int strings_offset;
+    int strings_size;
+};
+
+struct Binary_Animation
+{
+    int id;
+    int name;
+    int length;
+    int looping;
+    int loop_mode;
+    int loop_to;
+    Range position_x, position_y;
+    Range angle;
+    Range scale;
+    // Indexed by Binary_Record
+    int counts[NUM_ANIMATION_RECORDS];
+    int offsets[NUM_ANIMATION_RECORDS];
+};
+
+static void get_record_sizes(int* sizes)
+{
+    sizes[RECORD_MAINLINE_KEY] = sizeof(EntityPrototype::Animation::Mainline::Key);
+    sizes[RECORD_BONE_SLOT] = sizeof(EntityPrototype::Animation::Mainline::Key::Bone_Container);
+    sizes[RECORD_OBJECT_SLOT] = sizeof(EntityPrototype::Animation::Mainline::Key::Object_Container);
+    sizes[RECORD_BONE] = sizeof(EntityPrototype::Animation::Mainline::Key::Bone);
+    sizes[RECORD_BONE_REF] = sizeof(EntityPrototype::Animation::Mainline::Key::Bone_Ref);
+    sizes[RECORD_OBJECT] = sizeof(EntityPrototype::Animation::Mainline::Key::Object);
+    sizes[RECORD_OBJECT_REF] = sizeof(EntityPrototype::Animation::Mainline::Key::Object_Ref);
+    sizes[RECORD_DRAW_ORDER] = sizeof(int);
+    sizes[RECORD_TIMELINE] = sizeof(EntityPrototype::Animation::Timeline);
+    sizes[RECORD_TIMELINE_KEY] = sizeof(EntityPrototype::Animation::Timeline::Key);
+    sizes[RECORD_CURVE_SAMPLE] = sizeof(float);
+    sizes[RECORD_BONE_POSE] = sizeof(EntityPrototype::Animation::Timeline::Key::Pose);
+    sizes[RECORD_OBJECT_POSE] = sizeof(EntityPrototype::Animation::Timeline::Key::Pose);
+    sizes[RECORD_PACKED_BONE_POSE] = sizeof(EntityPrototype::Animation::Timeline::Key::Packed_Pose);
+    sizes[RECORD_PACKED_OBJECT_POSE] = sizeof(EntityPrototype::Animation::Timeline::Key::Packed_Pose);
+    sizes[RECORD_BONE_STYLE] = sizeof(EntityPrototype::Animation::Timeline::Key::Bone_Style);
+    sizes[RECORD_OBJECT_STYLE] = sizeof(EntityPrototype::Animation::Timeline::Key::Object_Style);
+    sizes[RECORD_FILE] = sizeof(BinaryData::File);
+    sizes[RECORD_ATLAS_PAGE] = sizeof(BinaryData::Atlas_Page);
+}
+
+// Appends data to the output, padded to 8 bytes first.  Returns the offset of the data.
+static int write_array(SCML_VECTOR(char)& out, const void* data, int size)
+{
+    while(SCML_VECTOR_SIZE(out) % 8 != 0)
+        SCML_VECTOR_PUSH_BACK(out, '\0');
+    
+    int offset = SCML_VECTOR_SIZE(out);
+    SCML_VECTOR_RESIZE(out, offset + size);
+    if(size > 0)
+        memcpy(&out[offset], data, size);
+    return offset;
+}
+
+template<typename T>
+static int write_span(SCML_VECTOR(char)& out, const Span<T>& records)
+{
+    return write_array(out, records.data, records.size*sizeof(T));
+}
+
+static int append_string(SCML_VECTOR(char)& strings, const SCML_STRING& str)
+{
+    if(SCML_STRING_SIZE(str) == 0)
+        return 0;
+    
+    int offset = SCML_VECTOR_SIZE(strings);
+    const char* s = SCML_TO_CSTRING(str);
+    for(int i = 0; i < int(SCML_STRING_SIZE(str)); i++)
+        SCML_VECTOR_PUSH_BACK(strings, s[i]);
+    SCML_VECTOR_PUSH_BACK(strings, '\0');
+    return offset;
+}
+
+// Checks that an array lies inside of the buffer
+static bool check_array(int buffer_size, int offset, int count, int record_size)
+{
+    if(offset < 0 || count < 0 || offset % 4 != 0)
+        return false;
+    return (offset + (long long)count*record_size <= buffer_size);
+}
+
+// Checks that a string table is terminated
+static bool check_strings(const char* buffer, int buffer_size, int offset, int size)
+{
+    if(!check_array(buffer_size, offset, size, 1))
+        return false;
+    return (size == 0 || buffer[offset + size - 1] == '\0');
+}
+
+// Checks that the indices stored in an animation's records stay inside of its arrays
+static bool check_animation(const EntityPrototype::Animation& animation)
+{
+    const EntityPrototype::Animation::Mainline& mainline = animation.mainline;
+    for(int i = 0; i < mainline.keys.size; i++)
+    {
+        const EntityPrototype::Animation::Mainline::Key& key = mainline.keys[i];
+        if(key.first_bone < 0 || key.num_bones < 0 || key.first_bone + key.num_bones > mainline.bone_slots.size)
+            return false;
+        if(key.first_object < 0 || key.num_objects < 0 || key.first_object + key.num_objects > mainline.object_slots.size)
+            return false;
+        if(key.first_draw >= 0)
+        {
+            if(key.first_draw + key.num_objects > mainline.draw_order.size)
+                return false;
+            for(int j = 0; j < key.num_objects; j++)
+            {
+                if(mainline.draw_order[key.first_draw + j] < 0 || mainline.draw_order[key.first_draw + j] >= key.num_objects)
+                    return false;
+            }
+        }
+    }
+    for(int i = 0; i < mainline.bone_slots.size; i++)
+    {
+        const EntityPrototype::Animation::Mainline::Key::Bone_Container& slot = mainline.bone_slots[i];
+        if(slot.bone >= mainline.bones.size || slot.bone_ref >= mainline.bone_refs.size)
+            return false;
+    }
+    for(int i = 0; i < mainline.object_slots.size; i++)
+    {
+        const EntityPrototype::Animation::Mainline::Key::Object_Container& slot = mainline.object_slots[i];
+        if(slot.object >= mainline.objects.size || slot.object_ref >= mainline.object_refs.size)
+            return false;
+    }
+    for(int i = 0; i < animation.timelines.size; i++)
+    {
+        const EntityPrototype::Animation::Timeline& timeline = animation.timelines[i];
+        if(timeline.first_key < 0 || timeline.num_keys < 0 || timeline.first_key + timeline.num_keys > animation.timeline_keys.size)
+            return false;
+    }
+    for(int i = 0; i < animation.timeline_keys.size; i++)
+    {
+        const EntityPrototype::Animation::Timeline::Key& key = animation.timeline_keys[i];
+        if(key.curve == EntityPrototype::Animation::Timeline::Key::CURVE_BEZIER && (key.curve_samples < 0 || key.curve_samples + EntityPrototype::Animation::Timeline::Key::CURVE_SEGMENTS >= animation.curve_samples.size))
+            return false;
+        int num_poses;
+        if(animation.quantized)
+            num_poses = (key.has_object? animation.packed_object_poses.size : animation.packed_bone_poses.size);
+        else
+            num_poses = (key.has_object? animation.object_poses.size : animation.bone_poses.size);
+        if(key.pose < 0 || key.pose >= num_poses)
+            return false;
+        if(key.style < 0 || key.style >= (key.has_object? animation.object_styles.size : animation.bone_styles.size))
+            return false;
+    }
+    return true;
+}
+
+
+BinaryData::BinaryData()
+    : buffer(NULL), size(0)
+{}
+
+BinaryData::BinaryData(const SCML_STRING& file)
+    : buffer(NULL), size(0)
+{
+    load(file);
+}
+
+BinaryData::~BinaryData()
+{
+    clear();
+}
+
+bool BinaryData::load(const SCML_STRING& file)
+{
+    clear();
+    
+    name = file;
+    
+    // Map the file copy-on-write.  Nothing writes to the records, but they are handed out through non-const pointers.
+    #if defined(WIN32) || defined(_WIN32)
+    HANDLE handle = CreateFileA(SCML_TO_CSTRING(file), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(handle == INVALID_HANDLE_VALUE)
+    {
+        log("SCML::BinaryData failed to open file: %s\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(handle, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(Binary_Header) || file_size.QuadPart > INT_MAX)
+    {
+        CloseHandle(handle);
+        log("SCML::BinaryData failed to load \"%s\": File is not a compiled SCML file.\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(mapping != NULL)
+    {
+        buffer = (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(handle);
+    #else
+    int fd = open(SCML_TO_CSTRING(file), O_RDONLY);
+    if(fd < 0)
+    {
+        log("SCML::BinaryData failed to open file: %s\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(Binary_Header) || file_stat.st_size > INT_MAX)
+    {
+        close(fd);
+        log("SCML::BinaryData failed to load \"%s\": File is not a compiled SCML file.\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    void* mapped = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    buffer = (mapped == MAP_FAILED? NULL : (char*)mapped);
+    close(fd);
+    #endif
+    
+    if(buffer == NULL)
+    {
+        log("SCML::BinaryData failed to map file: %s\n", SCML_TO_CSTRING(file));
+        return false;
+    }
+    
+    #if defined(WIN32) || defined(_WIN32)
+    size = int(file_size.QuadPart);
+    #else
+    size = int(file_stat.st_size);
+    #endif
+    
+    // Check that this build can use the records in place
+    const Binary_Header* header = (const Binary_Header*)buffer;
+    int record_sizes[NUM_BINARY_RECORDS];
+    get_record_sizes(record_sizes);
+    if(memcmp(header->magic, SCMLB_MAGIC, 4) != 0)
+    {
+        log("SCML::BinaryData failed to load \"%s\": File is not a compiled SCML file.\n", SCML_TO_CSTRING(file));
+        clear();
+        return false;
+    }
+    if(header->version != SCMLB_VERSION || header->endian_marker != SCMLB_ENDIAN_MARKER || memcmp(header->record_sizes, record_sizes, sizeof(record_sizes)) != 0)
+    {
+        log("SCML::BinaryData failed to load \"%s\": File was compiled for a different version or platform.\n", SCML_TO_CSTRING(file));
+        clear();
+        return false;
+    }
+    
+    if(!check_array(size, header->entities_offset, header->num_entities, sizeof(Binary_Entity))
+       || !check_array(size, header->files_offset, header->num_files, sizeof(File))
+       || !check_array(size, header->atlas_pages_offset, header->num_atlas_pages, sizeof(Atlas_Page))
+       || !check_strings(buffer, size, header->strings_offset, header->strings_size))
+    {
+        log("SCML::BinaryData failed to load \"%s\": File is corrupt.\n", SCML_TO_CSTRING(file));
+        clear();
+        return false;
+    }
+    
+    files = Span<File>((File*)(buffer + header->files_offset), header->num_files);
+    atlas_pages = Span<Atlas_Page>((Atlas_Page*)(buffer + header->atlas_pages_offset), header->num_atlas_pages);
+    strings = Span<char>(buffer + header->strings_offset, header->strings_size);
+    
+    const Binary_Entity* entities = (const Binary_Entity*)(buffer + header->entities_offset);
+    for(int i = 0; i < header->num_entities; i++)
+    {
+        const Binary_Entity& e = entities[i];
+        if(!check_array(size, e.animations_offset, e.num_animations, sizeof(Binary_Animation))
+           || !check_strings(buffer, size, e.strings_offset, e.strings_size))
+        {
+            log("SCML::BinaryData failed to load \"%s\": File is corrupt.\n", SCML_TO_CSTRING(file));
+            clear();
+            return false;
+        }
+        
+        EntityPrototype* prototype = new EntityPrototype;
+        prototype->retain();
+        SCML_VECTOR_PUSH_BACK(prototypes, prototype);
+        
+        prototype->id = e.id;
+        prototype->name = getString(e.name);
+        prototype->strings = Span<char>(buffer + e.strings_offset, e.strings_size);
+        prototype->quantized = (e.quantized != 0);
+        prototype->max_position_error = e.max_position_error;
+        prototype->max_angle_error = e.max_angle_error;
+        prototype->max_scale_error = e.max_scale_error;
+        
+        const Binary_Animation* animations = (const Binary_Animation*)(buffer + e.animations_offset);
+        SCML_VECTOR_RESIZE(prototype->animations, e.num_animations);
+        for(int j = 0; j < e.num_animations; j++)
+        {
+            const Binary_Animation& a = animations[j];
+            for(int k = 0; k < NUM_ANIMATION_RECORDS; k++)
+            {
+                if(!check_array(size, a.offsets[k], a.counts[k], record_sizes[k]))
+                {
+                    log("SCML::BinaryData failed to load \"%s\": File is corrupt.\n", SCML_TO_CSTRING(file));
+                    clear();
+                    return false;
+                }
+            }
+            
+            EntityPrototype::Animation& animation = prototype->animations[j];
+            animation.id = a.id;
+            animation.name = a.name;
+            animation.length = a.length;
+            animation.looping = a.looping;
+            animation.loop_mode = a.loop_mode;
+            animation.loop_to = a.loop_to;
+            animation.quantized = prototype->quantized;
+            animation.position_x = a.position_x;
+            animation.position_y = a.position_y;
+            animation.angle = a.angle;
+            animation.scale = a.scale;
             
-            transforms[bone1->id] = b_transform;
+            EntityPrototype::Animation::Mainline& mainline = animation.mainline;
+            mainline.keys = Span<EntityPrototype::Animation::Mainline::Key>((EntityPrototype::Animation::Mainline::Key*)(buffer + a.offsets[RECORD_MAINLINE_KEY]), a.counts[RECORD_MAINLINE_KEY]);
+            mainline.bone_slots = Span<EntityPrototype::Animation::Mainline::Key::Bone_Container>((EntityPrototype::Animation::Mainline::Key::Bone_Container*)(buffer + a.offsets[RECORD_BONE_SLOT]), a.counts[RECORD_BONE_SLOT]);
+            mainline.object_slots = Span<EntityPrototype::Animation::Mainline::Key::Object_Container>((EntityPrototype::Animation::Mainline::Key::Object_Container*)(buffer + a.offsets[RECORD_OBJECT_SLOT]), a.counts[RECORD_OBJECT_SLOT]);
+            mainline.bones = Span<EntityPrototype::Animation::Mainline::Key::Bone>((EntityPrototype::Animation::Mainline::Key::Bone*)(buffer + a.offsets[RECORD_BONE]), a.counts[RECORD_BONE]);
+            mainline.bone_refs = Span<EntityPrototype::Animation::Mainline::Key::Bone_Ref>((EntityPrototype::Animation::Mainline::Key::Bone_Ref*)(buffer + a.offsets[RECORD_BONE_REF]), a.counts[RECORD_BONE_REF]);
+            mainline.objects = Span<EntityPrototype::Animation::Mainline::Key::Object>((EntityPrototype::Animation::Mainline::Key::Object*)(buffer + a.offsets[RECORD_OBJECT]), a.counts[RECORD_OBJECT]);
+            mainline.object_refs = Span<EntityPrototype::Animation::Mainline::Key::Object_Ref>((EntityPrototype::Animation::Mainline::Key::Object_Ref*)(buffer + a.offsets[RECORD_OBJECT_REF]), a.counts[RECORD_OBJECT_REF]);
+            mainline.draw_order = Span<int>((int*)(buffer + a.offsets[RECORD_DRAW_ORDER]), a.counts[RECORD_DRAW_ORDER]);
+            animation.timelines = Span<EntityPrototype::Animation::Timeline>((EntityPrototype::Animation::Timeline*)(buffer + a.offsets[RECORD_TIMELINE]), a.counts[RECORD_TIMELINE]);
+            animation.timeline_keys = Span<EntityPrototype::Animation::Timeline::Key>((EntityPrototype::Animation::Timeline::Key*)(buffer + a.offsets[RECORD_TIMELINE_KEY]), a.counts[RECORD_TIMELINE_KEY]);
+            animation.curve_samples = Span<float>((float*)(buffer + a.offsets[RECORD_CURVE_SAMPLE]), a.counts[RECORD_CURVE_SAMPLE]);
+            animation.bone_poses = Span<EntityPrototype::Animation::Timeline::Key::Pose>((EntityPrototype::Animation::Timeline::Key::Pose*)(buffer + a.offsets[RECORD_BONE_POSE]), a.counts[RECORD_BONE_POSE]);
+            animation.object_poses = Span<EntityPrototype::Animation::Timeline::Key::Pose>((EntityPrototype::Animation::Timeline::Key::Pose*)(buffer + a.offsets[RECORD_OBJECT_POSE]), a.counts[RECORD_OBJECT_POSE]);
+            animation.packed_bone_poses = Span<EntityPrototype::Animation::Timeline::Key::Packed_Pose>((EntityPrototype::Animation::Timeline::Key::Packed_Pose*)(buffer + a.offsets[RECORD_PACKED_BONE_POSE]), a.counts[RECORD_PACKED_BONE_POSE]);
+            animation.packed_object_poses = Span<EntityPrototype::Animation::Timeline::Key::Packed_Pose>((EntityPrototype::Animation::Timeline::Key::Packed_Pose*)(buffer + a.offsets[RECORD_PACKED_OBJECT_POSE]), a.counts[RECORD_PACKED_OBJECT_POSE]);
+            animation.bone_styles = Span<EntityPrototype::Animation::Timeline::Key::Bone_Style>((EntityPrototype::Animation::Timeline::Key::Bone_Style*)(buffer + a.offsets[RECORD_BONE_STYLE]), a.counts[RECORD_BONE_STYLE]);
+            animation.object_styles = Span<EntityPrototype::Animation::Timeline::Key::Object_Style>((EntityPrototype::Animation::Timeline::Key::Object_Style*)(buffer + a.offsets[RECORD_OBJECT_STYLE]), a.counts[RECORD_OBJECT_STYLE]);
             
+            if(!check_animation(animation))
+            {
+                log("SCML::BinaryData failed to load \"%s\": File is corrupt.\n", SCML_TO_CSTRING(file));
+                clear();
+                return false;
+            }
         }
     }
-    SCML_END_MAP_FOREACH_CONST;
     
+    return true;
 }
 
-
-
-
-Entity::Animation::Animation(SCML::Data::Entity::Animation* animation)
-    : id(animation->id), name(animation->name), length(animation->length), looping(animation->looping), loop_to(animation->loop_to)
-    , mainline(&animation->mainline)
-{
-    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, SCML::Data::Entity::Animation::Timeline*, item)
-    {
-        SCML_MAP_INSERT(timelines, item->id, new Timeline(item));
-    }
-    SCML_END_MAP_FOREACH_CONST;
-}
-
-void Entity::Animation::clear()
-{
-    SCML_BEGIN_MAP_FOREACH_CONST(timelines, int, Timeline*, item)
-    {
-        delete item;
-    }
-    SCML_END_MAP_FOREACH_CONST;
-    timelines.clear();
-}
-
-
-Entity::Animation::Mainline::Mainline(SCML::Data::Entity::Animation::Mainline* mainline)
-{
-    SCML_BEGIN_MAP_FOREACH_CONST(mainline->keys, int, SCML::Data::Entity::Animation::Mainline::Key*, item)
-    {
-        SCML_MAP_INSERT(keys, item->id, new Key(item));
-    }
-    SCML_END_MAP_FOREACH_CONST;
-}
-
-void Entity::Animation::Mainline::clear()
+void BinaryData::clear()
 {
-    SCML_BEGIN_MAP_FOREACH_CONST(keys, int, Key*, item)
+    for(int i = 0; i < int(SCML_VECTOR_SIZE(prototypes)); i++)
+        prototypes[i]->release();
+    SCML_VECTOR_CLEAR(prototypes);
+    
+    files = Span<File>();
+    atlas_pages = Span<Atlas_Page>();
+    strings = Span<char>();
+    
+    if(buffer != NULL)
     {
-        delete item;
+        #if defined(WIN32) || defined(_WIN32)
+        UnmapViewOfFile(buffer);
+        #else
+        munmap(buffer, size);
+        #endif
     }
-    SCML_END_MAP_FOREACH_CONST;
-    keys.clear();
+    buffer = NULL;
+    size = 0;
+    
+    name = "";
 }
 
-
-Entity::Animation::Mainline::Key::Key(SCML::Data::Entity::Animation::Mainline::Key* key)
-    : id(key->id), time(key->time)
+bool BinaryData::write(SCML::Data* data, const SCML_STRING& file, bool quantized)
 {
-    // Load bones and objects
-    SCML_BEGIN_MAP_FOREACH_CONST(key->bones, int, SCML::Data::Entity::Animation::Mainline::Key::Bone_Container, item)
+    if(data == NULL)
+        return false;
+    
+    SCML_VECTOR(char) out;
+    SCML_VECTOR(char) file_strings;
+    SCML_VECTOR_PUSH_BACK(file_strings, '\0');
+    
+    // Placeholder for the header
+    Binary_Header header;
+    memset(&header, 0, sizeof(header));
+    write_array(out, &header, sizeof(header));
+    
+    SCML_VECTOR(Binary_Entity) entities;
+    SCML_BEGIN_MAP_FOREACH_CONST(data->entities, int, SCML::Data::Entity*, item)
     {
-        if(item.hasBone())
-        {
-            Bone* b = new Bone(item.bone);
-            SCML_MAP_INSERT(bones, b->id, Bone_Container(b));
-        }
-        if(item.hasBone_Ref())
+        EntityPrototype* prototype = item->getPrototype(quantized);
+        
+        Binary_Entity e;
+        e.id = prototype->id;
+        e.name = append_string(file_strings, prototype->name);
+        e.quantized = (prototype->quantized? 1 : 0);
+        e.max_position_error = prototype->max_position_error;
+        e.max_angle_error = prototype->max_angle_error;
+        e.max_scale_error = prototype->max_scale_error;
+        e.num_animations = SCML_VECTOR_SIZE(prototype->animations);
+        e.strings_size = prototype->strings.size;
+        e.strings_offset = write_span(out, prototype->strings);
+        
+        SCML_VECTOR(Binary_Animation) animations;
+        for(int i = 0; i < e.num_animations; i++)
         {
-            Bone_Ref* b = new Bone_Ref(item.bone_ref);
-            SCML_MAP_INSERT(bones, b->id, Bone_Container(b));
+            EntityPrototype::Animation& animation = prototype->animations[i];
+            
+            Binary_Animation a;
+            a.id = animation.id;
+            a.name = animation.name;
+            a.length = animation.length;
+            a.looping = animation.looping;
+            a.loop_mode = animation.loop_mode;
+            a.loop_to = animation.loop_to;
+            a.position_x = animation.position_x;
+            a.position_y = animation.position_y;
+            a.angle = animation.angle;
+            a.scale = animation.scale;
+            
+            a.counts[RECORD_MAINLINE_KEY] = animation.mainline.keys.size;
+            a.offsets[RECORD_MAINLINE_KEY] = write_span(out, animation.mainline.keys);
+            a.counts[RECORD_BONE_SLOT] = animation.mainline.bone_slots.size;
+            a.offsets[RECORD_BONE_SLOT] = write_span(out, animation.mainline.bone_slots);
+            a.counts[RECORD_OBJECT_SLOT] = animation.mainline.object_slots.size;
+            a.offsets[RECORD_OBJECT_SLOT] = write_span(out, animation.mainline.object_slots);
+            a.counts[RECORD_BONE] = animation.mainline.bones.size;
+            a.offsets[RECORD_BONE] = write_span(out, animation.mainline.bones);
+            a.counts[RECORD_BONE_REF] = animation.mainline.bone_refs.size;
+            a.offsets[RECORD_BONE_REF] = write_span(out, animation.mainline.bone_refs);
+            a.counts[RECORD_OBJECT] = animation.mainline.objects.size;
+            a.offsets[RECORD_OBJECT] = write_span(out, animation.mainline.objects);
+            a.counts[RECORD_OBJECT_REF] = animation.mainline.object_refs.size;
+            a.offsets[RECORD_OBJECT_REF] = write_span(out, animation.mainline.object_refs);
+            a.counts[RECORD_DRAW_ORDER] = animation.mainline.draw_order.size;
+            a.offsets[RECORD_DRAW_ORDER] = write_span(out, animation.mainline.draw_order);
+            a.counts[RECORD_TIMELINE] = animation.timelines.size;
+            a.offsets[RECORD_TIMELINE] = write_span(out, animation.timelines);
+            a.counts[RECORD_TIMELINE_KEY] = animation.timeline_keys.size;
+            a.offsets[RECORD_TIMELINE_KEY] = write_span(out, animation.timeline_keys);
+            a.counts[RECORD_CURVE_SAMPLE] = animation.curve_samples.size;
+            a.offsets[RECORD_CURVE_SAMPLE] = write_span(out, animation.curve_samples);
+            a.counts[RECORD_BONE_POSE] = animation.bone_poses.size;
+            a.offsets[RECORD_BONE_POSE] = write_span(out, animation.bone_poses);
+            a.counts[RECORD_OBJECT_POSE] = animation.object_poses.size;
+            a.offsets[RECORD_OBJECT_POSE] = write_span(out, animation.object_poses);
+            a.counts[RECORD_PACKED_BONE_POSE] = animation.packed_bone_poses.size;
+            a.offsets[RECORD_PACKED_BONE_POSE] = write_span(out, animation.packed_bone_poses);
+            a.counts[RECORD_PACKED_OBJECT_POSE] = animation.packed_object_poses.size;
+            a.offsets[RECORD_PACKED_OBJECT_POSE] = write_span(out, animation.packed_object_poses);
+            a.counts[RECORD_BONE_STYLE] = animation.bone_styles.size;
+            a.offsets[RECORD_BONE_STYLE] = write_span(out, animation.bone_styles);
+            a.counts[RECORD_OBJECT_STYLE] = animation.object_styles.size;
+            a.offsets[RECORD_OBJECT_STYLE] = write_span(out, animation.object_styles);
+            
+            SCML_VECTOR_PUSH_BACK(animations, a);
         }
+        
+        e.animations_offset = write_array(out, (e.num_animations > 0? &animations[0] : NULL), e.num_animations*sizeof(Binary_Animation));
+        SCML_VECTOR_PUSH_BACK(entities, e);
     }
     SCML_END_MAP_FOREACH_CONST;
     
-    
-    SCML_BEGIN_MAP_FOREACH_CONST(key->objects, int, SCML::Data::Entity::Animation::Mainline::Key::Object_Container, item)
+    SCML_VECTOR(File) files;
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, folder)
     {
-        if(item.hasObject())
+        SCML_BEGIN_MAP_FOREACH_CONST(folder->files, int, SCML::Data::Folder::File*, item)
         {
-            Object* b = new Object(item.object);
-            SCML_MAP_INSERT(objects, b->id, Object_Container(b));
-        }
-        if(item.hasObject_Ref())
-        {
-            Object_Ref* b = new Object_Ref(item.object_ref);
-            SCML_MAP_INSERT(objects, b->id, Object_Container(b));
+            File f;
+            f.folder = folder->id;
+            f.file = item->id;
+            f.type = append_string(file_strings, item->type);
+            f.name = append_string(file_strings, item->name);
+            f.width = item->width;
+            f.height = item->height;
+            f.pivot_x = item->pivot_x;
+            f.pivot_y = item->pivot_y;
+            f.atlas = item->atlas;
+            f.atlas_x = item->atlas_x;
+            f.atlas_y = item->atlas_y;
+            f.offset_x = item->offset_x;
+            f.offset_y = item->offset_y;
+            f.original_width = item->original_width;
+            f.original_height = item->original_height;
+            SCML_VECTOR_PUSH_BACK(files, f);
         }
+        SCML_END_MAP_FOREACH_CONST;
     }
     SCML_END_MAP_FOREACH_CONST;
-}
-
-void Entity::Animation::Mainline::Key::clear()
-{
-    SCML_BEGIN_MAP_FOREACH_CONST(bones, int, Bone_Container, item)
+    
+    SCML_VECTOR(Atlas_Page) atlas_pages;
+    SCML_BEGIN_MAP_FOREACH_CONST(data->atlases, int, SCML::Data::Atlas*, item)
     {
-        delete item.bone;
-        delete item.bone_ref;
+        if(SCML_STRING_SIZE(item->image_path) > 0)
+        {
+            Atlas_Page page;
+            page.atlas = item->id;
+            page.image_path = append_string(file_strings, item->image_path);
+            SCML_VECTOR_PUSH_BACK(atlas_pages, page);
+        }
     }
     SCML_END_MAP_FOREACH_CONST;
-    bones.clear();
     
-    SCML_BEGIN_MAP_FOREACH_CONST(objects, int, Object_Container, item)
+    memcpy(header.magic, SCMLB_MAGIC, 4);
+    header.version = SCMLB_VERSION;
+    header.endian_marker = SCMLB_ENDIAN_MARKER;
+    get_record_sizes(header.record_sizes);
+    header.num_entities = SCML_VECTOR_SIZE(entities);
+    header.entities_offset = write_array(out, (header.num_entities > 0? &entities[0] : NULL), header.num_entities*sizeof(Binary_Entity));
+    header.num_files = SCML_VECTOR_SIZE(files);
+    header.files_offset = write_array(out, (header.num_files > 0? &files[0] : NULL), header.num_files*sizeof(File));
+    header.num_atlas_pages = SCML_VECTOR_SIZE(atlas_pages);
+    header.atlas_pages_offset = write_array(out, (header.num_atlas_pages > 0? &atlas_pages[0] : NULL), header.num_atlas_pages*sizeof(Atlas_Page));
+    header.strings_size = SCML_VECTOR_SIZE(file_strings);
+    header.strings_offset = write_array(out, &file_strings[0], header.strings_size);
+    memcpy(&out[0], &header, sizeof(header));
+    
+    FILE* f = fopen(SCML_TO_CSTRING(file), "wb");
+    if(f == NULL)
     {
-        delete item.object;
-        delete item.object_ref;
+        log("SCML::BinaryData failed to open file for writing: %s\n", SCML_TO_CSTRING(file));
+        return false;
     }
-    SCML_END_MAP_FOREACH_CONST;
-    objects.clear();
+    bool result = (fwrite(&out[0], 1, SCML_VECTOR_SIZE(out), f) == SCML_VECTOR_SIZE(out));
+    if(fclose(f) != 0)
+        result = false;
+    if(!result)
+        log("SCML::BinaryData failed to write file: %s\n", SCML_TO_CSTRING(file));
+    return result;
 }
 
-
-Entity::Animation::Mainline::Key::Bone::Bone(SCML::Data::Entity::Animation::Mainline::Key::Bone* bone)
-    : parent(bone->parent)
-    , x(bone->x), y(bone->y), angle(bone->angle), scale_x(bone->scale_x), scale_y(bone->scale_y), r(bone->r), g(bone->g), b(bone->b), a(bone->a)
-{}
-
-void Entity::Animation::Mainline::Key::Bone::clear()
-{}
-
-
-Entity::Animation::Mainline::Key::Bone_Ref::Bone_Ref(SCML::Data::Entity::Animation::Mainline::Key::Bone_Ref* bone_ref)
-    : id(bone_ref->id), parent(bone_ref->parent), timeline(bone_ref->timeline), key(bone_ref->key)
-{}
-
-void Entity::Animation::Mainline::Key::Bone_Ref::clear()
-{}
-
-
-Entity::Animation::Mainline::Key::Object::Object(SCML::Data::Entity::Animation::Mainline::Key::Object* object)
-    : id(object->id), parent(object->parent), object_type(object->object_type), atlas(object->atlas), folder(object->folder), file(object->file)
-    , usage(object->usage), blend_mode(object->blend_mode), name(object->name)
-    , x(object->x), y(object->y), pivot_x(object->pivot_x), pivot_y(object->pivot_y)
-    , pixel_art_mode_x(object->pixel_art_mode_x), pixel_art_mode_y(object->pixel_art_mode_y), pixel_art_mode_pivot_x(object->pixel_art_mode_pivot_x), pixel_art_mode_pivot_y(object->pixel_art_mode_pivot_y), angle(object->angle)
-    , w(object->w), h(object->h), scale_x(object->scale_x), scale_y(object->scale_y), r(object->r), g(object->g), b(object->b), a(object->a)
-    , variable_type(object->variable_type), value_string(object->value_string), value_int(object->value_int), min_int(object->min_int), max_int(object->max_int)
-    , value_float(object->value_float), min_float(object->min_float), max_float(object->max_float), animation(object->animation), t(object->t)
-    , z_index(object->z_index)
-    , volume(object->volume), panning(object->panning)
-{}
-
-void Entity::Animation::Mainline::Key::Object::clear()
-{}
-
-
-Entity::Animation::Mainline::Key::Object_Ref::Object_Ref(SCML::Data::Entity::Animation::Mainline::Key::Object_Ref* object_ref)
-    : id(object_ref->id), parent(object_ref->parent), timeline(object_ref->timeline), key(object_ref->key), z_index(object_ref->z_index)
-{}
-
-void Entity::Animation::Mainline::Key::Object_Ref::clear()
-{}
-
-
-Entity::Animation::Timeline::Timeline(SCML::Data::Entity::Animation::Timeline* timeline)
-    : id(timeline->id), name(timeline->name), object_type(timeline->object_type), variable_type(timeline->variable_type), usage(timeline->usage)
+int BinaryData::getNumEntities() const
 {
-    SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, SCML::Data::Entity::Animation::Timeline::Key*, item)
-    {
-        SCML_MAP_INSERT(keys, item->id, new Key(item));
-    }
-    SCML_END_MAP_FOREACH_CONST;
+    return SCML_VECTOR_SIZE(prototypes);
 }
 
-void Entity::Animation::Timeline::clear()
+EntityPrototype* BinaryData::getPrototype(int entity) const
 {
-    SCML_BEGIN_MAP_FOREACH_CONST(keys, int, Key*, item)
+    for(int i = 0; i < int(SCML_VECTOR_SIZE(prototypes)); i++)
     {
-        delete item;
+        if(prototypes[i]->id == entity)
+            return prototypes[i];
     }
-    SCML_END_MAP_FOREACH_CONST;
-    keys.clear();
+    return NULL;
 }
 
-
-Entity::Animation::Timeline::Key::Key(SCML::Data::Entity::Animation::Timeline::Key* key)
-    : id(key->id), time(key->time), curve_type(key->curve_type), c1(key->c1), c2(key->c2), spin(key->spin), has_object(key->has_object), bone(&key->bone), object(&key->object)
+EntityPrototype* BinaryData::getPrototypeByIndex(int index) const
 {
-    
+    if(index < 0 || index >= int(SCML_VECTOR_SIZE(prototypes)))
+        return NULL;
+    return prototypes[index];
 }
 
-void Entity::Animation::Timeline::Key::clear()
+int BinaryData::getNumFiles() const
 {
-    bone.clear();
-    object.clear();
+    return files.size;
 }
 
+const BinaryData::File* BinaryData::getFile(int index) const
+{
+    if(index < 0 || index >= files.size)
+        return NULL;
+    return &files[index];
+}
 
-Entity::Animation::Timeline::Key::Bone::Bone(SCML::Data::Entity::Animation::Timeline::Key::Bone* bone)
-    : x(bone->x), y(bone->y), angle(bone->angle), scale_x(bone->scale_x), scale_y(bone->scale_y), r(bone->r), g(bone->g), b(bone->b), a(bone->a)
-{}
-
-void Entity::Animation::Timeline::Key::Bone::clear()
-{}
-
+int BinaryData::getNumAtlasPages() const
+{
+    return atlas_pages.size;
+}
 
-Entity::Animation::Timeline::Key::Object::Object(SCML::Data::Entity::Animation::Timeline::Key::Object* object)
-    : atlas(object->atlas), folder(object->folder), file(object->file), name(object->name)
-    , x(object->x), y(object->y), pivot_x(object->pivot_x), pivot_y(object->pivot_y), angle(object->angle)
-    , w(object->w), h(object->h), scale_x(object->scale_x), scale_y(object->scale_y), r(object->r), g(object->g), b(object->b), a(object->a)
-    , blend_mode(object->blend_mode), value_string(object->value_string), value_int(object->value_int), min_int(object->min_int), max_int(object->max_int)
-    , value_float(object->value_float), min_float(object->min_float), max_float(object->max_float), animation(object->animation), t(object->t)
-    , volume(object->volume), panning(object->panning)
+const BinaryData::Atlas_Page* BinaryData::getAtlasPage(int index) const
 {
-    
+    if(index < 0 || index >= atlas_pages.size)
+        return NULL;
+    return &atlas_pages[index];
 }
 
-void Entity::Animation::Timeline::Key::Object::clear()
+const char* BinaryData::getString(int offset) const
 {
-    
+    if(offset <= 0 || offset >= strings.size)
+        return "";
+    return &strings[offset];
 }
 
 
@@ -3060,56 +8361,52 @@ void Entity::Animation::Timeline::Key::Object::clear()
 
 int Entity::getNumAnimations() const
 {
-    return SCML_MAP_SIZE(animations);
+    if(prototype == NULL)
+        return 0;
+    return SCML_VECTOR_SIZE(prototype->animations);
 }
 
 Entity::Animation* Entity::getAnimation(int animation) const
 {
-    return SCML_MAP_FIND(animations, animation);
+    if(prototype == NULL)
+        return NULL;
+    return prototype->getAnimation(animation);
 }
 
-Entity::Animation::Mainline::Key* Entity::getKey(int animation, int key) const
+EntityPrototype::Animation::Mainline::Key* Entity::getKey(int animation, int key) const
 {
-    Animation* a = SCML_MAP_FIND(animations, animation);
+    Animation* a = getAnimation(animation);
     if(a == NULL)
         return NULL;
     
-    return SCML_MAP_FIND(a->mainline.keys, key);
+    return a->mainline.getKey(key);
 }
 
 
-Entity::Animation::Mainline::Key::Bone_Ref* Entity::getBoneRef(int animation, int key, int bone_ref) const
+EntityPrototype::Animation::Mainline::Key::Bone_Ref* Entity::getBoneRef(int animation, int key, int bone_ref) const
 {
-    Animation* a = SCML_MAP_FIND(animations, animation);
+    Animation* a = getAnimation(animation);
     if(a == NULL)
         return NULL;
     
-    Animation::Mainline::Key* k = SCML_MAP_FIND(a->mainline.keys, key);
-    if(k == NULL)
+    Animation::Mainline::Key::Bone_Container* b = a->mainline.getBoneSlot(a->mainline.getKey(key), bone_ref);
+    if(b == NULL)
         return NULL;
     
-    Animation::Mainline::Key::Bone_Container b = SCML_MAP_FIND(k->bones, bone_ref);
-    if(!b.hasBone_Ref())
-        return NULL;
-    
-    return b.bone_ref;
+    return a->mainline.getBoneRef(*b);
 }
 
-Entity::Animation::Mainline::Key::Object_Ref* Entity::getObjectRef(int animation, int key, int object_ref) const
+EntityPrototype::Animation::Mainline::Key::Object_Ref* Entity::getObjectRef(int animation, int key, int object_ref) const
 {
-    Animation* a = SCML_MAP_FIND(animations, animation);
+    Animation* a = getAnimation(animation);
     if(a == NULL)
         return NULL;
     
-    Animation::Mainline::Key* k = SCML_MAP_FIND(a->mainline.keys, key);
-    if(k == NULL)
-        return NULL;
-    
-    Animation::Mainline::Key::Object_Container o = SCML_MAP_FIND(k->objects, object_ref);
-    if(!o.hasObject_Ref())
+    Animation::Mainline::Key::Object_Container* o = a->mainline.getObjectSlot(a->mainline.getKey(key), object_ref);
+    if(o == NULL)
         return NULL;
     
-    return o.object_ref;
+    return a->mainline.getObjectRef(*o);
 }
 
 // Gets the next key index according to the animation's looping setting.
@@ -3123,23 +8420,20 @@ int Entity::getNextKeyID(int animation, int lastKey) const
     if(animation_ptr == NULL)
         return -2;
     
-    if(animation_ptr->looping == "true")
+    if(animation_ptr->loop_mode == Animation::LOOP_TRUE)
     {
         // If we've reached the end of the keys, loop.
-        if(lastKey+1 >= int(SCML_MAP_SIZE(animation_ptr->mainline.keys)))
+        if(lastKey+1 >= animation_ptr->mainline.keys.size)
             return animation_ptr->loop_to;
         else
             return lastKey+1;
     }
-    else if(animation_ptr->looping == "ping_pong")
-    {
-        // TODO: Implement ping_pong animation
-        return -3;
-    }
-    else  // assume "false"
+    else  // LOOP_FALSE or LOOP_PING_PONG
     {
+        // A pose only depends on the time, so a ping_pong animation tweens between the same keys in both directions.
+        // Its last key is held until the end, where it turns around.
         // If we've haven't reached the end of the keys, return the next one.
-        if(lastKey+1 < int(SCML_MAP_SIZE(animation_ptr->mainline.keys)))
+        if(lastKey+1 < animation_ptr->mainline.keys.size)
             return lastKey+1;
         else // if we have reached the end, stick to this key
             return lastKey;
@@ -3147,52 +8441,40 @@ int Entity::getNextKeyID(int animation, int lastKey) const
 }
 
 
-Entity::Animation::Timeline::Key* Entity::getTimelineKey(int animation, int timeline, int key)
+EntityPrototype::Animation::Timeline::Key* Entity::getTimelineKey(int animation, int timeline, int key)
 {
-    Animation* a = SCML_MAP_FIND(animations, animation);
+    Animation* a = getAnimation(animation);
     if(a == NULL)
         return NULL;
     
-    Animation::Timeline* t = SCML_MAP_FIND(a->timelines, timeline);
-    if(t == NULL)
-        return NULL;
-    
-    return SCML_MAP_FIND(t->keys, key);
+    return a->getTimelineKey(timeline, key);
 }
 
 
-Entity::Animation::Timeline::Key::Object* Entity::getTimelineObject(int animation, int timeline, int key)
+EntityPrototype::Animation::Timeline::Key::Object_Style* Entity::getTimelineObject(int animation, int timeline, int key)
 {
-    Animation* a = SCML_MAP_FIND(animations, animation);
+    Animation* a = getAnimation(animation);
     if(a == NULL)
         return NULL;
     
-    Animation::Timeline* t = SCML_MAP_FIND(a->timelines, timeline);
-    if(t == NULL)
-        return NULL;
-    
-    Animation::Timeline::Key* k = SCML_MAP_FIND(t->keys, key);
+    Animation::Timeline::Key* k = a->getTimelineKey(timeline, key);
     if(k == NULL || !k->has_object)
         return NULL;
     
-    return &k->object;
+    return &a->object_styles[k->style];
 }
 
-Entity::Animation::Timeline::Key::Bone* Entity::getTimelineBone(int animation, int timeline, int key)
+EntityPrototype::Animation::Timeline::Key::Bone_Style* Entity::getTimelineBone(int animation, int timeline, int key)
 {
-    Animation* a = SCML_MAP_FIND(animations, animation);
+    Animation* a = getAnimation(animation);
     if(a == NULL)
         return NULL;
     
-    Animation::Timeline* t = SCML_MAP_FIND(a->timelines, timeline);
-    if(t == NULL)
-        return NULL;
-    
-    Animation::Timeline::Key* k = SCML_MAP_FIND(t->keys, key);
+    Animation::Timeline::Key* k = a->getTimelineKey(timeline, key);
     if(k == NULL || k->has_object)
         return NULL;
     
-    return &k->bone;
+    return &a->bone_styles[k->style];
 }
 
 int Entity::getNumBones() const
@@ -3202,7 +8484,7 @@ int Entity::getNumBones() const
     if(key_ptr == NULL)
         return 0;
     
-    return SCML_MAP_SIZE(key_ptr->bones);
+    return key_ptr->num_bones;
 }
 
 int Entity::getNumObjects() const
@@ -3212,62 +8494,128 @@ int Entity::getNumObjects() const
     if(key_ptr == NULL)
         return 0;
     
-    return SCML_MAP_SIZE(key_ptr->objects);
+    return key_ptr->num_objects;
 }
 
 bool Entity::getBoneTransform(Transform& result, int boneID)
 {
     // Get key
-    Animation::Mainline::Key* key_ptr = getKey(animation, key);
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
+        return false;
+    
+    Animation::Mainline::Key* key_ptr = animation_ptr->mainline.getKey(key);
     if(key_ptr == NULL)
         return false;
     
-    // Find object
-    Animation::Mainline::Key::Bone_Container item = SCML_MAP_FIND(key_ptr->bones, boneID);
-    if(item.hasBone())
-    {
-        // Get bone transform
-        result = bone_transform_state.transforms[item.bone->id];
-        
-        // FIXME: Actually the inverse conversion...
-        convert_to_SCML_coords(result.x, result.y, result.angle);
-        return true;
-    }
-    else if(item.hasBone_Ref())
+    BakedPoses* poses = getBakedPoses();
+    if(poses != NULL)
     {
-        // Get bone transform
-        result = bone_transform_state.transforms[item.bone_ref->id];
+        int frame, next_frame;
+        float t;
+        if(!poses->findFrames(animation, time, frame, next_frame, t)
+           || !poses->getBoneTransform(result, frame, boneID, next_frame, t, bone_transform_state.base_transform, bone_transform_state.base_matrix))
+            return false;
         
         // FIXME: Actually the inverse conversion...
         convert_to_SCML_coords(result.x, result.y, result.angle);
         return true;
     }
-    else
+    
+    // Find bone
+    Animation::Mainline::Key::Bone_Container* item = animation_ptr->mainline.getBoneSlot(key_ptr, boneID);
+    if(item == NULL || item->id >= int(SCML_VECTOR_SIZE(bone_transform_state.transforms)))
         return false;
+    
+    // Get bone transform
+    result = bone_transform_state.transforms[item->id];
+    
+    // FIXME: Actually the inverse conversion...
+    convert_to_SCML_coords(result.x, result.y, result.angle);
+    return true;
 }
 
 bool Entity::getObjectTransform(Transform& result, int objectID)
+{
+    Sprite sprite;
+    if(!getObjectSprite(sprite, objectID))
+        return false;
+    
+    result = sprite.getDrawTransform();
+    
+    // FIXME: Actually the inverse conversion...
+    convert_to_SCML_coords(result.x, result.y, result.angle);
+    return true;
+}
+
+
+// Shrinks a sprite to the region of its image that is packed on an atlas page, keeping its pivot in the same place.
+static void trim_sprite(Entity::Sprite& sprite, const FileSystem::Atlas_Region* region)
+{
+    if(region == NULL || (region->width == region->original_width && region->height == region->original_height))
+        return;
+    
+    // The pivot is measured from the bottom-left corner of the original image and the offset from its top-left corner.
+    float pivot_x = sprite.pivot_x*region->original_width - region->offset_x;
+    float pivot_y = sprite.pivot_y*region->original_height - (region->original_height - region->offset_y - region->height);
+    sprite.width = region->width;
+    sprite.height = region->height;
+    sprite.pivot_x = pivot_x/region->width;
+    sprite.pivot_y = pivot_y/region->height;
+}
+
+bool Entity::getObjectSprite(Sprite& result, int objectID)
 {
     // Get key
-    Animation::Mainline::Key* key_ptr = getKey(animation, key);
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
+        return false;
+    
+    Animation::Mainline& mainline = animation_ptr->mainline;
+    Animation::Mainline::Key* key_ptr = mainline.getKey(key);
     if(key_ptr == NULL)
         return false;
     
+    BakedPoses* poses = getBakedPoses();
+    if(poses != NULL)
+    {
+        int frame, next_frame;
+        float t;
+        if(!poses->findFrames(animation, time, frame, next_frame, t))
+            return false;
+        
+        BakedPoses::Object object;
+        for(int i = 0; i < poses->frames[frame].num_objects; i++)
+        {
+            poses->getObject(object, frame, i);
+            if(object.id == objectID)
+            {
+                poses->getSprite(result, frame, i, next_frame, t, bone_transform_state.base_transform, bone_transform_state.base_matrix);
+                return true;
+            }
+        }
+        return false;
+    }
+    
     // Find object
-    Animation::Mainline::Key::Object_Container item = SCML_MAP_FIND(key_ptr->objects, objectID);
-    if(item.hasObject())
+    Animation::Mainline::Key::Object_Container* item = mainline.getObjectSlot(key_ptr, objectID);
+    if(item == NULL)
+        return false;
+    
+    if(item->hasObject())
     {
-        return getSimpleObjectTransform(result, item.object);
+        return getSimpleObjectSprite(result, mainline.getObject(*item));
     }
-    else if(item.hasObject_Ref())
+    else if(item->hasObject_Ref())
     {
         // Get the item to tween with
-        Animation::Mainline::Key* nextkey_ptr = getKey(animation, getNextKeyID(animation, key));
+        Animation::Mainline::Key* nextkey_ptr = mainline.getKey(getNextKeyID(animation, key));
         if(nextkey_ptr == NULL)
             nextkey_ptr = key_ptr;
-        Animation::Mainline::Key::Object_Container nextitem = SCML_MAP_FIND(nextkey_ptr->objects, objectID);  // Assuming that objects and object_refs match.
-        return getTweenedObjectTransform(result, item.object_ref, nextitem.object_ref);
-        return true;
+        Animation::Mainline::Key::Object_Container* nextitem = mainline.getObjectSlot(nextkey_ptr, objectID);  // Assuming that objects and object_refs match.
+        if(nextitem == NULL || !nextitem->hasObject_Ref())
+            nextitem = item;
+        return getTweenedObjectSprite(result, mainline.getObjectRef(*item), mainline.getObjectRef(*nextitem));
     }
     else
         return false;
@@ -3275,56 +8623,72 @@ bool Entity::getObjectTransform(Transform& result, int objectID)
 
 bool Entity::getSimpleObjectTransform(Transform& result, SCML::Entity::Animation::Mainline::Key::Object* obj1)
 {
-    if(obj1 == NULL)
+    Sprite sprite;
+    if(!getSimpleObjectSprite(sprite, obj1))
         return false;
     
-    // Get parent bone transform
-    Transform parent_transform;
+    result = sprite.getDrawTransform();
     
-    if(obj1->parent < 0)
-        parent_transform = bone_transform_state.base_transform;
-    else
-        parent_transform = bone_transform_state.transforms[obj1->parent];
+    // FIXME: Actually the inverse conversion...
+    convert_to_SCML_coords(result.x, result.y, result.angle);
+    return true;
+}
+
+bool Entity::getTweenedObjectTransform(Transform& result, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref1, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref2)
+{
+    Sprite sprite;
+    if(!getTweenedObjectSprite(sprite, ref1, ref2))
+        return false;
+    
+    result = sprite.getDrawTransform();
     
+    // FIXME: Actually the inverse conversion...
+    convert_to_SCML_coords(result.x, result.y, result.angle);
+    return true;
+}
+
+bool Entity::getSimpleObjectSprite(Sprite& result, SCML::Entity::Animation::Mainline::Key::Object* obj1)
+{
+    if(obj1 == NULL)
+        return false;
     
     // Set object transform
-    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
+    result.transform = Transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
     
     // Transform the sprite by the parent transform.
-    obj_transform.apply_parent_transform(parent_transform);
-    
+    if(obj1->parent < 0)
+        result.transform.apply_parent_transform(bone_transform_state.base_transform, bone_transform_state.base_matrix);
+    else
+        result.transform.apply_parent_transform(bone_transform_state.transforms[obj1->parent], bone_transform_state.matrices[obj1->parent]);
     
     // Transform the sprite by its own transform now.
-    
-    float pivot_x_ratio = obj1->pivot_x;
-    float pivot_y_ratio = obj1->pivot_y;
+    result.matrix = Affine(result.transform);
+    result.folder = obj1->folder;
+    result.file = obj1->file;
+    result.pivot_x = obj1->pivot_x;
+    result.pivot_y = obj1->pivot_y;
+    result.r = obj1->r;
+    result.g = obj1->g;
+    result.b = obj1->b;
+    result.a = obj1->a;
+    result.blend_mode = DrawList::toBlendMode(prototype->getString(obj1->blend_mode));
+    result.z_index = obj1->z_index;
     
     // No image tweening
-    std::pair<unsigned int, unsigned int> img_dims = getImageDimensions(obj1->folder, obj1->file);
-    
-    // Rotate about the pivot point and draw from the center of the image
-    float offset_x = (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-    float offset_y = (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-    float sprite_x = -offset_x*obj_transform.scale_x;
-    float sprite_y = -offset_y*obj_transform.scale_y;
-    
-    bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-    rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
-    
-    // Save the result
-    result.x = sprite_x;
-    result.y = sprite_y;
-    result.angle = flipped? -obj_transform.angle : obj_transform.angle;
-    result.scale_x = obj_transform.scale_x;
-    result.scale_y = obj_transform.scale_y;
-    
-    // FIXME: Actually the inverse conversion...
-    convert_to_SCML_coords(result.x, result.y, result.angle);
+    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(obj1->folder, obj1->file);
+    result.width = SCML_PAIR_FIRST(img_dims);
+    result.height = SCML_PAIR_SECOND(img_dims);
+    trim_sprite(result, getAtlasRegion(obj1->folder, obj1->file));
     return true;
 }
 
-bool Entity::getTweenedObjectTransform(Transform& result, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref1, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref2)
+bool Entity::getTweenedObjectSprite(Sprite& result, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref1, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref2)
 {
+    if(ref1 == NULL)
+        return false;
+    if(ref2 == NULL)
+        ref2 = ref1;
+    
     // Dereference object_ref and get the next one in the timeline for tweening
     Animation* animation_ptr = getAnimation(animation);  // Only needed if looping...
     Animation::Timeline::Key* t_key1 = getTimelineKey(animation, ref1->timeline, ref1->key);
@@ -3334,12 +8698,8 @@ bool Entity::getTweenedObjectTransform(Transform& result, SCML::Entity::Animatio
     if(t_key1 == NULL || !t_key1->has_object || !t_key2->has_object)
         return false;
     
-    Animation::Timeline::Key::Object* obj1 = &t_key1->object;
-    Animation::Timeline::Key::Object* obj2 = &t_key2->object;
-    if(obj2 == NULL)
-        obj2 = obj1;
-    if(obj1 == NULL)
-        return false;
+    Animation::Timeline::Key::Object_Style* obj1 = &animation_ptr->object_styles[t_key1->style];
+    Animation::Timeline::Key::Object_Style* obj2 = &animation_ptr->object_styles[t_key2->style];
     
     // Get interpolation (tweening) factor
     float t = 0.0f;
@@ -3347,52 +8707,39 @@ bool Entity::getTweenedObjectTransform(Transform& result, SCML::Entity::Animatio
         t = (time - t_key1->time)/float(t_key2->time - t_key1->time);
     else if(t_key2->time < t_key1->time)
         t = (time - t_key1->time)/float(animation_ptr->length - t_key1->time);
-    
-    // Get parent bone transform
-    Transform parent_transform;
-    if(ref1->parent < 0)
-        parent_transform = bone_transform_state.base_transform;
-    else
-        parent_transform = bone_transform_state.transforms[ref1->parent];
+    t = animation_ptr->applyCurve(*t_key1, t);
     
     // Set object transform
-    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
+    result.transform = animation_ptr->getPose(*t_key1);
     
     // Tween with next key's object
-    obj_transform.lerp(Transform(obj2->x, obj2->y, obj2->angle, obj2->scale_x, obj2->scale_y), t, t_key1->spin);
+    result.transform.lerp(animation_ptr->getPose(*t_key2), t, t_key1->spin);
     
     // Transform the sprite by the parent transform.
-    obj_transform.apply_parent_transform(parent_transform);
-    
+    if(ref1->parent < 0)
+        result.transform.apply_parent_transform(bone_transform_state.base_transform, bone_transform_state.base_matrix);
+    else
+        result.transform.apply_parent_transform(bone_transform_state.transforms[ref1->parent], bone_transform_state.matrices[ref1->parent]);
     
     // Transform the sprite by its own transform now.
-    
-    float pivot_x_ratio = lerp(obj1->pivot_x, obj2->pivot_x, t);
-    float pivot_y_ratio = lerp(obj1->pivot_y, obj2->pivot_y, t);
+    result.matrix = Affine(result.transform);
+    result.folder = obj1->folder;
+    result.file = obj1->file;
+    result.pivot_x = lerp(obj1->pivot_x, obj2->pivot_x, t);
+    result.pivot_y = lerp(obj1->pivot_y, obj2->pivot_y, t);
+    result.r = lerp(obj1->r, obj2->r, t);
+    result.g = lerp(obj1->g, obj2->g, t);
+    result.b = lerp(obj1->b, obj2->b, t);
+    result.a = lerp(obj1->a, obj2->a, t);
+    result.blend_mode = DrawList::toBlendMode(prototype->getString(obj1->blend_mode));
+    result.z_index = ref1->z_index;
     
     // No image tweening
-    std::pair<unsigned int, unsigned int> img_dims = getImageDimensions(obj1->folder, obj1->file);
-    
-    // Rotate about the pivot point and draw from the center of the image
-    float offset_x = (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-    float offset_y = (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-    float sprite_x = -offset_x*obj_transform.scale_x;
-    float sprite_y = -offset_y*obj_transform.scale_y;
-    
-    bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-    rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
-    
-    // Save the result
-    result.x = sprite_x;
-    result.y = sprite_y;
-    result.angle = flipped? -obj_transform.angle : obj_transform.angle;
-    result.scale_x = obj_transform.scale_x;
-    result.scale_y = obj_transform.scale_y;
-    
-    // FIXME: Actually the inverse conversion...
-    convert_to_SCML_coords(result.x, result.y, result.angle);
+    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(obj1->folder, obj1->file);
+    result.width = SCML_PAIR_FIRST(img_dims);
+    result.height = SCML_PAIR_SECOND(img_dims);
+    trim_sprite(result, getAtlasRegion(obj1->folder, obj1->file));
     return true;
 }
 
-
 }
@@ -17,6 +17,7 @@
     #define SCML_VECTOR_SIZE(v) (v).size()
     #define SCML_VECTOR_RESIZE(v,size) (v).resize(size)
     #define SCML_VECTOR_CLEAR(v) (v).clear()
+    #define SCML_VECTOR_PUSH_BACK(v,value) (v).push_back(value)
     
     #define SCML_PAIR_FIRST(p) (p).first
     #define SCML_PAIR_SECOND(p) (p).second
@@ -57,11 +58,18 @@
 
 #include "tinyxml.h"
 
+class XML_Stream;
+
 /*! \brief Namespace for SCMLpp
  */
 namespace SCML
 {
 
+class EntityPrototype;
+class BinaryData;
+class BakedPoses;
+class Flipbook;
+
 /*! \brief Representation and storage of an SCML file in memory.
  *
  *
@@ -92,8 +100,14 @@ public:
     Data& operator=(const Data& copy);
     ~Data();
 
+    /*! \brief Loads a .scml file, or a .scon file (see loadSCON()).
+     */
     bool load(const SCML_STRING& file);
+    /*! \brief Loads a Spriter JSON (.scon) file, in either its indented or compact form.
+     */
+    bool loadSCON(const SCML_STRING& file);
     bool load(TiXmlElement* elem);
+    bool load(XML_Stream& stream);
     Data& clone(const Data& copy, bool skip_base = false);
     void log(int recursive_depth = 0) const;
     void clear();
@@ -113,6 +127,7 @@ public:
         Meta_Data(TiXmlElement* elem);
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
@@ -131,6 +146,7 @@ public:
             Variable(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
         };
@@ -145,6 +161,7 @@ public:
             Tag(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
         };
@@ -164,6 +181,7 @@ public:
         Meta_Data_Tweenable(TiXmlElement* elem);
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
@@ -184,6 +202,7 @@ public:
             Variable(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
 
@@ -212,6 +231,8 @@ public:
 
         int id;
         SCML_STRING name;
+        /*! Id of the Atlas whose page holds this folder's images, or -1 if they are separate image files */
+        int atlas;
 
         class File;
         SCML_MAP(int, File*) files;
@@ -220,9 +241,14 @@ public:
         Folder(TiXmlElement* elem);
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
+        /*! \brief Puts the files that do not name an atlas on the folder's atlas.
+         */
+        void inheritAtlas();
+
         class File
         {
         public:
@@ -234,23 +260,34 @@ public:
             float pivot_y;
             int width;
             int height;
+            /*! When the image is packed in an atlas: The top-left corner of its (trimmed) rectangle on the atlas page,
+             *  which is width x height pixels.  It starts at (offset_x, offset_y) in the original image, which is
+             *  original_width x original_height pixels.
+             */
             int atlas_x;
             int atlas_y;
             int offset_x;
             int offset_y;
             int original_width;
             int original_height;
+            /*! Id of the Atlas whose page holds this image, or -1 if it is a separate image file */
+            int atlas;
 
             File();
             File(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
 
         };
     };
 
+    /*! \brief A texture atlas page.  image_path is the page's image file, relative to the SCML file.
+     *
+     * The images that are packed on the page name its id in their File::atlas (or their Folder::atlas).
+     */
     class Atlas
     {
     public:
@@ -265,6 +302,7 @@ public:
         Atlas(TiXmlElement* elem);
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
@@ -282,6 +320,7 @@ public:
             Folder(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
 
@@ -297,6 +336,7 @@ public:
                 Image(TiXmlElement* elem);
 
                 bool load(TiXmlElement* elem);
+                bool load(XML_Stream& stream);
                 void log(int recursive_depth = 0) const;
                 void clear();
 
@@ -316,13 +356,27 @@ public:
 
         Entity();
         Entity(TiXmlElement* elem);
+        ~Entity();
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
+        /*! \brief Gets the shared runtime data for this entity, building it on first use.
+         *
+         * The returned prototype is owned by this Data::Entity.  Call EntityPrototype::retain() to keep it beyond clear().
+         * \param quantized Whether to get the prototype whose timeline key transforms are stored as 16-bit steps (see
+         *        EntityPrototype).  Both kinds are built and kept separately.  Use SCML::Entity::setPrototype() to play one.
+         */
+        EntityPrototype* getPrototype(bool quantized = false);
+
         Meta_Data* meta_data;
 
+        /*! Lazily built runtime data, shared by all SCML::Entity instances of this entity */
+        EntityPrototype* prototype;
+        EntityPrototype* quantized_prototype;
+
         class Animation
         {
         public:
@@ -344,6 +398,7 @@ public:
                 Mainline(TiXmlElement* elem);
 
                 bool load(TiXmlElement* elem);
+                bool load(XML_Stream& stream);
                 void log(int recursive_depth = 0) const;
                 void clear();
 
@@ -362,6 +417,7 @@ public:
                     Key(TiXmlElement* elem);
 
                     bool load(TiXmlElement* elem);
+                    bool load(XML_Stream& stream);
                     void log(int recursive_depth = 0) const;
                     void clear();
 
@@ -451,6 +507,7 @@ public:
                         Bone(TiXmlElement* elem);
 
                         bool load(TiXmlElement* elem);
+                        bool load(XML_Stream& stream);
                         void log(int recursive_depth = 0) const;
                         void clear();
 
@@ -469,6 +526,7 @@ public:
                         Bone_Ref(TiXmlElement* elem);
 
                         bool load(TiXmlElement* elem);
+                        bool load(XML_Stream& stream);
                         void log(int recursive_depth = 0) const;
                         void clear();
                     };
@@ -523,6 +581,7 @@ public:
                         Object(TiXmlElement* elem);
 
                         bool load(TiXmlElement* elem);
+                        bool load(XML_Stream& stream);
                         void log(int recursive_depth = 0) const;
                         void clear();
 
@@ -542,6 +601,7 @@ public:
                         Object_Ref(TiXmlElement* elem);
 
                         bool load(TiXmlElement* elem);
+                        bool load(XML_Stream& stream);
                         void log(int recursive_depth = 0) const;
                         void clear();
                     };
@@ -558,6 +618,7 @@ public:
             Animation(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
 
@@ -578,6 +639,7 @@ public:
                 Timeline(TiXmlElement* elem);
 
                 bool load(TiXmlElement* elem);
+                bool load(XML_Stream& stream);
                 void log(int recursive_depth = 0) const;
                 void clear();
 
@@ -593,6 +655,8 @@ public:
                     SCML_STRING curve_type;
                     float c1;
                     float c2;
+                    float c3;
+                    float c4;
                     int spin;
 
                     bool has_object;
@@ -601,6 +665,7 @@ public:
                     Key(TiXmlElement* elem);
 
                     bool load(TiXmlElement* elem);
+                    bool load(XML_Stream& stream);
                     void log(int recursive_depth = 0) const;
                     void clear();
 
@@ -626,6 +691,7 @@ public:
                         Bone(TiXmlElement* elem);
 
                         bool load(TiXmlElement* elem);
+                        bool load(XML_Stream& stream);
                         void log(int recursive_depth = 0) const;
                         void clear();
                     };
@@ -676,6 +742,7 @@ public:
                         Object(TiXmlElement* elem);
 
                         bool load(TiXmlElement* elem);
+                        bool load(XML_Stream& stream);
                         void log(int recursive_depth = 0) const;
                         void clear();
 
@@ -698,6 +765,7 @@ public:
         Character_Map(TiXmlElement* elem);
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
@@ -716,6 +784,7 @@ public:
             Map(TiXmlElement* elem);
 
             bool load(TiXmlElement* elem);
+            bool load(XML_Stream& stream);
             void log(int recursive_depth = 0) const;
             void clear();
         };
@@ -738,6 +807,7 @@ public:
         Document_Info(TiXmlElement* elem);
 
         bool load(TiXmlElement* elem);
+        bool load(XML_Stream& stream);
         void log(int recursive_depth = 0) const;
         void clear();
 
@@ -754,6 +824,29 @@ class FileSystem
 {
 public:
 
+    /*! \brief Where an image is drawn from when it is packed on an atlas page.
+     *
+     * Packed images can be trimmed of their transparent border.  The region is then smaller than the original image
+     * and starts at (offset_x, offset_y) in it, from its top-left corner.
+     */
+    class Atlas_Region
+    {
+    public:
+
+        /*! Atlas id of the page */
+        int page;
+        /*! The rectangle on the page, in pixels from its top-left corner */
+        int x, y;
+        int width, height;
+        /*! The same rectangle in texture coordinates (0 to 1), from the top-left corner */
+        float u0, v0, u1, v1;
+        /*! Where the rectangle is in the original image */
+        int offset_x, offset_y;
+        int original_width, original_height;
+
+        Atlas_Region();
+    };
+
     virtual ~FileSystem() {}
 
     /*! \brief Loads all images referenced by the given SCML data.
@@ -761,6 +854,19 @@ public:
      */
     virtual void load(SCML::Data* data);
 
+    /*! \brief Loads all images referenced by the given compiled data.
+     * \param data Compiled data object
+     */
+    virtual void load(SCML::BinaryData* data);
+
+    /*! \brief Loads the sheets of a flipbook as atlas pages and places each of its frames on them.
+     *
+     * The frames are images of the flipbook's folder, so they can share a FileSystem with the SCML data that was
+     * baked.  Nothing is loaded if the renderer does not support atlas pages.
+     * \param flipbook Flipbook object
+     */
+    virtual void load(SCML::Flipbook* flipbook);
+
     /*! \brief Loads an image from a file and stores it so that the folderID and fileID can be used to reference the image.
      * \param folderID Integer folder ID
      * \param fileID Integer file ID
@@ -779,10 +885,60 @@ public:
      * \return A pair consisting of the width and height of the image.  Returns (0,0) on error.
      */
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const = 0;
+
+    /*! \brief Loads an atlas page and stores it so that the atlasID can be used to reference it.
+     *
+     * Renderers that draw from atlas pages override this and getAtlasPageDimensions().  When a page is loaded, its
+     * images are not loaded on their own.  They are drawn from their getAtlasRegion() of the page instead.
+     * \param atlasID Integer atlas ID
+     * \param filename Path of the page's image file
+     * \return true on success, false on failure (the default, which loads the images separately)
+     */
+    virtual bool loadAtlasPage(int atlasID, const SCML_STRING& filename)
+    {
+        return false;
+    }
+
+    /*! \brief Gets the dimensions of a loaded atlas page.  Returns (0,0) on error.
+     */
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const
+    {
+        return SCML_MAKE_PAIR(0, 0);
+    }
+
+    /*! \brief Gets where an image is on its atlas page.
+     *
+     * \return The region, or NULL if the image is not drawn from an atlas page.
+     */
+    const Atlas_Region* getAtlasRegion(int folderID, int fileID) const;
+
+    /*! \brief Gets the original dimensions of an image that is drawn from an atlas page.
+     *
+     * \return true and the dimensions if the image is on a page, otherwise false.
+     */
+    bool getAtlasImageDimensions(int folderID, int fileID, SCML_PAIR(unsigned int, unsigned int)& dimensions) const;
+
+protected:
+
+    /*! \brief Places an image on a loaded atlas page.
+     */
+    bool addAtlasRegion(int folderID, int fileID, int atlasID, int x, int y, int width, int height, int offset_x, int offset_y, int original_width, int original_height);
+
+    /*! \brief Forgets the atlas regions.  Renderers call this from clear().
+     */
+    void clearAtlasRegions();
+
+private:
+
+    SCML_VECTOR(Atlas_Region) atlas_regions;
+    /*! Index + 1 of each image's region (SCML_MAP_FIND gives 0 if there is none) */
+    SCML_MAP(SCML_PAIR(int, int), int) atlas_region_indices;
 };
 
 
 
+class Affine;
+
 /*! \brief The coordinate transform for a bone or object.
  */
 class Transform
@@ -801,64 +957,166 @@ class Transform
     
     void lerp(const Transform& transform, float t, int spin);
     void apply_parent_transform(const Transform& parent);
+
+    /*! \brief Same as apply_parent_transform(parent), but uses the parent's matrix instead of computing its sine and cosine again.
+     *
+     * \param parent The parent's transform
+     * \param parent_matrix Affine(parent)
+     */
+    void apply_parent_transform(const Transform& parent, const Affine& parent_matrix);
 };
 
 
-/*! \brief A class to directly interface with SCML character data and draw it (to be inherited).
+/*! \brief A 2x3 affine matrix: x' = a*x + c*y + tx, y' = b*x + d*y + ty
  *
- * Derived classes provide the means for the Entity to draw itself with a specific renderer.
+ * It is built from a composed Transform by the Spriter rules in "SCML notes.txt", so the sine and cosine of a bone's
+ * angle are only computed once.  Applying it to a child's position does the whole "scale, rotate, then translate" step
+ * of composing the child.
+ *
+ * The child's own matrix is built from its composed Transform again, not by multiplying the parent's matrix by the
+ * child's.  Spriter adds the angles and multiplies the scales, which a product of matrices would only match for
+ * uniform scales.
  */
-class Entity
+class Affine
+{
+    public:
+    
+    float a, b;
+    float c, d;
+    float tx, ty;
+    
+    /*! \brief Makes an identity matrix.
+     */
+    Affine();
+    
+    /*! \brief Makes the matrix that places the children of this transform (negating the angle if it is flipped).
+     */
+    Affine(const Transform& transform);
+    
+    void apply(float& x, float& y) const;
+    
+    /*! \brief Gets the matrix that applies the given matrix first and then this one.
+     */
+    Affine operator*(const Affine& matrix) const;
+    
+    /*! \brief Gets the corners of an image drawn with this matrix.
+     *
+     * \param width Width of the image
+     * \param height Height of the image
+     * \param pivot_x Pivot (x) as a fraction of the width, measured from the left
+     * \param pivot_y Pivot (y) as a fraction of the height, measured from the bottom
+     * \param corners Receives the top-left, top-right, bottom-right and bottom-left corners of the image as 4 (x, y) pairs.
+     */
+    void getQuad(float width, float height, float pivot_x, float pivot_y, float* corners) const;
+};
+
+
+/*! \brief A view of a contiguous array that is owned by someone else.
+ */
+template<typename T>
+class Span
 {
 public:
 
-    /*! Integer index of the SCML entity */
-    int entity;
-    /*! Integer index of the current SCML entity's animation */
-    int animation;
-    /*! Integer index of the current animation's current mainline keyframe */
-    int key;
+    T* data;
+    int size;
 
-    /*! Time (in milliseconds) tracking the position of the animation from its beginning. */
-    int time;
-    
-    class Bone_Transform_State
+    Span()
+        : data(NULL), size(0)
+    {}
+    Span(T* data, int size)
+        : data(data), size(size)
+    {}
+
+    T& operator[](int index) const
     {
-        public:
-        int entity;
-        int animation;
-        int key;
-        int nextKey;
-        int time;
-        
-        Transform base_transform;
-        SCML_VECTOR(Transform) transforms;
-        
-        Bone_Transform_State();
-        
-        bool should_rebuild(int entity, int animation, int key, int nextKeyID, int time, const Transform& base_transform);
-        void rebuild(int entity, int animation, int key, int nextKeyID, int time, Entity* entity_ptr, const Transform& base_transform);
-    };
-    
-    Bone_Transform_State bone_transform_state;
+        return data[index];
+    }
+};
+
+
+/*! \brief A range of values stored as 16-bit steps: value = min + step*q
+ */
+class Range
+{
+public:
+
+    float min;
+    float step;
+
+    Range();
+    Range(float min, float max);
+
+    unsigned short encode(float value) const;
+    float decode(unsigned short q) const;
+};
+
+
+/*! \brief Immutable animation data shared by every Entity created from the same SCML::Data::Entity.
+ *
+ * A prototype is built once per SCML::Data::Entity (see SCML::Data::Entity::getPrototype()) and is reference-counted,
+ * so creating another Entity only costs a retain() instead of a deep copy of every animation key.
+ *
+ * All records are stored in flat arrays sorted by id.  Spriter ids are dense (0..N-1), so a record is normally found
+ * at the index of its id without any searching.  Records refer to each other by index rather than by pointer.
+ *
+ * The records are plain data made only of 4-byte fields, with strings stored as offsets into a string table.
+ * This lets SCML::BinaryData write them to disk and map them back in place.  The transform of each timeline key is
+ * stored apart from the rest of its fields (its style), so evaluating the bones of many entities touches as little
+ * memory as possible.  A quantized prototype (see SCML::Data::Entity::getPrototype()) stores the transforms as 16-bit
+ * steps across each animation's ranges instead of as floats, which halves them again but loses some precision.
+ */
+class EntityPrototype
+{
+public:
 
+    /*! Integer index of the SCML entity that this prototype was built from */
+    int id;
     SCML_STRING name;
 
-    class Animation;
-    SCML_MAP(int, Animation*) animations;
+    /*! Whether the transforms of the timeline keys are stored as 16-bit steps */
+    bool quantized;
+    /*! Largest difference between the quantized transforms of the timeline keys and the SCML data (0 unless
+     * quantized).  Positions are in pixels, angles in degrees and scales are factors.
+     */
+    float max_position_error;
+    float max_angle_error;
+    float max_scale_error;
 
-    //Meta_Data* meta_data;
+    EntityPrototype(SCML::Data::Entity* entity, bool quantized = false);
+
+    /*! \brief Adds a reference to this prototype.
+     */
+    void retain();
+
+    /*! \brief Removes a reference to this prototype and deletes it when the last reference is gone.
+     */
+    void release();
+
+    int getRefCount() const;
+
+    /*! \brief Gets a string from the string table.
+     *
+     * \param offset A string field of one of the records (e.g. Animation::name)
+     */
+    const char* getString(int offset) const;
 
-    /*! \brief Stores all of the data that the Entity needs to update and draw itself, independent of the definition in SCML::Data.
+    /*! \brief Stores all of the data that an Entity needs to update and draw itself, independent of the definition in SCML::Data.
      */
     class Animation
     {
     public:
 
+        /*! \brief What an animation does after its end: Stop there, restart at its loop_to key, or play back toward it.
+         */
+        enum Loop_Mode { LOOP_FALSE, LOOP_TRUE, LOOP_PING_PONG };
+
         int id;
-        SCML_STRING name;
+        int name;  // string offset
         int length;
-        SCML_STRING looping;
+        int looping;  // string offset
+        /*! looping, resolved to a Loop_Mode */
+        int loop_mode;
         int loop_to;
 
         //Meta_Data* meta_data;
@@ -867,13 +1125,6 @@ public:
         {
         public:
 
-            Mainline(SCML::Data::Entity::Animation::Mainline* mainline);
-
-            void clear();
-
-            class Key;
-            SCML_MAP(int, Key*) keys;
-
             class Key
             {
             public:
@@ -882,73 +1133,73 @@ public:
                 int time;
                 //Meta_Data* meta_data;
 
-                Key(SCML::Data::Entity::Animation::Mainline::Key* key);
-
-                void clear();
+                /*! Span of this key's bones in Mainline::bone_slots, sorted by bone id */
+                int first_bone;
+                int num_bones;
+                /*! Span of this key's objects in Mainline::object_slots, sorted by object id */
+                int first_object;
+                int num_objects;
+                /*! Start of this key's drawing order in Mainline::draw_order, or -1 if its objects are already in z_index order */
+                int first_draw;
 
-                class Object;
-                class Object_Ref;
+                Key(SCML::Data::Entity::Animation::Mainline::Key* key);
 
+                /*! \brief An object slot of a mainline key.  Exactly one of the indices is valid (>= 0).
+                 */
                 class Object_Container
                 {
                 public:
-                    Object* object;
-                    Object_Ref* object_ref;
+                    int id;
+                    /*! Index into Mainline::objects */
+                    int object;
+                    /*! Index into Mainline::object_refs */
+                    int object_ref;
 
                     Object_Container()
-                        : object(NULL), object_ref(NULL)
-                    {}
-                    Object_Container(Object* object)
-                        : object(object), object_ref(NULL)
+                        : id(-1), object(-1), object_ref(-1)
                     {}
-                    Object_Container(Object_Ref* object_ref)
-                        : object(NULL), object_ref(object_ref)
+                    Object_Container(int id, int object, int object_ref)
+                        : id(id), object(object), object_ref(object_ref)
                     {}
 
                     bool hasObject() const
                     {
-                        return (object != NULL);
+                        return (object >= 0);
                     }
                     bool hasObject_Ref() const
                     {
-                        return (object_ref != NULL);
+                        return (object_ref >= 0);
                     }
                 };
 
-                SCML_MAP(int, Object_Container) objects;
-
-
-                class Bone;
-                class Bone_Ref;
-
+                /*! \brief A bone slot of a mainline key.  Exactly one of the indices is valid (>= 0).
+                 */
                 class Bone_Container
                 {
                 public:
-                    Bone* bone;
-                    Bone_Ref* bone_ref;
+                    int id;
+                    /*! Index into Mainline::bones */
+                    int bone;
+                    /*! Index into Mainline::bone_refs */
+                    int bone_ref;
 
                     Bone_Container()
-                        : bone(NULL), bone_ref(NULL)
+                        : id(-1), bone(-1), bone_ref(-1)
                     {}
-                    Bone_Container(Bone* bone)
-                        : bone(bone), bone_ref(NULL)
-                    {}
-                    Bone_Container(Bone_Ref* bone_ref)
-                        : bone(NULL), bone_ref(bone_ref)
+                    Bone_Container(int id, int bone, int bone_ref)
+                        : id(id), bone(bone), bone_ref(bone_ref)
                     {}
 
                     bool hasBone() const
                     {
-                        return (bone != NULL);
+                        return (bone >= 0);
                     }
                     bool hasBone_Ref() const
                     {
-                        return (bone_ref != NULL);
+                        return (bone_ref >= 0);
                     }
                 };
 
-                SCML_MAP(int, Bone_Container) bones;
-
 
                 class Bone
                 {
@@ -969,8 +1220,6 @@ public:
 
                     Bone(SCML::Data::Entity::Animation::Mainline::Key::Bone* bone);
 
-                    void clear();
-
                 };
 
                 class Bone_Ref
@@ -983,8 +1232,6 @@ public:
                     int key;
 
                     Bone_Ref(SCML::Data::Entity::Animation::Mainline::Key::Bone_Ref* bone_ref);
-
-                    void clear();
                 };
 
                 class Object
@@ -993,13 +1240,13 @@ public:
 
                     int id;
                     int parent; // a bone id
-                    SCML_STRING object_type;
+                    int object_type;  // string offset
                     int atlas;
                     int folder;
                     int file;
-                    SCML_STRING usage;
-                    SCML_STRING blend_mode;
-                    SCML_STRING name;
+                    int usage;  // string offset
+                    int blend_mode;  // string offset
+                    int name;  // string offset
                     float x;
                     float y;
                     float pivot_x;
@@ -1017,8 +1264,8 @@ public:
                     float g;
                     float b;
                     float a;
-                    SCML_STRING variable_type;
-                    SCML_STRING value_string;
+                    int variable_type;  // string offset
+                    int value_string;  // string offset
                     int value_int;
                     int min_int;
                     int max_int;
@@ -1033,9 +1280,7 @@ public:
 
                     //Meta_Data* meta_data;
 
-                    Object(SCML::Data::Entity::Animation::Mainline::Key::Object* object);
-
-                    void clear();
+                    Object(SCML::Data::Entity::Animation::Mainline::Key::Object* object, EntityPrototype* prototype);
 
                 };
 
@@ -1050,21 +1295,71 @@ public:
                     int z_index;
 
                     Object_Ref(SCML::Data::Entity::Animation::Mainline::Key::Object_Ref* object_ref);
-
-                    void clear();
                 };
             };
 
-        };
+            Span<Key> keys;
 
-        Mainline mainline;
+            Span<Key::Bone_Container> bone_slots;
+            Span<Key::Object_Container> object_slots;
 
-        class Timeline;
-        SCML_MAP(int, Timeline*) timelines;
+            Span<Key::Bone> bones;
+            Span<Key::Bone_Ref> bone_refs;
+            Span<Key::Object> objects;
+            Span<Key::Object_Ref> object_refs;
 
-        Animation(SCML::Data::Entity::Animation* animation);
+            /*! Object slots of the keys that need one, in drawing order (as offsets from Key::first_object) */
+            Span<int> draw_order;
 
-        void clear();
+            Key* getKey(int key);
+
+            /*! \brief Finds the key that is showing at the given time: the last key that starts at or before it.
+             *
+             * Keys are stored in time order, so this is a binary search.
+             * \return The key or NULL if there are no keys.
+             */
+            Key* getKeyAtTime(int time);
+
+            /*! \brief Finds the bone slot with the given bone id in a key's span.
+             *
+             * \return The slot or NULL if the key has no such bone.
+             */
+            Key::Bone_Container* getBoneSlot(const Key* key, int bone);
+
+            /*! \brief Finds the object slot with the given object id in a key's span.
+             *
+             * \return The slot or NULL if the key has no such object.
+             */
+            Key::Object_Container* getObjectSlot(const Key* key, int object);
+
+            Key::Bone* getBone(const Key::Bone_Container& slot)
+            {
+                return (slot.bone < 0? NULL : &bones[slot.bone]);
+            }
+            Key::Bone_Ref* getBoneRef(const Key::Bone_Container& slot)
+            {
+                return (slot.bone_ref < 0? NULL : &bone_refs[slot.bone_ref]);
+            }
+            Key::Object* getObject(const Key::Object_Container& slot)
+            {
+                return (slot.object < 0? NULL : &objects[slot.object]);
+            }
+            Key::Object_Ref* getObjectRef(const Key::Object_Container& slot)
+            {
+                return (slot.object_ref < 0? NULL : &object_refs[slot.object_ref]);
+            }
+
+            /*! \brief Gets the object slot of a key that is drawn i-th.  Objects are drawn in order of z_index, then of id.
+             */
+            Key::Object_Container& getDrawSlot(const Key* key, int i)
+            {
+                return object_slots[key->first_object + (key->first_draw < 0? i : draw_order[key->first_draw + i])];
+            }
+        };
+
+        Mainline mainline;
+
+        Animation();
 
 
 
@@ -1073,40 +1368,60 @@ public:
         public:
 
             int id;
-            SCML_STRING name;
-            SCML_STRING object_type;
-            SCML_STRING variable_type;
-            SCML_STRING usage;
+            int name;  // string offset
+            int object_type;  // string offset
+            int variable_type;  // string offset
+            int usage;  // string offset
             //Meta_Data* meta_data;
 
-            Timeline(SCML::Data::Entity::Animation::Timeline* timeline);
+            /*! Span of this timeline's keys in Animation::timeline_keys, sorted by key id */
+            int first_key;
+            int num_keys;
 
-            void clear();
-
-            class Key;
-            SCML_MAP(int, Key*) keys;
+            Timeline(SCML::Data::Entity::Animation::Timeline* timeline, EntityPrototype* prototype);
 
             class Key
             {
             public:
 
+                /*! \brief Spriter's tweening curves, which reshape the tweening factor from this key to the next one.
+                 */
+                enum Curve_Type { CURVE_INSTANT, CURVE_LINEAR, CURVE_QUADRATIC, CURVE_CUBIC, CURVE_QUARTIC, CURVE_QUINTIC, CURVE_BEZIER };
+
+                /*! Number of segments that a bezier curve is sampled in, evenly spaced in time */
+                enum { CURVE_SEGMENTS = 256 };
+
                 int id;
                 int time;
-                SCML_STRING curve_type;
+                int curve_type;  // string offset
                 float c1;
                 float c2;
+                float c3;
+                float c4;
+                /*! curve_type, resolved to a Curve_Type */
+                int curve;
+                /*! For a bezier curve, the first of its CURVE_SEGMENTS+1 samples in Animation::curve_samples, otherwise -1 */
+                int curve_samples;
                 int spin;
 
-                bool has_object;
+                int has_object;
+                /*! Index of the key's Pose in Animation::object_poses if has_object, otherwise in Animation::bone_poses (or
+                 * of its Packed_Pose in the packed_ arrays if the animation is quantized)
+                 */
+                int pose;
+                /*! Index of the key's style in Animation::object_styles if has_object, otherwise in Animation::bone_styles */
+                int style;
 
-                Key(SCML::Data::Entity::Animation::Timeline::Key* key);
-
-                void clear();
+                Key(SCML::Data::Entity::Animation::Timeline::Key* key, EntityPrototype* prototype);
 
 
                 //Meta_Data_Tweenable* meta_data;
 
-                class Bone
+                /*! \brief The transform of a bone or object key (see Animation::getPose()).
+                 *
+                 * This is all that evaluating the bones reads besides the key itself, so it is kept apart from the styles.
+                 */
+                class Pose
                 {
                 public:
 
@@ -1115,20 +1430,38 @@ public:
                     float angle;
                     float scale_x;
                     float scale_y;
+                };
+
+                /*! \brief The transform of a bone or object key as 16-bit steps of its animation's ranges, in quantized prototypes.
+                 */
+                class Packed_Pose
+                {
+                public:
+
+                    unsigned short x;
+                    unsigned short y;
+                    unsigned short angle;
+                    unsigned short scale_x;
+                    unsigned short scale_y;
+                };
+
+                /*! \brief The fields of a bone key besides its transform.  Consecutive keys of a timeline share equal ones.
+                 */
+                class Bone_Style
+                {
+                public:
+
                     float r;
                     float g;
                     float b;
                     float a;
-                    //Meta_Data_Tweenable* meta_data;
 
-                    Bone(SCML::Data::Entity::Animation::Timeline::Key::Bone* bone);
-
-                    void clear();
+                    Bone_Style(SCML::Data::Entity::Animation::Timeline::Key::Bone* bone);
                 };
 
-                Bone bone;
-
-                class Object
+                /*! \brief The fields of an object key besides its transform.  Consecutive keys of a timeline share equal ones.
+                 */
+                class Object_Style
                 {
                 public:
 
@@ -1137,24 +1470,19 @@ public:
                     int folder;
                     int file;
                     //SCML_STRING usage;  // Does this exist?
-                    SCML_STRING name;
-                    float x;
-                    float y;
+                    int name;  // string offset
                     float pivot_x;
                     float pivot_y;
                     // pixel_art_mode stuff?
-                    float angle;
                     float w;
                     float h;
-                    float scale_x;
-                    float scale_y;
                     float r;
                     float g;
                     float b;
                     float a;
-                    SCML_STRING blend_mode;
+                    int blend_mode;  // string offset
                     //SCML_STRING variable_type; // Does this exist?
-                    SCML_STRING value_string;
+                    int value_string;  // string offset
                     int value_int;
                     int min_int;
                     int max_int;
@@ -1168,75 +1496,563 @@ public:
                     float panning;
                     //Meta_Data_Tweenable* meta_data;
 
-                    Object(SCML::Data::Entity::Animation::Timeline::Key::Object* object);
-
-                    void clear();
-
+                    Object_Style(SCML::Data::Entity::Animation::Timeline::Key::Object* object, EntityPrototype* prototype);
                 };
-
-                Object object;
             };
         };
+
+        Span<Timeline> timelines;
+        Span<Timeline::Key> timeline_keys;
+        /*! Sample tables of the bezier curves of timeline_keys.  Keys with the same control points share one. */
+        Span<float> curve_samples;
+        /*! Transforms and styles of the bone keys and object keys of timeline_keys */
+        Span<Timeline::Key::Pose> bone_poses;
+        Span<Timeline::Key::Pose> object_poses;
+        Span<Timeline::Key::Bone_Style> bone_styles;
+        Span<Timeline::Key::Object_Style> object_styles;
+
+        /*! Whether the transforms are in packed_bone_poses and packed_object_poses instead of bone_poses and object_poses */
+        bool quantized;
+        Span<Timeline::Key::Packed_Pose> packed_bone_poses;
+        Span<Timeline::Key::Packed_Pose> packed_object_poses;
+        /*! Ranges of the packed poses' positions, angles and scales (x and y share one) */
+        Range position_x, position_y;
+        Range angle;
+        Range scale;
+
+        Timeline* getTimeline(int timeline);
+        Timeline::Key* getTimelineKey(int timeline, int key);
+
+        /*! \brief Decodes the transform of a bone or object key.
+         */
+        Transform getPose(const Timeline::Key& key) const;
+
+        /*! \brief Applies the curve of a timeline key to a tweening factor.
+         *
+         * \param key The key that is tweened from
+         * \param t Linear tweening factor, from 0 at the key to 1 at the next one
+         * \return The tweening factor to lerp with
+         */
+        float applyCurve(const Timeline::Key& key, float t) const;
+
+        /*! \brief Finds the key of a timeline that is showing at the given time, with a binary search.
+         */
+        Timeline::Key* getTimelineKeyAtTime(int timeline, int time);
     };
 
+    SCML_VECTOR(Animation) animations;
 
+    Animation* getAnimation(int animation);
 
-    Entity();
-    Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
-    virtual ~Entity();
+    /*! \brief Adds a string to the string table while the prototype is being built.
+     *
+     * \return The offset of the string
+     */
+    int addString(const SCML_STRING& str);
 
-    virtual void load(SCML::Data* data);
+private:
 
-    virtual void clear();
+    friend class BinaryData;
 
-    /*! \brief Converts the given values from the renderer-specific coordinate system to the SCML coordinate system.
-     *        SCML coords: +x to the right, +y up, +angle counter-clockwise
-     *
-     * \param x x-position in renderer coordinate system
-     * \param y y-position in renderer coordinate system
-     * \param angle Angle (in degrees) in renderer coordinate system
-     */
-    virtual void convert_to_SCML_coords(float& x, float& y, float& angle)
-    {}
+    int ref_count;
 
-    /*! \brief Gets the dimensions of an image (from a FileSystem, presumably)
+    /*! \brief Storage for the records when the prototype is built from SCML::Data.
      *
-     * \param folderID Integer folder ID of the image
-     * \param fileID Integer file ID of the image
-     * \return A pair consisting of the width and height of the image.  Returns (0,0) on error.
+     * Prototypes that are loaded by SCML::BinaryData use the mapped file instead and have none.
      */
-    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const = 0;
+    class Storage
+    {
+    public:
 
-    /*! \brief Updates the state of the entity, incrementing its timer and changing the keyframe.
-     *
-     * \param dt_ms Change in time since last update, in milliseconds
-     */
-    virtual void update(int dt_ms);
+        SCML_VECTOR(Animation::Mainline::Key) keys;
+        SCML_VECTOR(Animation::Mainline::Key::Bone_Container) bone_slots;
+        SCML_VECTOR(Animation::Mainline::Key::Object_Container) object_slots;
+        SCML_VECTOR(Animation::Mainline::Key::Bone) bones;
+        SCML_VECTOR(Animation::Mainline::Key::Bone_Ref) bone_refs;
+        SCML_VECTOR(Animation::Mainline::Key::Object) objects;
+        SCML_VECTOR(Animation::Mainline::Key::Object_Ref) object_refs;
+        SCML_VECTOR(int) draw_order;
+        SCML_VECTOR(Animation::Timeline) timelines;
+        SCML_VECTOR(Animation::Timeline::Key) timeline_keys;
+        SCML_VECTOR(float) curve_samples;
+        SCML_VECTOR(Animation::Timeline::Key::Pose) bone_poses;
+        SCML_VECTOR(Animation::Timeline::Key::Pose) object_poses;
+        SCML_VECTOR(Animation::Timeline::Key::Packed_Pose) packed_bone_poses;
+        SCML_VECTOR(Animation::Timeline::Key::Packed_Pose) packed_object_poses;
+        SCML_VECTOR(Animation::Timeline::Key::Bone_Style) bone_styles;
+        SCML_VECTOR(Animation::Timeline::Key::Object_Style) object_styles;
+        SCML_VECTOR(char) strings;
+        SCML_MAP(SCML_STRING, int) string_offsets;
+    };
 
-    /*! \brief Draws the entity using a specific renderer by calling draw_internal().
-     *
-     * \param x x-position in renderer coordinate system
-     * \param y y-position in renderer coordinate system
-     * \param angle Angle (in degrees) in renderer coordinate system
-     * \param scale_x Scale factor in the x-direction
-     * \param scale_y Scale factor in the y-direction
-     */
-    virtual void draw(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+    Storage* storage;
+    Span<char> strings;
 
-    virtual void draw_simple_object(Animation::Mainline::Key::Object* obj);
-    virtual void draw_tweened_object(Animation::Mainline::Key::Object_Ref* ref1, Animation::Mainline::Key::Object_Ref* ref2);
+    EntityPrototype();
 
-    /*! \brief Draws an image using a specific renderer.
-     *
-     * \param folderID Integer folder ID of the image
-     * \param fileID Integer file ID of the image
-     * \param x x-position in SCML coordinate system
-     * \param y y-position in SCML coordinate system
-     * \param angle Angle (in degrees) in SCML coordinate system
-     * \param scale_x Scale factor in the x-direction
-     * \param scale_y Scale factor in the y-direction
-     */
-    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y) = 0;
+    // Prototypes are shared, so only release() may delete them and they are never copied.
+    ~EntityPrototype();
+    EntityPrototype(const EntityPrototype& copy);
+    EntityPrototype& operator=(const EntityPrototype& copy);
+};
+
+
+/*! \brief Compiled animation data (.scmlb) that is memory-mapped and used in place.
+ *
+ * A .scmlb file holds the EntityPrototype records of every entity in a SCML file, plus the table of image files.
+ * Loading it maps the file and points the prototypes' arrays straight into it, so no parsing or per-key allocation is done.
+ * Files are written by BinaryData::write() (see the scmlc tool) in little-endian byte order and carry a format version.
+ *
+ * The BinaryData must outlive every Entity that uses one of its prototypes.
+ */
+class BinaryData
+{
+public:
+
+    /*! Path of the loaded file, used to find the image files */
+    SCML_STRING name;
+
+    /*! \brief An image file referenced by the compiled data.
+     */
+    class File
+    {
+    public:
+
+        int folder;
+        int file;
+        int type;  // string offset
+        int name;  // string offset
+        int width;
+        int height;
+        float pivot_x;
+        float pivot_y;
+        /*! Atlas id of the page that holds the image, or -1, and where it is on the page (see Data::Folder::File) */
+        int atlas;
+        int atlas_x;
+        int atlas_y;
+        int offset_x;
+        int offset_y;
+        int original_width;
+        int original_height;
+    };
+
+    /*! \brief An atlas page referenced by the compiled data.
+     */
+    class Atlas_Page
+    {
+    public:
+
+        int atlas;
+        int image_path;  // string offset
+    };
+
+    BinaryData();
+    BinaryData(const SCML_STRING& file);
+    ~BinaryData();
+
+    /*! \brief Maps a .scmlb file.
+     *
+     * \param file Path of the file
+     * \return true on success, false if the file could not be read or is not a compatible .scmlb file
+     */
+    bool load(const SCML_STRING& file);
+
+    /*! \brief Releases the prototypes and unmaps the file.
+     */
+    void clear();
+
+    /*! \brief Compiles SCML data into a .scmlb file.
+     *
+     * \param data SCML data object
+     * \param file Path of the file to write
+     * \param quantized Whether to write the quantized prototypes (see SCML::Data::Entity::getPrototype())
+     * \return true on success, false on failure
+     */
+    static bool write(SCML::Data* data, const SCML_STRING& file, bool quantized = false);
+
+    int getNumEntities() const;
+
+    /*! \brief Gets the prototype of an entity.
+     *
+     * \param entity Integer entity ID
+     * \return The prototype (owned by this BinaryData and pointing into its file) or NULL if there is no such entity.
+     */
+    EntityPrototype* getPrototype(int entity) const;
+
+    /*! \brief Gets the prototype at the given position, in order of entity ID.
+     */
+    EntityPrototype* getPrototypeByIndex(int index) const;
+
+    int getNumFiles() const;
+    const File* getFile(int index) const;
+    int getNumAtlasPages() const;
+    const Atlas_Page* getAtlasPage(int index) const;
+    const char* getString(int offset) const;
+
+private:
+
+    char* buffer;
+    int size;
+
+    Span<File> files;
+    Span<Atlas_Page> atlas_pages;
+    Span<char> strings;
+    SCML_VECTOR(EntityPrototype*) prototypes;
+
+    BinaryData(const BinaryData& copy);
+    BinaryData& operator=(const BinaryData& copy);
+};
+
+
+/*! \brief Draw commands from one or more entities, for a renderer to submit all at once.
+ *
+ * Entity::buildDrawList() appends commands here instead of calling draw_internal() for each object.  The commands are
+ * plain data, so the lists of many entities can be built anywhere (e.g. on worker threads), concatenated with
+ * append(), and then sorted or batched by the renderer's Entity::submit().
+ *
+ * Each command gets a sort key from the list's layer and depth, its z_index and its texture.  sort() orders a whole
+ * scene by these keys, so that the commands that use the same texture end up next to each other wherever the drawing
+ * order allows it.
+ */
+class DrawList
+{
+public:
+
+    enum Blend_Mode { BLEND_ALPHA, BLEND_ADDITIVE, BLEND_MULTIPLY, BLEND_SCREEN };
+
+    /*! \brief One image to draw.  Positions are in the SCML coordinate system (+x to the right, +y up).
+     */
+    class Command
+    {
+    public:
+
+        /*! Texture key: The folder and file IDs of the image */
+        int folder;
+        int file;
+
+        /*! The center of the image, as passed to Entity::draw_internal() */
+        float x, y;
+        float angle;
+        float scale_x, scale_y;
+
+        /*! Top-left, top-right, bottom-right and bottom-left corners of the image as 4 (x, y) pairs (see Affine::getQuad()) */
+        float corners[8];
+
+        /*! Tint color and opacity, from 0 to 1 */
+        float r, g, b, a;
+        /*! A Blend_Mode */
+        int blend_mode;
+        /*! The object's z_index.  Within an entity, commands are appended in drawing order. */
+        int z;
+        /*! What sort() orders the commands by: layer, depth, z and texture, from the most significant bits down */
+        unsigned long long sort_key;
+    };
+
+    /*! \brief Where and how to draw a command as a textured quad, for renderers that build their own vertices.
+     */
+    class Quad
+    {
+    public:
+
+        /*! Atlas id of the page to draw from, or -1 to draw from the command's own image */
+        int page;
+        /*! Top-left, top-right, bottom-right and bottom-left corners in the renderer's coordinate system (+y down) */
+        float x[4], y[4];
+        /*! Texture coordinates of the corners in pixels */
+        float u[4], v[4];
+        /*! Texture coordinates of the corners from 0 to 1 */
+        float s[4], t[4];
+    };
+
+    SCML_VECTOR(Command) commands;
+
+    /*! Layer (0 to 255) and depth (-32768 to 32767) of the commands that are added next.  Lower ones are drawn first by sort().
+     *  Set them before building each entity's commands.  AnimationWorld::Instance::buildDrawList() does.
+     */
+    int layer;
+    int depth;
+
+    DrawList();
+
+    int size() const;
+    bool empty() const;
+    void clear();
+
+    Command& operator[](int index);
+    const Command& operator[](int index) const;
+
+    /*! \brief Adds all of the commands of another list to the end of this one.
+     */
+    void append(const DrawList& list);
+
+    /*! \brief Gets the quad of a command, with the texture coordinates of its atlas region or of its whole image.
+     *
+     * \param index Index of the command
+     * \param file_system Where the command's image was loaded
+     * \param quad The result
+     * \return false if the image is not loaded
+     */
+    bool getQuad(int index, const FileSystem& file_system, Quad& quad) const;
+
+    /*! \brief Sorts the commands by their sort keys with a radix sort.
+     *
+     * Commands with the same key keep their order, so each entity's objects stay in drawing order.  The objects of
+     * entities with the same layer and depth are interleaved by z_index and grouped by texture, which lets a renderer
+     * batch them.  Give entities that overlap different depths to keep each one's objects together.
+     */
+    void sort();
+
+    /*! \brief Converts a blend_mode string from the SCML data ("alpha", "additive", "multiply" or "screen").  Unknown modes are BLEND_ALPHA.
+     */
+    static Blend_Mode toBlendMode(const char* name);
+
+    /*! \brief Makes the sort key of a command.  Values out of range are clamped, and only the low 12 bits of the folder and file are used.
+     */
+    static unsigned long long makeSortKey(int layer, int depth, int z, int folder, int file);
+
+private:
+
+    class Sort_Item
+    {
+    public:
+
+        unsigned long long key;
+        int index;
+    };
+
+    // Reused by sort()
+    SCML_VECTOR(Sort_Item) sort_items;
+    SCML_VECTOR(Sort_Item) sort_scratch;
+    SCML_VECTOR(Command) sorted_commands;
+};
+
+
+/*! \brief A class to directly interface with SCML character data and draw it (to be inherited).
+ *
+ * Derived classes provide the means for the Entity to draw itself with a specific renderer.
+ */
+class Entity
+{
+public:
+
+    /*! Integer index of the SCML entity */
+    int entity;
+    /*! Integer index of the current SCML entity's animation */
+    int animation;
+    /*! Integer index of the current animation's current mainline keyframe */
+    int key;
+
+    /*! Time (in milliseconds) tracking the position of the animation from its beginning. */
+    int time;
+    /*! Whether a ping_pong animation is playing backward, from its end toward its loop_to key.  time is still the position. */
+    bool reversed;
+    
+    typedef EntityPrototype::Animation Animation;
+    
+    class Bone_Transform_State
+    {
+        public:
+        int entity;
+        int animation;
+        int key;
+        int nextKey;
+        int time;
+        
+        Transform base_transform;
+        SCML_VECTOR(Transform) transforms;
+        
+        /*! Affine(base_transform) and Affine(transforms[i]), so the bones' children do not compute their sine and cosine again */
+        Affine base_matrix;
+        SCML_VECTOR(Affine) matrices;
+        
+        Bone_Transform_State();
+        
+        bool should_rebuild(int entity, int animation, int key, int nextKeyID, int time, const Transform& base_transform);
+        void rebuild(int entity, int animation, int key, int nextKeyID, int time, Entity* entity_ptr, const Transform& base_transform);
+    };
+    
+    Bone_Transform_State bone_transform_state;
+    
+    /*! \brief An object of the current key, placed by its bone and ready to be drawn.
+     */
+    class Sprite
+    {
+        public:
+        int folder;
+        int file;
+        
+        /*! The object's composed transform, positioned at its pivot */
+        Transform transform;
+        /*! Affine(transform) */
+        Affine matrix;
+        
+        /*! Image dimensions and the (tweened) pivot as fractions of them */
+        float width, height;
+        float pivot_x, pivot_y;
+        
+        /*! (Tweened) tint color and opacity */
+        float r, g, b, a;
+        /*! A DrawList::Blend_Mode */
+        int blend_mode;
+        int z_index;
+        
+        Sprite();
+        
+        /*! \brief Gets the transform of the center of the image, as passed to draw_internal().
+         */
+        Transform getDrawTransform() const;
+        
+        /*! \brief Gets the corners of the image in the SCML coordinate system (see Affine::getQuad()).
+         */
+        void getQuad(float* corners) const;
+    };
+
+    /*! Shared, read-only animation data.  The Entity itself only holds the playback state. */
+    EntityPrototype* prototype;
+    
+    /*! Poses to draw instead of tweening the keys, or NULL (see setBakedPoses()) */
+    BakedPoses* baked_poses;
+
+
+
+    Entity();
+    Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
+    virtual ~Entity();
+
+    virtual void load(SCML::Data* data);
+    virtual void load(SCML::BinaryData* data);
+
+    /*! \brief Makes this Entity play the animations of the given prototype, retaining it.
+     *
+     * \param prototype Shared animation data, or NULL to detach this Entity.
+     */
+    void setPrototype(EntityPrototype* prototype);
+    
+    /*! \brief Makes this Entity draw from pre-sampled poses instead of tweening its keys.
+     *
+     * The poses are shared and must outlive the Entity.  They are only used while they were baked from this Entity's
+     * prototype.  draw(), buildDrawList(), getBoneTransform() and getObjectSprite() then read the baked frames.
+     * \param poses Poses baked from an Entity with the same prototype, or NULL to go back to tweening the keys.
+     */
+    void setBakedPoses(BakedPoses* poses);
+    
+    /*! \brief Gets the baked poses that this Entity draws from, or NULL if it tweens its keys.
+     */
+    BakedPoses* getBakedPoses() const;
+
+    virtual void clear();
+
+    /*! \brief Converts the given values from the renderer-specific coordinate system to the SCML coordinate system.
+     *        SCML coords: +x to the right, +y up, +angle counter-clockwise
+     *
+     * \param x x-position in renderer coordinate system
+     * \param y y-position in renderer coordinate system
+     * \param angle Angle (in degrees) in renderer coordinate system
+     */
+    virtual void convert_to_SCML_coords(float& x, float& y, float& angle)
+    {}
+
+    /*! \brief Gets the dimensions of an image (from a FileSystem, presumably)
+     *
+     * \param folderID Integer folder ID of the image
+     * \param fileID Integer file ID of the image
+     * \return A pair consisting of the width and height of the image.  Returns (0,0) on error.
+     */
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const = 0;
+
+    /*! \brief Gets where an image is on its atlas page (from a FileSystem, presumably)
+     *
+     * Sprites of images that are trimmed on their page get the size of the region, with their pivot moved to match,
+     * so draw_internal() is given the center of the region instead of the center of the original image.
+     * \return The region, or NULL if the image is a separate image file (the default).
+     */
+    virtual const FileSystem::Atlas_Region* getAtlasRegion(int folderID, int fileID) const
+    {
+        return NULL;
+    }
+
+    /*! \brief Updates the state of the entity, incrementing its timer and changing the keyframe.
+     *
+     * \param dt_ms Change in time since last update, in milliseconds
+     */
+    virtual void update(int dt_ms);
+
+    /*! \brief Moves to the given time in the current animation, choosing the keyframe with a binary search.
+     *
+     * \param time_ms Time since the start of the animation, in milliseconds.  It is wrapped or clamped according to the animation's looping setting.
+     *                A ping_pong animation plays backward after its length, so e.g. length + 100 is 100 ms before the end.
+     */
+    void setTime(int time_ms);
+
+    /*! \brief Moves the current animation forward (or backward) by any amount of time.
+     *
+     * Unlike stepping one keyframe at a time, a large step lands on the right keyframe and loop.
+     * \param dt_ms Change in time, in milliseconds
+     */
+    void advance(int dt_ms);
+
+    /*! \brief Brings bone_transform_state up to date for drawing the entity at this position, without drawing it.
+     *
+     * This is the evaluation half of draw().  It does not call draw_internal(), so it can run away from the renderer,
+     * e.g. on a worker thread or on a server that only needs getBoneTransform() and getObjectSprite() for hit boxes.
+     *
+     * \param x x-position in renderer coordinate system
+     * \param y y-position in renderer coordinate system
+     * \param angle Angle (in degrees) in renderer coordinate system
+     * \param scale_x Scale factor in the x-direction
+     * \param scale_y Scale factor in the y-direction
+     */
+    void evaluate(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+    
+    /*! \brief Draws the entity using a specific renderer by calling draw_internal().
+     *
+     * \param x x-position in renderer coordinate system
+     * \param y y-position in renderer coordinate system
+     * \param angle Angle (in degrees) in renderer coordinate system
+     * \param scale_x Scale factor in the x-direction
+     * \param scale_y Scale factor in the y-direction
+     */
+    virtual void draw(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+
+    /*! \brief Appends a command for each object of the current key to a draw list, in drawing order.
+     *
+     * The bones must already be up to date, from evaluate() or AnimationWorld::evaluate().  Nothing is drawn, so this
+     * can run away from the renderer.  Pass the list to submit() afterward.
+     */
+    void buildDrawList(DrawList& list);
+    
+    /*! \brief Evaluates the entity at this position and appends its draw commands.
+     *
+     * \param list The list to append to
+     * \param x x-position in renderer coordinate system
+     * \param y y-position in renderer coordinate system
+     * \param angle Angle (in degrees) in renderer coordinate system
+     * \param scale_x Scale factor in the x-direction
+     * \param scale_y Scale factor in the y-direction
+     */
+    void buildDrawList(DrawList& list, float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+    
+    /*! \brief Draws every command of a draw list using a specific renderer.
+     *
+     * The list may hold commands from many entities, as long as they use this entity's renderer and images.  The default
+     * calls draw_internal() for each command, so renderers that can batch should override it.
+     */
+    virtual void submit(const DrawList& list);
+    
+    virtual void draw_simple_object(Animation::Mainline::Key::Object* obj);
+    virtual void draw_tweened_object(Animation::Mainline::Key::Object_Ref* ref1, Animation::Mainline::Key::Object_Ref* ref2);
+
+    /*! \brief Draws an image using a specific renderer.
+     *
+     * \param folderID Integer folder ID of the image
+     * \param fileID Integer file ID of the image
+     * \param x x-position in SCML coordinate system
+     * \param y y-position in SCML coordinate system
+     * \param angle Angle (in degrees) in SCML coordinate system
+     * \param scale_x Scale factor in the x-direction
+     * \param scale_y Scale factor in the y-direction
+     */
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y) = 0;
 
     /*! \brief Chooses and resets the current animation.
      *
@@ -1253,17 +2069,685 @@ public:
 
     int getNextKeyID(int animation, int lastKey) const;
     Animation::Timeline::Key* getTimelineKey(int animation, int timeline, int key);
-    Animation::Timeline::Key::Object* getTimelineObject(int animation, int timeline, int key);
-    Animation::Timeline::Key::Bone* getTimelineBone(int animation, int timeline, int key);
+    /*! \brief Gets the style of an object key of a timeline, or NULL if there is no such key or it is a bone key.
+     */
+    Animation::Timeline::Key::Object_Style* getTimelineObject(int animation, int timeline, int key);
+    /*! \brief Gets the style of a bone key of a timeline, or NULL if there is no such key or it is an object key.
+     */
+    Animation::Timeline::Key::Bone_Style* getTimelineBone(int animation, int timeline, int key);
     
     bool getSimpleObjectTransform(Transform& result, Animation::Mainline::Key::Object* obj1);
     bool getTweenedObjectTransform(Transform& result, Animation::Mainline::Key::Object_Ref* ref1, Animation::Mainline::Key::Object_Ref* ref2);
+    bool getSimpleObjectSprite(Sprite& result, Animation::Mainline::Key::Object* obj1);
+    bool getTweenedObjectSprite(Sprite& result, Animation::Mainline::Key::Object_Ref* ref1, Animation::Mainline::Key::Object_Ref* ref2);
     
     int getNumBones() const;
     int getNumObjects() const;
     
     bool getBoneTransform(Transform& result, int boneID);
     bool getObjectTransform(Transform& result, int objectID);
+    bool getObjectSprite(Sprite& result, int objectID);
+};
+
+
+/*! \brief Every animation of an entity, sampled at a fixed rate and stored as ready-to-draw poses.
+ *
+ * Baking evaluates each animation at rate frames per second, the same way Entity::draw() would, and stores the bones
+ * and objects relative to the entity in flat arrays.  An Entity that draws from the baked poses (see
+ * Entity::setBakedPoses()) finds the two frames around its time and does a single lerp between them, instead of
+ * looking up timeline keys and composing the bone hierarchy.  This is meant for crowds, where exact tweening is not
+ * worth its cost:  Motion between the frames is linear, and the entity's own transform is applied as a matrix, so a
+ * non-uniform scale of a rotated entity is only approximated.  Each mainline key also gets a frame at its time and one
+ * a millisecond before, so no two frames straddle a key and the poses snap where the animation does.
+ *
+ * The poses are read-only once baked, so any number of entities (on any thread) can share them.
+ *
+ * Quantized poses take about a third of the memory.  Their transforms are stored as 16-bit steps across the range
+ * that each animation covers, and the fields that rarely change between frames (image, pivot, color...) are stored
+ * once in a shared Object_Style.  The largest error that this causes is measured while baking.
+ */
+class BakedPoses
+{
+public:
+
+    /*! \brief A bone of a frame.
+     */
+    class Bone
+    {
+    public:
+
+        /*! Bone ID in the mainline key */
+        int id;
+        /*! Which bone this is across frames: The timeline, or -1 - id for bones that are not on a timeline */
+        int channel;
+        /*! Composed transform, relative to the entity */
+        Transform transform;
+    };
+
+    /*! \brief An object of a frame, in drawing order.
+     */
+    class Object
+    {
+    public:
+
+        /*! Object ID in the mainline key */
+        int id;
+        /*! Which object this is across frames: The timeline, or -1 - id for objects that are not on a timeline */
+        int channel;
+        int folder;
+        int file;
+
+        /*! Composed transform at the pivot and its matrix, relative to the entity */
+        Transform transform;
+        Affine matrix;
+
+        float width, height;
+        float pivot_x, pivot_y;
+        float r, g, b, a;
+        int blend_mode;
+        int z_index;
+    };
+
+    /*! \brief The fields of an Object that rarely change between frames, shared by the quantized objects.
+     */
+    class Object_Style
+    {
+    public:
+
+        int folder;
+        int file;
+        float width, height;
+        float pivot_x, pivot_y;
+        float r, g, b, a;
+        int blend_mode;
+        int z_index;
+    };
+
+    /*! \brief A quantized Bone.  The transform is in steps of its animation's ranges.
+     */
+    class Packed_Bone
+    {
+    public:
+
+        short id;
+        short channel;
+        unsigned short x, y, angle, scale_x, scale_y;
+    };
+
+    /*! \brief A quantized Object.  Its matrix shares the position of its transform.
+     */
+    class Packed_Object
+    {
+    public:
+
+        short id;
+        short channel;
+        /*! Index in BakedPoses::styles */
+        int style;
+        unsigned short x, y, angle, scale_x, scale_y;
+        unsigned short a, b, c, d;
+    };
+
+    /*! \brief The pose at one sampled time.
+     */
+    class Frame
+    {
+    public:
+
+        /*! Index of the frame's animation in BakedPoses::animations */
+        int animation;
+        int time;
+        /*! The mainline key at this time.  Angles only turn continuously between frames of the same key. */
+        int key;
+        /*! Span of this frame's bones in BakedPoses::bones (or packed_bones) */
+        int first_bone;
+        int num_bones;
+        /*! Span of this frame's objects in BakedPoses::objects (or packed_objects) */
+        int first_object;
+        int num_objects;
+    };
+
+    /*! \brief The frames of one animation, from time 0 to its length.
+     */
+    class Animation
+    {
+    public:
+
+        int id;
+        int length;
+        /*! Span of this animation's frames in BakedPoses::frames */
+        int first_frame;
+        int num_frames;
+
+        /*! Ranges of the quantized transforms.  The positions are shared with the matrices. */
+        Range position_x, position_y;
+        Range angle;
+        Range scale;
+        /*! Range of the a, b, c and d entries of the matrices */
+        Range matrix;
+    };
+
+    /*! The prototype that was baked (retained) */
+    EntityPrototype* prototype;
+    /*! Frames per second */
+    int rate;
+
+    /*! If true, the frames use packed_bones, packed_objects and styles instead of bones and objects. */
+    bool quantized;
+    /*! Largest difference between the quantized and the exact poses, measured while baking (0 unless quantized).
+     * Positions are in pixels, angles in degrees and scales (including the matrix entries) are factors.
+     */
+    float max_position_error;
+    float max_angle_error;
+    float max_scale_error;
+
+    SCML_VECTOR(Animation) animations;
+    SCML_VECTOR(Frame) frames;
+    SCML_VECTOR(Bone) bones;
+    SCML_VECTOR(Object) objects;
+    SCML_VECTOR(Packed_Bone) packed_bones;
+    SCML_VECTOR(Packed_Object) packed_objects;
+    SCML_VECTOR(Object_Style) styles;
+
+    BakedPoses();
+    BakedPoses(Entity* entity, int rate = 30, bool quantized = false);
+    ~BakedPoses();
+
+    /*! \brief Samples every animation of an entity's prototype.
+     *
+     * The entity provides the image dimensions.  Its playback state is put back afterward.
+     * \param entity An entity of the prototype to bake
+     * \param rate Frames per second, from 1 to 1000
+     * \param quantized Whether to store the poses as 16-bit steps.  Ids that do not fit in 16 bits keep them as floats.
+     * \return true on success, false if the entity has no prototype or the rate is out of range
+     */
+    bool bake(Entity* entity, int rate = 30, bool quantized = false);
+
+    /*! \brief Forgets the frames and releases the prototype.
+     */
+    void clear();
+
+    const Animation* getAnimation(int animation) const;
+
+    /*! \brief Finds the frames to tween between at a time of an animation.
+     *
+     * \param animation Integer animation ID
+     * \param time Time since the start of the animation, in milliseconds
+     * \param frame Receives the index of the frame at or before the time
+     * \param next_frame Receives the index of the frame after it (the same frame at the end)
+     * \param t Receives the tweening factor from frame to next_frame
+     * \return false if the animation was not baked
+     */
+    bool findFrames(int animation, int time, int& frame, int& next_frame, float& t) const;
+
+    /*! \brief Gets an object of a frame, tweened toward the same object in the next frame and placed by the entity's transform.
+     *
+     * \param result Receives the object
+     * \param frame Index of the frame, from findFrames()
+     * \param index Index of the object in the frame, in drawing order
+     * \param next_frame Index of the next frame, from findFrames()
+     * \param t Tweening factor, from findFrames()
+     * \param base_transform The entity's transform in SCML coordinates
+     * \param base_matrix Affine(base_transform)
+     */
+    void getSprite(Entity::Sprite& result, int frame, int index, int next_frame, float t, const Transform& base_transform, const Affine& base_matrix) const;
+
+    /*! \brief Gets a bone of a frame, tweened and placed like getSprite() does.
+     *
+     * \param boneID Bone ID in the mainline key
+     * \return false if the frame has no such bone
+     */
+    bool getBoneTransform(Transform& result, int frame, int boneID, int next_frame, float t, const Transform& base_transform, const Affine& base_matrix) const;
+
+    /*! \brief Gets a bone of a frame, relative to the entity, whether or not the poses are quantized.
+     */
+    void getBone(Bone& result, int frame, int index) const;
+
+    /*! \brief Gets an object of a frame, relative to the entity, whether or not the poses are quantized.
+     */
+    void getObject(Object& result, int frame, int index) const;
+
+    /*! \brief Gets the number of bytes that the frames take up.
+     */
+    int getMemorySize() const;
+
+private:
+
+    const Bone* get_bone(const Frame& frame, int index, Bone& storage) const;
+    const Object* get_object(const Frame& frame, int index, Object& storage) const;
+    int find_bone(const Frame& frame, int index, int channel) const;
+    int find_object(const Frame& frame, int index, int channel) const;
+    void quantize();
+
+    BakedPoses(const BakedPoses& copy);
+    BakedPoses& operator=(const BakedPoses& copy);
+};
+
+
+/*! \brief Pre-rendered frames of an entity's animations on sprite sheets, as written by the scmlbake tool.
+ *
+ * Each frame is one image: The whole entity, rendered at a fixed rate and scale and trimmed.  A FlipbookEntity draws
+ * it as a single quad, which is meant for characters that are too far away for their skeleton to be worth evaluating.
+ *
+ * The sheets and frames are loaded into a FileSystem as atlas pages and images (see FileSystem::load()).  The frames
+ * are the files of one folder, and scmlbake picks a folder ID and atlas IDs that the baked SCML data does not use.
+ */
+class Flipbook
+{
+public:
+
+    /*! \brief One frame and where it is on its sheet.
+     */
+    class Frame
+    {
+    public:
+
+        /*! File ID of the frame in the flipbook's folder */
+        int file;
+        /*! Atlas ID of its sheet and its rectangle on the sheet, in pixels from the top-left corner */
+        int atlas;
+        int x, y;
+        int width, height;
+        /*! Where the entity's origin is, as fractions of the frame's size measured from its bottom-left corner */
+        float pivot_x, pivot_y;
+
+        Frame();
+    };
+
+    /*! \brief A sprite sheet, which is loaded as an atlas page.
+     */
+    class Sheet
+    {
+    public:
+
+        int atlas;
+        /*! Relative to the .flipbook file */
+        SCML_STRING image_path;
+    };
+
+    class Animation
+    {
+    public:
+
+        /*! Index of the animation in the entity */
+        int id;
+        SCML_STRING name;
+        int length;
+        bool looping;
+        /*! Height of the tallest frame, in pixels of the entity at a scale of 1 */
+        float height;
+        /*! Frame i shows the animation at i*1000/fps ms */
+        SCML_VECTOR(Frame) frames;
+
+        Animation();
+    };
+
+    /*! The file this was loaded from */
+    SCML_STRING name;
+    /*! Entity ID of the entity that was baked */
+    int entity;
+    int fps;
+    /*! The scale that the frames were rendered at */
+    float scale;
+    /*! Folder ID of the frames */
+    int folder;
+    SCML_VECTOR(Sheet) sheets;
+    SCML_MAP(int, Animation*) animations;
+
+    Flipbook();
+    Flipbook(const SCML_STRING& file);
+    ~Flipbook();
+
+    /*! \brief Loads a .flipbook file.
+     *
+     * \return false (with the error logged) if it could not be read
+     */
+    bool load(const SCML_STRING& file);
+    void clear();
+
+    Animation* getAnimation(int animation) const;
+
+    /*! \brief Gets the frame to show at a time of an animation: The nearest one, wrapped around if it loops.
+     *
+     * \return NULL if the animation was not baked
+     */
+    const Frame* getFrame(int animation, int time) const;
+
+private:
+
+    Flipbook(const Flipbook& copy);
+    Flipbook& operator=(const Flipbook& copy);
+};
+
+
+/*! \brief Draws an entity from its Flipbook when it is small on screen, and as itself otherwise.
+ *
+ * The Entity keeps playing as usual (update() it as always), since its animation and time pick the frame.  Drawing
+ * from the flipbook then costs one quad and skips evaluating the skeleton altogether.  The entity also converts the
+ * coordinates and draws the quad, so the flipbook's frames must be in the same FileSystem as its images.
+ */
+class FlipbookEntity
+{
+public:
+
+    Entity* entity;
+    Flipbook* flipbook;
+
+    /*! The flipbook is drawn when the animation would be less than this many pixels high (64 by default) */
+    float lod_height;
+
+    FlipbookEntity();
+    FlipbookEntity(Entity* entity, Flipbook* flipbook);
+
+    /*! \brief Tells whether the entity's current animation is drawn from the flipbook at a scale.
+     */
+    bool useFlipbook(float scale_x, float scale_y) const;
+
+    /*! \brief Draws the entity or its current frame, whichever useFlipbook() picks.
+     *
+     * \param x Position in renderer coordinate system
+     * \param y Position in renderer coordinate system
+     * \param angle Angle (in degrees) in renderer coordinate system
+     * \param scale_x Scale factor in the x direction
+     * \param scale_y Scale factor in the y direction
+     */
+    void draw(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+
+    /*! \brief Like draw(), but appends the commands to a list, as Entity::buildDrawList() does.
+     */
+    void buildDrawList(DrawList& list, float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+
+    /*! \brief Appends the command of the current frame to a list, whatever the scale.
+     *
+     * \return false if the current animation has no frames
+     */
+    bool buildFlipbookCommand(DrawList& list, float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+
+private:
+
+    DrawList draw_list;
+};
+
+
+/*! \brief A mutual exclusion lock (pthreads or Win32 underneath).
+ */
+class Mutex
+{
+public:
+
+    Mutex();
+    ~Mutex();
+
+    void lock();
+    void unlock();
+
+private:
+
+    friend class JobScheduler;
+
+    void* handle;
+
+    Mutex(const Mutex& copy);
+    Mutex& operator=(const Mutex& copy);
+};
+
+
+/*! \brief Runs jobs on a pool of worker threads, balancing them by work stealing.
+ *
+ * Each thread has its own queue of jobs.  A thread takes the newest job from its own queue and, once that is empty,
+ * steals the oldest job from another thread's queue, so threads that get cheap jobs help the ones that got expensive
+ * ones.  The thread that calls run() works on the jobs as thread 0 and the workers sleep between calls.
+ */
+class JobScheduler
+{
+public:
+
+    /*! \brief A unit of work.  Jobs that run together must not write to the same data.
+     */
+    class Job
+    {
+    public:
+
+        virtual ~Job();
+
+        /*! \param thread Index of the thread that runs the job, from 0 to getNumThreads() - 1
+         */
+        virtual void run(int thread) = 0;
+    };
+
+    /*! \param num_threads Number of threads, counting the one that calls run().  0 uses one per core.
+     */
+    JobScheduler(int num_threads = 0);
+    ~JobScheduler();
+
+    int getNumThreads() const;
+
+    /*! \brief Runs the jobs and returns once all of them are done.  Jobs must not call run() themselves.
+     */
+    void run(const Span<Job*>& jobs);
+
+    /*! \brief Gets the number of processors that are online, or 1 if it is unknown.
+     */
+    static int getNumCores();
+
+private:
+
+    class Queue;
+    class Worker;
+
+    int num_threads;
+    SCML_VECTOR(Queue*) queues;
+    SCML_VECTOR(Worker*) workers;
+
+    // Guarded by mutex
+    Mutex mutex;
+    void* wake_condition;
+    void* done_condition;
+    int generation;
+    int remaining;
+    bool quit;
+
+    bool run_next_job(int thread);
+    void work(int thread);
+    int wait_for_work(int seen_generation);
+
+    JobScheduler(const JobScheduler& copy);
+    JobScheduler& operator=(const JobScheduler& copy);
+};
+
+
+/*! \brief Updates many entities at once and evaluates all of their bones together.
+ *
+ * Entity::draw() rebuilds one entity's bones at a time, one Transform after another.  evaluate() instead gathers the
+ * bones of every instance into structure-of-arrays buffers, ordered by depth in the hierarchy, and runs the tweening
+ * and parent-composition passes as flat loops over all of them.  These loops use AVX2 or SSE2 when the compiler
+ * targets them (define SCML_NO_SIMD to use only the scalar code).
+ *
+ * The results are stored in each Entity's bone_transform_state, so drawing an instance afterward at the same position
+ * (e.g. with Instance::draw()) does not rebuild its bones.  The buffers are kept between calls to avoid reallocating.
+ *
+ * With a JobScheduler, the batches of instances are evaluated in parallel.  Nothing is drawn during evaluate(), so the
+ * renderer only has to be used from the thread that draws afterward.  An entity must not be in more than one instance,
+ * and its convert_to_SCML_coords() must be safe to call from any thread (it is for the bundled renderers).
+ */
+class AnimationWorld
+{
+public:
+
+    /*! \brief An entity and the position that it will be drawn at.
+     */
+    class Instance
+    {
+    public:
+
+        Entity* entity;
+
+        /*! Position, angle (in degrees) and scale in the renderer coordinate system, as passed to Entity::draw() */
+        float x, y;
+        float angle;
+        float scale_x, scale_y;
+
+        /*! Where the draw commands go in a sorted DrawList (see DrawList::layer and DrawList::depth) */
+        int layer;
+        int depth;
+
+        Instance();
+        Instance(Entity* entity, float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+
+        /*! \brief Draws the entity at this instance's position.
+         */
+        void draw();
+
+        /*! \brief Appends the entity's draw commands at this instance's position to a draw list, with this instance's layer and depth.
+         */
+        void buildDrawList(DrawList& list);
+    };
+
+    /*! \param scheduler Threads to evaluate the batches of instances on, or NULL to evaluate them on the calling thread.
+     *                  The scheduler must outlive the AnimationWorld.
+     */
+    AnimationWorld(JobScheduler* scheduler = NULL);
+    ~AnimationWorld();
+
+    /*! \brief Updates every instance and evaluates the bones of all of them.
+     *
+     * \param instances Entities to update.  Instances without an entity are skipped.
+     * \param dt_ms Change in time since last update, in milliseconds
+     */
+    void evaluate(const Span<Instance>& instances, int dt_ms);
+
+    /*! \brief Forgets the cached key plans and releases the prototypes that they refer to.
+     */
+    void clear();
+
+private:
+
+    enum { PARENT_BASE = -1, PARENT_NONE = -2 };
+    enum { BATCH_SIZE = 64 };
+
+    /*! \brief The bones of a mainline key tweening toward the next key.
+     *
+     * Which timeline keys a bone tweens between does not depend on the time, so this is resolved once per key and shared
+     * by every instance that shows it.
+     */
+    class Key_Plan
+    {
+    public:
+
+        class Bone
+        {
+        public:
+
+            int id;
+            /*! Index of the parent in Key_Plan::bones, or one of the PARENT_* values */
+            int parent;
+            /*! Depth in the bone hierarchy, from 1 for root bones */
+            int depth;
+
+            Transform from;
+            /*! Transform to tween toward, with the spin already applied to the angle */
+            Transform to;
+
+            /*! If tweened, the tweening factor is (time - key_time)/tween_length, reshaped by curve_key's curve. */
+            bool tweened;
+            int key_time;
+            int tween_length;
+            /*! The timeline key that is tweened from, or NULL if its curve is linear */
+            const EntityPrototype::Animation::Timeline::Key* curve_key;
+
+            Bone();
+        };
+
+        EntityPrototype* prototype;
+        /*! The animation in the prototype, which has the curves' samples */
+        const EntityPrototype::Animation* animation;
+
+        /*! Size of Bone_Transform_State::transforms */
+        int num_transforms;
+        /*! In mainline order, so parents come before their children */
+        SCML_VECTOR(Bone) bones;
+        /*! Number of bones at each depth */
+        SCML_VECTOR(int) level_sizes;
+
+        Key_Plan(Entity* entity_ptr, int animation, int key, int nextKey);
+        ~Key_Plan();
+
+    private:
+
+        Key_Plan(const Key_Plan& copy);
+        Key_Plan& operator=(const Key_Plan& copy);
+    };
+
+    class Key_Plan_ID
+    {
+    public:
+
+        EntityPrototype* prototype;
+        int animation;
+        int key;
+        int nextKey;
+
+        Key_Plan_ID();
+        Key_Plan_ID(EntityPrototype* prototype, int animation, int key, int nextKey);
+
+        bool operator<(const Key_Plan_ID& id) const;
+    };
+
+    /*! \brief The buffers of one thread.
+     */
+    class Workspace
+    {
+    public:
+
+        /*! Plans that this thread has already found in AnimationWorld::plans, so it does not need to lock it */
+        SCML_MAP(Key_Plan_ID, Key_Plan*) plans;
+
+        // Per batch
+        SCML_VECTOR(Key_Plan*) instance_plans;
+        SCML_VECTOR(int) level_starts;
+        SCML_VECTOR(int) bone_nodes;
+
+        // Nodes in level order: Node 0 is the identity, then one base transform per instance, then the bones by depth.
+        SCML_VECTOR(int) parents;
+        SCML_VECTOR(int) node_instances;
+        SCML_VECTOR(int) node_ids;
+        SCML_VECTOR(float) x, y, angle, scale_x, scale_y;
+        SCML_VECTOR(float) next_x, next_y, next_angle, next_scale_x, next_scale_y, t;
+        SCML_VECTOR(float) matrix_a, matrix_b, matrix_c, matrix_d;
+
+        void set_node(int node, const Transform& transform);
+    };
+
+    class Batch_Job : public JobScheduler::Job
+    {
+    public:
+
+        AnimationWorld* world;
+        Span<Instance> instances;
+        int dt_ms;
+
+        Batch_Job();
+        Batch_Job(AnimationWorld* world, const Span<Instance>& instances, int dt_ms);
+
+        void run(int thread);
+    };
+
+    JobScheduler* scheduler;
+
+    /*! Shared by all threads and guarded by plans_mutex */
+    SCML_MAP(Key_Plan_ID, Key_Plan*) plans;
+    Mutex plans_mutex;
+
+    /*! One per scheduler thread */
+    SCML_VECTOR(Workspace*) workspaces;
+    SCML_VECTOR(Batch_Job) jobs;
+    SCML_VECTOR(JobScheduler::Job*) job_ptrs;
+
+    Key_Plan* getPlan(Workspace& w, Entity* entity_ptr);
+    void evaluate_batch(Workspace& w, const Span<Instance>& instances, int dt_ms);
+
+    AnimationWorld(const AnimationWorld& copy);
+    AnimationWorld& operator=(const AnimationWorld& copy);
 };
 
 
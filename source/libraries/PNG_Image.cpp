@@ -0,0 +1,811 @@
+#include "PNG_Image.h"
+#include <cstdio>
+#include <cstring>
+
+
+static const unsigned char png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+// Deflate's length and distance codes: The base value and number of extra bits of each symbol
+static const short length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const short length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const short distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const short distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+
+static unsigned int read_u32(const unsigned char* bytes)
+{
+    return (unsigned int)(bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
+
+static void write_u32(SCML_VECTOR(unsigned char)& out, unsigned int value)
+{
+    SCML_VECTOR_PUSH_BACK(out, (unsigned char)(value >> 24));
+    SCML_VECTOR_PUSH_BACK(out, (unsigned char)(value >> 16));
+    SCML_VECTOR_PUSH_BACK(out, (unsigned char)(value >> 8));
+    SCML_VECTOR_PUSH_BACK(out, (unsigned char)value);
+}
+
+static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+{
+    static unsigned int table[256];
+    static bool table_ready = false;
+    if(!table_ready)
+    {
+        for(unsigned int i = 0; i < 256; i++)
+        {
+            unsigned int c = i;
+            for(int k = 0; k < 8; k++)
+                c = (c & 1)? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static unsigned int adler32(const unsigned char* data, size_t size)
+{
+    unsigned int a = 1, b = 0;
+    for(size_t i = 0; i < size; i++)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static bool read_file(const SCML_STRING& filename, SCML_VECTOR(unsigned char)& data)
+{
+    FILE* file = fopen(SCML_TO_CSTRING(filename), "rb");
+    if(file == NULL)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    bool result = (size >= 0);
+    if(result)
+    {
+        SCML_VECTOR_RESIZE(data, size);
+        result = (size == 0 || fread(&data[0], 1, size, file) == size_t(size));
+    }
+    fclose(file);
+    return result;
+}
+
+
+
+
+// Reads deflate's bit stream, least significant bit first.
+class Bit_Reader
+{
+public:
+
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    unsigned int bit_buffer;
+    int bit_count;
+    bool error;
+
+    Bit_Reader(const unsigned char* data, size_t size)
+        : data(data), size(size), pos(0), bit_buffer(0), bit_count(0), error(false)
+    {}
+
+    int bits(int n)
+    {
+        while(bit_count < n)
+        {
+            if(pos >= size)
+            {
+                error = true;
+                return 0;
+            }
+            bit_buffer |= (unsigned int)data[pos++] << bit_count;
+            bit_count += 8;
+        }
+        int value = bit_buffer & ((1u << n) - 1);
+        bit_buffer >>= n;
+        bit_count -= n;
+        return value;
+    }
+
+    // Drops the rest of the current byte
+    void align()
+    {
+        bit_buffer = 0;
+        bit_count = 0;
+    }
+};
+
+// A canonical Huffman code: The number of codes of each length and the symbols in code order
+class Huffman
+{
+public:
+
+    short count[16];
+    short symbol[288];
+
+    // Returns false if the lengths describe more codes than fit
+    bool build(const short* lengths, int num_symbols)
+    {
+        memset(count, 0, sizeof(count));
+        for(int i = 0; i < num_symbols; i++)
+            count[lengths[i]]++;
+
+        int left = 1;
+        for(int length = 1; length < 16; length++)
+        {
+            left <<= 1;
+            left -= count[length];
+            if(left < 0)
+                return false;
+        }
+
+        short offsets[16];
+        offsets[1] = 0;
+        for(int length = 1; length < 15; length++)
+            offsets[length + 1] = offsets[length] + count[length];
+        for(int i = 0; i < num_symbols; i++)
+        {
+            if(lengths[i] != 0)
+                symbol[offsets[lengths[i]]++] = i;
+        }
+        return true;
+    }
+
+    int decode(Bit_Reader& in) const
+    {
+        int code = 0, first = 0, index = 0;
+        for(int length = 1; length < 16; length++)
+        {
+            code |= in.bits(1);
+            int n = count[length];
+            if(code - n < first)
+                return symbol[index + (code - first)];
+            index += n;
+            first += n;
+            first <<= 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+};
+
+static bool inflate_codes(Bit_Reader& in, SCML_VECTOR(unsigned char)& out, const Huffman& lengths, const Huffman& distances)
+{
+    while(true)
+    {
+        int symbol = lengths.decode(in);
+        if(symbol < 0 || in.error)
+            return false;
+        if(symbol < 256)
+        {
+            SCML_VECTOR_PUSH_BACK(out, (unsigned char)symbol);
+            continue;
+        }
+        if(symbol == 256)
+            return true;
+
+        symbol -= 257;
+        if(symbol >= 29)
+            return false;
+        int length = length_base[symbol] + in.bits(length_extra[symbol]);
+
+        symbol = distances.decode(in);
+        if(symbol < 0 || symbol >= 30)
+            return false;
+        size_t distance = distance_base[symbol] + in.bits(distance_extra[symbol]);
+        if(in.error || distance > SCML_VECTOR_SIZE(out))
+            return false;
+
+        // The copy can overlap what it writes
+        size_t from = SCML_VECTOR_SIZE(out) - distance;
+        for(int i = 0; i < length; i++)
+            SCML_VECTOR_PUSH_BACK(out, out[from + i]);
+    }
+}
+
+// Decompresses a zlib stream.
+static bool inflate(const unsigned char* data, size_t size, SCML_VECTOR(unsigned char)& out)
+{
+    if(size < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20))
+        return false;
+
+    Bit_Reader in(data + 2, size - 2);
+    bool last = false;
+    while(!last)
+    {
+        last = (in.bits(1) != 0);
+        int type = in.bits(2);
+        if(in.error)
+            return false;
+
+        if(type == 0)
+        {
+            // Stored
+            in.align();
+            if(in.pos + 4 > in.size)
+                return false;
+            unsigned int length = in.data[in.pos] | (in.data[in.pos + 1] << 8);
+            unsigned int check = in.data[in.pos + 2] | (in.data[in.pos + 3] << 8);
+            in.pos += 4;
+            if(length != (~check & 0xFFFF) || in.pos + length > in.size)
+                return false;
+            out.insert(out.end(), in.data + in.pos, in.data + in.pos + length);
+            in.pos += length;
+        }
+        else if(type == 1)
+        {
+            // Fixed Huffman codes
+            short lengths[288 + 30];
+            for(int i = 0; i < 144; i++)
+                lengths[i] = 8;
+            for(int i = 144; i < 256; i++)
+                lengths[i] = 9;
+            for(int i = 256; i < 280; i++)
+                lengths[i] = 7;
+            for(int i = 280; i < 288; i++)
+                lengths[i] = 8;
+            for(int i = 0; i < 30; i++)
+                lengths[288 + i] = 5;
+
+            Huffman length_code, distance_code;
+            length_code.build(lengths, 288);
+            distance_code.build(lengths + 288, 30);
+            if(!inflate_codes(in, out, length_code, distance_code))
+                return false;
+        }
+        else if(type == 2)
+        {
+            // Dynamic Huffman codes, which are themselves Huffman coded
+            static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            int num_lengths = in.bits(5) + 257;
+            int num_distances = in.bits(5) + 1;
+            int num_code_lengths = in.bits(4) + 4;
+            if(num_lengths > 286 || num_distances > 30)
+                return false;
+
+            short lengths[320];
+            memset(lengths, 0, sizeof(lengths));
+            for(int i = 0; i < num_code_lengths; i++)
+                lengths[order[i]] = in.bits(3);
+
+            Huffman code_length_code;
+            if(in.error || !code_length_code.build(lengths, 19))
+                return false;
+
+            int index = 0;
+            while(index < num_lengths + num_distances)
+            {
+                int symbol = code_length_code.decode(in);
+                if(symbol < 0 || in.error)
+                    return false;
+                if(symbol < 16)
+                {
+                    lengths[index++] = symbol;
+                    continue;
+                }
+
+                short value = 0;
+                int repeat;
+                if(symbol == 16)
+                {
+                    if(index == 0)
+                        return false;
+                    value = lengths[index - 1];
+                    repeat = 3 + in.bits(2);
+                }
+                else if(symbol == 17)
+                    repeat = 3 + in.bits(3);
+                else
+                    repeat = 11 + in.bits(7);
+                if(index + repeat > num_lengths + num_distances)
+                    return false;
+                while(repeat-- > 0)
+                    lengths[index++] = value;
+            }
+
+            Huffman length_code, distance_code;
+            if(lengths[256] == 0 || !length_code.build(lengths, num_lengths) || !distance_code.build(lengths + num_lengths, num_distances))
+                return false;
+            if(!inflate_codes(in, out, length_code, distance_code))
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+
+
+
+// Writes deflate's bit stream, least significant bit first.
+class Bit_Writer
+{
+public:
+
+    SCML_VECTOR(unsigned char)& out;
+    unsigned int bit_buffer;
+    int bit_count;
+
+    Bit_Writer(SCML_VECTOR(unsigned char)& out)
+        : out(out), bit_buffer(0), bit_count(0)
+    {}
+
+    void bits(unsigned int value, int n)
+    {
+        bit_buffer |= value << bit_count;
+        bit_count += n;
+        while(bit_count >= 8)
+        {
+            SCML_VECTOR_PUSH_BACK(out, (unsigned char)bit_buffer);
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    // Huffman codes are packed starting with their most significant bit
+    void code(unsigned int value, int n)
+    {
+        unsigned int reversed = 0;
+        for(int i = 0; i < n; i++)
+            reversed |= ((value >> i) & 1) << (n - 1 - i);
+        bits(reversed, n);
+    }
+
+    void flush()
+    {
+        if(bit_count > 0)
+            SCML_VECTOR_PUSH_BACK(out, (unsigned char)bit_buffer);
+        bit_buffer = 0;
+        bit_count = 0;
+    }
+};
+
+static void write_fixed_symbol(Bit_Writer& out, int symbol)
+{
+    if(symbol < 144)
+        out.code(0x30 + symbol, 8);
+    else if(symbol < 256)
+        out.code(0x190 + symbol - 144, 9);
+    else if(symbol < 280)
+        out.code(symbol - 256, 7);
+    else
+        out.code(0xC0 + symbol - 280, 8);
+}
+
+static void write_match(Bit_Writer& out, int length, int distance)
+{
+    int symbol = 28;
+    while(length_base[symbol] > length)
+        symbol--;
+    write_fixed_symbol(out, 257 + symbol);
+    out.bits(length - length_base[symbol], length_extra[symbol]);
+
+    symbol = 29;
+    while(distance_base[symbol] > distance)
+        symbol--;
+    out.code(symbol, 5);
+    out.bits(distance - distance_base[symbol], distance_extra[symbol]);
+}
+
+// Compresses data into a zlib stream, with greedy LZ77 matching and one block of fixed Huffman codes.
+static void deflate(const unsigned char* data, size_t size, SCML_VECTOR(unsigned char)& out)
+{
+    enum { WINDOW_SIZE = 32768, HASH_SIZE = 32768, MIN_MATCH = 3, MAX_MATCH = 258, MAX_CHAIN = 64 };
+
+    SCML_VECTOR_PUSH_BACK(out, 0x78);
+    SCML_VECTOR_PUSH_BACK(out, 0x01);
+
+    Bit_Writer writer(out);
+    writer.bits(1, 1);  // Last block
+    writer.bits(1, 2);  // Fixed codes
+
+    // The most recent position of each hash, and the previous position with the same hash for each position in the window
+    SCML_VECTOR(int) head(HASH_SIZE, -1);
+    SCML_VECTOR(int) prev(WINDOW_SIZE, -1);
+
+    size_t pos = 0;
+    while(pos < size)
+    {
+        int best_length = 0;
+        int best_distance = 0;
+        if(pos + MIN_MATCH <= size)
+        {
+            unsigned int hash = ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & (HASH_SIZE - 1);
+            int max_length = (size - pos < size_t(MAX_MATCH)? int(size - pos) : int(MAX_MATCH));
+            int candidate = head[hash];
+            for(int chain = 0; candidate >= 0 && pos - candidate <= size_t(WINDOW_SIZE) && chain < MAX_CHAIN; chain++)
+            {
+                const unsigned char* a = data + candidate;
+                const unsigned char* b = data + pos;
+                int length = 0;
+                while(length < max_length && a[length] == b[length])
+                    length++;
+                if(length > best_length)
+                {
+                    best_length = length;
+                    best_distance = int(pos - candidate);
+                    if(length == max_length)
+                        break;
+                }
+
+                // Slots of the window are reused, so stop when the chain stops going back
+                int next = prev[candidate & (WINDOW_SIZE - 1)];
+                if(next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        int advance = 1;
+        if(best_length >= MIN_MATCH)
+        {
+            write_match(writer, best_length, best_distance);
+            advance = best_length;
+        }
+        else
+            write_fixed_symbol(writer, data[pos]);
+
+        for(int i = 0; i < advance; i++, pos++)
+        {
+            if(pos + MIN_MATCH <= size)
+            {
+                unsigned int hash = ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & (HASH_SIZE - 1);
+                prev[pos & (WINDOW_SIZE - 1)] = head[hash];
+                head[hash] = int(pos);
+            }
+        }
+    }
+
+    write_fixed_symbol(writer, 256);
+    writer.flush();
+    write_u32(out, adler32(data, size));
+}
+
+
+
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = (p > a? p - a : a - p);
+    int pb = (p > b? p - b : b - p);
+    int pc = (p > c? p - c : c - p);
+    if(pa <= pb && pa <= pc)
+        return a;
+    if(pb <= pc)
+        return b;
+    return c;
+}
+
+// Reads sample i of a row of packed samples
+static unsigned int get_sample(const unsigned char* row, unsigned int i, int depth)
+{
+    if(depth == 8)
+        return row[i];
+    if(depth == 16)
+        return (row[2*i] << 8) | row[2*i + 1];
+    unsigned int bit = i*depth;
+    return (row[bit/8] >> (8 - depth - bit%8)) & ((1 << depth) - 1);
+}
+
+PNG_Image::PNG_Image()
+    : width(0), height(0)
+{}
+
+PNG_Image::PNG_Image(unsigned int width, unsigned int height)
+    : width(0), height(0)
+{
+    create(width, height);
+}
+
+void PNG_Image::create(unsigned int width, unsigned int height)
+{
+    this->width = width;
+    this->height = height;
+    SCML_VECTOR_CLEAR(pixels);
+    SCML_VECTOR_RESIZE(pixels, size_t(width)*height*4);
+}
+
+bool PNG_Image::load(const SCML_STRING& filename)
+{
+    SCML_VECTOR(unsigned char) file;
+    if(!read_file(filename, file))
+    {
+        printf("PNG_Image failed to read file: %s\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+    if(SCML_VECTOR_SIZE(file) < 8 || memcmp(&file[0], png_signature, 8) != 0)
+    {
+        printf("PNG_Image failed to load %s: Not a PNG file.\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+
+    // Gather the chunks
+    unsigned int w = 0, h = 0;
+    int depth = 0, color_type = -1, interlace = 0;
+    SCML_VECTOR(unsigned char) palette;
+    SCML_VECTOR(unsigned char) transparency;
+    SCML_VECTOR(unsigned char) compressed;
+    size_t pos = 8;
+    while(pos + 12 <= SCML_VECTOR_SIZE(file))
+    {
+        unsigned int length = read_u32(&file[pos]);
+        const unsigned char* type = &file[pos + 4];
+        const unsigned char* chunk = &file[pos + 8];
+        if(length > SCML_VECTOR_SIZE(file) - pos - 12)
+            break;
+
+        if(memcmp(type, "IHDR", 4) == 0 && length >= 13)
+        {
+            w = read_u32(chunk);
+            h = read_u32(chunk + 4);
+            depth = chunk[8];
+            color_type = chunk[9];
+            interlace = chunk[12];
+        }
+        else if(memcmp(type, "PLTE", 4) == 0)
+            palette.assign(chunk, chunk + length);
+        else if(memcmp(type, "tRNS", 4) == 0)
+            transparency.assign(chunk, chunk + length);
+        else if(memcmp(type, "IDAT", 4) == 0)
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        else if(memcmp(type, "IEND", 4) == 0)
+            break;
+        pos += length + 12;
+    }
+
+    int channels = 0;
+    switch(color_type)
+    {
+        case 0: channels = 1; break;  // Gray
+        case 2: channels = 3; break;  // RGB
+        case 3: channels = 1; break;  // Palette
+        case 4: channels = 2; break;  // Gray and alpha
+        case 6: channels = 4; break;  // RGBA
+    }
+    if(channels == 0 || w == 0 || h == 0 || (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16))
+    {
+        printf("PNG_Image failed to load %s: Unsupported format.\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+    if(interlace != 0)
+    {
+        printf("PNG_Image failed to load %s: Interlaced files are not supported.\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+
+    size_t stride = (size_t(w)*channels*depth + 7)/8;
+    int pixel_bytes = (channels*depth + 7)/8;
+    SCML_VECTOR(unsigned char) raw;
+    if(SCML_VECTOR_SIZE(compressed) == 0 || !inflate(&compressed[0], SCML_VECTOR_SIZE(compressed), raw) || SCML_VECTOR_SIZE(raw) < (stride + 1)*h)
+    {
+        printf("PNG_Image failed to load %s: Corrupt image data.\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+
+    // Undo the filter of each row in place.  Each row starts with its filter type.
+    for(unsigned int y = 0; y < h; y++)
+    {
+        unsigned char* row = &raw[y*(stride + 1) + 1];
+        const unsigned char* above = (y > 0? row - (stride + 1) : NULL);
+        int filter = row[-1];
+        for(size_t i = 0; i < stride; i++)
+        {
+            int left = (i >= size_t(pixel_bytes)? row[i - pixel_bytes] : 0);
+            int up = (above != NULL? above[i] : 0);
+            int up_left = (above != NULL && i >= size_t(pixel_bytes)? above[i - pixel_bytes] : 0);
+            switch(filter)
+            {
+                case 0: break;
+                case 1: row[i] += left; break;
+                case 2: row[i] += up; break;
+                case 3: row[i] += (left + up)/2; break;
+                case 4: row[i] += paeth(left, up, up_left); break;
+                default:
+                    printf("PNG_Image failed to load %s: Corrupt image data.\n", SCML_TO_CSTRING(filename));
+                    return false;
+            }
+        }
+    }
+
+    // Convert to 8-bit RGBA
+    create(w, h);
+    int max_value = (1 << depth) - 1;
+    for(unsigned int y = 0; y < h; y++)
+    {
+        const unsigned char* row = &raw[y*(stride + 1) + 1];
+        unsigned char* out = &pixels[size_t(y)*w*4];
+        for(unsigned int x = 0; x < w; x++, out += 4)
+        {
+            unsigned int s[4] = {0, 0, 0, 0};
+            for(int c = 0; c < channels; c++)
+                s[c] = get_sample(row, x*channels + c, depth);
+
+            if(color_type == 3)
+            {
+                unsigned int index = s[0];
+                if(3*index + 2 >= SCML_VECTOR_SIZE(palette))
+                {
+                    printf("PNG_Image failed to load %s: Palette index out of range.\n", SCML_TO_CSTRING(filename));
+                    return false;
+                }
+                out[0] = palette[3*index];
+                out[1] = palette[3*index + 1];
+                out[2] = palette[3*index + 2];
+                out[3] = (index < SCML_VECTOR_SIZE(transparency)? transparency[index] : 255);
+                continue;
+            }
+
+            unsigned char v[4] = {0, 0, 0, 0};
+            for(int c = 0; c < channels; c++)
+                v[c] = (depth == 16? s[c] >> 8 : s[c]*255/max_value);
+
+            if(channels <= 2)
+            {
+                out[0] = out[1] = out[2] = v[0];
+                out[3] = (channels == 2? v[1] : 255);
+                if(color_type == 0 && SCML_VECTOR_SIZE(transparency) >= 2 && s[0] == (unsigned int)((transparency[0] << 8) | transparency[1]))
+                    out[3] = 0;
+            }
+            else
+            {
+                out[0] = v[0];
+                out[1] = v[1];
+                out[2] = v[2];
+                out[3] = (channels == 4? v[3] : 255);
+                if(color_type == 2 && SCML_VECTOR_SIZE(transparency) >= 6 && s[0] == (unsigned int)((transparency[0] << 8) | transparency[1])
+                   && s[1] == (unsigned int)((transparency[2] << 8) | transparency[3]) && s[2] == (unsigned int)((transparency[4] << 8) | transparency[5]))
+                    out[3] = 0;
+            }
+        }
+    }
+    return true;
+}
+
+static void write_chunk(SCML_VECTOR(unsigned char)& png, const char* type, const unsigned char* data, size_t size)
+{
+    write_u32(png, size);
+    size_t start = SCML_VECTOR_SIZE(png);
+    png.insert(png.end(), (const unsigned char*)type, (const unsigned char*)type + 4);
+    if(size > 0)
+        png.insert(png.end(), data, data + size);
+    write_u32(png, crc32(&png[start], size + 4));
+}
+
+void PNG_Image::encode(SCML_VECTOR(unsigned char)& png) const
+{
+    SCML_VECTOR_CLEAR(png);
+    png.insert(png.end(), png_signature, png_signature + 8);
+
+    unsigned char header[13];
+    header[0] = width >> 24; header[1] = width >> 16; header[2] = width >> 8; header[3] = width;
+    header[4] = height >> 24; header[5] = height >> 16; header[6] = height >> 8; header[7] = height;
+    header[8] = 8;  // Bit depth
+    header[9] = 6;  // RGBA
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    write_chunk(png, "IHDR", header, 13);
+
+    // Filter each row with the filter that gives the smallest sum of (signed) differences, the usual heuristic
+    size_t stride = size_t(width)*4;
+    SCML_VECTOR(unsigned char) raw((stride + 1)*height);
+    SCML_VECTOR(unsigned char) candidate(stride);
+    for(unsigned int y = 0; y < height; y++)
+    {
+        const unsigned char* row = &pixels[y*stride];
+        const unsigned char* above = (y > 0? row - stride : NULL);
+        unsigned char* out = &raw[y*(stride + 1)];
+        long best_sum = -1;
+        for(int filter = 0; filter < 5; filter++)
+        {
+            long sum = 0;
+            for(size_t i = 0; i < stride; i++)
+            {
+                int left = (i >= 4? row[i - 4] : 0);
+                int up = (above != NULL? above[i] : 0);
+                int up_left = (above != NULL && i >= 4? above[i - 4] : 0);
+                int predicted = 0;
+                switch(filter)
+                {
+                    case 1: predicted = left; break;
+                    case 2: predicted = up; break;
+                    case 3: predicted = (left + up)/2; break;
+                    case 4: predicted = paeth(left, up, up_left); break;
+                }
+                unsigned char value = (unsigned char)(row[i] - predicted);
+                candidate[i] = value;
+                sum += (value < 128? value : 256 - value);
+            }
+            if(best_sum < 0 || sum < best_sum)
+            {
+                best_sum = sum;
+                out[0] = filter;
+                if(stride > 0)
+                    memcpy(out + 1, &candidate[0], stride);
+            }
+        }
+    }
+
+    SCML_VECTOR(unsigned char) compressed;
+    deflate((SCML_VECTOR_SIZE(raw) > 0? &raw[0] : NULL), SCML_VECTOR_SIZE(raw), compressed);
+    write_chunk(png, "IDAT", &compressed[0], SCML_VECTOR_SIZE(compressed));
+    write_chunk(png, "IEND", NULL, 0);
+}
+
+bool PNG_Image::save(const SCML_STRING& filename) const
+{
+    SCML_VECTOR(unsigned char) png;
+    encode(png);
+
+    FILE* file = fopen(SCML_TO_CSTRING(filename), "wb");
+    if(file == NULL)
+    {
+        printf("PNG_Image failed to open file for writing: %s\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+    bool result = (fwrite(&png[0], 1, SCML_VECTOR_SIZE(png), file) == SCML_VECTOR_SIZE(png));
+    if(fclose(file) != 0)
+        result = false;
+    if(!result)
+        printf("PNG_Image failed to write file: %s\n", SCML_TO_CSTRING(filename));
+    return result;
+}
+
+unsigned char* PNG_Image::getPixel(unsigned int x, unsigned int y)
+{
+    return &pixels[(size_t(y)*width + x)*4];
+}
+
+const unsigned char* PNG_Image::getPixel(unsigned int x, unsigned int y) const
+{
+    return &pixels[(size_t(y)*width + x)*4];
+}
+
+void PNG_Image::copy(const PNG_Image& source, int source_x, int source_y, int width, int height, int x, int y)
+{
+    for(int row = 0; row < height; row++)
+        memcpy(getPixel(x, y + row), source.getPixel(source_x, source_y + row), width*4);
+}
+
+bool PNG_Image::getOpaqueBounds(int& x, int& y, int& width, int& height) const
+{
+    int left = this->width, top = this->height, right = -1, bottom = -1;
+    for(unsigned int j = 0; j < this->height; j++)
+    {
+        const unsigned char* row = getPixel(0, j);
+        for(unsigned int i = 0; i < this->width; i++)
+        {
+            if(row[4*i + 3] != 0)
+            {
+                if(int(i) < left)
+                    left = i;
+                if(int(i) > right)
+                    right = i;
+                if(int(j) < top)
+                    top = j;
+                bottom = j;
+            }
+        }
+    }
+
+    if(right < 0)
+    {
+        x = y = width = height = 0;
+        return false;
+    }
+    x = left;
+    y = top;
+    width = right - left + 1;
+    height = bottom - top + 1;
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef _PNG_IMAGE_H__
+#define _PNG_IMAGE_H__
+
+#include "SCMLpp.h"
+
+/*! \brief An 8-bit RGBA image that can be read from and written to PNG files, without any other library.
+ *
+ * Reading supports every non-interlaced PNG (all color types and bit depths, with palettes and tRNS transparency).
+ * 16-bit samples are cut down to 8 bits.  Writing always produces RGBA with 8 bits per sample, compressed with LZ77
+ * and the fixed Huffman codes of deflate, which is plenty for sprites and atlas pages with large transparent areas.
+ *
+ * Pixels are stored row by row from the top-left corner, 4 bytes (r, g, b, a) each.
+ */
+class PNG_Image
+{
+public:
+
+    unsigned int width;
+    unsigned int height;
+    SCML_VECTOR(unsigned char) pixels;
+
+    PNG_Image();
+    PNG_Image(unsigned int width, unsigned int height);
+
+    /*! \brief Resizes the image and clears it to transparent black.
+     */
+    void create(unsigned int width, unsigned int height);
+
+    /*! \brief Reads a PNG file.
+     *
+     * \return true on success, false if the file could not be read or is not a supported PNG file (the error is printed).
+     */
+    bool load(const SCML_STRING& filename);
+
+    /*! \brief Writes a PNG file.
+     */
+    bool save(const SCML_STRING& filename) const;
+
+    /*! \brief Encodes the image as a PNG file in memory.
+     */
+    void encode(SCML_VECTOR(unsigned char)& png) const;
+
+    unsigned char* getPixel(unsigned int x, unsigned int y);
+    const unsigned char* getPixel(unsigned int x, unsigned int y) const;
+
+    /*! \brief Copies a rectangle of another image into this one, without blending.
+     */
+    void copy(const PNG_Image& source, int source_x, int source_y, int width, int height, int x, int y);
+
+    /*! \brief Finds the smallest rectangle that holds every pixel that is not fully transparent.
+     *
+     * \return false (with a 0 x 0 rectangle) if the whole image is transparent
+     */
+    bool getOpaqueBounds(int& x, int& y, int& width, int& height) const;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "Rect_Packer.h"
+#include <algorithm>
+
+Packer_Page::Packer_Page(int width, int height)
+{
+    SCML_VECTOR_PUSH_BACK(free_rects, Rect(0, 0, width, height));
+}
+
+bool Packer_Page::find(int width, int height, Rect& result) const
+{
+    int best_short = -1, best_long = -1;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(free_rects); i++)
+    {
+        const Rect& r = free_rects[i];
+        if(r.width < width || r.height < height)
+            continue;
+
+        int left_x = r.width - width;
+        int left_y = r.height - height;
+        int short_side = std::min(left_x, left_y);
+        int long_side = std::max(left_x, left_y);
+        if(best_short < 0 || short_side < best_short || (short_side == best_short && long_side < best_long))
+        {
+            best_short = short_side;
+            best_long = long_side;
+            result = Rect(r.x, r.y, width, height);
+        }
+    }
+    return (best_short >= 0);
+}
+
+void Packer_Page::place(const Rect& rect)
+{
+    // Split every free rectangle that the new one overlaps into the (up to) four parts around it
+    SCML_VECTOR(Rect) split;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(free_rects); i++)
+    {
+        const Rect& r = free_rects[i];
+        if(!r.intersects(rect))
+        {
+            SCML_VECTOR_PUSH_BACK(split, r);
+            continue;
+        }
+
+        if(rect.x > r.x)
+            SCML_VECTOR_PUSH_BACK(split, Rect(r.x, r.y, rect.x - r.x, r.height));
+        if(rect.x + rect.width < r.x + r.width)
+            SCML_VECTOR_PUSH_BACK(split, Rect(rect.x + rect.width, r.y, r.x + r.width - rect.x - rect.width, r.height));
+        if(rect.y > r.y)
+            SCML_VECTOR_PUSH_BACK(split, Rect(r.x, r.y, r.width, rect.y - r.y));
+        if(rect.y + rect.height < r.y + r.height)
+            SCML_VECTOR_PUSH_BACK(split, Rect(r.x, rect.y + rect.height, r.width, r.y + r.height - rect.y - rect.height));
+    }
+
+    // Drop the rectangles that another one contains.  Of two equal ones, the first is kept.
+    SCML_VECTOR_CLEAR(free_rects);
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(split); i++)
+    {
+        bool contained = false;
+        for(unsigned int j = 0; j < SCML_VECTOR_SIZE(split) && !contained; j++)
+        {
+            if(i != j && split[j].contains(split[i]) && (!split[i].contains(split[j]) || j < i))
+                contained = true;
+        }
+        if(!contained)
+            SCML_VECTOR_PUSH_BACK(free_rects, split[i]);
+    }
+}
+
+
+// Packs the rectangles onto one page size
+class Page_Packer::Trial : public SCML::JobScheduler::Job
+{
+public:
+
+    const SCML_VECTOR(Rect)* sizes;
+    int width, height;
+    int padding;
+
+    SCML_VECTOR(Rect) placements;
+    int num_placed;
+
+    Trial(int width, int height, int padding)
+        : sizes(NULL), width(width), height(height), padding(padding), num_placed(0)
+    {}
+
+    virtual void run(int thread)
+    {
+        Packer_Page packer(width + padding, height + padding);
+        SCML_VECTOR_CLEAR(placements);
+        SCML_VECTOR_RESIZE(placements, SCML_VECTOR_SIZE(*sizes));
+        num_placed = 0;
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(*sizes); i++)
+        {
+            Rect rect;
+            const Rect& size = (*sizes)[i];
+            if(!packer.find(size.width + padding, size.height + padding, rect))
+                continue;
+            packer.place(rect);
+            placements[i] = Rect(rect.x, rect.y, size.width, size.height);
+            num_placed++;
+        }
+    }
+};
+
+Page_Packer::Page_Packer(int max_size, int padding)
+    : max_size(1), padding(padding)
+{
+    // Pages larger than the largest power of two would never be tried
+    while(this->max_size*2 <= max_size)
+        this->max_size *= 2;
+
+    // The largest page is the last trial
+    for(int height = 1; height <= this->max_size; height *= 2)
+    {
+        for(int width = std::max(1, height/2); width <= std::min(this->max_size, height*2); width *= 2)
+            SCML_VECTOR_PUSH_BACK(trials, new Trial(width, height, padding));
+    }
+}
+
+Page_Packer::~Page_Packer()
+{
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(trials); i++)
+        delete trials[i];
+}
+
+int Page_Packer::pack(const SCML_VECTOR(Rect)& sizes, SCML_VECTOR(Rect)& placements, SCML::JobScheduler* scheduler)
+{
+    SCML_VECTOR(SCML::JobScheduler::Job*) jobs;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(trials); i++)
+    {
+        trials[i]->sizes = &sizes;
+        SCML_VECTOR_PUSH_BACK(jobs, trials[i]);
+    }
+    if(scheduler != NULL)
+        scheduler->run(SCML::Span<SCML::JobScheduler::Job*>(&jobs[0], SCML_VECTOR_SIZE(jobs)));
+    else
+    {
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(jobs); i++)
+            jobs[i]->run(0);
+    }
+
+    // Ties in area go to the wider page
+    int num_sizes = SCML_VECTOR_SIZE(sizes);
+    Trial* best = trials[SCML_VECTOR_SIZE(trials) - 1];
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(trials); i++)
+    {
+        Trial* trial = trials[i];
+        if(trial->num_placed == num_sizes
+           && (best->num_placed < num_sizes || trial->width*trial->height < best->width*best->height
+               || (trial->width*trial->height == best->width*best->height && trial->width > best->width)))
+            best = trial;
+    }
+
+    placements = best->placements;
+    return best->num_placed;
+}
@@ -0,0 +1,94 @@
+#ifndef _RECT_PACKER_H__
+#define _RECT_PACKER_H__
+
+#include "SCMLpp.h"
+
+/*! \brief A rectangle in pixels, from its top-left corner.
+ */
+class Rect
+{
+public:
+
+    int x, y;
+    int width, height;
+
+    Rect()
+        : x(0), y(0), width(0), height(0)
+    {}
+    Rect(int x, int y, int width, int height)
+        : x(x), y(y), width(width), height(height)
+    {}
+
+    bool contains(const Rect& other) const
+    {
+        return other.x >= x && other.y >= y && other.x + other.width <= x + width && other.y + other.height <= y + height;
+    }
+
+    bool intersects(const Rect& other) const
+    {
+        return other.x < x + width && other.x + other.width > x && other.y < y + height && other.y + other.height > y;
+    }
+};
+
+/*! \brief A page being packed with MaxRects: The free space is kept as the list of maximal free rectangles, which overlap.
+ *
+ * Used by the scmlpack and scmlbake tools to place images on atlas pages and sprite sheets.
+ */
+class Packer_Page
+{
+public:
+
+    SCML_VECTOR(Rect) free_rects;
+
+    Packer_Page(int width, int height);
+
+    /*! \brief Finds the free rectangle that leaves the shortest side over, breaking ties with the longer side.
+     *
+     * \return false if there is no room for the size
+     */
+    bool find(int width, int height, Rect& result) const;
+
+    /*! \brief Takes a rectangle (from find()) out of the free space.
+     */
+    void place(const Rect& rect);
+};
+
+/*! \brief Packs rectangles page by page onto power-of-two pages, for the scmlpack and scmlbake tools.
+ *
+ * Each page is tried at every power-of-two size up to the largest (at most twice as wide as high or the other way
+ * around), and the smallest that holds all of the rectangles is used.  If none does, the largest page is filled.
+ */
+class Page_Packer
+{
+public:
+
+    /*! The largest page size: The max_size that was given, rounded down to a power of two */
+    int max_size;
+    int padding;
+
+    /*! \param max_size Largest width and height of a page.  It is rounded down to a power of two.
+     * \param padding Pixels left between the rectangles and after the last ones
+     */
+    Page_Packer(int max_size, int padding);
+    ~Page_Packer();
+
+    /*! \brief Packs one page.
+     *
+     * \param sizes Width and height of each rectangle, largest first
+     * \param placements Where each rectangle goes on the page, with a width of 0 for those that do not fit
+     * \param scheduler Runs the trial sizes in parallel, or NULL to try them on this thread
+     * \return The number of rectangles placed.  0 means that the first one does not fit on even the largest page.
+     */
+    int pack(const SCML_VECTOR(Rect)& sizes, SCML_VECTOR(Rect)& placements, SCML::JobScheduler* scheduler = NULL);
+
+private:
+
+    class Trial;
+
+    SCML_VECTOR(Trial*) trials;
+
+    Page_Packer(const Page_Packer& copy);
+    Page_Packer& operator=(const Page_Packer& copy);
+};
+
+#endif
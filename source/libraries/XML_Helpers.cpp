@@ -62,6 +62,31 @@ float toFloat(const SCML_STRING& str)
     return atof(SCML_TO_CSTRING(str));
 }
 
+bool toBool(const char* str)
+{
+    // Case-insensitive match without building a lowercase copy
+    const char* words[2] = {"true", "false"};
+    for(int w = 0; w < 2; w++)
+    {
+        int i = 0;
+        while(str[i] != '\0' && tolower(str[i]) == words[w][i])
+            i++;
+        if(str[i] == '\0' && words[w][i] == '\0')
+            return (w == 0);
+    }
+    return atoi(str);
+}
+
+int toInt(const char* str)
+{
+    return atoi(str);
+}
+
+float toFloat(const char* str)
+{
+    return atof(str);
+}
+
 
 
 SCML_STRING toString(bool b)
@@ -8,6 +8,9 @@
 bool toBool(const SCML_STRING& str);
 int toInt(const SCML_STRING& str);
 float toFloat(const SCML_STRING& str);
+bool toBool(const char* str);
+int toInt(const char* str);
+float toFloat(const char* str);
 
 SCML_STRING toString(bool b);
 SCML_STRING toString(int n);
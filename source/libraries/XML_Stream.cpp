@@ -0,0 +1,893 @@
+#include "XML_Stream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+static bool isSpace(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+}
+
+static bool isNameEnd(char c)
+{
+    return (isSpace(c) || c == '/' || c == '>' || c == '=' || c == '\0');
+}
+
+static unsigned int hashName(const char* name, int length)
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for(int i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Writes a code point as UTF-8 and advances 'out'
+static void encodeUTF8(char*& out, unsigned long code)
+{
+    if(code < 0x80)
+        *out++ = char(code);
+    else if(code < 0x800)
+    {
+        *out++ = char(0xC0 | (code >> 6));
+        *out++ = char(0x80 | (code & 0x3F));
+    }
+    else if(code < 0x10000)
+    {
+        *out++ = char(0xE0 | (code >> 12));
+        *out++ = char(0x80 | ((code >> 6) & 0x3F));
+        *out++ = char(0x80 | (code & 0x3F));
+    }
+    else
+    {
+        *out++ = char(0xF0 | ((code >> 18) & 0x07));
+        *out++ = char(0x80 | ((code >> 12) & 0x3F));
+        *out++ = char(0x80 | ((code >> 6) & 0x3F));
+        *out++ = char(0x80 | (code & 0x3F));
+    }
+}
+
+// Reads the 4 hex digits of a JSON \u escape.  Returns -1 if they are malformed.
+static long readHex4(const char* s, const char* end)
+{
+    if(end - s < 4)
+        return -1;
+
+    long code = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        char c = s[i];
+        if(c >= '0' && c <= '9')
+            code = code*16 + (c - '0');
+        else if(c >= 'a' && c <= 'f')
+            code = code*16 + (c - 'a' + 10);
+        else if(c >= 'A' && c <= 'F')
+            code = code*16 + (c - 'A' + 10);
+        else
+            return -1;
+    }
+    return code;
+}
+
+// Finds the given terminator at or after 'cur'.  Returns NULL if it is not found before 'end'.
+static char* findString(char* cur, char* end, const char* terminator)
+{
+    int length = strlen(terminator);
+    for(; cur + length <= end; cur++)
+    {
+        if(*cur == terminator[0] && memcmp(cur, terminator, length) == 0)
+            return cur;
+    }
+    return NULL;
+}
+
+
+
+XML_Stream::XML_Stream(const char* const* names, int num_names)
+    : names(names), num_names(num_names), table(NULL), table_mask(0)
+    , owned_buffer(NULL), begin(NULL), cur(NULL), end(NULL)
+    , token(-1), empty_element(false), num_attributes(0)
+    , error(NULL), error_pos(NULL), error_line(0)
+    , json(false), nodes(NULL), num_nodes(0), nodes_capacity(0)
+    , frames(NULL), num_frames(0), frames_capacity(0)
+{
+    int size = 16;
+    while(size < 2*num_names)
+        size *= 2;
+    table_mask = size - 1;
+
+    table = new int[size];
+    for(int i = 0; i < size; i++)
+        table[i] = -1;
+
+    for(int i = 0; i < num_names; i++)
+    {
+        int length = strlen(names[i]);
+        if(intern(names[i], length) >= 0)
+            continue;  // Duplicate name
+
+        unsigned int slot = hashName(names[i], length) & table_mask;
+        while(table[slot] >= 0)
+            slot = (slot + 1) & table_mask;
+        table[slot] = i;
+    }
+}
+
+XML_Stream::~XML_Stream()
+{
+    delete[] table;
+    delete[] owned_buffer;
+    delete[] nodes;
+    delete[] frames;
+}
+
+bool XML_Stream::loadFile(const char* filename)
+{
+    int size = 0;
+    if(!readFile(filename, size))
+        return false;
+
+    setBuffer(owned_buffer, size);
+    return true;
+}
+
+bool XML_Stream::loadJSONFile(const char* filename)
+{
+    int size = 0;
+    if(!readFile(filename, size))
+        return false;
+
+    setJSONBuffer(owned_buffer, size);
+    return !hasError();
+}
+
+bool XML_Stream::readFile(const char* filename, int& buffer_size)
+{
+    error = NULL;
+    error_pos = NULL;
+    error_line = 0;
+
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+    {
+        setError("Couldn't open file", NULL);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if(size < 0)
+    {
+        fclose(file);
+        setError("Couldn't read file", NULL);
+        return false;
+    }
+
+    delete[] owned_buffer;
+    owned_buffer = new char[size + 1];
+    size_t read = fread(owned_buffer, 1, size, file);
+    fclose(file);
+
+    if(read != size_t(size))
+    {
+        setError("Couldn't read file", NULL);
+        return false;
+    }
+
+    owned_buffer[size] = '\0';
+    buffer_size = size;
+    return true;
+}
+
+void XML_Stream::setBuffer(char* buffer, int size)
+{
+    begin = buffer;
+    cur = buffer;
+    end = buffer + size;
+    token = -1;
+    empty_element = false;
+    num_attributes = 0;
+    error = NULL;
+    error_pos = NULL;
+    error_line = 0;
+    json = false;
+    num_nodes = 0;
+    num_frames = 0;
+
+    // Skip a UTF-8 byte order mark
+    if(size >= 3 && (unsigned char)buffer[0] == 0xEF && (unsigned char)buffer[1] == 0xBB && (unsigned char)buffer[2] == 0xBF)
+        cur += 3;
+}
+
+void XML_Stream::setJSONBuffer(char* buffer, int size)
+{
+    setBuffer(buffer, size);
+    json = true;
+    parseJSON();
+
+    // nextElement() moves to the end once it has returned the root
+    cur = begin;
+}
+
+bool XML_Stream::nextElement()
+{
+    if(error != NULL)
+        return false;
+
+    if(json)
+    {
+        // The root object is the only top-level element.
+        if(cur >= end || num_nodes == 0)
+            return false;
+        cur = end;
+        num_frames = 0;
+        openJSONElement(0, -1);
+        return true;
+    }
+
+    empty_element = false;
+    Tag_Type type = readTag();
+    if(type == START_TAG)
+        return true;
+    if(type == END_TAG)
+        setError("Unexpected end tag", cur);
+    return false;
+}
+
+bool XML_Stream::nextChild()
+{
+    if(error != NULL)
+        return false;
+
+    if(json)
+        return nextJSONChild();
+
+    // A self-closing element has no children and is already finished.
+    if(empty_element)
+    {
+        empty_element = false;
+        return false;
+    }
+
+    Tag_Type type = readTag();
+    if(type == START_TAG)
+        return true;
+    if(type == END_OF_DOCUMENT)
+        setError("Unexpected end of document", cur);
+    return false;
+}
+
+void XML_Stream::skipElement()
+{
+    if(json)
+    {
+        // The contents are already indexed, so the element can just be closed.
+        if(num_frames > 0)
+            num_frames--;
+        return;
+    }
+
+    while(nextChild())
+        skipElement();
+}
+
+int XML_Stream::getToken() const
+{
+    return token;
+}
+
+int XML_Stream::getNumAttributes() const
+{
+    return num_attributes;
+}
+
+int XML_Stream::getAttributeToken(int index) const
+{
+    return attributes[index].token;
+}
+
+const char* XML_Stream::getAttributeValue(int index) const
+{
+    return attributes[index].value;
+}
+
+bool XML_Stream::hasError() const
+{
+    return (error != NULL);
+}
+
+const char* XML_Stream::getError() const
+{
+    return (error == NULL? "" : error);
+}
+
+int XML_Stream::getErrorLine() const
+{
+    if(error_line > 0)
+        return error_line;
+    if(error_pos == NULL || begin == NULL)
+        return 0;
+
+    int line = 1;
+    for(const char* c = begin; c < error_pos && c < end; c++)
+    {
+        if(*c == '\n')
+            line++;
+    }
+    return line;
+}
+
+void XML_Stream::setError(const char* message, const char* pos)
+{
+    if(error != NULL)
+        return;
+    error = message;
+    error_pos = pos;
+}
+
+int XML_Stream::intern(const char* name, int length) const
+{
+    unsigned int slot = hashName(name, length) & table_mask;
+    while(table[slot] >= 0)
+    {
+        const char* candidate = names[table[slot]];
+        if(strncmp(candidate, name, length) == 0 && candidate[length] == '\0')
+            return table[slot];
+        slot = (slot + 1) & table_mask;
+    }
+    return -1;
+}
+
+char* XML_Stream::unescape(char* first, char* last)
+{
+    char* amp = (char*)memchr(first, '&', last - first);
+    if(amp == NULL)
+    {
+        *last = '\0';
+        return first;
+    }
+
+    char* out = amp;
+    char* in = amp;
+    while(in < last)
+    {
+        if(*in != '&')
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        char* semicolon = (char*)memchr(in, ';', last - in);
+        if(semicolon == NULL)
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        int length = semicolon - in - 1;
+        const char* name = in + 1;
+        unsigned long code = 0;
+        bool valid = true;
+
+        if(length == 2 && memcmp(name, "lt", 2) == 0)
+            code = '<';
+        else if(length == 2 && memcmp(name, "gt", 2) == 0)
+            code = '>';
+        else if(length == 3 && memcmp(name, "amp", 3) == 0)
+            code = '&';
+        else if(length == 4 && memcmp(name, "quot", 4) == 0)
+            code = '"';
+        else if(length == 4 && memcmp(name, "apos", 4) == 0)
+            code = '\'';
+        else if(length > 1 && name[0] == '#')
+        {
+            char* num_end = NULL;
+            if(name[1] == 'x' || name[1] == 'X')
+                code = strtoul(name + 2, &num_end, 16);
+            else
+                code = strtoul(name + 1, &num_end, 10);
+            valid = (num_end == semicolon);
+        }
+        else
+            valid = false;
+
+        if(!valid)
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        // The encoding is never longer than the entity it replaces.
+        encodeUTF8(out, code);
+        in = semicolon + 1;
+    }
+
+    *out = '\0';
+    return first;
+}
+
+XML_Stream::Tag_Type XML_Stream::readTag()
+{
+    while(true)
+    {
+        // Skip character data
+        while(cur < end && *cur != '<')
+            cur++;
+        if(cur >= end)
+            return END_OF_DOCUMENT;
+
+        char* tag = cur;
+
+        if(cur + 1 < end && cur[1] == '?')
+        {
+            char* close = findString(cur, end, "?>");
+            if(close == NULL)
+                break;
+            cur = close + 2;
+            continue;
+        }
+
+        if(cur + 1 < end && cur[1] == '!')
+        {
+            const char* terminator = ">";
+            if(cur + 3 < end && cur[2] == '-' && cur[3] == '-')
+                terminator = "-->";
+            else if(cur + 8 < end && memcmp(cur, "<![CDATA[", 9) == 0)
+                terminator = "]]>";
+
+            char* close = findString(cur + 2, end, terminator);
+            if(close == NULL)
+                break;
+            cur = close + strlen(terminator);
+            continue;
+        }
+
+        if(cur + 1 < end && cur[1] == '/')
+        {
+            char* close = (char*)memchr(cur, '>', end - cur);
+            if(close == NULL)
+                break;
+            cur = close + 1;
+            return END_TAG;
+        }
+
+        // Start tag
+        cur++;
+        char* name = cur;
+        while(cur < end && !isNameEnd(*cur))
+            cur++;
+        if(cur == name || cur >= end)
+            break;
+
+        token = intern(name, cur - name);
+        num_attributes = 0;
+        empty_element = false;
+
+        while(true)
+        {
+            while(cur < end && isSpace(*cur))
+                cur++;
+            if(cur >= end)
+            {
+                setError("Unterminated tag", tag);
+                return PARSE_ERROR;
+            }
+
+            if(*cur == '>')
+            {
+                cur++;
+                return START_TAG;
+            }
+            if(*cur == '/')
+            {
+                if(cur + 1 >= end || cur[1] != '>')
+                {
+                    setError("Malformed tag", cur);
+                    return PARSE_ERROR;
+                }
+                cur += 2;
+                empty_element = true;
+                return START_TAG;
+            }
+
+            // Attribute
+            char* attr_name = cur;
+            while(cur < end && !isNameEnd(*cur))
+                cur++;
+            int attr_length = cur - attr_name;
+            while(cur < end && isSpace(*cur))
+                cur++;
+            if(attr_length == 0 || cur >= end || *cur != '=')
+            {
+                setError("Malformed attribute", attr_name);
+                return PARSE_ERROR;
+            }
+            cur++;
+            while(cur < end && isSpace(*cur))
+                cur++;
+            if(cur >= end || (*cur != '"' && *cur != '\''))
+            {
+                setError("Attribute value is not quoted", attr_name);
+                return PARSE_ERROR;
+            }
+
+            char quote = *cur;
+            char* value = cur + 1;
+            char* close = (char*)memchr(value, quote, end - value);
+            if(close == NULL)
+            {
+                setError("Unterminated attribute value", attr_name);
+                return PARSE_ERROR;
+            }
+            cur = close + 1;
+
+            // Unknown attributes are skipped without being unescaped.
+            int attr_token = intern(attr_name, attr_length);
+            if(attr_token >= 0 && num_attributes < MAX_ATTRIBUTES)
+            {
+                attributes[num_attributes].token = attr_token;
+                attributes[num_attributes].value = unescape(value, close);
+                num_attributes++;
+            }
+        }
+    }
+
+    setError("Unterminated markup", cur);
+    return PARSE_ERROR;
+}
+
+int XML_Stream::addJSONNode(int type, int token, const char* value)
+{
+    if(num_nodes == nodes_capacity)
+    {
+        int capacity = (nodes_capacity < 256? 256 : 2*nodes_capacity);
+        JSON_Node* grown = new JSON_Node[capacity];
+        if(num_nodes > 0)
+            memcpy(grown, nodes, num_nodes*sizeof(JSON_Node));
+        delete[] nodes;
+        nodes = grown;
+        nodes_capacity = capacity;
+    }
+
+    JSON_Node& node = nodes[num_nodes];
+    node.type = type;
+    node.token = token;
+    node.value = value;
+    node.end = num_nodes + 1;
+    return num_nodes++;
+}
+
+bool XML_Stream::parseJSONString(char*& value)
+{
+    // 'cur' is on the opening quote.  The string is unescaped in place and null-terminated.
+    char* in = cur + 1;
+    char* out = in;
+    value = in;
+
+    while(in < end && *in != '"')
+    {
+        if(*in != '\\')
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        if(in + 1 >= end)
+            break;
+
+        char c = in[1];
+        in += 2;
+        switch(c)
+        {
+            case '"':
+            case '\\':
+            case '/':
+                *out++ = c;
+                break;
+            case 'b':
+                *out++ = '\b';
+                break;
+            case 'f':
+                *out++ = '\f';
+                break;
+            case 'n':
+                *out++ = '\n';
+                break;
+            case 'r':
+                *out++ = '\r';
+                break;
+            case 't':
+                *out++ = '\t';
+                break;
+            case 'u':
+            {
+                long code = readHex4(in, end);
+                if(code < 0)
+                {
+                    setError("Malformed escape in string", in - 2);
+                    return false;
+                }
+                in += 4;
+
+                // Combine a surrogate pair
+                if(code >= 0xD800 && code < 0xDC00 && end - in >= 6 && in[0] == '\\' && in[1] == 'u')
+                {
+                    long low = readHex4(in + 2, end);
+                    if(low >= 0xDC00 && low < 0xE000)
+                    {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        in += 6;
+                    }
+                }
+
+                // The encoding is never longer than the escape it replaces.
+                encodeUTF8(out, code);
+                break;
+            }
+            default:
+                setError("Malformed escape in string", in - 2);
+                return false;
+        }
+    }
+
+    if(in >= end)
+    {
+        setError("Unterminated string", cur);
+        return false;
+    }
+
+    *out = '\0';
+    cur = in + 1;
+    return true;
+}
+
+bool XML_Stream::parseJSON()
+{
+    enum State {EXPECT_VALUE, EXPECT_VALUE_OR_CLOSE, EXPECT_MEMBER, EXPECT_MEMBER_OR_CLOSE, EXPECT_SEPARATOR, DONE};
+
+    // Containers that are still open, as node indices
+    int open[MAX_JSON_DEPTH];
+    int depth = 0;
+
+    State state = EXPECT_VALUE;
+    int member_token = -1;
+    int line = 1;
+    // End of the last number or literal.  It is terminated once the character there has been read.
+    char* pending = NULL;
+
+    while(true)
+    {
+        while(cur < end && isSpace(*cur))
+        {
+            if(*cur == '\n')
+                line++;
+            cur++;
+        }
+        if(cur >= end)
+            break;
+
+        char c = *cur;
+        if(pending != NULL)
+        {
+            *pending = '\0';
+            pending = NULL;
+        }
+
+        if(state == DONE)
+        {
+            setError("Unexpected data after the root object", cur);
+            break;
+        }
+
+        if(state == EXPECT_SEPARATOR)
+        {
+            int container = open[depth-1];
+            bool is_object = (nodes[container].type == JSON_OBJECT);
+            if(c == ',')
+            {
+                cur++;
+                state = (is_object? EXPECT_MEMBER : EXPECT_VALUE);
+                member_token = -1;
+                continue;
+            }
+            if(c == (is_object? '}' : ']'))
+            {
+                cur++;
+                nodes[container].end = num_nodes;
+                depth--;
+                state = (depth == 0? DONE : EXPECT_SEPARATOR);
+                continue;
+            }
+            setError("Expected ',' or a closing bracket", cur);
+            break;
+        }
+
+        if(state == EXPECT_MEMBER || state == EXPECT_MEMBER_OR_CLOSE)
+        {
+            if(c == '}' && state == EXPECT_MEMBER_OR_CLOSE)
+            {
+                state = EXPECT_SEPARATOR;
+                continue;  // Closed by the separator state
+            }
+            if(c != '"')
+            {
+                setError("Expected a member name", cur);
+                break;
+            }
+
+            char* name = NULL;
+            if(!parseJSONString(name))
+                break;
+            member_token = intern(name, strlen(name));
+
+            while(cur < end && isSpace(*cur))
+            {
+                if(*cur == '\n')
+                    line++;
+                cur++;
+            }
+            if(cur >= end || *cur != ':')
+            {
+                setError("Expected ':' after a member name", cur);
+                break;
+            }
+            cur++;
+            state = EXPECT_VALUE;
+            continue;
+        }
+
+        // A value
+        if(c == ']' && state == EXPECT_VALUE_OR_CLOSE)
+        {
+            state = EXPECT_SEPARATOR;
+            continue;  // Closed by the separator state
+        }
+
+        if(depth == 0 && c != '{')
+        {
+            setError("The root of a JSON document must be an object", cur);
+            break;
+        }
+
+        if(c == '{' || c == '[')
+        {
+            if(depth >= MAX_JSON_DEPTH)
+            {
+                setError("Document is nested too deeply", cur);
+                break;
+            }
+            open[depth++] = addJSONNode((c == '{'? JSON_OBJECT : JSON_ARRAY), member_token, NULL);
+            cur++;
+            state = (c == '{'? EXPECT_MEMBER_OR_CLOSE : EXPECT_VALUE_OR_CLOSE);
+            member_token = -1;
+            continue;
+        }
+
+        if(c == '"')
+        {
+            char* value = NULL;
+            if(!parseJSONString(value))
+                break;
+            addJSONNode(JSON_VALUE, member_token, value);
+        }
+        else if(c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n')
+        {
+            // Numbers and literals are passed on as text, like XML attribute values.
+            char* value = cur;
+            while(cur < end && !isSpace(*cur) && *cur != ',' && *cur != '}' && *cur != ']')
+                cur++;
+            if(cur >= end)
+            {
+                setError("Unexpected end of document", value);
+                break;
+            }
+            pending = cur;
+
+            // null is the same as leaving the member out
+            if(!(cur - value == 4 && memcmp(value, "null", 4) == 0))
+                addJSONNode(JSON_VALUE, member_token, value);
+        }
+        else
+        {
+            setError("Expected a value", cur);
+            break;
+        }
+
+        state = EXPECT_SEPARATOR;
+    }
+
+    if(error == NULL && state != DONE)
+        setError("Unexpected end of document", cur);
+
+    if(error != NULL)
+    {
+        error_line = line;
+        num_nodes = 0;
+        return false;
+    }
+    return true;
+}
+
+void XML_Stream::openJSONElement(int node, int element_token)
+{
+    if(num_frames == frames_capacity)
+    {
+        int capacity = (frames_capacity < 16? 16 : 2*frames_capacity);
+        JSON_Frame* grown = new JSON_Frame[capacity];
+        if(num_frames > 0)
+            memcpy(grown, frames, num_frames*sizeof(JSON_Frame));
+        delete[] frames;
+        frames = grown;
+        frames_capacity = capacity;
+    }
+
+    JSON_Frame& frame = frames[num_frames++];
+    frame.member = node + 1;
+    frame.member_end = nodes[node].end;
+    frame.item = frame.item_end = 0;
+    frame.item_token = -1;
+
+    token = element_token;
+    empty_element = false;
+
+    // Plain members are the attributes.  They can come in any order relative to the children.
+    num_attributes = 0;
+    for(int i = frame.member; i < frame.member_end; i = nodes[i].end)
+    {
+        if(nodes[i].type == JSON_VALUE && nodes[i].token >= 0 && num_attributes < MAX_ATTRIBUTES)
+        {
+            attributes[num_attributes].token = nodes[i].token;
+            attributes[num_attributes].value = nodes[i].value;
+            num_attributes++;
+        }
+    }
+}
+
+bool XML_Stream::nextJSONChild()
+{
+    if(num_frames == 0)
+        return false;
+
+    JSON_Frame& frame = frames[num_frames-1];
+    while(true)
+    {
+        // Objects in the array member that is being visited
+        while(frame.item < frame.item_end)
+        {
+            int i = frame.item;
+            frame.item = nodes[i].end;
+            if(nodes[i].type == JSON_OBJECT)
+            {
+                openJSONElement(i, frame.item_token);
+                return true;
+            }
+        }
+
+        if(frame.member >= frame.member_end)
+            break;
+
+        int i = frame.member;
+        frame.member = nodes[i].end;
+        if(nodes[i].type == JSON_OBJECT)
+        {
+            openJSONElement(i, nodes[i].token);
+            return true;
+        }
+        if(nodes[i].type == JSON_ARRAY)
+        {
+            frame.item = i + 1;
+            frame.item_end = nodes[i].end;
+            frame.item_token = nodes[i].token;
+        }
+    }
+
+    // The element has ended
+    num_frames--;
+    return false;
+}
@@ -0,0 +1,164 @@
+#ifndef _XML_STREAM_H__
+#define _XML_STREAM_H__
+
+/*! \brief A small streaming (pull) XML parser that works in place on a byte buffer.
+ *
+ * No document tree is built.  Element and attribute names are interned into integer tokens from a table
+ * given by the caller, so that readers can switch on them instead of comparing strings.  Attribute values
+ * are unescaped and null-terminated inside the buffer, so they can be handed to atoi()/atof() directly.
+ *
+ * Reading an element looks like this:
+ *
+ *     // The stream is positioned on the element's start tag here.
+ *     for(int i = 0; i < stream.getNumAttributes(); i++)
+ *         switch(stream.getAttributeToken(i)) { ... }
+ *     while(stream.nextChild())
+ *     {
+ *         switch(stream.getToken())
+ *         {
+ *             // Each child must be consumed, either by reading it or with skipElement().
+ *             default:
+ *                 stream.skipElement();
+ *         }
+ *     }
+ *     // The element's end tag has been consumed here.
+ *
+ * The stream can also read JSON documents (e.g. Spriter's SCON format), which are mapped onto the same interface:
+ * an object is an element, its members with plain values are its attributes (in any order), and members holding an
+ * object or an array of objects are child elements named after the member.  The root object has the token -1.
+ */
+class XML_Stream
+{
+public:
+
+    enum { MAX_ATTRIBUTES = 64, MAX_JSON_DEPTH = 256 };
+
+    /*! \brief Creates a stream that interns names from the given table.
+     *
+     * \param names Array of names.  The token of a name is its index in this array.  Unknown names get the token -1.
+     * \param num_names Number of names in the array
+     */
+    XML_Stream(const char* const* names, int num_names);
+    ~XML_Stream();
+
+    /*! \brief Reads a whole file into a buffer owned by the stream and starts parsing it.
+     */
+    bool loadFile(const char* filename);
+
+    /*! \brief Starts parsing the given buffer.  The buffer is modified in place and must outlive the stream's use.
+     */
+    void setBuffer(char* buffer, int size);
+
+    /*! \brief Reads a whole JSON file into a buffer owned by the stream and starts parsing it.
+     */
+    bool loadJSONFile(const char* filename);
+
+    /*! \brief Starts parsing the given JSON buffer.  The buffer is modified in place and must outlive the stream's use.
+     *
+     * The whole document is checked and indexed here, so a syntax error is reported before any element is read.
+     */
+    void setJSONBuffer(char* buffer, int size);
+
+    /*! \brief Moves to the next start tag at the top level of the document (used to find the root element).
+     */
+    bool nextElement();
+
+    /*! \brief Moves to the next child of the current element.
+     *
+     * \return true if positioned on a child's start tag, false if the current element has ended (or on error).
+     */
+    bool nextChild();
+
+    /*! \brief Consumes the rest of the current element, including all of its children.
+     */
+    void skipElement();
+
+    int getToken() const;
+    int getNumAttributes() const;
+    int getAttributeToken(int index) const;
+    const char* getAttributeValue(int index) const;
+
+    bool hasError() const;
+    const char* getError() const;
+    /*! \brief Gets the line number of the parse error. */
+    int getErrorLine() const;
+
+private:
+
+    enum Tag_Type {START_TAG, END_TAG, END_OF_DOCUMENT, PARSE_ERROR};
+    enum JSON_Type {JSON_OBJECT, JSON_ARRAY, JSON_VALUE};
+
+    struct Attribute
+    {
+        int token;
+        const char* value;
+    };
+
+    // A JSON value.  Containers are followed by their contents, so the nodes form a flattened tree.
+    struct JSON_Node
+    {
+        int type;
+        // Token of the member name, or -1
+        int token;
+        // Null-terminated text of a JSON_VALUE
+        const char* value;
+        // Index of the first node after this one's contents
+        int end;
+    };
+
+    // An open JSON element and the position of the next child to visit
+    struct JSON_Frame
+    {
+        int member;
+        int member_end;
+        // Set while visiting the items of an array member
+        int item;
+        int item_end;
+        int item_token;
+    };
+
+    const char* const* names;
+    int num_names;
+
+    // Open-addressed hash table of name indices
+    int* table;
+    int table_mask;
+
+    char* owned_buffer;
+    char* begin;
+    char* cur;
+    char* end;
+
+    int token;
+    bool empty_element;
+    int num_attributes;
+    Attribute attributes[MAX_ATTRIBUTES];
+
+    const char* error;
+    const char* error_pos;
+    int error_line;
+
+    bool json;
+    JSON_Node* nodes;
+    int num_nodes;
+    int nodes_capacity;
+    JSON_Frame* frames;
+    int num_frames;
+    int frames_capacity;
+
+    bool readFile(const char* filename, int& buffer_size);
+    Tag_Type readTag();
+    bool parseJSON();
+    bool parseJSONString(char*& value);
+    int addJSONNode(int type, int token, const char* value);
+    void openJSONElement(int node, int token);
+    bool nextJSONChild();
+    int intern(const char* name, int length) const;
+    char* unescape(char* first, char* last);
+    void setError(const char* message, const char* pos);
+
+    XML_Stream(const XML_Stream& copy);
+    XML_Stream& operator=(const XML_Stream& copy);
+};
+
+#endif
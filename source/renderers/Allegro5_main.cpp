@@ -1,6 +1,7 @@
 #include				"SCML_Allegro5.h"
 #include				<allegro5/allegro.h>
 #include				<allegro5/allegro_image.h>
+#include				<allegro5/allegro_primitives.h>
 #include				<vector>
 #include				<list>
 
@@ -42,6 +43,7 @@ int					main_loop(std::vector<std::string>& data_files)
 
   bool				done = false;
   ALLEGRO_EVENT			ev;
+  SCML::DrawList			draw_list;
 
   while (!done)
     {
@@ -54,10 +56,14 @@ int					main_loop(std::vector<std::string>& data_files)
 	    }
 	  al_clear_to_color(al_map_rgb(255, 255, 255));
 
+	  // One list for all of the entities, so their objects are batched together
+	  draw_list.clear();
 	  for(std::list<Entity*>::iterator e = entities.begin(); e != entities.end(); e++)
 	    {
-	      (*e)->draw(x, y, angle, scale, scale);
+	      (*e)->buildDrawList(draw_list, x, y, angle, scale, scale);
 	    }
+	  if (!entities.empty())
+	    entities.front()->submit(draw_list);
 	  al_flip_display();
 	}
     }
@@ -69,6 +75,8 @@ bool					init(unsigned int w, unsigned int h)
     return false;
   if (!al_init_image_addon())
     return false;
+  if (!al_init_primitives_addon())
+    return false;
   if (!al_install_keyboard())
     return false;
   if (!al_install_mouse())
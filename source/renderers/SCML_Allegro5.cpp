@@ -28,6 +28,24 @@ bool					FileSystem::loadImageFile(int folderID,
   return true;
 }
 
+bool					FileSystem::loadAtlasPage(int atlasID,
+								  const std::string& filename)
+{
+  ALLEGRO_BITMAP*			img;
+
+  img = al_load_bitmap(filename.c_str());
+  if(img == NULL)
+    return false;
+
+  if (!SCML_MAP_INSERT(this->pages, atlasID, img))
+    {
+      printf("SCML_AL::FileSystem failed to load atlas page: Loading %s duplicates an atlas id (%d)\n", SCML_TO_CSTRING(filename), atlasID);
+      al_destroy_bitmap(img);
+      return false;
+    }
+  return true;
+}
+
 void					FileSystem::clear()
 {
 
@@ -39,11 +57,24 @@ void					FileSystem::clear()
     }
   SCML_END_MAP_FOREACH_CONST;
   this->images.clear();
+
+  SCML_BEGIN_MAP_FOREACH_CONST(pages, int, ALLEGRO_BITMAP*, item)
+    {
+      al_destroy_bitmap(item);
+    }
+  SCML_END_MAP_FOREACH_CONST;
+  this->pages.clear();
+  this->clearAtlasRegions();
 }
 
 SCML_PAIR(unsigned int, unsigned int)	FileSystem::getImageDimensions(int folderID, int fileID) const
 {
   ALLEGRO_BITMAP*			img;
+  SCML_PAIR(unsigned int, unsigned int)	dimensions;
+
+  // Images on an atlas page have their original size
+  if (this->getAtlasImageDimensions(folderID, fileID, dimensions))
+    return dimensions;
 
   img = SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
   if(img == NULL)
@@ -56,16 +87,31 @@ ALLEGRO_BITMAP*				FileSystem::getImage(int folderID, int fileID) const
   return SCML_MAP_FIND(this->images, SCML_MAKE_PAIR(folderID, fileID));
 }
 
+SCML_PAIR(unsigned int, unsigned int)	FileSystem::getAtlasPageDimensions(int atlasID) const
+{
+  ALLEGRO_BITMAP*			img;
+
+  img = SCML_MAP_FIND(pages, atlasID);
+  if(img == NULL)
+    return SCML_MAKE_PAIR(0,0);
+  return SCML_MAKE_PAIR(al_get_bitmap_width(img), al_get_bitmap_height(img));
+}
+
+ALLEGRO_BITMAP*				FileSystem::getAtlasPage(int atlasID) const
+{
+  return SCML_MAP_FIND(this->pages, atlasID);
+}
+
 
 
 
 
 Entity::Entity()
-  : SCML::Entity()
+  : SCML::Entity(), num_batches(0)
 {}
 
 Entity::Entity(SCML::Data* data, int entity, int animation, int key)
-  : SCML::Entity(data, entity, animation, key)
+  : SCML::Entity(data, entity, animation, key), num_batches(0)
 {}
 
 FileSystem				*Entity::setFileSystem(FileSystem* fs)
@@ -98,6 +144,11 @@ SCML_PAIR(unsigned int, unsigned int)	Entity::getImageDimensions(int folderID, i
   return file_system->getImageDimensions(folderID, fileID);
 }
 
+const SCML::FileSystem::Atlas_Region	*Entity::getAtlasRegion(int folderID, int fileID) const
+{
+  return file_system->getAtlasRegion(folderID, fileID);
+}
+
 // (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
 void					Entity::draw_internal(int folderID,
 							      int fileID,
@@ -111,6 +162,24 @@ void					Entity::draw_internal(int folderID,
   angle = 360 - angle;
 
   ALLEGRO_BITMAP			*img;
+  const SCML::FileSystem::Atlas_Region	*region;
+
+  // Images on an atlas page are drawn from their rectangle of it, which (x, y) is already the center of
+  region = file_system->getAtlasRegion(folderID, fileID);
+  if (region != NULL)
+    {
+      img = file_system->getAtlasPage(region->page);
+      if(img == NULL)
+	return;
+      al_draw_tinted_scaled_rotated_bitmap_region(img,
+						  region->x, region->y, region->width, region->height,
+						  al_map_rgb(255,255,255),
+						  region->width / 2.0f, region->height / 2.0f,
+						  x, y,
+						  scale_x, scale_y,
+						  angle * ALLEGRO_PI / 180, 0);
+      return;
+    }
 
   img = file_system->getImage(folderID, fileID);
   if(img == NULL)
@@ -128,3 +197,68 @@ void					Entity::draw_internal(int folderID,
 				       angle * ALLEGRO_PI / 180, 0);
   // screen->draw(sprite);
 }
+
+void					Entity::draw(float x, float y, float angle, float scale_x, float scale_y)
+{
+  bool					held;
+
+  // Consecutive objects on the same bitmap are then drawn together.  Drawing something else flushes them first, so the order is kept.
+  held = al_is_bitmap_drawing_held();
+  al_hold_bitmap_drawing(true);
+  SCML::Entity::draw(x, y, angle, scale_x, scale_y);
+  al_hold_bitmap_drawing(held);
+}
+
+void					Entity::flush(ALLEGRO_BITMAP *texture)
+{
+  if (texture == NULL || SCML_VECTOR_SIZE(this->vertices) == 0)
+    return;
+  al_draw_prim(&this->vertices[0], NULL, texture, 0, SCML_VECTOR_SIZE(this->vertices), ALLEGRO_PRIM_TRIANGLE_LIST);
+  SCML_VECTOR_CLEAR(this->vertices);
+  this->num_batches++;
+}
+
+// The commands are drawn in the order of the list.  Each run of commands that use the same bitmap becomes one batch.
+void					Entity::submit(const SCML::DrawList& list)
+{
+  ALLEGRO_BITMAP			*batch_texture;
+  ALLEGRO_BITMAP			*texture;
+  SCML::DrawList::Quad			quad;
+  ALLEGRO_VERTEX			vertex[4];
+  static const int			triangles[6] = {0, 1, 2, 0, 2, 3};
+
+  this->num_batches = 0;
+  SCML_VECTOR_CLEAR(this->vertices);
+  batch_texture = NULL;
+  for (int i = 0; i < list.size(); i++)
+    {
+      const SCML::DrawList::Command	&command = list[i];
+
+      if (!list.getQuad(i, *file_system, quad))
+	continue;
+      texture = (quad.page >= 0 ? file_system->getAtlasPage(quad.page) : file_system->getImage(command.folder, command.file));
+      if (texture == NULL)
+	continue;
+
+      if (texture != batch_texture)
+	{
+	  this->flush(batch_texture);
+	  batch_texture = texture;
+	}
+
+      // Allegro's texture coordinates are in pixels.  The tint is premultiplied, like Allegro's default blender expects.
+      ALLEGRO_COLOR			color = al_map_rgba_f(command.r * command.a, command.g * command.a, command.b * command.a, command.a);
+      for (int k = 0; k < 4; k++)
+	{
+	  vertex[k].x = quad.x[k];
+	  vertex[k].y = quad.y[k];
+	  vertex[k].z = 0;
+	  vertex[k].u = quad.u[k];
+	  vertex[k].v = quad.v[k];
+	  vertex[k].color = color;
+	}
+      for (int k = 0; k < 6; k++)
+	SCML_VECTOR_PUSH_BACK(this->vertices, vertex[triangles[k]]);
+    }
+  this->flush(batch_texture);
+}
@@ -3,6 +3,7 @@
 
 #include				<allegro5/allegro.h>
 #include				<allegro5/allegro_image.h>
+#include				<allegro5/allegro_primitives.h>
 #include				"SCMLpp.h"
 
 /*! \brief Namespace for Allegro5 renderer
@@ -13,30 +14,50 @@ namespace SCML_AL
   {
   public:
     SCML_MAP(SCML_PAIR(int, int), ALLEGRO_BITMAP*) images;
+    SCML_MAP(int, ALLEGRO_BITMAP*) pages;
     virtual ~FileSystem();
     virtual bool			loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool			loadAtlasPage(int atlasID, const std::string& filename);
     virtual void			clear();
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const;
     ALLEGRO_BITMAP			*getImage(int folderID, int fileID) const;
+    ALLEGRO_BITMAP			*getAtlasPage(int atlasID) const;
 };
 
+  /*! draw() holds bitmap drawing, so Allegro batches the objects that use the same bitmap.  submit() goes further: It
+   *  turns a whole DrawList into textured, tinted triangles and draws each run of commands that use the same bitmap
+   *  (or atlas page) with one al_draw_prim() call.  It needs the primitives addon (al_init_primitives_addon()).
+   */
   class Entity : public SCML::Entity
   {
   public:
     FileSystem				*file_system;
     ALLEGRO_DISPLAY			*screen;
 
+    // Number of al_draw_prim() calls of the last submit()
+    int					num_batches;
+
     Entity();
     Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
 
     FileSystem				*setFileSystem(FileSystem* fs);
     ALLEGRO_DISPLAY			*setScreen(ALLEGRO_DISPLAY *scr);
 
+    virtual void			draw(float x,
+					     float y,
+					     float angle = 0.0f,
+					     float scale_x = 1.0f,
+					     float scale_y = 1.0f);
+    virtual void			submit(const SCML::DrawList& list);
+
     virtual void			convert_to_SCML_coords(float& x,
 								 float& y,
 								 float& angle);
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID,
 								       int fileID) const;
+    virtual const SCML::FileSystem::Atlas_Region *getAtlasRegion(int folderID,
+								  int fileID) const;
     virtual void			draw_internal(int folderID,
 							int fileID,
 							float x,
@@ -44,6 +65,12 @@ namespace SCML_AL
 							float angle,
 							float scale_x,
 							float scale_y);
+
+  private:
+    // Reused by submit()
+    SCML_VECTOR(ALLEGRO_VERTEX)		vertices;
+
+    void				flush(ALLEGRO_BITMAP *texture);
   };
 }
 
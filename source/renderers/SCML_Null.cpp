@@ -0,0 +1,253 @@
+#include "SCML_Null.h"
+#include <cstdio>
+#include <cstring>
+
+
+namespace SCML_Null
+{
+
+
+FileSystem::~FileSystem()
+{
+    // Delete everything
+    clear();
+}
+
+bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+{
+    // Read the dimensions and store them somewhere accessible by the image's folder/file ID combo.
+    unsigned int width, height;
+    if(!readImageDimensions(filename, width, height))
+    {
+        printf("SCML_Null::FileSystem failed to read image size: %s\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+    if(!SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), SCML_MAKE_PAIR(width, height)))
+    {
+        printf("SCML_Null::FileSystem failed to load image: Loading %s duplicates a folder/file id (%d/%d)\n", SCML_TO_CSTRING(filename), folderID, fileID);
+        return false;
+    }
+    return true;
+}
+
+bool FileSystem::loadAtlasPage(int atlasID, const std::string& filename)
+{
+    unsigned int width, height;
+    if(!readImageDimensions(filename, width, height))
+    {
+        printf("SCML_Null::FileSystem failed to read atlas page size: %s\n", SCML_TO_CSTRING(filename));
+        return false;
+    }
+    if(!SCML_MAP_INSERT(pages, atlasID, SCML_MAKE_PAIR(width, height)))
+    {
+        printf("SCML_Null::FileSystem failed to load atlas page: Loading %s duplicates an atlas id (%d)\n", SCML_TO_CSTRING(filename), atlasID);
+        return false;
+    }
+    return true;
+}
+
+void FileSystem::clear()
+{
+    // Nothing to free
+    images.clear();
+    pages.clear();
+    clearAtlasRegions();
+}
+
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getImageDimensions(int folderID, int fileID) const
+{
+    // Images on an atlas page have their original size
+    SCML_PAIR(unsigned int, unsigned int) dimensions;
+    if(getAtlasImageDimensions(folderID, fileID, dimensions))
+        return dimensions;
+    
+    // Return the width and height of an image (as a pair of unsigned ints)
+    return SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
+}
+
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getAtlasPageDimensions(int atlasID) const
+{
+    return SCML_MAP_FIND(pages, atlasID);
+}
+
+static unsigned int read_big_endian(const unsigned char* bytes, int size)
+{
+    unsigned int result = 0;
+    for(int i = 0; i < size; i++)
+        result = (result << 8) | bytes[i];
+    return result;
+}
+
+static unsigned int read_little_endian(const unsigned char* bytes, int size)
+{
+    unsigned int result = 0;
+    for(int i = size - 1; i >= 0; i--)
+        result = (result << 8) | bytes[i];
+    return result;
+}
+
+// JPEG keeps the size in its start-of-frame segment, so walk the segments until one turns up.
+static bool read_jpeg_dimensions(FILE* file, unsigned int& width, unsigned int& height)
+{
+    unsigned char segment[7];
+    fseek(file, 2, SEEK_SET);
+    while(fread(segment, 1, 4, file) == 4 && segment[0] == 0xFF)
+    {
+        int marker = segment[1];
+        unsigned int length = read_big_endian(segment + 2, 2);
+    
+        // SOF0 to SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            if(fread(segment, 1, 5, file) != 5)
+                return false;
+            height = read_big_endian(segment + 1, 2);
+            width = read_big_endian(segment + 3, 2);
+            return true;
+        }
+    
+        if(length < 2 || fseek(file, length - 2, SEEK_CUR) != 0)
+            return false;
+    }
+    return false;
+}
+
+bool FileSystem::readImageDimensions(const std::string& filename, unsigned int& width, unsigned int& height)
+{
+    FILE* file = fopen(SCML_TO_CSTRING(filename), "rb");
+    if(file == NULL)
+        return false;
+    
+    unsigned char header[26];
+    size_t size = fread(header, 1, sizeof(header), file);
+    
+    bool result = false;
+    if(size >= 24 && memcmp(header, "\x89PNG\r\n\x1A\n", 8) == 0)
+    {
+        // The IHDR chunk comes first
+        width = read_big_endian(header + 16, 4);
+        height = read_big_endian(header + 20, 4);
+        result = true;
+    }
+    else if(size >= 10 && (memcmp(header, "GIF87a", 6) == 0 || memcmp(header, "GIF89a", 6) == 0))
+    {
+        width = read_little_endian(header + 6, 2);
+        height = read_little_endian(header + 8, 2);
+        result = true;
+    }
+    else if(size >= 26 && header[0] == 'B' && header[1] == 'M')
+    {
+        // BITMAPINFOHEADER.  The height is negative for top-down bitmaps.
+        width = read_little_endian(header + 18, 4);
+        int signed_height = int(read_little_endian(header + 22, 4));
+        height = (signed_height < 0? -signed_height : signed_height);
+        result = true;
+    }
+    else if(size >= 2 && header[0] == 0xFF && header[1] == 0xD8)
+    {
+        result = read_jpeg_dimensions(file, width, height);
+    }
+    
+    fclose(file);
+    return result;
+}
+
+
+
+
+
+
+Recorder::Recorder()
+    : keep_calls(true), num_calls(0)
+{}
+
+void Recorder::clear()
+{
+    SCML_VECTOR_CLEAR(calls);
+    num_calls = 0;
+}
+
+
+
+
+
+
+// Pass the initialization on to the base class, SCML::Entity.
+Entity::Entity()
+    : SCML::Entity(), file_system(NULL), recorder(NULL)
+{}
+
+Entity::Entity(SCML::Data* data, int entity, int animation, int key)
+    : SCML::Entity(data, entity, animation, key), file_system(NULL), recorder(NULL)
+{}
+
+// Set the renderer-specific FileSystem
+FileSystem* Entity::setFileSystem(FileSystem* fs)
+{
+    FileSystem* old = file_system;
+    file_system = fs;
+    return old;
+}
+
+// Set the renderer-specific render target
+Recorder* Entity::setRecorder(Recorder* rec)
+{
+    Recorder* old = recorder;
+    recorder = rec;
+    return old;
+}
+
+
+
+
+// Convert from the renderer's coordinate system to SCML's coordinate system (+x to the right, +y up, +angle counter-clockwise)
+void Entity::convert_to_SCML_coords(float& x, float& y, float& angle)
+{
+    // Same as the other renderers (+x to the right, +y down, +angle clockwise), so the work is comparable.
+    y = -y;
+    angle = 360 - angle;
+}
+
+SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, int fileID) const
+{
+    // Let the FileSystem do the work
+    if(file_system == NULL)
+        return SCML_MAKE_PAIR(0, 0);
+    return file_system->getImageDimensions(folderID, fileID);
+}
+
+const SCML::FileSystem::Atlas_Region* Entity::getAtlasRegion(int folderID, int fileID) const
+{
+    if(file_system == NULL)
+        return NULL;
+    return file_system->getAtlasRegion(folderID, fileID);
+}
+
+// The "rendering" call.
+// (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
+void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+{
+    if(recorder == NULL)
+        return;
+    
+    recorder->num_calls++;
+    if(!recorder->keep_calls)
+        return;
+    
+    // Keep the arguments as they are, in the SCML coordinate system.
+    Recorder::Draw_Call call;
+    call.folder = folderID;
+    call.file = fileID;
+    call.x = x;
+    call.y = y;
+    call.angle = angle;
+    call.scale_x = scale_x;
+    call.scale_y = scale_y;
+    SCML_VECTOR_PUSH_BACK(recorder->calls, call);
+}
+
+
+
+
+
+}
@@ -0,0 +1,134 @@
+#ifndef _NULL_RENDERER_H__
+#define _NULL_RENDERER_H__
+
+#include "SCMLpp.h"
+
+/*! \brief Namespace for the headless renderer, which records draw calls instead of drawing
+ *
+ * It needs no window or GPU, so it can be used to measure SCMLpp itself (see tools/scmlbench.cpp) or to run animations
+ * on a server.
+*/
+namespace SCML_Null
+{
+
+/*! \brief Storage class for image dimensions, indexed by folder and file IDs.
+ *
+ * Only the header of each image is read, so loading is cheap and no pixels are ever decoded.
+*/
+class FileSystem : public SCML::FileSystem
+{
+    public:
+    
+    /*! These ints are: Folder, File.  SCMLpp uses these two integers to uniquely identify to an image.
+     * The values are the width and height of the image.
+    */
+    SCML_MAP(SCML_PAIR(int, int), SCML_PAIR(unsigned int, unsigned int)) images;
+    
+    /*! The width and height of each atlas page, by atlas ID
+    */
+    SCML_MAP(int, SCML_PAIR(unsigned int, unsigned int)) pages;
+    
+    virtual ~FileSystem();
+    
+    /*! Read the image's dimensions from its header and store them so they can be accessed again by the folder/file ID combo.
+    */
+    virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    
+    /*! Read the atlas page's dimensions from its header and store them by its atlas ID.
+    */
+    virtual bool loadAtlasPage(int atlasID, const std::string& filename);
+    
+    /*! Forget all stored images
+    */
+    virtual void clear();
+    
+    /*! Get the width and height of an image
+    */
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    
+    /*! Get the width and height of an atlas page
+    */
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const;
+    
+    /*! Read the width and height from the header of a PNG, JPEG, GIF or BMP file.
+    */
+    static bool readImageDimensions(const std::string& filename, unsigned int& width, unsigned int& height);
+};
+
+/*! \brief Where a headless Entity "draws" to: A list of the draw_internal() calls.
+ */
+class Recorder
+{
+    public:
+    
+    /*! The arguments of one draw_internal() call
+    */
+    class Draw_Call
+    {
+        public:
+    
+        int folder;
+        int file;
+        float x, y;
+        float angle;
+        float scale_x, scale_y;
+    };
+    
+    SCML_VECTOR(Draw_Call) calls;
+    
+    /*! When false, calls are only counted, which keeps the recording out of benchmarks.
+    */
+    bool keep_calls;
+    int num_calls;
+    
+    Recorder();
+    
+    /*! Forget the recorded calls (keeping the memory for the next frame)
+    */
+    void clear();
+};
+
+/*! \brief A class to "draw" SCML character data without a renderer.
+ */
+class Entity : public SCML::Entity
+{
+    public:
+    
+    /*! The entity needs to have a way to retrieve image data from the folder/file IDs that SCMLpp uses.
+    */
+    FileSystem* file_system;
+    
+    /*! The entity also needs a place to draw to.  Calls are dropped if this is NULL.
+    */
+    Recorder* recorder;
+    
+    Entity();
+    Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
+    
+    FileSystem* setFileSystem(FileSystem* fs);
+    Recorder* setRecorder(Recorder* rec);
+    
+    /*! This converts x, y, and angle to the proper coordinate system, as necessary.
+     * Like most renderers, this one uses +y down and clockwise angles.
+     */
+    virtual void convert_to_SCML_coords(float& x, float& y, float& angle);
+    
+    /*! Get the width and height of an image.
+    */
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    
+    /*! Get where an image is on its atlas page, or NULL.
+    */
+    virtual const SCML::FileSystem::Atlas_Region* getAtlasRegion(int folderID, int fileID) const;
+    
+    /*! Record the call.
+     * (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise).
+     */
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+};
+
+}
+
+
+
+#endif
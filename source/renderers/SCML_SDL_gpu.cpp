@@ -1,5 +1,9 @@
 #include "SCML_SDL_gpu.h"
+#define NO_SDL_GLEXT  // Only OpenGL 1.1 is used
+#include "SDL_opengl.h"
+#include "SDL_gpu_OpenGL.h"
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 
 
@@ -28,6 +32,21 @@ bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& file
     return true;
 }
 
+bool FileSystem::loadAtlasPage(int atlasID, const std::string& filename)
+{
+    // Load the page and store it by its atlas ID.  The base class places the images on it.
+    GPU_Image* img = GPU_LoadImage(SCML_TO_CSTRING(filename));
+    if(img == NULL)
+        return false;
+    if(!SCML_MAP_INSERT(pages, atlasID, img))
+    {
+        printf("SCML_SDL_gpu::FileSystem failed to load atlas page: Loading %s duplicates an atlas id (%d)\n", SCML_TO_CSTRING(filename), atlasID);
+        GPU_FreeImage(img);
+        return false;
+    }
+    return true;
+}
+
 void FileSystem::clear()
 {
     // Delete the stored images
@@ -38,10 +57,23 @@ void FileSystem::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
+    
+    SCML_BEGIN_MAP_FOREACH_CONST(pages, int, GPU_Image*, item)
+    {
+        GPU_FreeImage(item);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    pages.clear();
+    clearAtlasRegions();
 }
 
 SCML_PAIR(unsigned int, unsigned int) FileSystem::getImageDimensions(int folderID, int fileID) const
 {
+    // Images on an atlas page have their original size
+    SCML_PAIR(unsigned int, unsigned int) dimensions;
+    if(getAtlasImageDimensions(folderID, fileID, dimensions))
+        return dimensions;
+    
     // Return the width and height of an image (as a pair of unsigned ints)
     GPU_Image* img = SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
     if(img == NULL)
@@ -55,6 +87,19 @@ GPU_Image* FileSystem::getImage(int folderID, int fileID) const
     return SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
 }
 
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getAtlasPageDimensions(int atlasID) const
+{
+    GPU_Image* img = SCML_MAP_FIND(pages, atlasID);
+    if(img == NULL)
+        return SCML_MAKE_PAIR(0,0);
+    return SCML_MAKE_PAIR(img->w, img->h);
+}
+
+GPU_Image* FileSystem::getAtlasPage(int atlasID) const
+{
+    return SCML_MAP_FIND(pages, atlasID);
+}
+
 
 
 
@@ -62,11 +107,11 @@ GPU_Image* FileSystem::getImage(int folderID, int fileID) const
 
 // Pass the initialization on to the base class, SCML::Entity.
 Entity::Entity()
-    : SCML::Entity()
+    : SCML::Entity(), num_flushes(0), batch_image(NULL)
 {}
 
 Entity::Entity(SCML::Data* data, int entity, int animation, int key)
-    : SCML::Entity(data, entity, animation, key)
+    : SCML::Entity(data, entity, animation, key), num_flushes(0), batch_image(NULL)
 {}
 
 // Set the renderer-specific FileSystem
@@ -102,6 +147,11 @@ SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, i
     return file_system->getImageDimensions(folderID, fileID);
 }
 
+const SCML::FileSystem::Atlas_Region* Entity::getAtlasRegion(int folderID, int fileID) const
+{
+    return file_system->getAtlasRegion(folderID, fileID);
+}
+
 // The actual rendering call.
 // (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
 void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
@@ -111,6 +161,19 @@ void Entity::draw_internal(int folderID, int fileID, float x, float y, float ang
     y = -y;
     angle = 360 - angle;
     
+    // Images on an atlas page are drawn from their rectangle of it.  SCMLpp already moved (x, y) to its center.
+    const SCML::FileSystem::Atlas_Region* region = file_system->getAtlasRegion(folderID, fileID);
+    if(region != NULL)
+    {
+        SDL_Rect rect;
+        rect.x = region->x;
+        rect.y = region->y;
+        rect.w = region->width;
+        rect.h = region->height;
+        GPU_BlitTransform(file_system->getAtlasPage(region->page), &rect, screen, x, y, angle, scale_x, scale_y);
+        return;
+    }
+    
     // Get the image
     GPU_Image* img = file_system->getImage(folderID, fileID);
     
@@ -118,6 +181,91 @@ void Entity::draw_internal(int folderID, int fileID, float x, float y, float ang
     GPU_BlitTransform(img, NULL, screen, x, y, angle, scale_x, scale_y);
 }
 
+// The streams are drawn with OpenGL directly, in the display's coordinates like SDL_gpu's blits.  Render targets and
+// clipping are left to the blits.
+static bool can_batch(GPU_Target* target)
+{
+    const char* renderer = GPU_GetCurrentRendererID();
+    return (renderer != NULL && strcmp(renderer, "OpenGL") == 0 && target == GPU_GetDisplayTarget() && !target->useClip);
+}
+
+void Entity::submit(const SCML::DrawList& list)
+{
+    if(!can_batch(screen))
+    {
+        SCML::Entity::submit(list);
+        num_flushes += list.size();
+        return;
+    }
+    
+    // The tint is modulated by the color that was set with GPU_SetColor(), like the blits are
+    GLfloat color[4];
+    glGetFloatv(GL_CURRENT_COLOR, color);
+    float z = GPU_GetZ();
+    
+    batch_image = NULL;
+    SCML_VECTOR_CLEAR(batch_vertices);
+    for(int i = 0; i < list.size(); i++)
+    {
+        const SCML::DrawList::Command& command = list[i];
+        
+        SCML::DrawList::Quad quad;
+        if(!list.getQuad(i, *file_system, quad))
+            continue;
+        GPU_Image* img = (quad.page >= 0? file_system->getAtlasPage(quad.page) : file_system->getImage(command.folder, command.file));
+        if(img == NULL)
+            continue;
+        
+        if(img != batch_image)
+        {
+            flush();
+            batch_image = img;
+        }
+        
+        int first = SCML_VECTOR_SIZE(batch_vertices);
+        SCML_VECTOR_RESIZE(batch_vertices, first + 4*9);
+        float* vertex = &batch_vertices[first];
+        for(int k = 0; k < 4; k++, vertex += 9)
+        {
+            vertex[0] = quad.x[k];
+            vertex[1] = quad.y[k];
+            vertex[2] = z;
+            vertex[3] = quad.s[k];
+            vertex[4] = quad.t[k];
+            vertex[5] = command.r*color[0];
+            vertex[6] = command.g*color[1];
+            vertex[7] = command.b*color[2];
+            vertex[8] = command.a*color[3];
+        }
+    }
+    flush();
+    
+    glColor4fv(color);
+}
+
+void Entity::flush()
+{
+    if(batch_image == NULL || SCML_VECTOR_SIZE(batch_vertices) == 0)
+        return;
+    
+    glBindTexture(GL_TEXTURE_2D, ((ImageData_OpenGL*)batch_image->data)->handle);
+    
+    const float* vertices = &batch_vertices[0];
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 9*sizeof(float), vertices);
+    glTexCoordPointer(2, GL_FLOAT, 9*sizeof(float), vertices + 3);
+    glColorPointer(4, GL_FLOAT, 9*sizeof(float), vertices + 5);
+    glDrawArrays(GL_QUADS, 0, SCML_VECTOR_SIZE(batch_vertices)/9);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    
+    SCML_VECTOR_CLEAR(batch_vertices);
+    num_flushes++;
+}
+
 
 
 
@@ -21,6 +21,10 @@ class FileSystem : public SCML::FileSystem
     */
     SCML_MAP(SCML_PAIR(int, int), GPU_Image*) images;
     
+    /*! Atlas pages, by atlas ID.  The images on them are drawn from their SCML::FileSystem::Atlas_Region.
+    */
+    SCML_MAP(int, GPU_Image*) pages;
+    
     /*! Delete all of the stored images in the destructor
     */
     virtual ~FileSystem();
@@ -29,6 +33,10 @@ class FileSystem : public SCML::FileSystem
     */
     virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
     
+    /*! Load an atlas page and store it so it can be accessed again by its atlas ID.
+    */
+    virtual bool loadAtlasPage(int atlasID, const std::string& filename);
+    
     /*! Delete all stored images
     */
     virtual void clear();
@@ -37,10 +45,18 @@ class FileSystem : public SCML::FileSystem
     */
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
     
+    /*! Get the width and height of an atlas page
+    */
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const;
+    
     /*! Get an image
     */
     GPU_Image* getImage(int folderID, int fileID) const;
     
+    /*! Get an atlas page
+    */
+    GPU_Image* getAtlasPage(int atlasID) const;
+    
 };
 
 /*! \brief A class to draw SCML character data.
@@ -57,6 +73,10 @@ class Entity : public SCML::Entity
     */
     GPU_Target* screen;
     
+    /*! Number of batches that submit() has drawn.  Set it to 0 each frame to count the batches per frame.
+    */
+    int num_flushes;
+    
     Entity();
     Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
     
@@ -72,10 +92,29 @@ class Entity : public SCML::Entity
     */
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
     
+    /*! Get where an image is on its atlas page, or NULL if it is a separate image.
+    */
+    virtual const SCML::FileSystem::Atlas_Region* getAtlasRegion(int folderID, int fileID) const;
+    
     /*! The actual drawing call
      * (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise), so they must be converted,
      */
     virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+    
+    /*! Draws a whole draw list, in order.  Each run of commands that use the same image (or atlas page) is collected
+     * into one stream of vertices, texture coordinates and tint colors and drawn with one call when the image changes.
+     * The streams are drawn directly with the OpenGL renderer on the display target.  Otherwise, each command is blitted.
+     */
+    virtual void submit(const SCML::DrawList& list);
+    
+    private:
+    
+    /*! The image of the stream being collected, and x, y, z, s, t, r, g, b, a for each of its vertices
+    */
+    GPU_Image* batch_image;
+    SCML_VECTOR(float) batch_vertices;
+    
+    void flush();
 };
 
 }
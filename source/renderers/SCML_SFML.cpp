@@ -29,6 +29,24 @@ bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& file
     return true;
 }
 
+bool FileSystem::loadAtlasPage(int atlasID, const std::string& filename)
+{
+    sf::Texture* img = new sf::Texture;
+    if(!img->loadFromFile(filename))
+    {
+        delete img;
+        return false;
+    }
+    
+    if(!SCML_MAP_INSERT(pages, atlasID, img))
+    {
+        printf("SCML_SFML::FileSystem failed to load atlas page: Loading %s duplicates an atlas id (%d)\n", SCML_TO_CSTRING(filename), atlasID);
+        delete img;
+        return false;
+    }
+    return true;
+}
+
 void FileSystem::clear()
 {
     typedef SCML_PAIR(int,int) pair_type;
@@ -38,10 +56,22 @@ void FileSystem::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
+    
+    SCML_BEGIN_MAP_FOREACH_CONST(pages, int, sf::Texture*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    pages.clear();
+    clearAtlasRegions();
 }
 
 SCML_PAIR(unsigned int, unsigned int) FileSystem::getImageDimensions(int folderID, int fileID) const
 {
+    SCML_PAIR(unsigned int, unsigned int) dimensions;
+    if(getAtlasImageDimensions(folderID, fileID, dimensions))
+        return dimensions;
+    
     sf::Texture* img = SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
     if(img == NULL)
         return SCML_MAKE_PAIR(0,0);
@@ -53,6 +83,19 @@ sf::Texture* FileSystem::getImage(int folderID, int fileID) const
     return SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
 }
 
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getAtlasPageDimensions(int atlasID) const
+{
+    sf::Texture* img = SCML_MAP_FIND(pages, atlasID);
+    if(img == NULL)
+        return SCML_MAKE_PAIR(0,0);
+    return SCML_MAKE_PAIR(img->getSize().x, img->getSize().y);
+}
+
+sf::Texture* FileSystem::getAtlasPage(int atlasID) const
+{
+    return SCML_MAP_FIND(pages, atlasID);
+}
+
 
 
 
@@ -60,11 +103,11 @@ sf::Texture* FileSystem::getImage(int folderID, int fileID) const
 
     
 Entity::Entity()
-    : SCML::Entity()
+    : SCML::Entity(), batched(false), vertices(sf::Quads), batch_texture(NULL)
 {}
 
 Entity::Entity(SCML::Data* data, int entity, int animation, int key)
-    : SCML::Entity(data, entity, animation, key)
+    : SCML::Entity(data, entity, animation, key), batched(false), vertices(sf::Quads), batch_texture(NULL)
 {}
 
 FileSystem* Entity::setFileSystem(FileSystem* fs)
@@ -81,6 +124,13 @@ sf::RenderTarget* Entity::setScreen(sf::RenderTarget* scr)
     return old;
 }
 
+bool Entity::setBatched(bool enable)
+{
+    bool old = batched;
+    batched = enable;
+    return old;
+}
+
 
 
 
@@ -97,18 +147,37 @@ SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, i
     return file_system->getImageDimensions(folderID, fileID);
 }
 
+const SCML::FileSystem::Atlas_Region* Entity::getAtlasRegion(int folderID, int fileID) const
+{
+    return file_system->getAtlasRegion(folderID, fileID);
+}
+
 // (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
 void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
 {
     y = -y;
     angle = 360 - angle;
     
-    sf::Texture* img = file_system->getImage(folderID, fileID);
-    if(img == NULL)
-        return;
-    
-    sf::Sprite sprite(*img);
-    sprite.setOrigin(img->getSize().x/2, img->getSize().y/2);
+    sf::Sprite sprite;
+    const SCML::FileSystem::Atlas_Region* region = file_system->getAtlasRegion(folderID, fileID);
+    if(region != NULL)
+    {
+        // Draw the image's rectangle of its atlas page.  (x, y) is already the center of the rectangle.
+        sf::Texture* page = file_system->getAtlasPage(region->page);
+        if(page == NULL)
+            return;
+        sprite.setTexture(*page);
+        sprite.setTextureRect(sf::IntRect(region->x, region->y, region->width, region->height));
+        sprite.setOrigin(region->width/2.0f, region->height/2.0f);
+    }
+    else
+    {
+        sf::Texture* img = file_system->getImage(folderID, fileID);
+        if(img == NULL)
+            return;
+        sprite.setTexture(*img);
+        sprite.setOrigin(img->getSize().x/2, img->getSize().y/2);
+    }
     sprite.setScale(scale_x, scale_y);
     sprite.setRotation(angle);
     sprite.setPosition(x, y);
@@ -116,6 +185,59 @@ void Entity::draw_internal(int folderID, int fileID, float x, float y, float ang
     screen->draw(sprite);
 }
 
+void Entity::draw(float x, float y, float angle, float scale_x, float scale_y)
+{
+    if(!batched)
+    {
+        SCML::Entity::draw(x, y, angle, scale_x, scale_y);
+        return;
+    }
+    
+    draw_list.clear();
+    buildDrawList(draw_list, x, y, angle, scale_x, scale_y);
+    submit(draw_list);
+}
+
+void Entity::flush()
+{
+    if(batch_texture != NULL && vertices.getVertexCount() > 0)
+        screen->draw(vertices, sf::RenderStates(batch_texture));
+    
+    // clear() keeps the capacity, so the next frames do not allocate
+    vertices.clear();
+}
+
+// The commands are drawn in the order of the list.  Each run of commands that use the same texture is one draw.
+void Entity::submit(const SCML::DrawList& list)
+{
+    batch_texture = NULL;
+    vertices.clear();
+    for(int i = 0; i < list.size(); i++)
+    {
+        const SCML::DrawList::Command& command = list[i];
+        
+        SCML::DrawList::Quad quad;
+        if(!list.getQuad(i, *file_system, quad))
+            continue;
+        const sf::Texture* texture = (quad.page >= 0? file_system->getAtlasPage(quad.page) : file_system->getImage(command.folder, command.file));
+        if(texture == NULL)
+            continue;
+        
+        if(texture != batch_texture)
+        {
+            flush();
+            batch_texture = texture;
+        }
+        
+        // SFML's texture coordinates are in pixels
+        sf::Color color(sf::Uint8(command.r*255), sf::Uint8(command.g*255), sf::Uint8(command.b*255), sf::Uint8(command.a*255));
+        for(int k = 0; k < 4; k++)
+            vertices.append(sf::Vertex(sf::Vector2f(quad.x[k], quad.y[k]), color, sf::Vector2f(quad.u[k], quad.v[k])));
+    }
+    flush();
+    batch_texture = NULL;
+}
+
 
 
 
@@ -2,6 +2,7 @@
 #define _SFML_RENDERER_H__
 
 #include "SFML/Graphics/Texture.hpp"
+#include "SFML/Graphics/VertexArray.hpp"
 #include "SCMLpp.h"
 
 /*! \brief Namespace for SFML renderer
@@ -15,32 +16,55 @@ class FileSystem : public SCML::FileSystem
     
     // Folder, File
     SCML_MAP(SCML_PAIR(int, int), sf::Texture*) images;
+    // Atlas ID
+    SCML_MAP(int, sf::Texture*) pages;
     
     virtual ~FileSystem();
     virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadAtlasPage(int atlasID, const std::string& filename);
     virtual void clear();
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const;
     
     sf::Texture* getImage(int folderID, int fileID) const;
+    sf::Texture* getAtlasPage(int atlasID) const;
     
 };
 
+/*! With batched set, draw() builds the entity's draw list and submit()s it instead of drawing a sprite per object.
+ * submit() appends four vertices per command to one vertex array and draws it once per run of commands that use the
+ * same texture (or atlas page).  The array and the list keep their memory between frames.
+ */
 class Entity : public SCML::Entity
 {
     public:
     
     FileSystem* file_system;
     sf::RenderTarget* screen;
+    bool batched;
     
     Entity();
     Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
     
     FileSystem* setFileSystem(FileSystem* fs);
     sf::RenderTarget* setScreen(sf::RenderTarget* scr);
+    bool setBatched(bool enable);
+    
+    virtual void draw(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+    virtual void submit(const SCML::DrawList& list);
     
     virtual void convert_to_SCML_coords(float& x, float& y, float& angle);
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual const SCML::FileSystem::Atlas_Region* getAtlasRegion(int folderID, int fileID) const;
     virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+    
+    private:
+    
+    SCML::DrawList draw_list;
+    sf::VertexArray vertices;
+    const sf::Texture* batch_texture;
+    
+    void flush();
 };
 
 }
@@ -0,0 +1,634 @@
+#include "SCML_Software.h"
+#include <cstdio>
+#include <cmath>
+
+// SSE2 for sampling and blending.  Define SCML_NO_SIMD to use only the scalar code.
+#ifndef SCML_NO_SIMD
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #include <emmintrin.h>
+        #define SCML_USE_SSE2
+    #endif
+#endif
+
+
+namespace SCML_Software
+{
+
+
+FileSystem::~FileSystem()
+{
+    clear();
+}
+
+bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+{
+    PNG_Image* img = new PNG_Image;
+    if(!img->load(filename))
+    {
+        printf("SCML_Software::FileSystem failed to load image: %s\n", SCML_TO_CSTRING(filename));
+        delete img;
+        return false;
+    }
+    premultiply(*img);
+
+    if(!SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), img))
+    {
+        printf("SCML_Software::FileSystem failed to load image: Loading %s duplicates a folder/file id (%d/%d)\n", SCML_TO_CSTRING(filename), folderID, fileID);
+        delete img;
+        return false;
+    }
+    return true;
+}
+
+bool FileSystem::loadAtlasPage(int atlasID, const std::string& filename)
+{
+    PNG_Image* page = new PNG_Image;
+    if(!page->load(filename))
+    {
+        printf("SCML_Software::FileSystem failed to load atlas page: %s\n", SCML_TO_CSTRING(filename));
+        delete page;
+        return false;
+    }
+    premultiply(*page);
+
+    if(!SCML_MAP_INSERT(pages, atlasID, page))
+    {
+        printf("SCML_Software::FileSystem failed to load atlas page: Loading %s duplicates an atlas id (%d)\n", SCML_TO_CSTRING(filename), atlasID);
+        delete page;
+        return false;
+    }
+    return true;
+}
+
+void FileSystem::clear()
+{
+    typedef SCML_PAIR(int,int) pair_type;
+    SCML_BEGIN_MAP_FOREACH_CONST(images, pair_type, PNG_Image*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    images.clear();
+
+    SCML_BEGIN_MAP_FOREACH_CONST(pages, int, PNG_Image*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    pages.clear();
+    clearAtlasRegions();
+}
+
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getImageDimensions(int folderID, int fileID) const
+{
+    SCML_PAIR(unsigned int, unsigned int) dimensions;
+    if(getAtlasImageDimensions(folderID, fileID, dimensions))
+        return dimensions;
+
+    PNG_Image* img = SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
+    if(img == NULL)
+        return SCML_MAKE_PAIR(0,0);
+    return SCML_MAKE_PAIR(img->width, img->height);
+}
+
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getAtlasPageDimensions(int atlasID) const
+{
+    PNG_Image* page = SCML_MAP_FIND(pages, atlasID);
+    if(page == NULL)
+        return SCML_MAKE_PAIR(0,0);
+    return SCML_MAKE_PAIR(page->width, page->height);
+}
+
+const PNG_Image* FileSystem::getPixels(int folderID, int fileID, int& x, int& y, int& width, int& height) const
+{
+    const SCML::FileSystem::Atlas_Region* region = getAtlasRegion(folderID, fileID);
+    if(region != NULL)
+    {
+        PNG_Image* page = SCML_MAP_FIND(pages, region->page);
+        if(page == NULL)
+            return NULL;
+        x = region->x;
+        y = region->y;
+        width = region->width;
+        height = region->height;
+        return page;
+    }
+
+    PNG_Image* img = SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
+    if(img == NULL)
+        return NULL;
+    x = 0;
+    y = 0;
+    width = img->width;
+    height = img->height;
+    return img;
+}
+
+void FileSystem::premultiply(PNG_Image& image)
+{
+    unsigned int size = image.width*image.height*4;
+    for(unsigned int i = 0; i < size; i += 4)
+    {
+        unsigned char* p = &image.pixels[i];
+        int a = p[3];
+        if(a == 255)
+            continue;
+        p[0] = (unsigned char)((p[0]*a + 127)/255);
+        p[1] = (unsigned char)((p[1]*a + 127)/255);
+        p[2] = (unsigned char)((p[2]*a + 127)/255);
+    }
+}
+
+
+
+
+
+
+class Framebuffer::Tile_Job : public SCML::JobScheduler::Job
+{
+public:
+
+    Framebuffer* framebuffer;
+    int tile;
+
+    Tile_Job(Framebuffer* framebuffer, int tile)
+        : framebuffer(framebuffer), tile(tile)
+    {}
+
+    virtual void run(int thread)
+    {
+        framebuffer->draw_tile(tile);
+    }
+};
+
+Framebuffer::Framebuffer()
+    : scheduler(NULL), tile_size(64), num_tiles_drawn(0), num_tiles_x(0), num_tiles_y(0)
+{}
+
+Framebuffer::Framebuffer(unsigned int width, unsigned int height)
+    : scheduler(NULL), tile_size(64), num_tiles_drawn(0), num_tiles_x(0), num_tiles_y(0)
+{
+    create(width, height);
+}
+
+Framebuffer::~Framebuffer()
+{
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(jobs); i++)
+        delete jobs[i];
+}
+
+void Framebuffer::create(unsigned int width, unsigned int height)
+{
+    image.create(width, height);
+}
+
+void Framebuffer::clear(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    unsigned char color[4] = {(unsigned char)((r*a + 127)/255), (unsigned char)((g*a + 127)/255), (unsigned char)((b*a + 127)/255), a};
+    unsigned int size = image.width*image.height*4;
+    for(unsigned int i = 0; i < size; i += 4)
+    {
+        image.pixels[i] = color[0];
+        image.pixels[i+1] = color[1];
+        image.pixels[i+2] = color[2];
+        image.pixels[i+3] = color[3];
+    }
+}
+
+void Framebuffer::getImage(PNG_Image& result) const
+{
+    result = image;
+    unsigned int size = result.width*result.height*4;
+    for(unsigned int i = 0; i < size; i += 4)
+    {
+        unsigned char* p = &result.pixels[i];
+        int a = p[3];
+        if(a == 0 || a == 255)
+            continue;
+        for(int k = 0; k < 3; k++)
+        {
+            int c = (p[k]*255 + a/2)/a;
+            p[k] = (unsigned char)(c > 255? 255 : c);
+        }
+    }
+}
+
+bool Framebuffer::save(const SCML_STRING& filename) const
+{
+    PNG_Image result;
+    getImage(result);
+    return result.save(filename);
+}
+
+static int to_tint(float value)
+{
+    if(value <= 0.0f)
+        return 0;
+    if(value >= 1.0f)
+        return 256;
+    return int(value*256.0f + 0.5f);
+}
+
+void Framebuffer::draw(const SCML::DrawList& list, const FileSystem& fs)
+{
+    int width = image.width;
+    int height = image.height;
+    if(width == 0 || height == 0 || tile_size <= 0)
+        return;
+
+    SCML_VECTOR_CLEAR(quads);
+    for(int i = 0; i < list.size(); i++)
+    {
+        const SCML::DrawList::Command& command = list[i];
+
+        Quad quad;
+        quad.texture = fs.getPixels(command.folder, command.file, quad.x, quad.y, quad.width, quad.height);
+        if(quad.texture == NULL || quad.width <= 0 || quad.height <= 0)
+            continue;
+
+        float a = (command.a < 0.0f? 0.0f : (command.a > 1.0f? 1.0f : command.a));
+        quad.tint[0] = to_tint(command.r*a);
+        quad.tint[1] = to_tint(command.g*a);
+        quad.tint[2] = to_tint(command.b*a);
+        quad.tint[3] = to_tint(a);
+        if(quad.tint[3] == 0)
+            continue;
+        quad.blend_mode = command.blend_mode;
+
+        // Top-left corner and the edges toward the top-right and bottom-left corners, in pixels
+        const float* c = command.corners;
+        float x0 = c[0], y0 = -c[1];
+        float ux = c[2] - c[0], uy = -c[3] + c[1];
+        float vx = c[6] - c[0], vy = -c[7] + c[1];
+        float det = ux*vy - uy*vx;
+        if(fabsf(det) < 1e-6f)
+            continue;
+
+        // Invert the mapping from (u, v) in [0, 1] to pixels, then scale it to the texture's rectangle
+        float du_dx = vy/det, du_dy = -vx/det;
+        float dv_dx = -uy/det, dv_dy = ux/det;
+        quad.ds_dx = du_dx*quad.width;
+        quad.ds_dy = du_dy*quad.width;
+        quad.dt_dx = dv_dx*quad.height;
+        quad.dt_dy = dv_dy*quad.height;
+        quad.s0 = quad.x - (x0*du_dx + y0*du_dy)*quad.width;
+        quad.t0 = quad.y - (x0*dv_dx + y0*dv_dy)*quad.height;
+
+        float min_x = x0, max_x = x0, min_y = y0, max_y = y0;
+        for(int k = 2; k < 8; k += 2)
+        {
+            float x = c[k], y = -c[k+1];
+            min_x = (x < min_x? x : min_x);
+            max_x = (x > max_x? x : max_x);
+            min_y = (y < min_y? y : min_y);
+            max_y = (y > max_y? y : max_y);
+        }
+        if(max_x <= 0.0f || max_y <= 0.0f || min_x >= width || min_y >= height)
+            continue;
+        quad.min_x = (min_x < 0.0f? 0 : int(min_x));
+        quad.min_y = (min_y < 0.0f? 0 : int(min_y));
+        quad.max_x = (max_x >= width? width - 1 : int(max_x));
+        quad.max_y = (max_y >= height? height - 1 : int(max_y));
+
+        SCML_VECTOR_PUSH_BACK(quads, quad);
+    }
+
+    // Bin the quads by the tiles that their bounds overlap
+    num_tiles_x = (width + tile_size - 1)/tile_size;
+    num_tiles_y = (height + tile_size - 1)/tile_size;
+    int num_tiles = num_tiles_x*num_tiles_y;
+    if(int(SCML_VECTOR_SIZE(bins)) < num_tiles)
+        SCML_VECTOR_RESIZE(bins, num_tiles);
+    for(int i = 0; i < num_tiles; i++)
+        SCML_VECTOR_CLEAR(bins[i]);
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(quads); i++)
+    {
+        const Quad& quad = quads[i];
+        for(int ty = quad.min_y/tile_size; ty <= quad.max_y/tile_size; ty++)
+        {
+            for(int tx = quad.min_x/tile_size; tx <= quad.max_x/tile_size; tx++)
+                SCML_VECTOR_PUSH_BACK(bins[ty*num_tiles_x + tx], i);
+        }
+    }
+
+    while(int(SCML_VECTOR_SIZE(jobs)) < num_tiles)
+        SCML_VECTOR_PUSH_BACK(jobs, new Tile_Job(this, SCML_VECTOR_SIZE(jobs)));
+    SCML_VECTOR_CLEAR(pending);
+    for(int i = 0; i < num_tiles; i++)
+    {
+        if(SCML_VECTOR_SIZE(bins[i]) > 0)
+            SCML_VECTOR_PUSH_BACK(pending, jobs[i]);
+    }
+    num_tiles_drawn = SCML_VECTOR_SIZE(pending);
+
+    if(scheduler != NULL && num_tiles_drawn > 1)
+        scheduler->run(SCML::Span<SCML::JobScheduler::Job*>(&pending[0], num_tiles_drawn));
+    else
+    {
+        for(int i = 0; i < num_tiles_drawn; i++)
+            pending[i]->run(0);
+    }
+}
+
+// Narrows [lo, hi) to the x where lower <= value + slope*x < upper.  Returns false if there are none.
+static bool clip_span(float value, float slope, float lower, float upper, float& lo, float& hi)
+{
+    if(slope == 0.0f)
+        return (value >= lower && value < upper);
+
+    float a = (lower - value)/slope;
+    float b = (upper - value)/slope;
+    if(slope < 0.0f)
+    {
+        float t = a;
+        a = b;
+        b = t;
+    }
+    lo = (a > lo? a : lo);
+    hi = (b < hi? b : hi);
+    return lo < hi;
+}
+
+// Rounds x/255 for x from 0 to 65025
+static inline int div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Blends a premultiplied source pixel into a premultiplied destination pixel
+template<int blend_mode>
+static inline void blend(unsigned char* dest, const int* src)
+{
+    int sa = src[3];
+    int da = dest[3];
+    for(int k = 0; k < 4; k++)
+    {
+        int s = src[k];
+        int d = dest[k];
+        int out;
+        if(blend_mode == SCML::DrawList::BLEND_ADDITIVE)
+            out = s + d;
+        else if(blend_mode == SCML::DrawList::BLEND_MULTIPLY)
+            out = div255(s*d) + div255(s*(255 - da)) + div255(d*(255 - sa));
+        else if(blend_mode == SCML::DrawList::BLEND_SCREEN)
+            out = s + d - div255(s*d);
+        else
+            out = s + div255(d*(255 - sa));
+        dest[k] = (unsigned char)(out > 255? 255 : out);
+    }
+}
+
+#ifdef SCML_USE_SSE2
+// The same arithmetic as blend(), on the 16-bit lanes 0 to 3.  The results are packed with saturation.
+static inline __m128i div255_sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+template<int blend_mode>
+static inline void blend_sse2(unsigned char* dest, __m128i s)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i d = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)dest), zero);
+    __m128i full = _mm_set1_epi16(255);
+    __m128i sa = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i out;
+    if(blend_mode == SCML::DrawList::BLEND_ADDITIVE)
+        out = _mm_add_epi16(s, d);
+    else if(blend_mode == SCML::DrawList::BLEND_MULTIPLY)
+    {
+        __m128i da = _mm_shufflelo_epi16(d, _MM_SHUFFLE(3, 3, 3, 3));
+        out = _mm_add_epi16(div255_sse2(_mm_mullo_epi16(s, d)), div255_sse2(_mm_mullo_epi16(s, _mm_sub_epi16(full, da))));
+        out = _mm_add_epi16(out, div255_sse2(_mm_mullo_epi16(d, _mm_sub_epi16(full, sa))));
+    }
+    else if(blend_mode == SCML::DrawList::BLEND_SCREEN)
+        out = _mm_sub_epi16(_mm_add_epi16(s, d), div255_sse2(_mm_mullo_epi16(s, d)));
+    else
+        out = _mm_add_epi16(s, div255_sse2(_mm_mullo_epi16(d, _mm_sub_epi16(full, sa))));
+    *(int*)dest = _mm_cvtsi128_si32(_mm_packus_epi16(out, zero));
+}
+#endif
+
+// Draws the pixels [x_begin, x_end) of a row of the image from a quad
+template<int blend_mode>
+static void draw_span(unsigned char* row, int x_begin, int x_end, float s_row, float t_row, const PNG_Image& texture, int s_min, int s_max, int t_min, int t_max, float ds_dx, float dt_dx, const int* tint)
+{
+    const unsigned char* texels = &texture.pixels[0];
+    int stride = texture.width*4;
+    float s_lo = float(s_min), s_hi = float(s_max);
+    float t_lo = float(t_min), t_hi = float(t_max);
+
+    #ifdef SCML_USE_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i tint_16 = _mm_setr_epi16(tint[0], tint[1], tint[2], tint[3], 0, 0, 0, 0);
+    #endif
+
+    for(int x = x_begin; x < x_end; x++)
+    {
+        // Sample between the texel centers, clamped to the rectangle, in 8-bit fixed point
+        float xc = x + 0.5f;
+        float s = s_row + ds_dx*xc - 0.5f;
+        float t = t_row + dt_dx*xc - 0.5f;
+        s = (s < s_lo? s_lo : (s > s_hi? s_hi : s));
+        t = (t < t_lo? t_lo : (t > t_hi? t_hi : t));
+        int fs = int(s*256.0f);
+        int ft = int(t*256.0f);
+        int s0 = fs >> 8, t0 = ft >> 8;
+        int ws = fs & 255, wt = ft & 255;
+        int s1 = (s0 < s_max? s0 + 1 : s0);
+        int t1 = (t0 < t_max? t0 + 1 : t0);
+
+        const unsigned char* p00 = texels + t0*stride + s0*4;
+        const unsigned char* p10 = texels + t0*stride + s1*4;
+        const unsigned char* p01 = texels + t1*stride + s0*4;
+        const unsigned char* p11 = texels + t1*stride + s1*4;
+        // Nothing to add where all four texels are transparent
+        if((p00[3] | p10[3] | p01[3] | p11[3]) == 0)
+            continue;
+        unsigned char* dest = row + x*4;
+
+        #ifdef SCML_USE_SSE2
+        // Lanes 0 to 3 are the left texels and 4 to 7 the right ones.  Blend the rows, then the columns.
+        __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int*)p00), _mm_cvtsi32_si128(*(const int*)p10)), zero);
+        __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int*)p01), _mm_cvtsi32_si128(*(const int*)p11)), zero);
+        __m128i column = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16(short(256 - wt))), _mm_mullo_epi16(bottom, _mm_set1_epi16(short(wt)))), 8);
+        column = _mm_mullo_epi16(column, _mm_setr_epi16(short(256 - ws), short(256 - ws), short(256 - ws), short(256 - ws), short(ws), short(ws), short(ws), short(ws)));
+        __m128i texel = _mm_srli_epi16(_mm_add_epi16(column, _mm_srli_si128(column, 8)), 8);
+        __m128i src = _mm_srli_epi16(_mm_mullo_epi16(texel, tint_16), 8);
+        blend_sse2<blend_mode>(dest, src);
+        #else
+        int src[4];
+        for(int k = 0; k < 4; k++)
+        {
+            int left = (p00[k]*(256 - wt) + p01[k]*wt) >> 8;
+            int right = (p10[k]*(256 - wt) + p11[k]*wt) >> 8;
+            int texel = (left*(256 - ws) + right*ws) >> 8;
+            src[k] = (texel*tint[k]) >> 8;
+        }
+        blend<blend_mode>(dest, src);
+        #endif
+    }
+}
+
+void Framebuffer::draw_tile(int tile)
+{
+    int tile_x0 = (tile % num_tiles_x)*tile_size;
+    int tile_y0 = (tile / num_tiles_x)*tile_size;
+    int tile_x1 = tile_x0 + tile_size;
+    int tile_y1 = tile_y0 + tile_size;
+    if(tile_x1 > int(image.width))
+        tile_x1 = image.width;
+    if(tile_y1 > int(image.height))
+        tile_y1 = image.height;
+
+    const SCML_VECTOR(int)& bin = bins[tile];
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(bin); i++)
+    {
+        const Quad& quad = quads[bin[i]];
+        int y_begin = (quad.min_y > tile_y0? quad.min_y : tile_y0);
+        int y_end = (quad.max_y + 1 < tile_y1? quad.max_y + 1 : tile_y1);
+
+        for(int y = y_begin; y < y_end; y++)
+        {
+            // The pixel centers of this row that map inside the quad's rectangle
+            float yc = y + 0.5f;
+            float s_row = quad.s0 + quad.ds_dy*yc;
+            float t_row = quad.t0 + quad.dt_dy*yc;
+            float lo = float(tile_x0) + 0.5f, hi = float(tile_x1) + 0.5f;
+            if(!clip_span(s_row, quad.ds_dx, float(quad.x), float(quad.x + quad.width), lo, hi)
+               || !clip_span(t_row, quad.dt_dx, float(quad.y), float(quad.y + quad.height), lo, hi))
+                continue;
+            int x_begin = int(ceilf(lo - 0.5f));
+            int x_end = int(ceilf(hi - 0.5f));
+            x_begin = (x_begin < tile_x0? tile_x0 : x_begin);
+            x_end = (x_end > tile_x1? tile_x1 : x_end);
+            if(x_begin >= x_end)
+                continue;
+
+            unsigned char* row = image.getPixel(0, y);
+            int s_max = quad.x + quad.width - 1;
+            int t_max = quad.y + quad.height - 1;
+            switch(quad.blend_mode)
+            {
+                case SCML::DrawList::BLEND_ADDITIVE:
+                    draw_span<SCML::DrawList::BLEND_ADDITIVE>(row, x_begin, x_end, s_row, t_row, *quad.texture, quad.x, s_max, quad.y, t_max, quad.ds_dx, quad.dt_dx, quad.tint);
+                    break;
+                case SCML::DrawList::BLEND_MULTIPLY:
+                    draw_span<SCML::DrawList::BLEND_MULTIPLY>(row, x_begin, x_end, s_row, t_row, *quad.texture, quad.x, s_max, quad.y, t_max, quad.ds_dx, quad.dt_dx, quad.tint);
+                    break;
+                case SCML::DrawList::BLEND_SCREEN:
+                    draw_span<SCML::DrawList::BLEND_SCREEN>(row, x_begin, x_end, s_row, t_row, *quad.texture, quad.x, s_max, quad.y, t_max, quad.ds_dx, quad.dt_dx, quad.tint);
+                    break;
+                default:
+                    draw_span<SCML::DrawList::BLEND_ALPHA>(row, x_begin, x_end, s_row, t_row, *quad.texture, quad.x, s_max, quad.y, t_max, quad.ds_dx, quad.dt_dx, quad.tint);
+                    break;
+            }
+        }
+    }
+}
+
+
+
+
+
+
+Entity::Entity()
+    : SCML::Entity(), file_system(NULL), screen(NULL)
+{}
+
+Entity::Entity(SCML::Data* data, int entity, int animation, int key)
+    : SCML::Entity(data, entity, animation, key), file_system(NULL), screen(NULL)
+{}
+
+FileSystem* Entity::setFileSystem(FileSystem* fs)
+{
+    FileSystem* old = file_system;
+    file_system = fs;
+    return old;
+}
+
+Framebuffer* Entity::setScreen(Framebuffer* scr)
+{
+    Framebuffer* old = screen;
+    screen = scr;
+    return old;
+}
+
+void Entity::draw(float x, float y, float angle, float scale_x, float scale_y)
+{
+    draw_list.clear();
+    buildDrawList(draw_list, x, y, angle, scale_x, scale_y);
+    submit(draw_list);
+}
+
+void Entity::submit(const SCML::DrawList& list)
+{
+    if(screen == NULL || file_system == NULL)
+        return;
+    screen->draw(list, *file_system);
+}
+
+void Entity::convert_to_SCML_coords(float& x, float& y, float& angle)
+{
+    y = -y;
+    angle = 360 - angle;
+}
+
+SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, int fileID) const
+{
+    return file_system->getImageDimensions(folderID, fileID);
+}
+
+const SCML::FileSystem::Atlas_Region* Entity::getAtlasRegion(int folderID, int fileID) const
+{
+    return file_system->getAtlasRegion(folderID, fileID);
+}
+
+// (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
+void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+{
+    if(screen == NULL || file_system == NULL)
+        return;
+
+    // Images on an atlas page are drawn from their rectangle of it, which (x, y) is already the center of
+    float width, height;
+    const SCML::FileSystem::Atlas_Region* region = file_system->getAtlasRegion(folderID, fileID);
+    if(region != NULL)
+    {
+        width = region->width;
+        height = region->height;
+    }
+    else
+    {
+        SCML_PAIR(unsigned int, unsigned int) dimensions = file_system->getImageDimensions(folderID, fileID);
+        width = dimensions.first;
+        height = dimensions.second;
+    }
+
+    SCML::DrawList list;
+    SCML_VECTOR_PUSH_BACK(list.commands, SCML::DrawList::Command());
+    SCML::DrawList::Command& command = list.commands.back();
+    command.folder = folderID;
+    command.file = fileID;
+    command.x = x;
+    command.y = y;
+    command.angle = angle;
+    command.scale_x = scale_x;
+    command.scale_y = scale_y;
+    command.r = command.g = command.b = command.a = 1.0f;
+    command.blend_mode = SCML::DrawList::BLEND_ALPHA;
+    command.z = 0;
+    command.sort_key = 0;
+
+    // The angle was negated for flipped images, and Affine negates it back
+    bool flipped = ((scale_x < 0) != (scale_y < 0));
+    SCML::Affine(SCML::Transform(x, y, flipped? -angle : angle, scale_x, scale_y)).getQuad(width, height, 0.5f, 0.5f, command.corners);
+
+    screen->draw(list, *file_system);
+}
+
+
+
+}
@@ -0,0 +1,165 @@
+#ifndef _SOFTWARE_RENDERER_H__
+#define _SOFTWARE_RENDERER_H__
+
+#include "SCMLpp.h"
+#include "PNG_Image.h"
+
+/*! \brief Namespace for the software renderer, which rasterizes draw lists into an image in memory
+ *
+ * It needs no window, GPU or other library, so it can render animation frames to PNG files on a server, e.g. for
+ * thumbnails or to compare the output of two versions of SCMLpp pixel for pixel (see tools/scmlrender.cpp).
+*/
+namespace SCML_Software
+{
+
+/*! \brief Storage class for the pixels of images and atlas pages, indexed by folder and file IDs or by atlas ID.
+ *
+ * Only PNG files are read.  The pixels are kept with premultiplied alpha, which is what the Framebuffer blends.
+*/
+class FileSystem : public SCML::FileSystem
+{
+    public:
+
+    // Folder, File
+    SCML_MAP(SCML_PAIR(int, int), PNG_Image*) images;
+    // Atlas ID
+    SCML_MAP(int, PNG_Image*) pages;
+
+    virtual ~FileSystem();
+    virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadAtlasPage(int atlasID, const std::string& filename);
+    virtual void clear();
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const;
+
+    /*! \brief Gets the pixels that an image is drawn from: Its own image or its atlas page, and its rectangle of them.
+     *
+     * \return NULL if the image is not loaded
+     */
+    const PNG_Image* getPixels(int folderID, int fileID, int& x, int& y, int& width, int& height) const;
+
+    /*! \brief Multiplies the color of each pixel by its alpha.
+     */
+    static void premultiply(PNG_Image& image);
+};
+
+/*! \brief An RGBA image with premultiplied alpha to draw into.
+ *
+ * It is split into square tiles that are rasterized in parallel when a JobScheduler is set.  Each tile draws the
+ * commands in order and the arithmetic is all integer past the texture coordinates, so the result does not depend on
+ * the number of threads or on whether the SSE2 code is used (define SCML_NO_SIMD to use only the scalar code).
+ * Compile it without fused multiply-adds (-ffp-contract=off) for the same result on every CPU.
+ * Images are sampled bilinearly within their own rectangle, so neighbors on an atlas page do not bleed in.
+*/
+class Framebuffer
+{
+    public:
+
+    PNG_Image image;
+
+    /*! Runs the tiles in parallel if it is not NULL */
+    SCML::JobScheduler* scheduler;
+
+    /*! Width and height of a tile in pixels */
+    int tile_size;
+
+    /*! Number of tiles that draw() rasterized the last time (tiles that no command touches are skipped) */
+    int num_tiles_drawn;
+
+    Framebuffer();
+    Framebuffer(unsigned int width, unsigned int height);
+    ~Framebuffer();
+
+    void create(unsigned int width, unsigned int height);
+
+    /*! \brief Fills the image with a color (0 to 255, not premultiplied).
+     */
+    void clear(unsigned char r = 0, unsigned char g = 0, unsigned char b = 0, unsigned char a = 0);
+
+    /*! \brief Rasterizes the commands of a list in order, with their tint, opacity and blend mode.
+     *
+     * The commands' corners are in the SCML coordinate system, so y is flipped: SCML (x, y) is pixel (x, -y).
+     */
+    void draw(const SCML::DrawList& list, const FileSystem& fs);
+
+    /*! \brief Copies the image without the premultiplication.
+     */
+    void getImage(PNG_Image& result) const;
+
+    /*! \brief Writes the image to a PNG file, without the premultiplication.
+     */
+    bool save(const SCML_STRING& filename) const;
+
+    private:
+
+    class Tile_Job;
+
+    // A command, ready to rasterize.  (s, t) are texel coordinates (linear in the pixel coordinates) and the command
+    // covers the pixels whose centers map inside its rectangle of the texture.
+    class Quad
+    {
+        public:
+
+        const PNG_Image* texture;
+        int x, y, width, height;
+        float s0, ds_dx, ds_dy;
+        float t0, dt_dx, dt_dy;
+        int min_x, min_y, max_x, max_y;
+        /*! Premultiplied tint, from 0 to 256 */
+        int tint[4];
+        int blend_mode;
+    };
+
+    int num_tiles_x, num_tiles_y;
+    SCML_VECTOR(Quad) quads;
+    // The quads that overlap each tile, in order, and the jobs that draw them
+    SCML_VECTOR(SCML_VECTOR(int)) bins;
+    SCML_VECTOR(Tile_Job*) jobs;
+    SCML_VECTOR(SCML::JobScheduler::Job*) pending;
+
+    void draw_tile(int tile);
+
+    Framebuffer(const Framebuffer& copy);
+    Framebuffer& operator=(const Framebuffer& copy);
+};
+
+/*! \brief A class to draw SCML character data into a Framebuffer.
+ */
+class Entity : public SCML::Entity
+{
+    public:
+
+    FileSystem* file_system;
+    Framebuffer* screen;
+
+    Entity();
+    Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
+
+    FileSystem* setFileSystem(FileSystem* fs);
+    Framebuffer* setScreen(Framebuffer* scr);
+
+    /*! Builds a draw list and rasterizes all of it at once.
+     */
+    virtual void draw(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
+    virtual void submit(const SCML::DrawList& list);
+
+    /*! Like most renderers, this one uses +y down and clockwise angles.
+     */
+    virtual void convert_to_SCML_coords(float& x, float& y, float& angle);
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual const SCML::FileSystem::Atlas_Region* getAtlasRegion(int folderID, int fileID) const;
+
+    /*! Draws one image, without a tint.  draw() and submit() do not use this.
+     */
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+
+    private:
+
+    SCML::DrawList draw_list;
+};
+
+}
+
+
+
+#endif
@@ -30,6 +30,23 @@ bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& file
     return true;
 }
 
+bool FileSystem::loadAtlasPage(int atlasID, const std::string& filename)
+{
+    CCTexture2D* page = CCTextureCache::sharedTextureCache()->addImage(SCML_TO_CSTRING(filename));
+    
+    if(page == NULL)
+        return false;
+    
+    if(!SCML_MAP_INSERT(pages, atlasID, page))
+    {
+        printf("SCML_cocos2dx::FileSystem failed to load atlas page: Loading %s duplicates an atlas id (%d)\n", SCML_TO_CSTRING(filename), atlasID);
+        return false;
+    }
+    else
+        page->retain();
+    return true;
+}
+
 void FileSystem::clear()
 {
     typedef SCML_PAIR(int,int) pair_type;
@@ -39,10 +56,22 @@ void FileSystem::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
+    
+    SCML_BEGIN_MAP_FOREACH_CONST(pages, int, CCTexture2D*, item)
+    {
+        item->release();
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    pages.clear();
+    clearAtlasRegions();
 }
 
 SCML_PAIR(unsigned int, unsigned int) FileSystem::getImageDimensions(int folderID, int fileID) const
 {
+    SCML_PAIR(unsigned int, unsigned int) dimensions;
+    if(getAtlasImageDimensions(folderID, fileID, dimensions))
+        return dimensions;
+    
     CCSprite* img = SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
     if(img == NULL)
         return SCML_MAKE_PAIR(0,0);
@@ -54,6 +83,41 @@ CCSprite* FileSystem::getImage(int folderID, int fileID) const
     return SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
 }
 
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getAtlasPageDimensions(int atlasID) const
+{
+    CCTexture2D* page = SCML_MAP_FIND(pages, atlasID);
+    if(page == NULL)
+        return SCML_MAKE_PAIR(0,0);
+    return SCML_MAKE_PAIR(page->getPixelsWide(), page->getPixelsHigh());
+}
+
+CCTexture2D* FileSystem::getAtlasPage(int atlasID) const
+{
+    return SCML_MAP_FIND(pages, atlasID);
+}
+
+CCSprite* FileSystem::getSprite(int folderID, int fileID)
+{
+    CCSprite* img = getImage(folderID, fileID);
+    if(img != NULL)
+        return img;
+    
+    const SCML::FileSystem::Atlas_Region* region = getAtlasRegion(folderID, fileID);
+    if(region == NULL)
+        return NULL;
+    CCTexture2D* page = getAtlasPage(region->page);
+    if(page == NULL)
+        return NULL;
+    
+    // The sprites of one page share its texture
+    img = CCSprite::createWithTexture(page, CC_RECT_PIXELS_TO_POINTS(CCRectMake(region->x, region->y, region->width, region->height)));
+    if(img == NULL)
+        return NULL;
+    img->retain();
+    SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), img);
+    return img;
+}
+
 
 
 
@@ -91,13 +155,19 @@ SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, i
     return file_system->getImageDimensions(folderID, fileID);
 }
 
+const SCML::FileSystem::Atlas_Region* Entity::getAtlasRegion(int folderID, int fileID) const
+{
+    return file_system->getAtlasRegion(folderID, fileID);
+}
+
 // (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
 void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
 {
     //y = -y;
     angle = 360 - angle;
     
-    CCSprite* img = file_system->getImage(folderID, fileID);
+    // Images on an atlas page are drawn from their rectangle of it, which (x, y) is already the center of
+    CCSprite* img = file_system->getSprite(folderID, fileID);
     if(img == NULL)
         return;
 
@@ -112,6 +182,172 @@ void Entity::draw_internal(int folderID, int fileID, float x, float y, float ang
 	img->visit();
 }
 
+int Entity::getBatch(CCTexture2D* texture, int run)
+{
+    // Runs claim the batch nodes of their texture in the order they were made, so each run keeps its node between frames
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(batches); i++)
+    {
+        Batch& batch = batches[i];
+        if(batch.texture == texture && batch.run < 0)
+        {
+            batch.run = run;
+            if(batch.z != run)
+            {
+                reorderChild(batch.node, run);
+                batch.z = run;
+            }
+            return i;
+        }
+    }
+    
+    Batch batch;
+    batch.node = CCSpriteBatchNode::createWithTexture(texture);
+    batch.texture = texture;
+    batch.run = run;
+    batch.z = run;
+    addChild(batch.node, run);
+    SCML_VECTOR_PUSH_BACK(batches, batch);
+    return SCML_VECTOR_SIZE(batches) - 1;
+}
+
+void Entity::updateNodes()
+{
+    // The children are placed relative to this node, which carries the entity's own transform
+    draw_list.clear();
+    buildDrawList(draw_list, 0.0f, 0.0f);
+    
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(batches); i++)
+        batches[i].run = -1;
+    
+    CCTexture2D* run_texture = NULL;
+    int run = -1;
+    int batch = -1;
+    unsigned int num_slots = 0;
+    for(int i = 0; i < draw_list.size(); i++)
+    {
+        const SCML::DrawList::Command& command = draw_list[i];
+        
+        CCSprite* img = file_system->getSprite(command.folder, command.file);
+        if(img == NULL)
+            continue;
+        CCTexture2D* texture = img->getTexture();
+        if(texture != run_texture)
+        {
+            run++;
+            run_texture = texture;
+            batch = getBatch(texture, run);
+        }
+        
+        if(num_slots == SCML_VECTOR_SIZE(slots))
+        {
+            Slot slot;
+            slot.sprite = CCSprite::createWithTexture(texture, img->getTextureRect());
+            slot.batch = batch;
+            slot.folder = command.folder;
+            slot.file = command.file;
+            slot.x = slot.y = slot.angle = 0.0f;
+            slot.scale_x = slot.scale_y = 1.0f;
+            slot.z = i;
+            slot.color = ccc3(255, 255, 255);
+            slot.opacity = 255;
+            slot.visible = true;
+            batches[batch].node->addChild(slot.sprite, i);
+            SCML_VECTOR_PUSH_BACK(slots, slot);
+        }
+        Slot& slot = slots[num_slots];
+        num_slots++;
+        CCSprite* sprite = slot.sprite;
+        
+        if(slot.batch != batch)
+        {
+            // Moving to another batch node needs the sprite to take that node's texture first
+            sprite->retain();
+            batches[slot.batch].node->removeChild(sprite, false);
+            sprite->setTexture(texture);
+            sprite->setTextureRect(img->getTextureRect());
+            batches[batch].node->addChild(sprite, i);
+            sprite->release();
+            slot.batch = batch;
+            slot.folder = command.folder;
+            slot.file = command.file;
+            slot.z = i;
+        }
+        else if(slot.folder != command.folder || slot.file != command.file)
+        {
+            sprite->setTextureRect(img->getTextureRect());
+            slot.folder = command.folder;
+            slot.file = command.file;
+        }
+        
+        if(slot.z != i)
+        {
+            batches[batch].node->reorderChild(sprite, i);
+            slot.z = i;
+        }
+        
+        if(slot.x != command.x || slot.y != command.y)
+        {
+            sprite->setPosition(ccp(command.x, command.y));
+            slot.x = command.x;
+            slot.y = command.y;
+        }
+        
+        float angle = 360 - command.angle;
+        if(slot.angle != angle)
+        {
+            sprite->setRotation(angle);
+            slot.angle = angle;
+        }
+        if(slot.scale_x != command.scale_x)
+        {
+            sprite->setScaleX(command.scale_x);
+            slot.scale_x = command.scale_x;
+        }
+        if(slot.scale_y != command.scale_y)
+        {
+            sprite->setScaleY(command.scale_y);
+            slot.scale_y = command.scale_y;
+        }
+        
+        ccColor3B color = ccc3(GLubyte(command.r*255), GLubyte(command.g*255), GLubyte(command.b*255));
+        if(slot.color.r != color.r || slot.color.g != color.g || slot.color.b != color.b)
+        {
+            sprite->setColor(color);
+            slot.color = color;
+        }
+        GLubyte opacity = GLubyte(command.a*255);
+        if(slot.opacity != opacity)
+        {
+            sprite->setOpacity(opacity);
+            slot.opacity = opacity;
+        }
+        
+        if(!slot.visible)
+        {
+            sprite->setVisible(true);
+            slot.visible = true;
+        }
+    }
+    
+    // Slots that the current key does not use are kept for later keys
+    for(unsigned int i = num_slots; i < SCML_VECTOR_SIZE(slots); i++)
+    {
+        if(slots[i].visible)
+        {
+            slots[i].sprite->setVisible(false);
+            slots[i].visible = false;
+        }
+    }
+}
+
+void Entity::clearNodes()
+{
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(batches); i++)
+        removeChild(batches[i].node, true);
+    SCML_VECTOR_CLEAR(batches);
+    SCML_VECTOR_CLEAR(slots);
+}
+
 
 
 
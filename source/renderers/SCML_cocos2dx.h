@@ -15,13 +15,21 @@ class FileSystem : public SCML::FileSystem
     
     // Folder, File
     SCML_MAP(SCML_PAIR(int, int), cocos2d::CCSprite*) images;
+    // Atlas ID
+    SCML_MAP(int, cocos2d::CCTexture2D*) pages;
     
     virtual ~FileSystem();
     virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadAtlasPage(int atlasID, const std::string& filename);
     virtual void clear();
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual SCML_PAIR(unsigned int, unsigned int) getAtlasPageDimensions(int atlasID) const;
     
     cocos2d::CCSprite* getImage(int folderID, int fileID) const;
+    cocos2d::CCTexture2D* getAtlasPage(int atlasID) const;
+    
+    // Gets the sprite of an image, creating it from the image's rectangle of its atlas page the first time.
+    cocos2d::CCSprite* getSprite(int folderID, int fileID);
     
 };
 
@@ -38,7 +46,56 @@ class Entity : public cocos2d::CCNode, public SCML::Entity
     
     virtual void convert_to_SCML_coords(float& x, float& y, float& angle);
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual const SCML::FileSystem::Atlas_Region* getAtlasRegion(int folderID, int fileID) const;
     virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+    
+    /*! \brief Brings the entity's child nodes up to date with its current key (retained mode).
+     *
+     * Each object slot gets a persistent CCSprite under a CCSpriteBatchNode for its texture, so an entity whose images
+     * are on one atlas page is drawn in one call.  Only the positions, rotations, scales, z-orders and colors that
+     * changed are set on the sprites.  The node's own position, rotation and scale place the entity, so call this
+     * after update() instead of draw().
+     */
+    void updateNodes();
+    
+    /*! \brief Removes the child nodes that updateNodes() made, e.g. before the FileSystem is cleared.
+     */
+    void clearNodes();
+    
+    private:
+    
+    // A batch node for one run of consecutive objects on the same texture.  A texture that is used by several runs
+    // gets a batch node for each, so objects on different textures still draw in order.
+    class Batch
+    {
+        public:
+        
+        cocos2d::CCSpriteBatchNode* node;
+        cocos2d::CCTexture2D* texture;
+        int run;
+        int z;
+    };
+    
+    // The sprite of one object slot and the values that were last set on it
+    class Slot
+    {
+        public:
+        
+        cocos2d::CCSprite* sprite;
+        int batch;
+        int folder, file;
+        float x, y, angle, scale_x, scale_y;
+        int z;
+        cocos2d::ccColor3B color;
+        GLubyte opacity;
+        bool visible;
+    };
+    
+    SCML::DrawList draw_list;
+    SCML_VECTOR(Batch) batches;
+    SCML_VECTOR(Slot) slots;
+    
+    int getBatch(cocos2d::CCTexture2D* texture, int run);
 };
 
 }
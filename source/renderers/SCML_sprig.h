@@ -8,7 +8,10 @@
 */
 namespace SCML_sprig
 {
-    
+
+/*! SPriG transforms whole surfaces, so this FileSystem does not load atlas pages.  Packed images are loaded from
+ * their own files instead.
+ */
 class FileSystem : public SCML::FileSystem
 {
     public:
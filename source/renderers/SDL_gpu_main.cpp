@@ -9,6 +9,37 @@ using namespace SCML_SDL_gpu;
 GPU_Target* screen = NULL;
 Uint8* keystates = NULL;
 
+// Crowd sizes of the stress mode
+static const int crowd_sizes[] = {0, 100, 1000, 5000};
+
+
+static void clear_crowd(list<Entity*>& crowd)
+{
+    for(list<Entity*>::iterator e = crowd.begin(); e != crowd.end(); e++)
+    {
+        delete (*e);
+    }
+    crowd.clear();
+}
+
+// Creates count instances of each entity, at different animations and times
+static void create_crowd(list<Entity*>& crowd, SCML::Data& data, FileSystem& fs, int count)
+{
+    clear_crowd(crowd);
+    for(int i = 0; i < count; i++)
+    {
+        for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+        {
+            Entity* entity = new Entity(&data, e->first);
+            entity->setFileSystem(&fs);
+            entity->setScreen(screen);
+            entity->startAnimation(i%data.getNumAnimations(e->first));
+            entity->update(rand()%1000);
+            crowd.push_back(entity);
+        }
+    }
+}
+
 
 void main_loop(vector<string>& data_files)
 {
@@ -40,6 +71,15 @@ void main_loop(vector<string>& data_files)
     
     bool paused = false;
     
+    // Stress mode: s cycles through the crowd sizes and u switches between batched drawing and one blit per object
+    list<Entity*> crowd;
+    int crowd_index = 0;
+    bool batched = true;
+    SCML::DrawList draw_list;
+    int report_frames = 0;
+    int report_flushes = 0;
+    Uint32 report_start = SDL_GetTicks();
+    
     bool done = false;
     SDL_Event event;
     int dt_ms = 0;
@@ -108,6 +148,21 @@ void main_loop(vector<string>& data_files)
                 {
                     drawBones = !drawBones;
                 }
+                else if(event.key.keysym.sym == SDLK_s)
+                {
+                    crowd_index = (crowd_index + 1)%(sizeof(crowd_sizes)/sizeof(int));
+                    create_crowd(crowd, data, fs, crowd_sizes[crowd_index]);
+                    printf("Stress mode: %zu instances\n", crowd.size());
+                    report_frames = report_flushes = 0;
+                    report_start = SDL_GetTicks();
+                }
+                else if(event.key.keysym.sym == SDLK_u)
+                {
+                    batched = !batched;
+                    printf("Stress mode: %s\n", (batched? "batched" : "one blit per object"));
+                    report_frames = report_flushes = 0;
+                    report_start = SDL_GetTicks();
+                }
                 else if(event.key.keysym.sym == SDLK_RETURN)
                 {
                     // Destroy all of our data
@@ -116,6 +171,7 @@ void main_loop(vector<string>& data_files)
                         delete (*e);
                     }
                     entities.clear();
+                    clear_crowd(crowd);
                     
                     fs.clear();
                     data.clear();
@@ -140,6 +196,8 @@ void main_loop(vector<string>& data_files)
                         entities.push_back(entity);
                     }
                     printf("Loaded %zu entities.\n", entities.size());
+                    
+                    create_crowd(crowd, data, fs, crowd_sizes[crowd_index]);
                 }
             }
         }
@@ -171,6 +229,41 @@ void main_loop(vector<string>& data_files)
         
         GPU_ClearRGBA(screen, 255, 255, 255, 255);
         
+        // The crowd fills the screen in a grid, behind the other entities
+        if(!crowd.empty())
+        {
+            int columns = int(ceil(sqrt(crowd.size()*4/3.0)));
+            float spacing = 800.0f/columns;
+            int i = 0;
+            draw_list.clear();
+            for(list<Entity*>::iterator e = crowd.begin(); e != crowd.end(); e++, i++)
+            {
+                if(!paused)
+                    (*e)->update(dt_ms);
+                (*e)->buildDrawList(draw_list, (i%columns + 0.5f)*spacing, (i/columns + 1)*spacing, 0.0f, spacing/400, spacing/400);
+            }
+            
+            Entity* renderer = crowd.front();
+            if(batched)
+                renderer->submit(draw_list);
+            else
+            {
+                renderer->SCML::Entity::submit(draw_list);
+                renderer->num_flushes += draw_list.size();
+            }
+            
+            report_frames++;
+            report_flushes += renderer->num_flushes;
+            renderer->num_flushes = 0;
+            if(SDL_GetTicks() - report_start >= 1000)
+            {
+                printf("%zu instances, %s: %.2f ms per frame, %d draw calls per frame\n", crowd.size(), (batched? "batched" : "unbatched"),
+                       float(SDL_GetTicks() - report_start)/report_frames, report_flushes/report_frames);
+                report_frames = 0;
+                report_flushes = 0;
+                report_start = SDL_GetTicks();
+            }
+        }
         
         for(list<Entity*>::iterator e = entities.begin(); e != entities.end(); e++)
         {
@@ -224,6 +317,7 @@ void main_loop(vector<string>& data_files)
         delete (*e);
     }
     entities.clear();
+    clear_crowd(crowd);
     
     data.clear();
 }
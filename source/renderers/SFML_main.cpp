@@ -20,12 +20,16 @@ void main_loop(vector<string>& data_files)
     fs.load(&data);
     printf("Loaded %zu images.\n", fs.images.size());
     
+    // B switches between drawing a sprite per object and batching them into vertex arrays
+    bool batched = true;
+    
     list<Entity*> entities;
     for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
     {
         Entity* entity = new Entity(&data, e->first);
         entity->setFileSystem(&fs);
         entity->setScreen(screen);
+        entity->setBatched(batched);
         entities.push_back(entity);
     }
     printf("Loaded %zu entities.\n", entities.size());
@@ -60,6 +64,14 @@ void main_loop(vector<string>& data_files)
                         (*e)->startAnimation(rand()%data.getNumAnimations((*e)->entity));
                     }
                 }
+                else if(event.key.code == sf::Keyboard::B)
+                {
+                    batched = !batched;
+                    for(list<Entity*>::iterator e = entities.begin(); e != entities.end(); e++)
+                    {
+                        (*e)->setBatched(batched);
+                    }
+                }
                 else if(event.key.code == sf::Keyboard::Return)
                 {
                     // Destroy all of our data
@@ -89,6 +101,7 @@ void main_loop(vector<string>& data_files)
                         Entity* entity = new Entity(&data, e->first);
                         entity->setFileSystem(&fs);
                         entity->setScreen(screen);
+                        entity->setBatched(batched);
                         entities.push_back(entity);
                     }
                     printf("Loaded %zu entities.\n", entities.size());
@@ -34,7 +34,6 @@ public:
 
 	bool ccTouchBegan(cocos2d::CCTouch* touch, cocos2d::CCEvent* event);
 	void update(float dt);
-	void draw();
 };
 
 
@@ -121,15 +120,8 @@ void Test::update(float dt)
         entity->setRotation(angle);
         entity->setScale(scale);
         entity->SCML::Entity::update(dt * 1000.0f);
-    }
-}
-
-void Test::draw()
-{
-    for(list<Entity*>::iterator e = entities.begin(); e != entities.end(); e++)
-    {
-        Entity* entity = *e;
-        entity->SCML::Entity::draw(entity->getPositionX(), entity->getPositionY(), entity->getRotation(), entity->getScale(), entity->getScale());
+        // The entities are children of this layer, so cocos2d-x draws their sprites
+        entity->updateNodes();
     }
 }
 
@@ -0,0 +1,470 @@
+// scmlbake: Renders every frame of an entity's animations onto sprite sheets, for drawing far-away characters with
+// SCML::FlipbookEntity.
+//
+// Usage: scmlbake [-entity ID] [-fps N] [-scale S] [-size N] [-padding N] [-threads N] input.scml output.flipbook
+//
+// -entity is the entity ID (the first one by default), -fps the frame rate (15) and -scale the size the entity is
+// rendered at (0.25).  Frame i of an animation shows it at i*1000/fps ms, and an animation that does not loop gets
+// a last frame at its end.  Each frame is rendered whole with the software renderer (renderers/SCML_Software) and its
+// transparent borders are trimmed off.
+//
+// The frames are packed with MaxRects like scmlpack does: -size is the largest sheet width and height (2048 by
+// default, rounded down to a power of two), -padding the number of transparent pixels between frames (2).  The sheets
+// are saved next to the output as <output name>_<sheet>.png.  The output lists the sheets and, for each animation, each
+// frame's rectangle and where the entity's origin is in it:
+//
+// <flipbook entity="0" fps="15" scale="0.25" folder="5">
+//     <sheet atlas="0" image_path="monster_0.png"/>
+//     <animation id="0" name="Idle" length="1000" looping="true" height="412">
+//         <frame file="0" atlas="0" x="0" y="0" width="90" height="103" pivot_x="0.51" pivot_y="0.04"/>
+//
+// The folder and atlas IDs are ones that the input does not use, so a FileSystem can load both.  Animations are
+// rendered in parallel with -threads threads (one per core by default).
+//
+// Returns 0 on success, 1 on a load/write error and 2 if the sheets do not match the rendered frames.
+
+#include "SCMLpp.h"
+#include "SCML_Software.h"
+#include "PNG_Image.h"
+#include "Rect_Packer.h"
+#include "tinyxml.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+static SCML_STRING get_filename(const SCML_STRING& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return (slash == SCML_STRING::npos? path : path.substr(slash + 1));
+}
+
+static SCML_STRING remove_extension(const SCML_STRING& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot == SCML_STRING::npos || (slash != SCML_STRING::npos && dot < slash))
+        return path;
+    return path.substr(0, dot);
+}
+
+static int next_power_of_two(int value)
+{
+    int result = 1;
+    while(result < value)
+        result *= 2;
+    return result;
+}
+
+
+
+
+class Frame
+{
+public:
+
+    int animation;
+    int index;
+    int time;
+
+    // The trimmed rendering and where the entity's origin is in it, in pixels from its top-left corner
+    PNG_Image png;
+    float origin_x, origin_y;
+
+    // Where it goes
+    int file;
+    int sheet;
+    int x, y;
+
+    Frame(int animation, int index, int time)
+        : animation(animation), index(index), time(time), origin_x(0.0f), origin_y(0.0f), file(0), sheet(-1), x(0), y(0)
+    {}
+};
+
+// Sorts the largest frames first, so the small ones fill the gaps.  Ties keep the animation order.
+static bool larger_frame(const Frame* a, const Frame* b)
+{
+    if(a->png.height != b->png.height)
+        return a->png.height > b->png.height;
+    if(a->png.width != b->png.width)
+        return a->png.width > b->png.width;
+    if(a->animation != b->animation)
+        return a->animation < b->animation;
+    return a->index < b->index;
+}
+
+// Renders the frames of one animation.  The entity is made beforehand, as making entities is not thread-safe.
+class Render_Job : public SCML::JobScheduler::Job
+{
+public:
+
+    SCML_Software::Entity* entity;
+    float scale;
+    SCML_VECTOR(Frame*) frames;
+
+    Render_Job(SCML_Software::Entity* entity, float scale)
+        : entity(entity), scale(scale)
+    {}
+
+    virtual void run(int thread)
+    {
+        SCML::DrawList list;
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(frames); i++)
+        {
+            Frame* frame = frames[i];
+            entity->setTime(frame->time);
+
+            // Find the bounds in pixels (+y down) with the origin at (0, 0), plus a pixel all around
+            list.clear();
+            entity->buildDrawList(list, 0.0f, 0.0f, 0.0f, scale, scale);
+            float min_x = 0.0f, max_x = 0.0f, min_y = 0.0f, max_y = 0.0f;
+            for(int j = 0; j < list.size(); j++)
+            {
+                for(int k = 0; k < 8; k += 2)
+                {
+                    float x = list[j].corners[k], y = -list[j].corners[k+1];
+                    min_x = std::min(min_x, x);
+                    max_x = std::max(max_x, x);
+                    min_y = std::min(min_y, y);
+                    max_y = std::max(max_y, y);
+                }
+            }
+            int left = int(floorf(min_x)) - 1;
+            int top = int(floorf(min_y)) - 1;
+            int width = int(ceilf(max_x)) + 1 - left;
+            int height = int(ceilf(max_y)) + 1 - top;
+
+            SCML_Software::Framebuffer framebuffer(width, height);
+            entity->setScreen(&framebuffer);
+            entity->draw(float(-left), float(-top), 0.0f, scale, scale);
+            entity->setScreen(NULL);
+
+            PNG_Image rendering;
+            framebuffer.getImage(rendering);
+            int x, y, w, h;
+            // A frame with nothing on it still needs a pixel on the sheet
+            if(!rendering.getOpaqueBounds(x, y, w, h))
+            {
+                x = y = 0;
+                w = h = 1;
+            }
+            frame->png.create(w, h);
+            frame->png.copy(rendering, x, y, w, h, 0, 0);
+            frame->origin_x = float(-left - x);
+            frame->origin_y = float(-top - y);
+        }
+    }
+};
+
+
+
+
+// Checks that each frame is on its sheet, pixel for pixel.
+static bool verify(const SCML_VECTOR(SCML_STRING)& sheet_files, const SCML_VECTOR(Frame*)& frames)
+{
+    SCML_VECTOR(PNG_Image) sheets(SCML_VECTOR_SIZE(sheet_files));
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(sheet_files); i++)
+    {
+        if(!sheets[i].load(sheet_files[i]))
+            return false;
+    }
+
+    bool result = true;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(frames); i++)
+    {
+        const Frame* frame = frames[i];
+        const PNG_Image& sheet = sheets[frame->sheet];
+        bool match = true;
+        for(unsigned int y = 0; y < frame->png.height && match; y++)
+            match = (memcmp(sheet.getPixel(frame->x, frame->y + y), frame->png.getPixel(0, y), frame->png.width*4) == 0);
+        if(!match)
+        {
+            printf("Frame %d of animation %d does not match its sheet.\n", frame->index, frame->animation);
+            result = false;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int entity_id = -1;
+    int fps = 15;
+    float scale = 0.25f;
+    int max_size = 2048;
+    int padding = 2;
+    int num_threads = 0;
+    const char* input = NULL;
+    const char* output = NULL;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-entity") == 0 && i + 1 < argc)
+            entity_id = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-fps") == 0 && i + 1 < argc)
+            fps = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-scale") == 0 && i + 1 < argc)
+            scale = float(atof(argv[++i]));
+        else if(strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+            max_size = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-padding") == 0 && i + 1 < argc)
+            padding = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if(input == NULL)
+            input = argv[i];
+        else if(output == NULL)
+            output = argv[i];
+        else
+            input = output = NULL;
+    }
+    if(input == NULL || output == NULL || fps <= 0 || fps > 1000 || scale <= 0.0f || max_size <= 0 || padding < 0 || num_threads < 0)
+    {
+        printf("Usage: %s [-entity ID] [-fps N] [-scale S] [-size N] [-padding N] [-threads N] input.scml output.flipbook\n", argv[0]);
+        return 1;
+    }
+
+    SCML::Data data;
+    if(!data.load(input))
+    {
+        printf("Failed to load %s\n", input);
+        return 1;
+    }
+    if(entity_id < 0 && SCML_MAP_SIZE(data.entities) > 0)
+        entity_id = data.entities.begin()->first;
+    SCML::Data::Entity* data_entity = SCML_MAP_FIND(data.entities, entity_id);
+    if(data_entity == NULL)
+    {
+        printf("%s has no entity %d\n", input, entity_id);
+        return 1;
+    }
+
+    // The frames go in a folder and on atlas pages that the input does not use
+    int folder_id = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(data.folders, int, SCML::Data::Folder*, folder)
+    {
+        folder_id = std::max(folder_id, folder->id + 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    int first_atlas = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(data.atlases, int, SCML::Data::Atlas*, atlas)
+    {
+        first_atlas = std::max(first_atlas, atlas->id + 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML_Software::FileSystem fs;
+    fs.load(&data);
+
+    // One job per animation, each with its own entity
+    SCML_VECTOR(SCML_Software::Entity*) entities;
+    SCML_VECTOR(Render_Job*) render_jobs;
+    SCML_VECTOR(Frame*) frames;
+    SCML_Software::Entity prototype_entity(&data, entity_id);
+    for(int i = 0; i < prototype_entity.getNumAnimations(); i++)
+    {
+        SCML::Entity::Animation* animation = prototype_entity.getAnimation(i);
+        if(animation == NULL)
+            continue;
+
+        SCML_Software::Entity* entity = new SCML_Software::Entity(&data, entity_id, i);
+        entity->setFileSystem(&fs);
+        SCML_VECTOR_PUSH_BACK(entities, entity);
+        Render_Job* job = new Render_Job(entity, scale);
+        SCML_VECTOR_PUSH_BACK(render_jobs, job);
+
+        bool looping = (animation->loop_mode == SCML::Entity::Animation::LOOP_TRUE);
+        int num_frames = int((animation->length*(long long)fps + (looping? 999 : 0))/1000) + (looping? 0 : 1);
+        if(num_frames < 1)
+            num_frames = 1;
+        for(int f = 0; f < num_frames; f++)
+        {
+            int time = int(f*1000.0/fps + 0.5);
+            if(time > animation->length)
+                time = animation->length;
+            Frame* frame = new Frame(i, f, time);
+            frame->file = SCML_VECTOR_SIZE(frames);
+            SCML_VECTOR_PUSH_BACK(frames, frame);
+            SCML_VECTOR_PUSH_BACK(job->frames, frame);
+        }
+    }
+
+    SCML::JobScheduler scheduler(num_threads);
+    if(SCML_VECTOR_SIZE(render_jobs) > 0)
+    {
+        SCML_VECTOR(SCML::JobScheduler::Job*) jobs(render_jobs.begin(), render_jobs.end());
+        scheduler.run(SCML::Span<SCML::JobScheduler::Job*>(&jobs[0], SCML_VECTOR_SIZE(jobs)));
+    }
+
+    Page_Packer packer(max_size, padding);
+    int result = 0;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(frames); i++)
+    {
+        if(int(frames[i]->png.width) > packer.max_size || int(frames[i]->png.height) > packer.max_size)
+        {
+            printf("Frame %d of animation %d (%u x %u) does not fit on a %d x %d sheet.\n", frames[i]->index, frames[i]->animation,
+                   frames[i]->png.width, frames[i]->png.height, packer.max_size, packer.max_size);
+            result = 1;
+        }
+    }
+
+    // Pack sheet by sheet
+    int num_sheets = 0;
+    SCML_VECTOR(int) sheet_widths, sheet_heights;
+    if(result == 0)
+    {
+        SCML_VECTOR(Frame*) left = frames;
+        std::sort(left.begin(), left.end(), larger_frame);
+
+        while(SCML_VECTOR_SIZE(left) > 0)
+        {
+            SCML_VECTOR(Rect) sizes;
+            for(unsigned int i = 0; i < SCML_VECTOR_SIZE(left); i++)
+                SCML_VECTOR_PUSH_BACK(sizes, Rect(0, 0, left[i]->png.width, left[i]->png.height));
+            SCML_VECTOR(Rect) best;
+            if(packer.pack(sizes, best, &scheduler) == 0)
+            {
+                printf("Frame %d of animation %d (%u x %u) does not fit on a %d x %d sheet.\n", left[0]->index, left[0]->animation,
+                       left[0]->png.width, left[0]->png.height, packer.max_size, packer.max_size);
+                result = 1;
+                num_sheets = 0;
+                break;
+            }
+
+            SCML_VECTOR(Frame*) next;
+            int used_width = 1, used_height = 1;
+            for(unsigned int i = 0; i < SCML_VECTOR_SIZE(left); i++)
+            {
+                Frame* frame = left[i];
+                if(best[i].width == 0)
+                {
+                    SCML_VECTOR_PUSH_BACK(next, frame);
+                    continue;
+                }
+                frame->sheet = num_sheets;
+                frame->x = best[i].x;
+                frame->y = best[i].y;
+                used_width = std::max(used_width, next_power_of_two(frame->x + frame->png.width));
+                used_height = std::max(used_height, next_power_of_two(frame->y + frame->png.height));
+            }
+            SCML_VECTOR_PUSH_BACK(sheet_widths, used_width);
+            SCML_VECTOR_PUSH_BACK(sheet_heights, used_height);
+            left = next;
+            num_sheets++;
+        }
+    }
+
+    // Compose and save the sheets
+    SCML_STRING sheet_base = remove_extension(output);
+    SCML_VECTOR(SCML_STRING) sheet_files;
+    for(int i = 0; i < num_sheets && result == 0; i++)
+    {
+        char suffix[32];
+        sprintf(suffix, "_%d.png", i);
+        SCML_VECTOR_PUSH_BACK(sheet_files, sheet_base + suffix);
+
+        PNG_Image sheet(sheet_widths[i], sheet_heights[i]);
+        for(unsigned int j = 0; j < SCML_VECTOR_SIZE(frames); j++)
+        {
+            if(frames[j]->sheet == i)
+                sheet.copy(frames[j]->png, 0, 0, frames[j]->png.width, frames[j]->png.height, frames[j]->x, frames[j]->y);
+        }
+        if(!sheet.save(sheet_files[i]))
+        {
+            printf("Failed to write %s\n", SCML_TO_CSTRING(sheet_files[i]));
+            result = 1;
+        }
+    }
+
+    if(result == 0)
+    {
+        TiXmlDocument doc;
+        doc.InsertEndChild(TiXmlDeclaration("1.0", "UTF-8", ""));
+        TiXmlElement root("flipbook");
+        root.SetAttribute("entity", entity_id);
+        root.SetAttribute("fps", fps);
+        root.SetDoubleAttribute("scale", scale);
+        root.SetAttribute("folder", folder_id);
+
+        for(int i = 0; i < num_sheets; i++)
+        {
+            TiXmlElement sheet("sheet");
+            sheet.SetAttribute("atlas", first_atlas + i);
+            sheet.SetAttribute("image_path", SCML_TO_CSTRING(get_filename(sheet_files[i])));
+            root.InsertEndChild(sheet);
+        }
+
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(render_jobs); i++)
+        {
+            const SCML_VECTOR(Frame*)& animation_frames = render_jobs[i]->frames;
+            int animation_id = animation_frames[0]->animation;
+            SCML::Entity::Animation* source = prototype_entity.getAnimation(animation_id);
+            SCML::Data::Entity::Animation* data_animation = SCML_MAP_FIND(data_entity->animations, animation_id);
+
+            unsigned int height = 0;
+            for(unsigned int j = 0; j < SCML_VECTOR_SIZE(animation_frames); j++)
+                height = std::max(height, animation_frames[j]->png.height);
+
+            TiXmlElement animation("animation");
+            animation.SetAttribute("id", animation_id);
+            animation.SetAttribute("name", (data_animation == NULL? "" : SCML_TO_CSTRING(data_animation->name)));
+            animation.SetAttribute("length", source->length);
+            animation.SetAttribute("looping", (source->loop_mode == SCML::Entity::Animation::LOOP_TRUE? "true" : "false"));
+            animation.SetDoubleAttribute("height", height/scale);
+
+            for(unsigned int j = 0; j < SCML_VECTOR_SIZE(animation_frames); j++)
+            {
+                const Frame* frame = animation_frames[j];
+                TiXmlElement item("frame");
+                item.SetAttribute("file", frame->file);
+                item.SetAttribute("atlas", first_atlas + frame->sheet);
+                item.SetAttribute("x", frame->x);
+                item.SetAttribute("y", frame->y);
+                item.SetAttribute("width", frame->png.width);
+                item.SetAttribute("height", frame->png.height);
+                // The pivot is measured from the bottom-left corner, as in SCML
+                item.SetDoubleAttribute("pivot_x", frame->origin_x/frame->png.width);
+                item.SetDoubleAttribute("pivot_y", (frame->png.height - frame->origin_y)/frame->png.height);
+                animation.InsertEndChild(item);
+            }
+            root.InsertEndChild(animation);
+        }
+
+        doc.InsertEndChild(root);
+        if(!doc.SaveFile(output))
+        {
+            printf("Failed to write %s\n", output);
+            result = 1;
+        }
+    }
+
+    if(result == 0 && !verify(sheet_files, frames))
+        result = 2;
+
+    if(result == 0)
+    {
+        printf("Baked %d frames of %d animations from %s onto %d sheets for %s\n", int(SCML_VECTOR_SIZE(frames)), int(SCML_VECTOR_SIZE(render_jobs)), input, num_sheets, output);
+        for(int i = 0; i < num_sheets; i++)
+        {
+            long area = 0;
+            int count = 0;
+            for(unsigned int j = 0; j < SCML_VECTOR_SIZE(frames); j++)
+            {
+                if(frames[j]->sheet != i)
+                    continue;
+                area += long(frames[j]->png.width)*frames[j]->png.height;
+                count++;
+            }
+            printf("  %s: %d x %d, %d frames, %.1f%% used\n", SCML_TO_CSTRING(sheet_files[i]), sheet_widths[i], sheet_heights[i],
+                   count, 100.0*area/(long(sheet_widths[i])*sheet_heights[i]));
+        }
+    }
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(render_jobs); i++)
+        delete render_jobs[i];
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entities); i++)
+        delete entities[i];
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(frames); i++)
+        delete frames[i];
+    return result;
+}
@@ -0,0 +1,318 @@
+// scmlbench: Measures loading, updating and drawing with the headless renderer (renderers/SCML_Null).
+//
+// Usage: scmlbench [file.scml ...]
+//
+// Without arguments, the bundled samples are measured (run it from the repository's root directory).
+// For 1, 100, 10000 and 100000 instances of each file's entities, it reports the time per entity to create them,
+// to update() them by one frame, to draw() them afterward, to evaluate them in an AnimationWorld instead and to draw()
+// them from poses baked at baked_rate, as floats and quantized.  The memory of each entity's timeline keys and baked poses is reported too, exact and
+// quantized, with how far the quantized timeline keys move the drawn images from the exact ones.
+
+#include "SCMLpp.h"
+#include "SCML_Null.h"
+#include <cstdio>
+
+#if defined(WIN32) || defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+static const char* const default_files[] = {"samples/monster/Example.SCML", "samples/knight/knight.scml", "samples/hero/Hero.SCML"};
+static const int instance_counts[] = {1, 100, 10000, 100000};
+
+// Each measurement repeats frames for at least this long, so the small counts are not all timer noise.
+static const double min_seconds = 0.2;
+static const int min_frames = 3;
+static const int frame_ms = 16;
+static const int baked_rate = 30;
+
+static double get_seconds()
+{
+    #if defined(WIN32) || defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart/double(frequency.QuadPart);
+    #else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+    #endif
+}
+
+class Benchmark
+{
+public:
+
+    SCML::Data* data;
+    SCML_Null::FileSystem* fs;
+    SCML_Null::Recorder recorder;
+    SCML_VECTOR(SCML_Null::Entity*) entities;
+    SCML_VECTOR(SCML::AnimationWorld::Instance) instances;
+
+    Benchmark(SCML::Data* data, SCML_Null::FileSystem* fs)
+        : data(data), fs(fs)
+    {
+        // Only count the calls, so storing them is not part of the draw time
+        recorder.keep_calls = false;
+    }
+
+    ~Benchmark()
+    {
+        destroy();
+    }
+
+    // Creates the instances, cycling through the entities and their animations.  Returns the time per entity in ns.
+    double create(int count)
+    {
+        destroy();
+
+        SCML_VECTOR(int) entity_ids;
+        SCML_BEGIN_MAP_FOREACH_CONST(data->entities, int, SCML::Data::Entity*, entity)
+        {
+            SCML_VECTOR_PUSH_BACK(entity_ids, entity->id);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+        if(SCML_VECTOR_SIZE(entity_ids) == 0)
+            return 0.0;
+
+        double start = get_seconds();
+        for(int i = 0; i < count; i++)
+        {
+            int entity_id = entity_ids[i % SCML_VECTOR_SIZE(entity_ids)];
+            SCML_Null::Entity* entity = new SCML_Null::Entity(data, entity_id);
+            entity->setFileSystem(fs);
+            entity->setRecorder(&recorder);
+
+            // Spread the instances over the animations and their timelines
+            int num_animations = data->getNumAnimations(entity_id);
+            entity->startAnimation(num_animations > 0? (i / SCML_VECTOR_SIZE(entity_ids)) % num_animations : 0);
+            entity->update((i*37) % 1000);
+
+            SCML_VECTOR_PUSH_BACK(entities, entity);
+            SCML_VECTOR_PUSH_BACK(instances, SCML::AnimationWorld::Instance(entity, float(i % 1000), float(i / 1000)));
+        }
+        return (get_seconds() - start)*1e9/count;
+    }
+
+    void destroy()
+    {
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entities); i++)
+            delete entities[i];
+        SCML_VECTOR_CLEAR(entities);
+        SCML_VECTOR_CLEAR(instances);
+    }
+
+    // Runs frames of update() followed by draw(), like a game loop, and returns the time per entity of each in ns.
+    // The draws include rebuilding the bones, since update() changes the time.
+    void run_frames(double& update_ns, double& draw_ns)
+    {
+        int frames = 0;
+        double update_seconds = 0.0;
+        double draw_seconds = 0.0;
+        do
+        {
+            double start = get_seconds();
+            for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entities); i++)
+                entities[i]->update(frame_ms);
+            double middle = get_seconds();
+
+            recorder.clear();
+            for(unsigned int i = 0; i < SCML_VECTOR_SIZE(instances); i++)
+                instances[i].draw();
+            double end = get_seconds();
+
+            update_seconds += middle - start;
+            draw_seconds += end - middle;
+            frames++;
+        }
+        while(frames < min_frames || update_seconds + draw_seconds < min_seconds);
+
+        update_ns = update_seconds*1e9/(double(frames)*SCML_VECTOR_SIZE(entities));
+        draw_ns = draw_seconds*1e9/(double(frames)*SCML_VECTOR_SIZE(entities));
+    }
+
+    // Bakes the poses of each entity once, then runs frames that draw from them.  Returns the draw time per entity in ns.
+    double run_baked_frames(bool quantized)
+    {
+        typedef SCML::BakedPoses* BakedPoses_Ptr;
+        SCML_MAP(int, BakedPoses_Ptr) poses;
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entities); i++)
+        {
+            SCML::BakedPoses* entity_poses = SCML_MAP_FIND(poses, entities[i]->entity);
+            if(entity_poses == NULL)
+            {
+                entity_poses = new SCML::BakedPoses(entities[i], baked_rate, quantized);
+                SCML_MAP_INSERT(poses, entities[i]->entity, entity_poses);
+            }
+            entities[i]->setBakedPoses(entity_poses);
+        }
+
+        double update_ns, draw_ns;
+        run_frames(update_ns, draw_ns);
+
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entities); i++)
+            entities[i]->setBakedPoses(NULL);
+        SCML_BEGIN_MAP_FOREACH_CONST(poses, int, BakedPoses_Ptr, entity_poses)
+        {
+            delete entity_poses;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+        return draw_ns;
+    }
+
+    double evaluate(SCML::AnimationWorld& world)
+    {
+        int frames = 0;
+        double start = get_seconds();
+        double elapsed = 0.0;
+        do
+        {
+            world.evaluate(SCML::Span<SCML::AnimationWorld::Instance>(&instances[0], SCML_VECTOR_SIZE(instances)), frame_ms);
+            frames++;
+            elapsed = get_seconds() - start;
+        }
+        while(frames < min_frames || elapsed < min_seconds);
+        return elapsed*1e9/(double(frames)*SCML_VECTOR_SIZE(entities));
+    }
+};
+
+// Memory of the timeline keys and everything they refer to
+static int get_timeline_key_bytes(SCML::EntityPrototype* prototype)
+{
+    typedef SCML::EntityPrototype::Animation::Timeline::Key Key;
+    int bytes = 0;
+    for(unsigned int i = 0; i < prototype->animations.size(); i++)
+    {
+        SCML::EntityPrototype::Animation& animation = prototype->animations[i];
+        bytes += animation.timeline_keys.size*sizeof(Key);
+        bytes += (animation.bone_poses.size + animation.object_poses.size)*sizeof(Key::Pose);
+        bytes += (animation.packed_bone_poses.size + animation.packed_object_poses.size)*sizeof(Key::Packed_Pose);
+        bytes += animation.bone_styles.size*sizeof(Key::Bone_Style) + animation.object_styles.size*sizeof(Key::Object_Style);
+    }
+    return bytes;
+}
+
+// Draws every millisecond of every animation from the exact and the quantized prototype and measures how far apart the
+// corners of the images are, in pixels.  Frames whose images differ are counted instead.
+static float get_drawn_error(SCML::Data* data, SCML_Null::FileSystem* fs, SCML::Data::Entity* entity, int& mismatched_frames)
+{
+    SCML_Null::Entity exact(data, entity->id);
+    SCML_Null::Entity quantized(data, entity->id);
+    exact.setFileSystem(fs);
+    quantized.setFileSystem(fs);
+    quantized.setPrototype(entity->getPrototype(true));
+
+    float max_error = 0.0f;
+    mismatched_frames = 0;
+    SCML::DrawList a, b;
+    for(int i = 0; i < exact.getNumAnimations(); i++)
+    {
+        for(int time = 0; time <= exact.getAnimation(i)->length; time++)
+        {
+            exact.startAnimation(i);
+            quantized.startAnimation(i);
+            exact.setTime(time);
+            quantized.setTime(time);
+            a.clear();
+            b.clear();
+            exact.buildDrawList(a, 0, 0, 0, 1, 1);
+            quantized.buildDrawList(b, 0, 0, 0, 1, 1);
+
+            bool match = (a.size() == b.size());
+            for(int j = 0; j < a.size() && match; j++)
+                match = (a[j].folder == b[j].folder && a[j].file == b[j].file);
+            if(!match)
+            {
+                mismatched_frames++;
+                continue;
+            }
+            for(int j = 0; j < a.size(); j++)
+            {
+                for(int k = 0; k < 8; k++)
+                {
+                    float error = a[j].corners[k] - b[j].corners[k];
+                    if(error < 0.0f)
+                        error = -error;
+                    if(error > max_error)
+                        max_error = error;
+                }
+            }
+        }
+    }
+    return max_error;
+}
+
+static bool run(const char* filename)
+{
+    double start = get_seconds();
+    SCML::Data data;
+    if(!data.load(filename))
+    {
+        printf("Failed to load %s\n", filename);
+        return false;
+    }
+    double load_ms = (get_seconds() - start)*1e3;
+
+    SCML_Null::FileSystem fs;
+    start = get_seconds();
+    fs.load(&data);
+    double images_ms = (get_seconds() - start)*1e3;
+
+    printf("\n%s: %d entities, data loaded in %.2f ms, %d image headers read in %.2f ms\n", filename, int(data.entities.size()), load_ms, int(fs.images.size()), images_ms);
+    SCML_BEGIN_MAP_FOREACH_CONST(data.entities, int, SCML::Data::Entity*, entity)
+    {
+        SCML::EntityPrototype* keys = entity->getPrototype(true);
+        int mismatched_frames;
+        float drawn_error = get_drawn_error(&data, &fs, entity, mismatched_frames);
+        printf("Entity %d timeline keys: %d bytes, quantized %d bytes (max error %.4f px, %.4f degrees, %.6f scale, drawn %.4f px, %d frames with other images)\n",
+               entity->id, get_timeline_key_bytes(entity->getPrototype()), get_timeline_key_bytes(keys),
+               keys->max_position_error, keys->max_angle_error, keys->max_scale_error, drawn_error, mismatched_frames);
+        SCML_Null::Entity prototype(&data, entity->id);
+        prototype.setFileSystem(&fs);
+        SCML::BakedPoses poses(&prototype, baked_rate);
+        SCML::BakedPoses packed(&prototype, baked_rate, true);
+        printf("Entity %d poses baked at %d fps: %d bytes, quantized %d bytes (max error %.4f px, %.4f degrees, %.6f scale)\n", entity->id, baked_rate,
+               poses.getMemorySize(), packed.getMemorySize(), packed.max_position_error, packed.max_angle_error, packed.max_scale_error);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    printf("%10s %12s %12s %12s %12s %12s %12s %12s\n", "instances", "create ns", "update ns", "draw ns", "world ns", "baked ns", "quant. ns", "draws/frame");
+
+    Benchmark benchmark(&data, &fs);
+    for(unsigned int i = 0; i < sizeof(instance_counts)/sizeof(int); i++)
+    {
+        int count = instance_counts[i];
+        double create_ns = benchmark.create(count);
+        double update_ns, draw_ns;
+        benchmark.run_frames(update_ns, draw_ns);
+        // The recorder is cleared every frame, so this counts the last one.
+        int draws = benchmark.recorder.num_calls;
+
+        SCML::AnimationWorld world;
+        double world_ns = benchmark.evaluate(world);
+        double baked_ns = benchmark.run_baked_frames(false);
+        double quantized_ns = benchmark.run_baked_frames(true);
+
+        printf("%10d %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f %12d\n", count, create_ns, update_ns, draw_ns, world_ns, baked_ns, quantized_ns, draws);
+        fflush(stdout);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    bool result = true;
+    if(argc < 2)
+    {
+        for(unsigned int i = 0; i < sizeof(default_files)/sizeof(char*); i++)
+            result = run(default_files[i]) && result;
+    }
+    else
+    {
+        for(int i = 1; i < argc; i++)
+            result = run(argv[i]) && result;
+    }
+    return (result? 0 : 1);
+}
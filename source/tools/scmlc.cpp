@@ -0,0 +1,234 @@
+// scmlc: Compiles a SCML file into the memory-mappable .scmlb format.
+//
+// Usage: scmlc [-quantize] input.scml output.scmlb
+//
+// -quantize stores the transforms of the timeline keys as 16-bit steps (see SCML::EntityPrototype) and reports the
+// largest error that adds.  The output is loaded again and compared with the animation data built from the SCML file.
+// Returns 0 on success, 1 on a load/write error and 2 if the compiled data does not match.
+
+#include "SCMLpp.h"
+#include <cstdio>
+#include <cstring>
+
+template<typename T>
+static bool compare_span(const SCML::Span<T>& a, const SCML::Span<T>& b, const char* what, int entity, int animation)
+{
+    if(a.size != b.size || (a.size > 0 && memcmp(a.data, b.data, a.size*sizeof(T)) != 0))
+    {
+        printf("Entity %d, animation %d: %s do not match.\n", entity, animation, what);
+        return false;
+    }
+    return true;
+}
+
+static bool compare_ranges(const SCML::Range& a, const SCML::Range& b)
+{
+    return (a.min == b.min && a.step == b.step);
+}
+
+static bool compare_prototypes(SCML::EntityPrototype* a, SCML::EntityPrototype* b)
+{
+    if(a->id != b->id || a->name != b->name || a->animations.size() != b->animations.size() || a->quantized != b->quantized
+       || a->max_position_error != b->max_position_error || a->max_angle_error != b->max_angle_error
+       || a->max_scale_error != b->max_scale_error)
+    {
+        printf("Entity %d does not match.\n", a->id);
+        return false;
+    }
+
+    bool result = true;
+    for(unsigned int i = 0; i < a->animations.size(); i++)
+    {
+        SCML::EntityPrototype::Animation& x = a->animations[i];
+        SCML::EntityPrototype::Animation& y = b->animations[i];
+
+        if(x.id != y.id || x.length != y.length || x.loop_mode != y.loop_mode || x.loop_to != y.loop_to
+           || strcmp(a->getString(x.name), b->getString(y.name)) != 0
+           || strcmp(a->getString(x.looping), b->getString(y.looping)) != 0
+           || x.quantized != y.quantized || !compare_ranges(x.position_x, y.position_x) || !compare_ranges(x.position_y, y.position_y)
+           || !compare_ranges(x.angle, y.angle) || !compare_ranges(x.scale, y.scale))
+        {
+            printf("Entity %d, animation %d does not match.\n", a->id, x.id);
+            result = false;
+            continue;
+        }
+
+        // String fields are offsets, so the records are only equal if the string tables are too.
+        result = compare_span(x.mainline.keys, y.mainline.keys, "mainline keys", a->id, x.id) && result;
+        result = compare_span(x.mainline.bone_slots, y.mainline.bone_slots, "bone slots", a->id, x.id) && result;
+        result = compare_span(x.mainline.object_slots, y.mainline.object_slots, "object slots", a->id, x.id) && result;
+        result = compare_span(x.mainline.bones, y.mainline.bones, "bones", a->id, x.id) && result;
+        result = compare_span(x.mainline.bone_refs, y.mainline.bone_refs, "bone refs", a->id, x.id) && result;
+        result = compare_span(x.mainline.objects, y.mainline.objects, "objects", a->id, x.id) && result;
+        result = compare_span(x.mainline.object_refs, y.mainline.object_refs, "object refs", a->id, x.id) && result;
+        result = compare_span(x.mainline.draw_order, y.mainline.draw_order, "draw order", a->id, x.id) && result;
+        result = compare_span(x.timelines, y.timelines, "timelines", a->id, x.id) && result;
+        result = compare_span(x.timeline_keys, y.timeline_keys, "timeline keys", a->id, x.id) && result;
+        result = compare_span(x.curve_samples, y.curve_samples, "curve samples", a->id, x.id) && result;
+        result = compare_span(x.bone_poses, y.bone_poses, "bone poses", a->id, x.id) && result;
+        result = compare_span(x.object_poses, y.object_poses, "object poses", a->id, x.id) && result;
+        result = compare_span(x.packed_bone_poses, y.packed_bone_poses, "packed bone poses", a->id, x.id) && result;
+        result = compare_span(x.packed_object_poses, y.packed_object_poses, "packed object poses", a->id, x.id) && result;
+        result = compare_span(x.bone_styles, y.bone_styles, "bone styles", a->id, x.id) && result;
+        result = compare_span(x.object_styles, y.object_styles, "object styles", a->id, x.id) && result;
+    }
+    return result;
+}
+
+static bool compare_strings(SCML::EntityPrototype* a, SCML::EntityPrototype* b)
+{
+    // Walk the whole string table.  Offset 0 is the only empty string, so the table ends at the next empty one.
+    int offset = 1;
+    while(true)
+    {
+        const char* x = a->getString(offset);
+        const char* y = b->getString(offset);
+        if(strcmp(x, y) != 0)
+        {
+            printf("Entity %d: String tables do not match.\n", a->id);
+            return false;
+        }
+        if(x[0] == '\0')
+            return true;
+        offset += strlen(x) + 1;
+    }
+}
+
+static bool compare_files(SCML::Data& data, SCML::BinaryData& binary)
+{
+    int num_files = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(data.folders, int, SCML::Data::Folder*, folder)
+    {
+        num_files += folder->files.size();
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    if(num_files != binary.getNumFiles())
+    {
+        printf("File tables do not match.\n");
+        return false;
+    }
+
+    for(int i = 0; i < binary.getNumFiles(); i++)
+    {
+        const SCML::BinaryData::File* file = binary.getFile(i);
+        SCML::Data::Folder* folder = SCML_MAP_FIND(data.folders, file->folder);
+        SCML::Data::Folder::File* original = (folder == NULL? NULL : SCML_MAP_FIND(folder->files, file->file));
+        if(original == NULL || original->name != binary.getString(file->name) || original->type != binary.getString(file->type)
+           || original->width != file->width || original->height != file->height
+           || original->atlas != file->atlas || original->atlas_x != file->atlas_x || original->atlas_y != file->atlas_y
+           || original->offset_x != file->offset_x || original->offset_y != file->offset_y
+           || original->original_width != file->original_width || original->original_height != file->original_height)
+        {
+            printf("File %d/%d does not match.\n", file->folder, file->file);
+            return false;
+        }
+    }
+    
+    // Only atlases with a page image are compiled
+    int num_pages = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(data.atlases, int, SCML::Data::Atlas*, atlas)
+    {
+        if(atlas->image_path.size() > 0)
+            num_pages++;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    
+    if(num_pages != binary.getNumAtlasPages())
+    {
+        printf("Atlas page tables do not match.\n");
+        return false;
+    }
+    
+    for(int i = 0; i < binary.getNumAtlasPages(); i++)
+    {
+        const SCML::BinaryData::Atlas_Page* page = binary.getAtlasPage(i);
+        SCML::Data::Atlas* original = SCML_MAP_FIND(data.atlases, page->atlas);
+        if(original == NULL || original->image_path != binary.getString(page->image_path))
+        {
+            printf("Atlas page %d does not match.\n", page->atlas);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    bool quantized = false;
+    const char* input = NULL;
+    const char* output = NULL;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-quantize") == 0)
+            quantized = true;
+        else if(input == NULL)
+            input = argv[i];
+        else if(output == NULL)
+            output = argv[i];
+        else
+        {
+            output = NULL;
+            break;
+        }
+    }
+    if(input == NULL || output == NULL)
+    {
+        printf("Usage: %s [-quantize] input.scml output.scmlb\n", argv[0]);
+        return 1;
+    }
+
+    SCML::Data data;
+    if(!data.load(input))
+    {
+        printf("Failed to load %s\n", input);
+        return 1;
+    }
+
+    if(!SCML::BinaryData::write(&data, output, quantized))
+    {
+        printf("Failed to write %s\n", output);
+        return 1;
+    }
+
+    // Round trip
+    SCML::BinaryData binary;
+    if(!binary.load(output))
+    {
+        printf("Failed to load %s\n", output);
+        return 2;
+    }
+
+    bool result = (binary.getNumEntities() == int(data.entities.size()));
+    if(!result)
+        printf("Number of entities does not match.\n");
+
+    SCML_BEGIN_MAP_FOREACH_CONST(data.entities, int, SCML::Data::Entity*, entity)
+    {
+        SCML::EntityPrototype* original = entity->getPrototype(quantized);
+        SCML::EntityPrototype* compiled = binary.getPrototype(entity->id);
+        if(compiled == NULL)
+        {
+            printf("Entity %d is missing.\n", entity->id);
+            result = false;
+            continue;
+        }
+        result = compare_prototypes(original, compiled) && result;
+        result = compare_strings(original, compiled) && result;
+        if(quantized)
+            printf("Entity %d: Largest quantization error is %g px, %g degrees, %g scale\n", entity->id,
+                   original->max_position_error, original->max_angle_error, original->max_scale_error);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    result = compare_files(data, binary) && result;
+
+    if(!result)
+    {
+        printf("%s does not match %s\n", output, input);
+        return 2;
+    }
+
+    printf("Compiled %s to %s (%d entities)\n", input, output, binary.getNumEntities());
+    return 0;
+}
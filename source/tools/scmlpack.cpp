@@ -0,0 +1,449 @@
+// scmlpack: Packs the images of a SCML file onto atlas pages and writes a SCML file that draws them from the pages.
+//
+// Usage: scmlpack [-size N] [-padding N] [-threads N] [-no-trim] input.scml output.scml
+//
+// -size is the largest page width and height (2048 by default, rounded down to a power of two), -padding the number of transparent pixels between
+// images (2) and -threads the number of threads (one per core by default).  The transparent borders of each image
+// are trimmed off unless -no-trim is given.
+//
+// Images are placed with MaxRects (best short side fit), largest first.  Each page gets the smallest power-of-two size
+// that holds the images that are left, or the largest size if none does, and is saved next to the output as
+// <output name>_<page>.png.
+// The output gets an <atlas> element per page and each <file> gets its page, its rectangle on the page and its trim
+// offsets.  File pivots stay relative to the original image, as SCML::FileSystem adjusts them for the trim.
+//
+// Decoding and trimming the images, trying the page sizes and composing and encoding the pages run in parallel, but
+// the result does not depend on the number of threads: Every trial packs the images in the same fixed order.
+//
+// Returns 0 on success, 1 on a load/write error and 2 if the packed output does not match the input images.
+
+#include "SCMLpp.h"
+#include "PNG_Image.h"
+#include "Rect_Packer.h"
+#include "tinyxml.h"
+#include "XML_Helpers.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static SCML_STRING get_directory(const SCML_STRING& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return (slash == SCML_STRING::npos? SCML_STRING() : path.substr(0, slash + 1));
+}
+
+static SCML_STRING get_filename(const SCML_STRING& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return (slash == SCML_STRING::npos? path : path.substr(slash + 1));
+}
+
+static SCML_STRING remove_extension(const SCML_STRING& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot == SCML_STRING::npos || (slash != SCML_STRING::npos && dot < slash))
+        return path;
+    return path.substr(0, dot);
+}
+
+static int next_power_of_two(int value)
+{
+    int result = 1;
+    while(result < value)
+        result *= 2;
+    return result;
+}
+
+
+
+
+class Image
+{
+public:
+
+    int folder;
+    int file;
+    SCML_STRING filename;
+
+    PNG_Image png;
+    bool loaded;
+
+    // The part that is kept, in the original image
+    Rect trimmed;
+
+    // Where it goes
+    int page;
+    int x, y;
+
+    Image(int folder, int file, const SCML_STRING& filename)
+        : folder(folder), file(file), filename(filename), loaded(false), page(-1), x(0), y(0)
+    {}
+};
+
+// Sorts the largest images first, so the small ones fill the gaps.  Ties keep the file order.
+static bool larger_image(const Image* a, const Image* b)
+{
+    if(a->trimmed.height != b->trimmed.height)
+        return a->trimmed.height > b->trimmed.height;
+    if(a->trimmed.width != b->trimmed.width)
+        return a->trimmed.width > b->trimmed.width;
+    if(a->folder != b->folder)
+        return a->folder < b->folder;
+    return a->file < b->file;
+}
+
+class Load_Job : public SCML::JobScheduler::Job
+{
+public:
+
+    Image* image;
+    bool trim;
+
+    Load_Job(Image* image, bool trim)
+        : image(image), trim(trim)
+    {}
+
+    virtual void run(int thread)
+    {
+        image->loaded = image->png.load(image->filename);
+        if(!image->loaded)
+            return;
+
+        Rect& r = image->trimmed;
+        r = Rect(0, 0, image->png.width, image->png.height);
+        // A fully transparent image still needs a pixel on the page
+        if(trim && !image->png.getOpaqueBounds(r.x, r.y, r.width, r.height))
+            r = Rect(0, 0, 1, 1);
+    }
+};
+
+// Packs as many images as fit onto a page of the given size, in order.  The padding goes to the right of and below
+// each image, so the page gets that much extra room for it.
+class Page_Job : public SCML::JobScheduler::Job
+{
+public:
+
+    SCML_STRING filename;
+    int width, height;
+    SCML_VECTOR(Image*) images;
+    PNG_Image png;
+    bool saved;
+
+    Page_Job(const SCML_STRING& filename, int width, int height)
+        : filename(filename), width(width), height(height), saved(false)
+    {}
+
+    virtual void run(int thread)
+    {
+        png.create(width, height);
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+        {
+            Image* image = images[i];
+            png.copy(image->png, image->trimmed.x, image->trimmed.y, image->trimmed.width, image->trimmed.height, image->x, image->y);
+        }
+        saved = png.save(filename);
+    }
+};
+
+
+
+
+// Checks that each image of the packed file is on its page, pixel for pixel.
+static bool verify(const char* filename, const SCML_VECTOR(Page_Job*)& pages, const SCML_VECTOR(Image*)& images)
+{
+    SCML::Data data;
+    if(!data.load(filename))
+    {
+        printf("Failed to load %s\n", filename);
+        return false;
+    }
+    if(SCML_MAP_SIZE(data.atlases) != SCML_VECTOR_SIZE(pages))
+    {
+        printf("%s has %d atlas pages instead of %d.\n", filename, int(SCML_MAP_SIZE(data.atlases)), int(SCML_VECTOR_SIZE(pages)));
+        return false;
+    }
+
+    bool result = true;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+    {
+        Image* image = images[i];
+        SCML::Data::Folder* folder = SCML_MAP_FIND(data.folders, image->folder);
+        SCML::Data::Folder::File* file = (folder == NULL? NULL : SCML_MAP_FIND(folder->files, image->file));
+        if(file == NULL || file->atlas < 0 || file->atlas >= int(SCML_VECTOR_SIZE(pages)))
+        {
+            printf("Image %d/%d is not packed.\n", image->folder, image->file);
+            result = false;
+            continue;
+        }
+
+        const PNG_Image& page = pages[file->atlas]->png;
+        const PNG_Image& original = image->png;
+        bool match = (file->original_width == int(original.width) && file->original_height == int(original.height)
+                      && file->atlas_x >= 0 && file->atlas_y >= 0 && file->width > 0 && file->height > 0
+                      && file->atlas_x + file->width <= int(page.width) && file->atlas_y + file->height <= int(page.height)
+                      && file->offset_x >= 0 && file->offset_y >= 0
+                      && file->offset_x + file->width <= file->original_width && file->offset_y + file->height <= file->original_height);
+        for(int y = 0; y < file->height && match; y++)
+        {
+            match = (memcmp(page.getPixel(file->atlas_x, file->atlas_y + y), original.getPixel(file->offset_x, file->offset_y + y), file->width*4) == 0);
+        }
+
+        // What was trimmed off must be fully transparent
+        for(int y = 0; y < file->original_height && match; y++)
+        {
+            for(int x = 0; x < file->original_width && match; x++)
+            {
+                if(x < file->offset_x || x >= file->offset_x + file->width || y < file->offset_y || y >= file->offset_y + file->height)
+                    match = (original.getPixel(x, y)[3] == 0);
+            }
+        }
+
+        if(!match)
+        {
+            printf("Image %d/%d does not match its atlas region.\n", image->folder, image->file);
+            result = false;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int max_size = 2048;
+    int padding = 2;
+    int num_threads = 0;
+    bool trim = true;
+    const char* input = NULL;
+    const char* output = NULL;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+            max_size = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-padding") == 0 && i + 1 < argc)
+            padding = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-no-trim") == 0)
+            trim = false;
+        else if(input == NULL)
+            input = argv[i];
+        else if(output == NULL)
+            output = argv[i];
+        else
+            input = output = NULL;
+    }
+    if(input == NULL || output == NULL || max_size <= 0 || padding < 0 || num_threads < 0)
+    {
+        printf("Usage: %s [-size N] [-padding N] [-threads N] [-no-trim] input.scml output.scml\n", argv[0]);
+        return 1;
+    }
+
+    SCML::Data data;
+    if(!data.load(input))
+    {
+        printf("Failed to load %s\n", input);
+        return 1;
+    }
+
+    // Gather the images
+    SCML_STRING input_dir = get_directory(input);
+    SCML_VECTOR(Image*) images;
+    SCML_BEGIN_MAP_FOREACH_CONST(data.folders, int, SCML::Data::Folder*, folder)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(folder->files, int, SCML::Data::Folder::File*, file)
+        {
+            if(file->type == "image")
+                SCML_VECTOR_PUSH_BACK(images, new Image(folder->id, file->id, input_dir + file->name));
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML::JobScheduler scheduler(num_threads);
+
+    SCML_VECTOR(SCML::JobScheduler::Job*) load_jobs;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+        SCML_VECTOR_PUSH_BACK(load_jobs, new Load_Job(images[i], trim));
+    if(SCML_VECTOR_SIZE(load_jobs) > 0)
+        scheduler.run(SCML::Span<SCML::JobScheduler::Job*>(&load_jobs[0], SCML_VECTOR_SIZE(load_jobs)));
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(load_jobs); i++)
+        delete load_jobs[i];
+
+    Page_Packer packer(max_size, padding);
+    int result = 0;
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+    {
+        Image* image = images[i];
+        if(!image->loaded)
+            result = 1;
+        else if(image->trimmed.width > packer.max_size || image->trimmed.height > packer.max_size)
+        {
+            printf("%s (%d x %d) does not fit on a %d x %d page.\n", SCML_TO_CSTRING(image->filename), image->trimmed.width, image->trimmed.height, packer.max_size, packer.max_size);
+            result = 1;
+        }
+    }
+
+    // Pack page by page.  The page sizes are tried in parallel.
+    int num_pages = 0;
+    if(result == 0)
+    {
+        SCML_VECTOR(Image*) left = images;
+        std::sort(left.begin(), left.end(), larger_image);
+
+        while(SCML_VECTOR_SIZE(left) > 0)
+        {
+            SCML_VECTOR(Rect) sizes;
+            for(unsigned int i = 0; i < SCML_VECTOR_SIZE(left); i++)
+                SCML_VECTOR_PUSH_BACK(sizes, left[i]->trimmed);
+            SCML_VECTOR(Rect) placements;
+            if(packer.pack(sizes, placements, &scheduler) == 0)
+            {
+                printf("%s (%d x %d) does not fit on a %d x %d page.\n", SCML_TO_CSTRING(left[0]->filename), left[0]->trimmed.width, left[0]->trimmed.height, packer.max_size, packer.max_size);
+                result = 1;
+                for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+                    images[i]->page = -1;
+                num_pages = 0;
+                break;
+            }
+
+            SCML_VECTOR(Image*) next;
+            for(unsigned int i = 0; i < SCML_VECTOR_SIZE(left); i++)
+            {
+                Image* image = left[i];
+                const Rect& rect = placements[i];
+                if(rect.width == 0)
+                {
+                    SCML_VECTOR_PUSH_BACK(next, image);
+                    continue;
+                }
+                image->page = num_pages;
+                image->x = rect.x;
+                image->y = rect.y;
+            }
+            left = next;
+            num_pages++;
+        }
+    }
+
+    // Compose and save the pages, each at the power-of-two size that holds its images
+    SCML_STRING page_base = remove_extension(output);
+    SCML_VECTOR(Page_Job*) pages;
+    for(int i = 0; i < num_pages; i++)
+    {
+        char suffix[32];
+        sprintf(suffix, "_%d.png", i);
+        SCML_VECTOR_PUSH_BACK(pages, new Page_Job(page_base + suffix, 1, 1));
+    }
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+    {
+        Image* image = images[i];
+        if(image->page < 0)
+            continue;
+        Page_Job* page = pages[image->page];
+        SCML_VECTOR_PUSH_BACK(page->images, image);
+        page->width = std::max(page->width, next_power_of_two(image->x + image->trimmed.width));
+        page->height = std::max(page->height, next_power_of_two(image->y + image->trimmed.height));
+    }
+
+    if(SCML_VECTOR_SIZE(pages) > 0)
+    {
+        SCML_VECTOR(SCML::JobScheduler::Job*) page_jobs(pages.begin(), pages.end());
+        scheduler.run(SCML::Span<SCML::JobScheduler::Job*>(&page_jobs[0], SCML_VECTOR_SIZE(page_jobs)));
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(pages); i++)
+        {
+            if(!pages[i]->saved)
+                result = 1;
+        }
+    }
+
+    // Rewrite the SCML file: The pages go before the folders and each image file gets its region
+    TiXmlDocument doc;
+    TiXmlElement* root = NULL;
+    if(result == 0)
+    {
+        if(!doc.LoadFile(input) || (root = doc.FirstChildElement("spriter_data")) == NULL)
+        {
+            printf("Failed to load %s\n", input);
+            result = 1;
+        }
+    }
+    if(result == 0)
+    {
+        while(TiXmlElement* atlas = root->FirstChildElement("atlas"))
+            root->RemoveChild(atlas);
+
+        TiXmlNode* first_folder = root->FirstChildElement("folder");
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(pages); i++)
+        {
+            TiXmlElement atlas("atlas");
+            atlas.SetAttribute("id", i);
+            atlas.SetAttribute("image_path", SCML_TO_CSTRING(get_filename(pages[i]->filename)));
+            if(first_folder != NULL)
+                root->InsertBeforeChild(first_folder, atlas);
+            else
+                root->InsertEndChild(atlas);
+        }
+
+        // Files without their own page inherit the folder's, so that goes
+        SCML_MAP(SCML_PAIR(int, int), Image*) lookup;
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+            SCML_MAP_INSERT(lookup, SCML_MAKE_PAIR(images[i]->folder, images[i]->file), images[i]);
+        for(TiXmlElement* folder = root->FirstChildElement("folder"); folder != NULL; folder = folder->NextSiblingElement("folder"))
+        {
+            folder->RemoveAttribute("atlas");
+            int folder_id = xmlGetIntAttr(folder, "id", 0);
+            for(TiXmlElement* file = folder->FirstChildElement("file"); file != NULL; file = file->NextSiblingElement("file"))
+            {
+                Image* image = SCML_MAP_FIND(lookup, SCML_MAKE_PAIR(folder_id, xmlGetIntAttr(file, "id", 0)));
+                if(image == NULL || xmlGetStringAttr(file, "type", "image") != "image")
+                    continue;
+
+                file->SetAttribute("width", image->trimmed.width);
+                file->SetAttribute("height", image->trimmed.height);
+                file->SetAttribute("atlas", image->page);
+                file->SetAttribute("atlas_x", image->x);
+                file->SetAttribute("atlas_y", image->y);
+                file->SetAttribute("offset_x", image->trimmed.x);
+                file->SetAttribute("offset_y", image->trimmed.y);
+                file->SetAttribute("original_width", image->png.width);
+                file->SetAttribute("original_height", image->png.height);
+            }
+        }
+
+        if(!doc.SaveFile(output))
+        {
+            printf("Failed to write %s\n", output);
+            result = 1;
+        }
+    }
+
+    if(result == 0)
+    {
+        if(!verify(output, pages, images))
+        {
+            printf("%s does not match %s\n", output, input);
+            result = 2;
+        }
+    }
+
+    if(result == 0)
+    {
+        printf("Packed %d images from %s onto %d pages for %s\n", int(SCML_VECTOR_SIZE(images)), input, int(SCML_VECTOR_SIZE(pages)), output);
+        for(unsigned int i = 0; i < SCML_VECTOR_SIZE(pages); i++)
+        {
+            long area = 0;
+            for(unsigned int j = 0; j < SCML_VECTOR_SIZE(pages[i]->images); j++)
+                area += long(pages[i]->images[j]->trimmed.width)*pages[i]->images[j]->trimmed.height;
+            printf("  %s: %d x %d, %d images, %.1f%% used\n", SCML_TO_CSTRING(pages[i]->filename), pages[i]->width, pages[i]->height,
+                   int(SCML_VECTOR_SIZE(pages[i]->images)), 100.0*area/(long(pages[i]->width)*pages[i]->height));
+        }
+    }
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(pages); i++)
+        delete pages[i];
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(images); i++)
+        delete images[i];
+    return result;
+}
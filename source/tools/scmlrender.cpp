@@ -0,0 +1,157 @@
+// scmlrender: Renders the frames of an animation to PNG files with the software renderer (renderers/SCML_Software).
+//
+// Usage: scmlrender [-size WxH] [-position X Y] [-scale S] [-entity ID] [-animation N] [-fps N] [-frames N] [-threads N]
+//                   input.scml output
+//
+// Frame i shows the animation at i*1000/fps ms and is saved as <output>_<i>.png, with i padded to 4 digits.  The image
+// is 256x256 and transparent by default, with the entity's origin at its center, or at -position (from the top-left
+// corner, +y down).  -entity is an entity ID (the first one by default), -animation an animation index (0), -fps the
+// frame rate (30) and -frames the number of frames (enough to cover the animation once).  The tiles of each frame are
+// rasterized by -threads threads (one per core by default).
+//
+// The output does not depend on the number of threads or on the SIMD code, so it can be compared pixel for pixel with
+// reference frames, e.g. to check that a change to SCMLpp does not change how animations look.  The animation and the
+// texture coordinates are computed with floats, so the output is only the same on other CPUs and compilers if they do
+// not fuse multiplies and adds.  The CMake build turns that off for SCMLpp, the software renderer and scmlrender.
+//
+// Returns 0 on success and 1 on a load/write error.
+
+#include "SCMLpp.h"
+#include "SCML_Software.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(WIN32) || defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+static double get_seconds()
+{
+    #if defined(WIN32) || defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart/double(frequency.QuadPart);
+    #else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+    #endif
+}
+
+int main(int argc, char* argv[])
+{
+    int width = 256;
+    int height = 256;
+    float x = -1.0f;
+    float y = -1.0f;
+    float scale = 1.0f;
+    int entity_id = -1;
+    int animation = 0;
+    int fps = 30;
+    int num_frames = 0;
+    int num_threads = 0;
+    const char* input = NULL;
+    const char* output = NULL;
+    bool valid = true;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+            valid = (sscanf(argv[++i], "%dx%d", &width, &height) == 2);
+        else if(strcmp(argv[i], "-position") == 0 && i + 2 < argc)
+        {
+            x = float(atof(argv[++i]));
+            y = float(atof(argv[++i]));
+        }
+        else if(strcmp(argv[i], "-scale") == 0 && i + 1 < argc)
+            scale = float(atof(argv[++i]));
+        else if(strcmp(argv[i], "-entity") == 0 && i + 1 < argc)
+            entity_id = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-animation") == 0 && i + 1 < argc)
+            animation = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-fps") == 0 && i + 1 < argc)
+            fps = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            num_frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if(input == NULL)
+            input = argv[i];
+        else if(output == NULL)
+            output = argv[i];
+        else
+            valid = false;
+    }
+    if(!valid || input == NULL || output == NULL || width <= 0 || height <= 0 || fps <= 0 || num_frames < 0 || num_threads < 0)
+    {
+        printf("Usage: %s [-size WxH] [-position X Y] [-scale S] [-entity ID] [-animation N] [-fps N] [-frames N] [-threads N] input.scml output\n", argv[0]);
+        return 1;
+    }
+    if(x < 0.0f && y < 0.0f)
+    {
+        x = width/2.0f;
+        y = height/2.0f;
+    }
+
+    SCML::Data data;
+    if(!data.load(input))
+    {
+        printf("Failed to load %s\n", input);
+        return 1;
+    }
+    if(entity_id < 0 && SCML_MAP_SIZE(data.entities) > 0)
+        entity_id = data.entities.begin()->first;
+    if(SCML_MAP_FIND(data.entities, entity_id) == NULL)
+    {
+        printf("%s has no entity %d\n", input, entity_id);
+        return 1;
+    }
+
+    SCML_Software::FileSystem fs;
+    fs.load(&data);
+
+    SCML::JobScheduler scheduler(num_threads);
+    SCML_Software::Framebuffer framebuffer(width, height);
+    framebuffer.scheduler = &scheduler;
+
+    SCML_Software::Entity entity(&data, entity_id, animation);
+    entity.setFileSystem(&fs);
+    entity.setScreen(&framebuffer);
+    SCML::Entity::Animation* animation_ptr = entity.getAnimation(animation);
+    if(animation_ptr == NULL)
+    {
+        printf("Entity %d has no animation %d\n", entity_id, animation);
+        return 1;
+    }
+    if(num_frames == 0)
+    {
+        num_frames = int((animation_ptr->length*(long long)fps + 999)/1000);
+        if(num_frames < 1)
+            num_frames = 1;
+    }
+
+    double draw_seconds = 0.0;
+    for(int i = 0; i < num_frames; i++)
+    {
+        entity.setTime(int(i*1000LL/fps));
+
+        double start = get_seconds();
+        framebuffer.clear();
+        entity.draw(x, y, 0.0f, scale, scale);
+        draw_seconds += get_seconds() - start;
+
+        char filename[32];
+        snprintf(filename, sizeof(filename), "_%04d.png", i);
+        if(!framebuffer.save(SCML_STRING(output) + filename))
+        {
+            printf("Failed to write %s%s\n", output, filename);
+            return 1;
+        }
+    }
+
+    printf("Rendered %d frames of %dx%d with %d threads in %.3f ms per frame.\n", num_frames, width, height, scheduler.getNumThreads(), draw_seconds*1000.0/num_frames);
+    return 0;
+}
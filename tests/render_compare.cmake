@@ -0,0 +1,38 @@
+# Renders frames with scmlrender and compares them byte for byte with reference frames.  Run by ctest with:
+#   -DSCMLRENDER=<scmlrender executable>
+#   -DINPUT=<.scml file>
+#   -DOUTPUT=<prefix of the rendered frames>
+#   -DREFERENCE=<prefix of the reference frames>
+#   -DFRAMES=<number of frames>
+#   -DARGS=<other scmlrender options, separated by spaces>
+#
+# To update the reference frames after an intended change, copy the rendered frames over them (see GETTING_STARTED.txt).
+
+separate_arguments(args UNIX_COMMAND "${ARGS}")
+
+get_filename_component(output_dir "${OUTPUT}" DIRECTORY)
+file(MAKE_DIRECTORY "${output_dir}")
+
+execute_process(COMMAND "${SCMLRENDER}" ${args} -frames ${FRAMES} "${INPUT}" "${OUTPUT}"
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "scmlrender failed to render ${INPUT}")
+endif()
+
+set(failed "")
+math(EXPR last "${FRAMES} - 1")
+foreach(i RANGE ${last})
+    string(LENGTH "000${i}" length)
+    math(EXPR start "${length} - 4")
+    string(SUBSTRING "000${i}" ${start} 4 number)
+    set(frame "${OUTPUT}_${number}.png")
+    set(reference "${REFERENCE}_${number}.png")
+    execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${frame}" "${reference}" RESULT_VARIABLE different)
+    if(NOT different EQUAL 0)
+        list(APPEND failed "${frame}")
+    endif()
+endforeach()
+
+if(failed)
+    message(FATAL_ERROR "These frames do not match ${REFERENCE}_*.png: ${failed}")
+endif()